@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/Blake3.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace watchman {
+
+namespace {
+
+constexpr uint32_t kChunkStart = 1 << 0;
+constexpr uint32_t kChunkEnd = 1 << 1;
+constexpr uint32_t kParent = 1 << 2;
+constexpr uint32_t kRoot = 1 << 3;
+
+constexpr Blake3::ChainingValue kIV = {
+    0x6A09E667,
+    0xBB67AE85,
+    0x3C6EF372,
+    0xA54FF53A,
+    0x510E527F,
+    0x9B05688C,
+    0x1F83D9AB,
+    0x5BE0CD19};
+
+constexpr size_t kMsgPermutation[16] =
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+using BlockWords = std::array<uint32_t, 16>;
+
+inline uint32_t rotr(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline void
+g(uint32_t* s, size_t a, size_t b, size_t c, size_t d, uint32_t x, uint32_t y) {
+  s[a] = s[a] + s[b] + x;
+  s[d] = rotr(s[d] ^ s[a], 16);
+  s[c] = s[c] + s[d];
+  s[b] = rotr(s[b] ^ s[c], 12);
+  s[a] = s[a] + s[b] + y;
+  s[d] = rotr(s[d] ^ s[a], 8);
+  s[c] = s[c] + s[d];
+  s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+inline void mixRound(uint32_t* s, const uint32_t* m) {
+  // Mix the columns.
+  g(s, 0, 4, 8, 12, m[0], m[1]);
+  g(s, 1, 5, 9, 13, m[2], m[3]);
+  g(s, 2, 6, 10, 14, m[4], m[5]);
+  g(s, 3, 7, 11, 15, m[6], m[7]);
+  // Mix the diagonals.
+  g(s, 0, 5, 10, 15, m[8], m[9]);
+  g(s, 1, 6, 11, 12, m[10], m[11]);
+  g(s, 2, 7, 8, 13, m[12], m[13]);
+  g(s, 3, 4, 9, 14, m[14], m[15]);
+}
+
+std::array<uint32_t, 16> compress(
+    const Blake3::ChainingValue& cv,
+    const BlockWords& blockWords,
+    uint64_t counter,
+    uint32_t blockLen,
+    uint32_t flags) {
+  std::array<uint32_t, 16> state = {
+      cv[0],
+      cv[1],
+      cv[2],
+      cv[3],
+      cv[4],
+      cv[5],
+      cv[6],
+      cv[7],
+      kIV[0],
+      kIV[1],
+      kIV[2],
+      kIV[3],
+      uint32_t(counter),
+      uint32_t(counter >> 32),
+      blockLen,
+      flags};
+  BlockWords m = blockWords;
+  for (size_t r = 0; r < 7; ++r) {
+    mixRound(state.data(), m.data());
+    if (r < 6) {
+      BlockWords permuted;
+      for (size_t i = 0; i < 16; ++i) {
+        permuted[i] = m[kMsgPermutation[i]];
+      }
+      m = permuted;
+    }
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    state[i] ^= state[i + 8];
+    state[i + 8] ^= cv[i];
+  }
+  return state;
+}
+
+BlockWords loadBlockWords(const uint8_t* block) {
+  BlockWords words;
+  for (size_t i = 0; i < 16; ++i) {
+    const uint8_t* b = block + i * 4;
+    words[i] = uint32_t(b[0]) | (uint32_t(b[1]) << 8) |
+        (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+  }
+  return words;
+}
+
+Blake3::ChainingValue firstEightWords(const std::array<uint32_t, 16>& words) {
+  Blake3::ChainingValue cv;
+  std::copy(words.begin(), words.begin() + 8, cv.begin());
+  return cv;
+}
+
+} // namespace
+
+struct Blake3::Output {
+  ChainingValue inputCv;
+  BlockWords blockWords;
+  uint64_t counter;
+  uint32_t blockLen;
+  uint32_t flags;
+
+  ChainingValue chainingValue() const {
+    return firstEightWords(
+        compress(inputCv, blockWords, counter, blockLen, flags));
+  }
+
+  Hash rootHash() const {
+    // The default output length fits in the first output block, so we
+    // only ever need to compress with a counter of zero.
+    auto words = compress(inputCv, blockWords, 0, blockLen, flags | kRoot);
+    Hash hash;
+    for (size_t i = 0; i < 8; ++i) {
+      hash[i * 4 + 0] = uint8_t(words[i]);
+      hash[i * 4 + 1] = uint8_t(words[i] >> 8);
+      hash[i * 4 + 2] = uint8_t(words[i] >> 16);
+      hash[i * 4 + 3] = uint8_t(words[i] >> 24);
+    }
+    return hash;
+  }
+
+  static Output parent(const ChainingValue& left, const ChainingValue& right) {
+    Output output;
+    output.inputCv = kIV;
+    std::copy(left.begin(), left.end(), output.blockWords.begin());
+    std::copy(right.begin(), right.end(), output.blockWords.begin() + 8);
+    output.counter = 0;
+    output.blockLen = kBlockLen;
+    output.flags = kParent;
+    return output;
+  }
+};
+
+Blake3::ChunkState::ChunkState(uint64_t chunkCounter)
+    : cv{kIV}, counter{chunkCounter} {}
+
+size_t Blake3::ChunkState::update(const uint8_t* data, size_t len) {
+  size_t consumed = 0;
+  while (len > 0 && this->len() < kChunkLen) {
+    // Only compress a full block once we know more input follows, as the
+    // last block of the chunk needs the CHUNK_END flag.
+    if (blockLen == kBlockLen) {
+      compressBlock();
+    }
+    size_t want = kBlockLen - blockLen;
+    size_t take = want < len ? want : len;
+    memcpy(block.data() + blockLen, data, take);
+    blockLen += uint8_t(take);
+    data += take;
+    len -= take;
+    consumed += take;
+  }
+  return consumed;
+}
+
+void Blake3::ChunkState::compressBlock() {
+  uint32_t flags = blocksCompressed == 0 ? kChunkStart : 0;
+  cv = firstEightWords(
+      compress(cv, loadBlockWords(block.data()), counter, kBlockLen, flags));
+  ++blocksCompressed;
+  block.fill(0);
+  blockLen = 0;
+}
+
+Blake3::Output Blake3::ChunkState::output() const {
+  Output output;
+  output.inputCv = cv;
+  output.blockWords = loadBlockWords(block.data());
+  output.counter = counter;
+  output.blockLen = blockLen;
+  output.flags = (blocksCompressed == 0 ? kChunkStart : 0) | kChunkEnd;
+  return output;
+}
+
+void Blake3::CvStack::push(ChainingValue cv, uint64_t total) {
+  // Each trailing zero bit of the total means that a subtree to our left
+  // is now complete and can be merged with this one.
+  while ((total & 1) == 0) {
+    cv = Output::parent(entries[--len], cv).chainingValue();
+    total >>= 1;
+  }
+  entries[len++] = cv;
+}
+
+void Blake3::consume(
+    ChunkState& chunk,
+    CvStack& stack,
+    uint64_t firstChunk,
+    const uint8_t* data,
+    size_t len) {
+  while (len > 0) {
+    if (chunk.len() == kChunkLen) {
+      auto total = chunk.counter - firstChunk + 1;
+      stack.push(chunk.output().chainingValue(), total);
+      chunk = ChunkState{chunk.counter + 1};
+    }
+    auto used = chunk.update(data, len);
+    data += used;
+    len -= used;
+  }
+}
+
+Blake3::Blake3() = default;
+
+void Blake3::update(const void* data, size_t len) {
+  consume(chunk_, stack_, 0, static_cast<const uint8_t*>(data), len);
+}
+
+Blake3::Hash Blake3::finalize() const {
+  auto output = chunk_.output();
+  for (size_t i = stack_.len; i > 0; --i) {
+    output = Output::parent(stack_.entries[i - 1], output.chainingValue());
+  }
+  return output.rootHash();
+}
+
+void Blake3::appendSubtree(const ChainingValue& cv, size_t log2Chunks) {
+  if (chunk_.len() == kChunkLen) {
+    stack_.push(chunk_.output().chainingValue(), chunk_.counter + 1);
+    chunk_ = ChunkState{chunk_.counter + 1};
+  }
+  uint64_t numChunks = uint64_t(1) << log2Chunks;
+  if (chunk_.len() != 0 || chunk_.counter % numChunks != 0) {
+    throw std::logic_error("Blake3::appendSubtree: unaligned subtree");
+  }
+  stack_.push(cv, (chunk_.counter >> log2Chunks) + 1);
+  chunk_ = ChunkState{chunk_.counter + numChunks};
+}
+
+Blake3::Subtree::Subtree(uint64_t firstChunk, size_t log2Chunks)
+    : firstChunk_{firstChunk},
+      numChunks_{uint64_t(1) << log2Chunks},
+      chunk_{firstChunk} {
+  if (firstChunk % numChunks_ != 0) {
+    throw std::logic_error("Blake3::Subtree: unaligned subtree");
+  }
+}
+
+void Blake3::Subtree::update(const void* data, size_t len) {
+  consume(chunk_, stack_, firstChunk_, static_cast<const uint8_t*>(data), len);
+}
+
+Blake3::ChainingValue Blake3::Subtree::finalize() const {
+  if (chunk_.counter - firstChunk_ + 1 != numChunks_ ||
+      chunk_.len() != kChunkLen) {
+    throw std::logic_error("Blake3::Subtree: incomplete subtree");
+  }
+  auto cv = chunk_.output().chainingValue();
+  for (size_t i = stack_.len; i > 0; --i) {
+    cv = Output::parent(stack_.entries[i - 1], cv).chainingValue();
+  }
+  return cv;
+}
+
+} // namespace watchman
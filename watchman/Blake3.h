@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace watchman {
+
+/**
+ * A portable implementation of the BLAKE3 hash function, producing the
+ * default 32 byte output.
+ *
+ * BLAKE3 hashes its input as a binary tree of 1KiB chunks, which allows
+ * large inputs to be split into independently hashed subtrees. Subtrees
+ * are hashed with Blake3::Subtree, potentially on different threads, and
+ * their chaining values are combined in order with appendSubtree().
+ */
+class Blake3 {
+ public:
+  static constexpr size_t kChunkLen = 1024;
+  static constexpr size_t kBlockLen = 64;
+  static constexpr size_t kOutLen = 32;
+  // Enough for 2^54 chunks, which comfortably exceeds any file we'll see.
+  static constexpr size_t kMaxDepth = 54;
+
+  using Hash = std::array<uint8_t, kOutLen>;
+  using ChainingValue = std::array<uint32_t, 8>;
+
+  Blake3();
+
+  void update(const void* data, size_t len);
+
+  // Returns the hash of everything passed to update() and appendSubtree().
+  // The hasher may continue to be updated after calling this.
+  Hash finalize() const;
+
+  /**
+   * Appends a complete subtree of 2^log2Chunks chunks, computed by a
+   * Blake3::Subtree that was started at the current input offset.
+   * The input so far must be a multiple of the subtree size, and the
+   * subtree must not be the last input; the final chunk of the input
+   * must always be passed to update().
+   */
+  void appendSubtree(const ChainingValue& cv, size_t log2Chunks);
+
+  class Subtree;
+
+ private:
+  // The inputs to a final compression, which produces either a chaining
+  // value for a parent node or the root hash.
+  struct Output;
+
+  struct ChunkState {
+    ChainingValue cv;
+    uint64_t counter;
+    std::array<uint8_t, kBlockLen> block{};
+    uint8_t blockLen{0};
+    uint8_t blocksCompressed{0};
+
+    explicit ChunkState(uint64_t chunkCounter);
+    size_t len() const {
+      return kBlockLen * blocksCompressed + blockLen;
+    }
+    // Consumes input up to the end of the chunk, returning the bytes used.
+    size_t update(const uint8_t* data, size_t len);
+    Output output() const;
+    void compressBlock();
+  };
+
+  // Chaining values of completed subtrees, largest first.
+  struct CvStack {
+    std::array<ChainingValue, kMaxDepth> entries;
+    size_t len{0};
+
+    // Adds the chaining value of a subtree, merging completed subtrees as
+    // we go. total is the number of subtrees of this size seen so far,
+    // including this one.
+    void push(ChainingValue cv, uint64_t total);
+  };
+
+  // Feeds input through chunk, pushing completed chunks onto stack.
+  // The final chunk is left in chunk even when full, so that it can be
+  // finalized with the appropriate flags. firstChunk is the index that
+  // stack's chunk counts are relative to.
+  static void consume(
+      ChunkState& chunk,
+      CvStack& stack,
+      uint64_t firstChunk,
+      const uint8_t* data,
+      size_t len);
+
+  ChunkState chunk_{0};
+  CvStack stack_;
+
+  friend class Subtree;
+};
+
+/**
+ * Computes the chaining value of a complete, aligned subtree of
+ * 2^log2Chunks chunks starting at chunk index firstChunk, which must be a
+ * multiple of the subtree size.
+ */
+class Blake3::Subtree {
+ public:
+  Subtree(uint64_t firstChunk, size_t log2Chunks);
+
+  void update(const void* data, size_t len);
+
+  // Must only be called once exactly the subtree size has been added.
+  ChainingValue finalize() const;
+
+ private:
+  uint64_t firstChunk_;
+  uint64_t numChunks_;
+  ChunkState chunk_;
+  CvStack stack_;
+};
+
+} // namespace watchman
@@ -436,6 +436,17 @@ std::unique_ptr<Pipe> ChildProcess::takeStdin() {
   return pipe;
 }
 
+std::unique_ptr<Pipe> ChildProcess::takePipe(int targetFd) {
+  auto it = pipes_.find(targetFd);
+  if (it == pipes_.end()) {
+    throw std::runtime_error(
+        fmt::format("no pipe was configured for fd {}", targetFd));
+  }
+  auto pipe = std::move(it->second);
+  pipes_.erase(it);
+  return pipe;
+}
+
 std::pair<std::optional<w_string>, std::optional<w_string>>
 ChildProcess::communicate(pipeWriteCallback writeCallback) {
 #ifdef _WIN32
@@ -163,6 +163,11 @@ class ChildProcess {
   // terminate.
   std::unique_ptr<Pipe> takeStdin();
 
+  // Extracts the parent side of the pipe that was set up for targetFd via
+  // Options::pipe().  This is intended for long-lived children that we
+  // converse with incrementally, rather than through communicate().
+  std::unique_ptr<Pipe> takePipe(int targetFd);
+
   // The pipeWriteCallback is called by communicate when it is safe to write
   // data to the pipe.  The callback should then attempt to write to it.
   // The callback must return true when it has nothing more
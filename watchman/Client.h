@@ -121,6 +121,8 @@ class ClientSubscription
 
   std::shared_ptr<Query> query;
   bool vcs_defer;
+  // Send the files as a single byte string; see encodeFilesDelta.
+  bool delta_encoding{false};
   uint32_t last_sub_tick{0};
   // map of statename => bool.  If true, policy is drop, else defer
   std::unordered_map<w_string, bool> drop_or_defer;
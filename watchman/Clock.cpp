@@ -195,6 +195,23 @@ QuerySince ClockSpec::evaluate(
       });
 }
 
+bool ClockSpec::isFreshInstance(
+    const ClockPosition& position,
+    const ClockTicks lastAgeOutTick,
+    const folly::Synchronized<std::unordered_map<w_string, ClockTicks>>*
+        cursorMap) const {
+  if (auto* named_cursor = std::get_if<NamedCursor>(&spec)) {
+    if (!cursorMap) {
+      return true;
+    }
+    auto cursors = cursorMap->rlock();
+    auto it = cursors->find(named_cursor->cursor);
+    return it == cursors->end() || it->second < lastAgeOutTick;
+  }
+  auto since = evaluate(position, lastAgeOutTick);
+  return !since.is_timestamp() && since.is_fresh_instance();
+}
+
 bool clock_id_string(
     ClockRoot root_number,
     ClockTicks ticks,
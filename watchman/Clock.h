@@ -115,6 +115,15 @@ struct ClockSpec {
       folly::Synchronized<std::unordered_map<w_string, ClockTicks>>* cursorMap =
           nullptr) const;
 
+  /** Returns true if evaluate() would return a fresh instance, but without
+   * moving a named cursor. Timestamps are never fresh instances.
+   * If cursorMap is passed in, it MUST be unlocked. */
+  bool isFreshInstance(
+      const ClockPosition& position,
+      const ClockTicks lastAgeOutTick,
+      const folly::Synchronized<std::unordered_map<w_string, ClockTicks>>*
+          cursorMap = nullptr) const;
+
   /** Initializes some global state needed for clockspec evaluation */
   static void init();
 
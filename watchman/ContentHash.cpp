@@ -7,8 +7,16 @@
 
 #include "watchman/ContentHash.h"
 #include <fmt/core.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
 #include <folly/ScopeGuard.h>
+#include <folly/Synchronized.h>
+#include <folly/executors/InlineExecutor.h>
+#include <folly/futures/Future.h>
+#include <atomic>
 #include <string>
+#include <vector>
+#include "watchman/Blake3.h"
 #include "watchman/Hash.h"
 #include "watchman/Logging.h"
 #include "watchman/ThreadPool.h"
@@ -28,6 +36,177 @@ namespace watchman {
 
 using HashValue = typename ContentHashCache::HashValue;
 using Node = typename ContentHashCache::Node;
+using Blake3Value = typename ContentHashCache::Blake3Value;
+using Blake3Node = typename ContentHashCache::Blake3Node;
+
+namespace {
+
+constexpr size_t kBlake3ReadSize = 64 * 1024;
+
+// Hint to the kernel that we're going to read the given range from start
+// to finish so that it can read ahead more aggressively, and drop the
+// pages sooner once we're done with them.
+void adviseSequential(int fd, off_t offset, off_t len) {
+#ifdef __linux__
+  posix_fadvise(fd, offset, len, POSIX_FADV_SEQUENTIAL);
+#else
+  (void)fd;
+  (void)offset;
+  (void)len;
+#endif
+}
+
+// Starts bringing a range of the file into the page cache, so that the
+// hashing task that follows finds it there. Errors are ignored; the task
+// will report them when it opens the file itself.
+void readAheadFile(const w_string& fullPath, off_t offset, off_t len) {
+#ifdef __linux__
+  int fd = ::open(fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+  ::close(fd);
+#else
+  (void)fullPath;
+  (void)offset;
+  (void)len;
+#endif
+}
+
+bool isCancellation(const folly::exception_wrapper& ew) {
+  bool cancelled = false;
+  ew.with_exception([&](const std::system_error& exc) {
+    cancelled = exc.code() == std::errc::operation_canceled;
+  });
+  return cancelled;
+}
+
+// Runs func on the hashing executor, or on the thread pool if the hashing
+// executor hasn't been started.
+template <typename T>
+folly::Future<T> runHashingTask(
+    HashingExecutor::Priority priority,
+    folly::Function<T()> func,
+    folly::Function<bool()> isCancelled,
+    folly::Function<void()> readAhead) {
+  if (!getHashingExecutor().isRunning()) {
+    return folly::via(&getThreadPool(), std::move(func));
+  }
+
+  folly::Promise<T> promise;
+  auto future = promise.getFuture();
+
+  HashingExecutor::Task task;
+  task.run = [promise = std::move(promise),
+              func = std::move(func)](bool cancelled) mutable {
+    if (cancelled) {
+      promise.setException(std::system_error(
+          std::make_error_code(std::errc::operation_canceled),
+          "content hashing was cancelled"));
+      return;
+    }
+    promise.setWith(std::move(func));
+  };
+  task.isCancelled = std::move(isCancelled);
+  task.readAhead = std::move(readAhead);
+
+  if (!getHashingExecutor().add(priority, std::move(task))) {
+    return folly::makeFuture<T>(std::runtime_error(
+        "content hashing queue is full or the executor is not running"));
+  }
+  return future;
+}
+
+// Feeds the contents of file from offset through to EOF into hasher.
+void blake3ReadFrom(
+    Blake3& hasher,
+    const folly::File& file,
+    off_t offset,
+    const char* fullPath) {
+  adviseSequential(file.fd(), offset, 0);
+  std::vector<uint8_t> buf(kBlake3ReadSize);
+  while (true) {
+    auto n = folly::preadNoInt(file.fd(), buf.data(), buf.size(), offset);
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      throw std::system_error(
+          errno,
+          std::generic_category(),
+          fmt::format("while reading from {}", fullPath));
+    }
+    hasher.update(buf.data(), size_t(n));
+    offset += n;
+  }
+}
+
+// Computes the chaining value for the index'th subtree of the file.
+Blake3::ChainingValue hashBlake3Subtree(
+    const w_string& fullPath,
+    size_t index) {
+  constexpr auto kLog2Chunks = ContentHashCache::kBlake3SubtreeLog2Chunks;
+  constexpr auto kSubtreeSize = ContentHashCache::kBlake3SubtreeSize;
+
+  folly::File file{fullPath.c_str(), O_RDONLY};
+  off_t offset = off_t(index * kSubtreeSize);
+  adviseSequential(file.fd(), offset, off_t(kSubtreeSize));
+
+  Blake3::Subtree subtree{uint64_t(index) << kLog2Chunks, kLog2Chunks};
+  std::vector<uint8_t> buf(kBlake3ReadSize);
+  size_t remaining = kSubtreeSize;
+  while (remaining > 0) {
+    auto n = folly::preadNoInt(
+        file.fd(), buf.data(), std::min(buf.size(), remaining), offset);
+    if (n < 0) {
+      throw std::system_error(
+          errno,
+          std::generic_category(),
+          fmt::format("while reading from {}", fullPath));
+    }
+    if (n == 0) {
+      throw std::runtime_error(
+          "file was truncated during hashing; "
+          "query again to get latest status");
+    }
+    subtree.update(buf.data(), size_t(n));
+    offset += n;
+    remaining -= size_t(n);
+  }
+  return subtree.finalize();
+}
+
+} // namespace
+
+class ContentHashCache::Interest {
+ public:
+  void add(const folly::CancellationToken& token) {
+    if (!token.canBeCancelled()) {
+      uncancellable_ = true;
+      return;
+    }
+    tokens_.wlock()->push_back(token);
+  }
+
+  // Returns true if everybody waiting on the hash has been cancelled.
+  bool allCancelled() const {
+    if (uncancellable_) {
+      return false;
+    }
+    auto tokens = tokens_.rlock();
+    for (auto& token : *tokens) {
+      if (!token.isCancellationRequested()) {
+        return false;
+      }
+    }
+    return !tokens->empty();
+  }
+
+ private:
+  std::atomic<bool> uncancellable_{false};
+  folly::Synchronized<std::vector<folly::CancellationToken>> tokens_;
+};
 
 bool ContentHashCacheKey::operator==(const ContentHashCacheKey& other) const {
   return fileSize == other.fileSize && mtime.tv_sec == other.mtime.tv_sec &&
@@ -47,12 +226,75 @@ ContentHashCache::ContentHashCache(
     const w_string& rootPath,
     size_t maxItems,
     std::chrono::milliseconds errorTTL)
-    : cache_(maxItems, errorTTL), rootPath_(rootPath) {}
+    : cache_(maxItems, errorTTL),
+      blake3Cache_(maxItems, errorTTL),
+      rootPath_(rootPath) {}
+
+template <typename Value, typename Compute>
+folly::Future<std::shared_ptr<
+    const typename LRUCache<ContentHashCacheKey, Value>::NodeType>>
+ContentHashCache::getWithInterest(
+    LRUCache<ContentHashCacheKey, Value>& cache,
+    InterestMap& interests,
+    const ContentHashCacheKey& key,
+    const ContentHashRequest& request,
+    Compute compute) {
+  using NodePtr = std::shared_ptr<
+      const typename LRUCache<ContentHashCacheKey, Value>::NodeType>;
+
+  // Register our interest before looking in the cache, so that a hash
+  // that is in flight, or that we start below, isn't cancelled out from
+  // under us by the other requests waiting on it.
+  std::shared_ptr<Interest> interest;
+  bool created = false;
+  {
+    auto map = interests.wlock();
+    auto& entry = (*map)[key];
+    if (!entry) {
+      entry = std::make_shared<Interest>();
+      created = true;
+    }
+    entry->add(request.cancellationToken);
+    interest = entry;
+  }
+  auto forget = [&interests, interest](const ContentHashCacheKey& k) {
+    auto map = interests.wlock();
+    auto it = map->find(k);
+    if (it != map->end() && it->second == interest) {
+      map->erase(it);
+    }
+  };
+
+  auto started = std::make_shared<std::atomic<bool>>(false);
+  auto future = cache.get(
+      key,
+      [this, request, compute, interest, forget, started](
+          const ContentHashCacheKey& k) {
+        started->store(true);
+        return (this->*compute)(k, request.priority, interest)
+            .ensure([forget, k] { forget(k); });
+      });
+  if (created && !started->load()) {
+    // The cache already had the hash, or another request had just started
+    // it, so nothing will forget our interest for us.
+    forget(key);
+  }
+
+  return std::move(future).thenValue([&cache](NodePtr node) {
+    // Don't let a cancellation poison the cache for later requests.
+    if (node->result().hasException() &&
+        isCancellation(node->result().exception())) {
+      cache.erase(node);
+    }
+    return node;
+  });
+}
 
 folly::Future<std::shared_ptr<const Node>> ContentHashCache::get(
-    const ContentHashCacheKey& key) {
-  return cache_.get(
-      key, [this](const ContentHashCacheKey& k) { return computeHash(k); });
+    const ContentHashCacheKey& key,
+    const ContentHashRequest& request) {
+  return getWithInterest(
+      cache_, sha1Interests_, key, request, &ContentHashCache::computeHashFor);
 }
 
 HashValue ContentHashCache::computeHashImmediate(const char* fullPath) {
@@ -66,6 +308,8 @@ HashValue ContentHashCache::computeHashImmediate(const char* fullPath) {
   }
 
 #ifndef _WIN32
+  adviseSequential(stm->getFileDescriptor().system_handle(), 0, 0);
+
   SHA_CTX ctx;
   SHA1_Init(&ctx);
 
@@ -142,7 +386,13 @@ HashValue ContentHashCache::computeHashImmediate(
     const ContentHashCacheKey& key) const {
   auto fullPath = w_string::pathCat({rootPath_, key.relativePath});
   auto result = computeHashImmediate(fullPath.c_str());
+  checkUnchanged(fullPath, key);
+  return result;
+}
 
+void ContentHashCache::checkUnchanged(
+    const w_string& fullPath,
+    const ContentHashCacheKey& key) {
   // Since TOCTOU is everywhere and everything, double check to make sure that
   // the file looks like we were expecting at the start.  If it isn't, then
   // we want to throw an exception and avoid associating the hash of whatever
@@ -154,14 +404,112 @@ HashValue ContentHashCache::computeHashImmediate(
     throw std::runtime_error(
         "metadata changed during hashing; query again to get latest status");
   }
-
-  return result;
 }
 
 folly::Future<HashValue> ContentHashCache::computeHash(
-    const ContentHashCacheKey& key) const {
-  return folly::via(
-      &getThreadPool(), [key, this] { return computeHashImmediate(key); });
+    const ContentHashCacheKey& key,
+    HashingExecutor::Priority priority) const {
+  return computeHashFor(key, priority, nullptr);
+}
+
+folly::Future<HashValue> ContentHashCache::computeHashFor(
+    const ContentHashCacheKey& key,
+    HashingExecutor::Priority priority,
+    std::shared_ptr<Interest> interest) const {
+  auto fullPath = w_string::pathCat({rootPath_, key.relativePath});
+  return runHashingTask<HashValue>(
+      priority,
+      [key, this] { return computeHashImmediate(key); },
+      [interest] { return interest && interest->allCancelled(); },
+      [fullPath, size = off_t(key.fileSize)] {
+        readAheadFile(fullPath, 0, size);
+      });
+}
+
+folly::Future<std::shared_ptr<const Blake3Node>> ContentHashCache::getBlake3(
+    const ContentHashCacheKey& key,
+    const ContentHashRequest& request) {
+  return getWithInterest(
+      blake3Cache_,
+      blake3Interests_,
+      key,
+      request,
+      &ContentHashCache::computeBlake3For);
+}
+
+Blake3Value ContentHashCache::computeBlake3Immediate(const char* fullPath) {
+  folly::File file{fullPath, O_RDONLY};
+  Blake3 hasher;
+  blake3ReadFrom(hasher, file, 0, fullPath);
+  return hasher.finalize();
+}
+
+folly::Future<Blake3Value> ContentHashCache::computeBlake3(
+    const ContentHashCacheKey& key,
+    HashingExecutor::Priority priority) const {
+  return computeBlake3For(key, priority, nullptr);
+}
+
+folly::Future<Blake3Value> ContentHashCache::computeBlake3For(
+    const ContentHashCacheKey& key,
+    HashingExecutor::Priority priority,
+    std::shared_ptr<Interest> interest) const {
+  auto fullPath = w_string::pathCat({rootPath_, key.relativePath});
+  auto isCancelled = [interest] {
+    return interest && interest->allCancelled();
+  };
+
+  // The final chunk of the file has to be hashed by the hasher that
+  // produces the result, so a file that is an exact multiple of the
+  // subtree size still leaves its last subtree for the tail.
+  size_t numSubtrees =
+      key.fileSize > 0 ? (key.fileSize - 1) / kBlake3SubtreeSize : 0;
+  if (numSubtrees < 2) {
+    return runHashingTask<Blake3Value>(
+        priority,
+        [fullPath, key] {
+          auto result = computeBlake3Immediate(fullPath.c_str());
+          checkUnchanged(fullPath, key);
+          return result;
+        },
+        isCancelled,
+        [fullPath, size = off_t(key.fileSize)] {
+          readAheadFile(fullPath, 0, size);
+        });
+  }
+
+  std::vector<folly::Future<Blake3::ChainingValue>> subtrees;
+  subtrees.reserve(numSubtrees);
+  for (size_t i = 0; i < numSubtrees; ++i) {
+    auto offset = off_t(i * kBlake3SubtreeSize);
+    subtrees.emplace_back(runHashingTask<Blake3::ChainingValue>(
+        priority,
+        [fullPath, i] { return hashBlake3Subtree(fullPath, i); },
+        isCancelled,
+        [fullPath, offset] {
+          readAheadFile(fullPath, offset, off_t(kBlake3SubtreeSize));
+        }));
+  }
+
+  // The tail is hashed on whichever hashing worker finishes the last
+  // subtree.
+  return folly::collect(subtrees.begin(), subtrees.end())
+      .via(&folly::InlineExecutor::instance())
+      .thenValue(
+          [fullPath, key](std::vector<Blake3::ChainingValue>&& subtreeCvs) {
+            Blake3 hasher;
+            for (auto& cv : subtreeCvs) {
+              hasher.appendSubtree(cv, kBlake3SubtreeLog2Chunks);
+            }
+            folly::File file{fullPath.c_str(), O_RDONLY};
+            blake3ReadFrom(
+                hasher,
+                file,
+                off_t(subtreeCvs.size() * kBlake3SubtreeSize),
+                fullPath.c_str());
+            checkUnchanged(fullPath, key);
+            return hasher.finalize();
+          });
 }
 
 const w_string& ContentHashCache::rootPath() const {
@@ -171,4 +519,8 @@ const w_string& ContentHashCache::rootPath() const {
 CacheStats ContentHashCache::stats() const {
   return cache_.stats();
 }
+
+CacheStats ContentHashCache::blake3Stats() const {
+  return blake3Cache_.stats();
+}
 } // namespace watchman
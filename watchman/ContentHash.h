@@ -6,7 +6,9 @@
  */
 
 #pragma once
+#include <folly/CancellationToken.h>
 #include <array>
+#include "watchman/HashingExecutor.h"
 #include "watchman/LRUCache.h"
 #include "watchman/watchman_string.h"
 #include "watchman/watchman_system.h"
@@ -36,10 +38,29 @@ struct hash<watchman::ContentHashCacheKey> {
 } // namespace std
 
 namespace watchman {
+
+// Describes who is asking for a content hash.
+struct ContentHashRequest {
+  HashingExecutor::Priority priority{HashingExecutor::Priority::Interactive};
+  // Requested when the caller no longer needs the result. Hashing is
+  // skipped if every caller waiting on it has been cancelled before it
+  // starts, in which case the result is an operation_canceled error that
+  // isn't cached.
+  folly::CancellationToken cancellationToken;
+};
+
 class ContentHashCache {
  public:
   using HashValue = std::array<uint8_t, 20>;
   using Node = LRUCache<ContentHashCacheKey, HashValue>::NodeType;
+  using Blake3Value = std::array<uint8_t, 32>;
+  using Blake3Node = LRUCache<ContentHashCacheKey, Blake3Value>::NodeType;
+
+  // When computing BLAKE3 hashes, files larger than two subtrees are split
+  // into subtrees of this size (4MiB) that are hashed concurrently.
+  static constexpr size_t kBlake3SubtreeLog2Chunks = 12;
+  static constexpr size_t kBlake3SubtreeSize = size_t(1024)
+      << kBlake3SubtreeLog2Chunks;
 
   // Construct a cache for a given root, holding the specified
   // maximum number of items, using the configured negative
@@ -55,7 +76,8 @@ class ContentHashCache {
   // to populate the cache.  Returns a future with the result
   // of the lookup.
   folly::Future<std::shared_ptr<const Node>> get(
-      const ContentHashCacheKey& key);
+      const ContentHashCacheKey& key,
+      const ContentHashRequest& request = {});
 
   // Compute the hash value for a given input.
   // This will block the calling thread while the I/O is performed.
@@ -67,18 +89,75 @@ class ContentHashCache {
   // Throws exceptions for any errors that may occur.
   static HashValue computeHashImmediate(const char* fullPath);
 
-  // Compute the hash value for a given input via the thread pool.
+  // Compute the hash value for a given input via the hashing executor.
   // Returns a future to operate on the result of this async operation
-  folly::Future<HashValue> computeHash(const ContentHashCacheKey& key) const;
+  folly::Future<HashValue> computeHash(
+      const ContentHashCacheKey& key,
+      HashingExecutor::Priority priority =
+          HashingExecutor::Priority::Interactive) const;
+
+  // Obtain the BLAKE3 content hash for the given input.
+  // Results are cached separately from the SHA-1 hashes, but otherwise
+  // this behaves just like get().
+  folly::Future<std::shared_ptr<const Blake3Node>> getBlake3(
+      const ContentHashCacheKey& key,
+      const ContentHashRequest& request = {});
+
+  // Compute the BLAKE3 hash for a given input.
+  // This will block the calling thread while the I/O is performed.
+  // Throws exceptions for any errors that may occur.
+  static Blake3Value computeBlake3Immediate(const char* fullPath);
+
+  // Compute the BLAKE3 hash for a given input via the hashing executor.
+  // Large files are hashed as several subtrees in parallel.
+  folly::Future<Blake3Value> computeBlake3(
+      const ContentHashCacheKey& key,
+      HashingExecutor::Priority priority =
+          HashingExecutor::Priority::Interactive) const;
 
   // Returns the root path that this cache is associated with
   const w_string& rootPath() const;
 
   // Returns cache statistics
   CacheStats stats() const;
+  CacheStats blake3Stats() const;
 
  private:
+  // The callers waiting on an in-flight hash.
+  class Interest;
+  using InterestMap = folly::Synchronized<
+      std::unordered_map<ContentHashCacheKey, std::shared_ptr<Interest>>>;
+
+  // Looks up key in cache, calling compute(key, priority, interest) on a
+  // miss, and tracks request's interest in the in-flight result.
+  template <typename Value, typename Compute>
+  folly::Future<std::shared_ptr<
+      const typename LRUCache<ContentHashCacheKey, Value>::NodeType>>
+  getWithInterest(
+      LRUCache<ContentHashCacheKey, Value>& cache,
+      InterestMap& interests,
+      const ContentHashCacheKey& key,
+      const ContentHashRequest& request,
+      Compute compute);
+
+  folly::Future<HashValue> computeHashFor(
+      const ContentHashCacheKey& key,
+      HashingExecutor::Priority priority,
+      std::shared_ptr<Interest> interest) const;
+  folly::Future<Blake3Value> computeBlake3For(
+      const ContentHashCacheKey& key,
+      HashingExecutor::Priority priority,
+      std::shared_ptr<Interest> interest) const;
+
+  // Throws if the file no longer matches the size and mtime in key.
+  static void checkUnchanged(
+      const w_string& fullPath,
+      const ContentHashCacheKey& key);
+
   LRUCache<ContentHashCacheKey, HashValue> cache_;
+  LRUCache<ContentHashCacheKey, Blake3Value> blake3Cache_;
+  InterestMap sha1Interests_;
+  InterestMap blake3Interests_;
   w_string rootPath_;
 };
 } // namespace watchman
@@ -10,13 +10,12 @@
 #include <folly/String.h>
 #include <exception>
 #include <optional>
+#include <utility>
 #include "watchman/Logging.h"
 #include "watchman/watchman_stream.h"
 
 namespace watchman {
 
-CookieSync::Cookie::Cookie(uint64_t numCookies) : numPending(numCookies) {}
-
 CookieSync::CookieSync(FileSystem& fs, const w_string& dir) : fileSystem_{fs} {
   char hostname[256];
   gethostname(hostname, sizeof(hostname));
@@ -79,72 +78,102 @@ std::vector<w_string> CookieSync::getOutstandingCookieFileList() const {
 
 folly::SemiFuture<CookieSync::SyncResult> CookieSync::sync() {
   std::shared_ptr<Cookie> cookie;
-  std::vector<w_string> cookieFileNames;
+  bool writing;
   {
-    // We need to hold the cookieDirs lock while we lay cookies on disk to
-    // avoid a race where a cookie directory is removed after collecting all
-    // the cookie directories. In that case, this function would lay cookies on
-    // disk, but the cookie directory removal wouldn't be able to notify them,
-    // thus leaving them in a never notified state.
-    auto cookieDirsGuard = cookieDirs_.rlock();
-    auto prefixes = cookiePrefixLocked(*cookieDirsGuard);
-    auto serial = serial_++;
-
-    cookie = std::make_shared<Cookie>(prefixes.size());
-
-    // Even though we only write to the cookie at the end of the function, we
-    // need to hold it while the files are written on disk to avoid a race where
-    // cookies are detected on disk by the watcher, and notifyCookie is called
-    // prior to all the pending cookies being added to cookies_. Holding the
-    // lock will make sure that notifyCookie will be serialized with this code.
-    auto cookiesLock = cookies_.wlock();
-
-    CookieMap pendingCookies;
-    std::optional<std::tuple<w_string, int>> lastError;
-
-    cookieFileNames.reserve(prefixes.size());
-    for (const auto& prefix : prefixes) {
-      auto path_str = w_string::build(prefix, serial);
-      cookieFileNames.push_back(path_str);
-
-      /* then touch the file */
-      try {
-        fileSystem_.touch(path_str.c_str());
-      } catch (const std::system_error& e) {
-        lastError = {path_str, e.code().value()};
-        cookie->numPending.fetch_sub(1, std::memory_order_acq_rel);
-        logf(
-            ERR,
-            "sync cookie {} couldn't be created: {}\n",
-            path_str,
-            folly::errnoStr(e.code().value()));
-        continue;
-      }
-
-      /* insert the cookie into the temporary map */
-      pendingCookies[path_str] = cookie;
-      logf(DBG, "sync created cookie file {}\n", path_str);
+    auto next = nextCookie_.lock();
+    if (!next->cookie) {
+      next->cookie = std::make_shared<Cookie>();
     }
-
-    if (pendingCookies.size() == 0) {
-      w_assert(lastError.has_value(), "no cookies written, but no errors set");
-      auto errCode = std::get<int>(*lastError);
-      throw std::system_error(
-          errCode,
-          std::generic_category(),
-          fmt::format(
-              "sync: creat({}) failed: {}",
-              std::get<w_string>(*lastError),
-              folly::errnoStr(errCode)));
+    cookie = next->cookie;
+    // A cookie touched before we got here wouldn't tell us anything about
+    // the changes made before now, so wait for the current writer to finish
+    // and then touch ours, unless someone sharing it got there first. Each
+    // caller writes at most its own cookie, so a steady stream of syncs
+    // can't keep one of them from returning to its query.
+    cookieWritten_.wait(next.as_lock(), [&] {
+      return !next->writing || next->cookie != cookie;
+    });
+    writing = next->cookie == cookie;
+    if (writing) {
+      next->cookie.reset();
+      next->writing = true;
     }
+  }
 
-    cookiesLock->insert(pendingCookies.begin(), pendingCookies.end());
+  if (writing) {
+    try {
+      writeCookie(cookie);
+    } catch (const std::exception& e) {
+      cookie->promise.setException(
+          folly::exception_wrapper{std::current_exception(), e});
+    }
+    nextCookie_.lock()->writing = false;
+    cookieWritten_.notify_all();
   }
 
   return cookie->promise.getSemiFuture().deferValue(
-      [cookieFileNames = std::move(cookieFileNames)](folly::Unit) mutable {
-        return SyncResult{std::move(cookieFileNames)};
-      });
+      [cookie](folly::Unit) { return SyncResult{cookie->fileNames}; });
+}
+
+void CookieSync::writeCookie(const std::shared_ptr<Cookie>& cookie) {
+  // We need to hold the cookieDirs lock while we lay cookies on disk to
+  // avoid a race where a cookie directory is removed after collecting all
+  // the cookie directories. In that case, this function would lay cookies on
+  // disk, but the cookie directory removal wouldn't be able to notify them,
+  // thus leaving them in a never notified state.
+  auto cookieDirsGuard = cookieDirs_.rlock();
+  auto prefixes = cookiePrefixLocked(*cookieDirsGuard);
+  auto serial = serial_++;
+
+  cookie->numPending.store(prefixes.size(), std::memory_order_release);
+
+  // Even though we only write to the cookie at the end of the function, we
+  // need to hold it while the files are written on disk to avoid a race where
+  // cookies are detected on disk by the watcher, and notifyCookie is called
+  // prior to all the pending cookies being added to cookies_. Holding the
+  // lock will make sure that notifyCookie will be serialized with this code.
+  auto cookiesLock = cookies_.wlock();
+
+  CookieMap pendingCookies;
+  std::optional<std::tuple<w_string, int>> lastError;
+
+  cookie->fileNames.reserve(prefixes.size());
+  for (const auto& prefix : prefixes) {
+    auto path_str = w_string::build(prefix, serial);
+    cookie->fileNames.push_back(path_str);
+
+    /* then touch the file */
+    try {
+      fileSystem_.touch(path_str.c_str());
+    } catch (const std::system_error& e) {
+      lastError = {path_str, e.code().value()};
+      cookie->numPending.fetch_sub(1, std::memory_order_acq_rel);
+      logf(
+          ERR,
+          "sync cookie {} couldn't be created: {}\n",
+          path_str,
+          folly::errnoStr(e.code().value()));
+      continue;
+    }
+
+    /* insert the cookie into the temporary map */
+    pendingCookies[path_str] = cookie;
+    logf(DBG, "sync created cookie file {}\n", path_str);
+  }
+
+  if (pendingCookies.size() == 0) {
+    w_assert(lastError.has_value(), "no cookies written, but no errors set");
+    auto errCode = std::get<int>(*lastError);
+    throw std::system_error(
+        errCode,
+        std::generic_category(),
+        fmt::format(
+            "sync: creat({}) failed: {}",
+            std::get<w_string>(*lastError),
+            folly::errnoStr(errCode)));
+  }
+
+  cookiesLock->insert(pendingCookies.begin(), pendingCookies.end());
 }
 
 CookieSync::SyncResult CookieSync::syncToNow(
@@ -171,6 +200,9 @@ CookieSync::SyncResult CookieSync::syncToNow(
       // Success!
       return std::move(result).value();
     }
+    if (!result.hasException<CookieSyncAborted>()) {
+      result.throwUnlessValue();
+    }
 
     // Sync was aborted by a recrawl; recompute the timeout
     // and wait again if we still have time
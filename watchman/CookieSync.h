@@ -8,6 +8,9 @@
 #pragma once
 #include <folly/Synchronized.h>
 #include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
+#include <condition_variable>
+#include <mutex>
 #include "watchman/Cookie.h"
 #include "watchman/fs/FileSystem.h"
 #include "watchman/watchman_string.h"
@@ -54,6 +57,8 @@ class CookieSync {
    * Touches a cookie file and returns a Future that will
    * be ready when that cookie file is processed by the IO
    * thread at some future time.
+   * Callers that arrive while another is touching its cookie files share a
+   * single cookie, which is touched as soon as that one is done.
    * Important: if you chain a lambda onto the future, it
    * will execute in the context of the IO thread.
    * It is recommended that you minimize the actions performed
@@ -92,14 +97,24 @@ class CookieSync {
   CookieSync& operator=(CookieSync&&) = delete;
 
   struct Cookie {
-    folly::Promise<folly::Unit> promise;
-    std::atomic<uint64_t> numPending;
-
-    explicit Cookie(uint64_t numCookies);
+    folly::SharedPromise<folly::Unit> promise;
+    std::atomic<uint64_t> numPending{0};
+    std::vector<w_string> fileNames;
 
     void notify();
   };
 
+  struct NextCookie {
+    // The cookie that the callers waiting for the current writer to finish
+    // will share. One of them writes it once the current writer is done.
+    std::shared_ptr<Cookie> cookie;
+    // Whether some caller is touching cookie files.
+    bool writing{false};
+  };
+
+  // Touches the files for cookie in each cookie directory.
+  void writeCookie(const std::shared_ptr<Cookie>& cookie);
+
   struct CookieDirectories {
     // paths to the query cookies directories. A cookie will be written to each
     // of these when calling `sync`.
@@ -118,5 +133,8 @@ class CookieSync {
   std::atomic<uint32_t> serial_{0};
   using CookieMap = std::unordered_map<w_string, std::shared_ptr<Cookie>>;
   folly::Synchronized<CookieMap> cookies_;
+  folly::Synchronized<NextCookie, std::mutex> nextCookie_;
+  // Signalled when a writer is done touching cookie files.
+  std::condition_variable cookieWritten_;
 };
 } // namespace watchman
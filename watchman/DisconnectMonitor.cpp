@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/DisconnectMonitor.h"
+#include <folly/String.h>
+#include <thread>
+#include <vector>
+#include "watchman/Logging.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace watchman {
+
+namespace {
+// How long it may take us to notice a hangup.
+constexpr int kPollIntervalMs = 100;
+} // namespace
+
+DisconnectMonitor& getDisconnectMonitor() {
+  static DisconnectMonitor monitor;
+  return monitor;
+}
+
+DisconnectMonitor::Registration::Registration(
+    DisconnectMonitor* monitor,
+    uint64_t id)
+    : monitor_{monitor}, id_{id} {}
+
+DisconnectMonitor::Registration::Registration(Registration&& other) noexcept
+    : monitor_{other.monitor_}, id_{other.id_} {
+  other.monitor_ = nullptr;
+}
+
+DisconnectMonitor::Registration& DisconnectMonitor::Registration::operator=(
+    Registration&& other) noexcept {
+  if (this != &other) {
+    if (monitor_) {
+      monitor_->unwatch(id_);
+    }
+    monitor_ = other.monitor_;
+    id_ = other.id_;
+    other.monitor_ = nullptr;
+  }
+  return *this;
+}
+
+DisconnectMonitor::Registration::~Registration() {
+  if (monitor_) {
+    monitor_->unwatch(id_);
+  }
+}
+
+DisconnectMonitor::Registration DisconnectMonitor::watch(
+    const FileDescriptor& fd,
+    folly::CancellationSource source) {
+#ifdef _WIN32
+  (void)fd;
+  (void)source;
+  return Registration{};
+#else
+  uint64_t id;
+  bool startThread = false;
+  {
+    auto state = state_.lock();
+    id = state->nextId++;
+    state->watches.emplace(id, Watch{fd.system_handle(), std::move(source)});
+    if (!state->threadRunning) {
+      state->threadRunning = true;
+      startThread = true;
+    }
+  }
+  if (startThread) {
+    std::thread([this] {
+      w_set_thread_name("DisconnectMonitor");
+      runThread();
+    }).detach();
+  }
+  return Registration{this, id};
+#endif
+}
+
+void DisconnectMonitor::unwatch(uint64_t id) {
+  state_.lock()->watches.erase(id);
+}
+
+void DisconnectMonitor::runThread() {
+#ifndef _WIN32
+  std::vector<uint64_t> ids;
+  std::vector<pollfd> pfds;
+  while (true) {
+    ids.clear();
+    pfds.clear();
+    {
+      auto state = state_.lock();
+      if (state->watches.empty()) {
+        state->threadRunning = false;
+        return;
+      }
+      for (auto& [id, watch] : state->watches) {
+        ids.push_back(id);
+        // Hangups are always reported; we don't want to know about input
+        // as the client may legitimately send its next request early.
+        pfds.push_back(pollfd{watch.fd, 0, 0});
+      }
+    }
+
+    auto r = ::poll(pfds.data(), pfds.size(), kPollIntervalMs);
+    if (r < 0 && errno != EINTR) {
+      log(ERR,
+          "DisconnectMonitor: poll failed: ",
+          folly::errnoStr(errno),
+          "\n");
+      std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+      continue;
+    }
+    if (r <= 0) {
+      continue;
+    }
+
+    std::vector<folly::CancellationSource> hungUp;
+    {
+      auto state = state_.lock();
+      for (size_t i = 0; i < pfds.size(); ++i) {
+        if (!(pfds[i].revents & (POLLHUP | POLLERR | POLLNVAL))) {
+          continue;
+        }
+        // The watch may have been removed while we were polling, in which
+        // case the descriptor may already refer to something else.
+        auto it = state->watches.find(ids[i]);
+        if (it != state->watches.end()) {
+          hungUp.push_back(std::move(it->second.source));
+          state->watches.erase(it);
+        }
+      }
+    }
+    // Cancellation callbacks run synchronously, so don't hold the lock.
+    for (auto& source : hungUp) {
+      source.requestCancellation();
+    }
+  }
+#endif
+}
+
+} // namespace watchman
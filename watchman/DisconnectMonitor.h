@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/CancellationToken.h>
+#include <folly/Synchronized.h>
+#include <cstdint>
+#include <unordered_map>
+#include "watchman/fs/FileDescriptor.h"
+
+namespace watchman {
+
+/**
+ * Notices when the peer of a client connection hangs up while we are busy
+ * running one of its commands, and we are therefore not reading from it.
+ *
+ * Watched descriptors are polled from a helper thread that only runs while
+ * something is being watched. Not supported on Windows, where watch() is a
+ * no-op.
+ */
+class DisconnectMonitor {
+ public:
+  /**
+   * Keeps the watch alive; the descriptor is no longer watched once it is
+   * destroyed.
+   */
+  class Registration {
+   public:
+    Registration() = default;
+    Registration(DisconnectMonitor* monitor, uint64_t id);
+    Registration(Registration&& other) noexcept;
+    Registration& operator=(Registration&& other) noexcept;
+    ~Registration();
+
+   private:
+    DisconnectMonitor* monitor_{nullptr};
+    uint64_t id_{0};
+  };
+
+  /**
+   * Requests cancellation from source once the peer of fd hangs up.
+   * fd must remain open until the returned Registration is destroyed.
+   */
+  Registration watch(
+      const FileDescriptor& fd,
+      folly::CancellationSource source);
+
+ private:
+  struct Watch {
+    int fd;
+    folly::CancellationSource source;
+  };
+  struct State {
+    std::unordered_map<uint64_t, Watch> watches;
+    uint64_t nextId{1};
+    bool threadRunning{false};
+  };
+
+  void unwatch(uint64_t id);
+  void runThread();
+
+  folly::Synchronized<State, std::mutex> state_;
+};
+
+// Return a reference to the shared DisconnectMonitor for the process.
+DisconnectMonitor& getDisconnectMonitor();
+
+} // namespace watchman
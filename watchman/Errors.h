@@ -156,6 +156,17 @@ class QueryExecError : public WatchmanError<QueryExecError> {
   using WatchmanError::WatchmanError;
 };
 
+/**
+ * Represents a query that was abandoned before it completed, because the
+ * client that issued it disconnected or its deadline passed. Anything that
+ * handles a QueryExecError also handles this.
+ */
+class QueryCancelledError : public QueryExecError {
+ public:
+  explicit QueryCancelledError(const std::string& what)
+      : QueryExecError{what} {}
+};
+
 /**
  * Represents an error resolving a root.
  */
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/HashingExecutor.h"
+#include "watchman/Logging.h"
+
+namespace watchman {
+
+HashingExecutor& getHashingExecutor() {
+  static HashingExecutor executor;
+  return executor;
+}
+
+HashingExecutor::~HashingExecutor() {
+  stop();
+}
+
+void HashingExecutor::start(
+    size_t numWorkers,
+    size_t maxQueued,
+    size_t readAhead) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!workers_.empty()) {
+    throw std::runtime_error("HashingExecutor already started");
+  }
+  if (stopping_) {
+    throw std::runtime_error("Cannot restart a stopped HashingExecutor");
+  }
+  maxQueued_ = maxQueued;
+  readAhead_ = readAhead;
+
+  for (auto i = 0U; i < numWorkers; ++i) {
+    workers_.emplace_back([this, i]() noexcept {
+      w_set_thread_name("Hashing-", i);
+      runWorker();
+    });
+  }
+}
+
+void HashingExecutor::stop() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+
+  for (auto& worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+bool HashingExecutor::add(Priority priority, Task task) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_ || workers_.empty() ||
+        interactive_.size() + background_.size() >= maxQueued_) {
+      ++rejected_;
+      return false;
+    }
+    auto& queue =
+        priority == Priority::Interactive ? interactive_ : background_;
+    queue.push_back(QueuedTask{std::move(task)});
+  }
+  condition_.notify_one();
+  return true;
+}
+
+bool HashingExecutor::isRunning() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !stopping_ && !workers_.empty();
+}
+
+std::vector<folly::Function<void()>> HashingExecutor::takeReadAhead(
+    std::unique_lock<std::mutex>&) {
+  std::vector<folly::Function<void()>> result;
+  size_t considered = 0;
+  for (auto* queue : {&interactive_, &background_}) {
+    for (auto& queued : *queue) {
+      if (considered++ >= readAhead_) {
+        return result;
+      }
+      if (!queued.readAheadIssued && queued.task.readAhead) {
+        queued.readAheadIssued = true;
+        result.push_back(std::move(queued.task.readAhead));
+      }
+    }
+  }
+  return result;
+}
+
+void HashingExecutor::runWorker() {
+  while (true) {
+    Task task;
+    std::vector<folly::Function<void()>> readAhead;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] {
+        return stopping_ || !interactive_.empty() || !background_.empty();
+      });
+      auto& queue = !interactive_.empty() ? interactive_ : background_;
+      if (queue.empty()) {
+        // stopping_ and there is nothing left to do
+        return;
+      }
+      task = std::move(queue.front().task);
+      queue.pop_front();
+      readAhead = takeReadAhead(lock);
+      readAheadIssued_ += readAhead.size();
+      ++running_;
+    }
+
+    for (auto& func : readAhead) {
+      func();
+    }
+
+    bool cancelled = task.isCancelled && task.isCancelled();
+    task.run(cancelled);
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      --running_;
+      ++completed_;
+      if (cancelled) {
+        ++cancelled_;
+      }
+    }
+  }
+}
+
+HashingExecutorStats HashingExecutor::getStats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  HashingExecutorStats stats;
+  stats.workers = int64_t(workers_.size());
+  stats.running = int64_t(running_);
+  stats.queued_interactive = int64_t(interactive_.size());
+  stats.queued_background = int64_t(background_.size());
+  stats.completed = int64_t(completed_);
+  stats.cancelled = int64_t(cancelled_);
+  stats.rejected = int64_t(rejected_);
+  stats.read_ahead = int64_t(readAheadIssued_);
+  return stats;
+}
+
+} // namespace watchman
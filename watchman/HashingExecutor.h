@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "watchman/Serde.h"
+
+namespace watchman {
+
+struct HashingExecutorStats : serde::Object {
+  int64_t workers = 0;
+  int64_t running = 0;
+  int64_t queued_interactive = 0;
+  int64_t queued_background = 0;
+  int64_t completed = 0;
+  int64_t cancelled = 0;
+  int64_t rejected = 0;
+  int64_t read_ahead = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("workers", workers);
+    x("running", running);
+    x("queued_interactive", queued_interactive);
+    x("queued_background", queued_background);
+    x("completed", completed);
+    x("cancelled", cancelled);
+    x("rejected", rejected);
+    x("read_ahead", read_ahead);
+  }
+};
+
+/**
+ * Runs content hashing work separately from the general purpose
+ * ThreadPool, so that a query asking for the hashes of a large result set
+ * can't starve other users of the pool, and hashing I/O stays bounded by
+ * its own worker count.
+ *
+ * Interactive work (hashes a client is waiting for) always runs ahead of
+ * background work (cache warming). When a worker picks up a task, it
+ * gives the next few queued tasks a chance to start bringing their file
+ * into the page cache so that their reads don't stall on the disk.
+ */
+class HashingExecutor {
+ public:
+  enum class Priority { Interactive, Background };
+
+  struct Task {
+    // Does the work. Passed true if isCancelled reported that nobody is
+    // interested in the result any more, in which case it should fail
+    // quickly without doing any I/O. Must not throw; failures should be
+    // reported through whatever promise the task fulfils.
+    folly::Function<void(bool cancelled)> run;
+    // Optional. Checked just before run is called.
+    folly::Function<bool()> isCancelled;
+    // Optional. Called on a worker thread shortly before run is likely
+    // to be called, eg: to issue read-ahead for the file to be hashed.
+    folly::Function<void()> readAhead;
+  };
+
+  HashingExecutor() = default;
+  ~HashingExecutor();
+
+  /**
+   * Start numWorkers threads. At most maxQueued tasks may be queued at
+   * once, and up to readAhead queued tasks are read ahead of the workers.
+   */
+  void start(size_t numWorkers, size_t maxQueued, size_t readAhead);
+
+  // Stop the workers, after they have finished with the queued tasks.
+  void stop();
+
+  /**
+   * Queue a task. Returns false, without calling any of its functions, if
+   * the executor isn't running or its queue is full.
+   */
+  bool add(Priority priority, Task task);
+
+  // Whether start has been called and stop hasn't.
+  bool isRunning() const;
+
+  HashingExecutorStats getStats() const;
+
+ private:
+  struct QueuedTask {
+    Task task;
+    bool readAheadIssued{false};
+  };
+
+  void runWorker();
+  // Collects read-ahead functions for the next tasks in line.
+  std::vector<folly::Function<void()>> takeReadAhead(
+      std::unique_lock<std::mutex>& lock);
+
+  std::vector<std::thread> workers_;
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<QueuedTask> interactive_;
+  std::deque<QueuedTask> background_;
+  bool stopping_{false};
+  size_t maxQueued_{0};
+  size_t readAhead_{0};
+
+  size_t running_{0};
+  uint64_t completed_{0};
+  uint64_t cancelled_{0};
+  uint64_t rejected_{0};
+  uint64_t readAheadIssued_{0};
+};
+
+// Return a reference to the shared hashing executor for the process.
+HashingExecutor& getHashingExecutor();
+
+} // namespace watchman
@@ -6,6 +6,11 @@
  */
 
 #include "watchman/IgnoreSet.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include "watchman/thirdparty/wildmatch/wildmatch.h"
 
 // The path and everything below it is ignored.
 #define FULL_IGNORE 0x1
@@ -15,6 +20,55 @@
 
 namespace watchman {
 
+namespace {
+
+bool containsSorted(const std::vector<std::string>& vec, std::string_view s) {
+  auto it = std::lower_bound(vec.begin(), vec.end(), s);
+  return it != vec.end() && *it == s;
+}
+
+void insertSorted(std::vector<std::string>& vec, std::string s) {
+  auto it = std::lower_bound(vec.begin(), vec.end(), s);
+  if (it == vec.end() || *it != s) {
+    vec.insert(it, std::move(s));
+  }
+}
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+bool endsWith(std::string_view s, std::string_view suffix) {
+  return s.size() >= suffix.size() &&
+      s.substr(s.size() - suffix.size()) == suffix;
+}
+
+// wildmatch wants NUL terminated strings, so relative paths are copied here
+// rather than into a new string on each check.
+std::string& globScratch(std::string_view relative) {
+  thread_local std::string scratch;
+  scratch.assign(relative.data(), relative.size());
+#ifdef _WIN32
+  std::replace(scratch.begin(), scratch.end(), '\\', '/');
+#endif
+  return scratch;
+}
+
+struct IgnoredDirCache {
+  uint64_t generation{0};
+  std::string dir;
+  bool ignored{false};
+};
+
+thread_local IgnoredDirCache lastIgnoredDir;
+
+} // namespace
+
+uint64_t IgnoreSet::nextGlobGeneration() {
+  static std::atomic<uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
 void IgnoreSet::add(const w_string& path, bool is_vcs_ignore) {
   (is_vcs_ignore ? ignore_vcs : ignore_dirs).insert(path);
 
@@ -26,6 +80,52 @@ void IgnoreSet::add(const w_string& path, bool is_vcs_ignore) {
 }
 
 bool IgnoreSet::isIgnored(const char* path, uint32_t pathlen) const {
+  if (isIgnoredByPrefix(path, pathlen)) {
+    return true;
+  }
+  if (!hasGlobs()) {
+    return false;
+  }
+
+  auto relative = relativeToGlobRoot(w_string_piece{path, pathlen});
+  if (!relative) {
+    return false;
+  }
+  // Check the parent dirs, and then the path itself. We don't know whether
+  // the path is a dir, so leave dir-only patterns for statPath to apply once
+  // it has looked.
+  for (size_t i = relative->size(); i > 0; --i) {
+    if (is_slash((*relative)[i - 1])) {
+      if (isDirIgnoredByGlob(relative->substr(0, i - 1))) {
+        return true;
+      }
+      break;
+    }
+  }
+  return matchesGlob(*relative, false);
+}
+
+bool IgnoreSet::isDirIgnoredByGlob(std::string_view relativeDir) const {
+  auto& cache = lastIgnoredDir;
+  if (cache.generation == globGeneration_ && cache.dir == relativeDir) {
+    return cache.ignored;
+  }
+
+  auto& text = globScratch(relativeDir);
+  bool ignored = false;
+  for (size_t i = 1; i <= text.size() && !ignored; ++i) {
+    if (i == text.size() || text[i] == '/') {
+      ignored = matchesGlob(text, i, true);
+    }
+  }
+
+  cache.generation = globGeneration_;
+  cache.dir.assign(relativeDir.data(), relativeDir.size());
+  cache.ignored = ignored;
+  return ignored;
+}
+
+bool IgnoreSet::isIgnoredByPrefix(const char* path, uint32_t pathlen) const {
   const char* skip_prefix;
   uint32_t len;
   auto leaf = tree.longestMatch((const unsigned char*)path, (int)pathlen);
@@ -94,6 +194,126 @@ bool IgnoreSet::isIgnored(const char* path, uint32_t pathlen) const {
 #endif
 }
 
+void IgnoreSet::addGlob(const w_string& root_path, std::string_view pattern) {
+  if (!globRoot_.empty() && globRoot_ != root_path) {
+    throw std::logic_error("all ignore globs must share the same root");
+  }
+
+  std::string_view p = pattern;
+  if (startsWith(p, "!")) {
+    throw std::domain_error(fmt::format(
+        "negated ignore pattern \"{}\" is not supported", pattern));
+  }
+
+  bool dirOnly = false;
+  bool anchored = false;
+  // "foo/**" ignores everything inside of foo, which we implement by not
+  // descending into foo at all. Like any pattern with a slash in the middle,
+  // it only matches relative to the root.
+  if (endsWith(p, "/**")) {
+    p.remove_suffix(3);
+    dirOnly = true;
+    anchored = true;
+  }
+  while (endsWith(p, "/")) {
+    p.remove_suffix(1);
+    dirOnly = true;
+  }
+  if (startsWith(p, "/")) {
+    p.remove_prefix(1);
+    anchored = true;
+  }
+  // A leading "**/" matches at any depth, which is already the case for a
+  // pattern without a slash.
+  if (startsWith(p, "**/") &&
+      p.find('/', 3) == std::string_view::npos) {
+    p.remove_prefix(3);
+    anchored = false;
+  }
+  if (p.empty()) {
+    throw std::domain_error(
+        fmt::format("ignore pattern \"{}\" matches nothing", pattern));
+  }
+  if (p.find('/') != std::string_view::npos) {
+    anchored = true;
+  }
+
+  if (p.find_first_of("*?[\\") == std::string_view::npos) {
+    if (anchored) {
+      insertSorted(dirOnly ? globDirPaths_ : globPaths_, std::string{p});
+    } else {
+      insertSorted(dirOnly ? globDirNames_ : globNames_, std::string{p});
+    }
+  } else {
+    globRules_.push_back(GlobRule{std::string{p}, !anchored, dirOnly});
+  }
+  globRoot_ = root_path;
+  globGeneration_ = nextGlobGeneration();
+}
+
+bool IgnoreSet::isIgnoredByGlob(w_string_piece path, bool mayBeDir) const {
+  if (!hasGlobs()) {
+    return false;
+  }
+  auto relative = relativeToGlobRoot(path);
+  return relative && matchesGlob(*relative, mayBeDir);
+}
+
+std::optional<std::string_view> IgnoreSet::relativeToGlobRoot(
+    w_string_piece path) const {
+  if (path.size() <= globRoot_.size() + 1 ||
+      memcmp(path.data(), globRoot_.data(), globRoot_.size()) != 0 ||
+      !is_slash(path.data()[globRoot_.size()])) {
+    return std::nullopt;
+  }
+  return std::string_view{path.data(), path.size()}.substr(
+      globRoot_.size() + 1);
+}
+
+bool IgnoreSet::matchesGlob(std::string_view relative, bool mayBeDir) const {
+  auto& text = globScratch(relative);
+  return matchesGlob(text, text.size(), mayBeDir);
+}
+
+bool IgnoreSet::matchesGlob(std::string& text, size_t len, bool mayBeDir)
+    const {
+  std::string_view relative{text.data(), len};
+  auto slash = relative.rfind('/');
+  size_t nameStart = slash == std::string_view::npos ? 0 : slash + 1;
+  auto name = relative.substr(nameStart);
+
+  if (containsSorted(globNames_, name) ||
+      containsSorted(globPaths_, relative)) {
+    return true;
+  }
+  if (mayBeDir &&
+      (containsSorted(globDirNames_, name) ||
+       containsSorted(globDirPaths_, relative))) {
+    return true;
+  }
+  if (globRules_.empty()) {
+    return false;
+  }
+
+  char saved = text[len];
+  text[len] = '\0';
+  bool matched = false;
+  for (auto& rule : globRules_) {
+    if (rule.dirOnly && !mayBeDir) {
+      continue;
+    }
+    auto result = rule.basenameOnly
+        ? wildmatch(rule.pattern.c_str(), text.c_str() + nameStart, 0, nullptr)
+        : wildmatch(rule.pattern.c_str(), text.c_str(), WM_PATHNAME, nullptr);
+    if (result == WM_MATCH) {
+      matched = true;
+      break;
+    }
+  }
+  text[len] = saved;
+  return matched;
+}
+
 bool IgnoreSet::isIgnoreVCS(const w_string& path) const {
   return ignore_vcs.find(path) != ignore_vcs.end();
 }
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 #include "watchman/thirdparty/libart/src/art.h"
@@ -21,7 +24,36 @@ class IgnoreSet {
   // or a vcs-style grandchild ignore.
   void add(const w_string& path, bool is_vcs_ignore);
 
-  // Tests whether path is ignored.
+  // Adds a gitignore-style glob pattern, relative to root_path, which must
+  // be the same for every pattern added to a set:
+  //
+  //   node_modules    a file or dir with this name anywhere in the tree
+  //   **/target       the same as "target"
+  //   /buck-out       only at the top of the tree
+  //   build/out       only this path, relative to the top of the tree
+  //   out/            only dirs; "out/**" is treated the same way
+  //   *.egg-info      globs match a name anywhere in the tree, or the
+  //   src/*/gen       whole path if they contain a slash
+  //
+  // Negated ("!") and empty patterns are not supported, and throw
+  // std::domain_error.
+  void addGlob(const w_string& root_path, std::string_view pattern);
+
+  bool hasGlobs() const {
+    return !globRoot_.empty();
+  }
+
+  /**
+   * Tests whether path itself matches any glob pattern. Its parents are
+   * not considered, as the crawler never descends into an ignored dir.
+   * mayBeDir should be false when path is known not to be a dir, so that
+   * dir-only patterns don't match it.
+   */
+  bool isIgnoredByGlob(w_string_piece path, bool mayBeDir) const;
+
+  // Tests whether path is ignored, either because it is in an ignored dir
+  // or it or one of its parents matches a glob pattern. Dir-only patterns
+  // are only applied to the parents.
   // Returns true if the path is ignored, false otherwise.
   bool isIgnored(const char* path, uint32_t pathlen) const;
 
@@ -47,6 +79,43 @@ class IgnoreSet {
    * that we can exclude things deterministically and fit within
    * system limits. */
   std::vector<w_string> dirs_vec;
+
+  // A glob pattern that can't be matched with a simple lookup.
+  struct GlobRule {
+    std::string pattern;
+    // Matches only the final path component rather than the whole path.
+    bool basenameOnly;
+    bool dirOnly;
+  };
+
+  bool isIgnoredByPrefix(const char* path, uint32_t pathlen) const;
+
+  // Returns the path relative to globRoot_, or nullopt if it isn't
+  // strictly inside of it.
+  std::optional<std::string_view> relativeToGlobRoot(
+      w_string_piece path) const;
+  bool matchesGlob(std::string_view relative, bool mayBeDir) const;
+  // Matches the first len bytes of text, which holds a relative path with
+  // '/' separators. The byte at len is briefly replaced with a NUL, so that
+  // each parent can be matched in place rather than copied.
+  bool matchesGlob(std::string& text, size_t len, bool mayBeDir) const;
+  // Tests whether the relative dir, or any of its parents, matches a glob.
+  // The answer for the last dir is remembered per thread, as paths tend to
+  // arrive a directory at a time.
+  bool isDirIgnoredByGlob(std::string_view relativeDir) const;
+
+  w_string globRoot_;
+  // Changes whenever a glob is added, so that the answers remembered by
+  // isDirIgnoredByGlob are never applied to a different set of globs.
+  uint64_t globGeneration_{nextGlobGeneration()};
+  static uint64_t nextGlobGeneration();
+  // Sorted literal names matched at any depth, and literal paths relative
+  // to the root; the dir variants only match dirs.
+  std::vector<std::string> globNames_;
+  std::vector<std::string> globDirNames_;
+  std::vector<std::string> globPaths_;
+  std::vector<std::string> globDirPaths_;
+  std::vector<GlobRule> globRules_;
 };
 
 } // namespace watchman
@@ -62,26 +62,28 @@ InMemoryViewCaches::InMemoryViewCaches(
 
 InMemoryFileResult::InMemoryFileResult(
     const watchman_file* file,
-    InMemoryViewCaches& caches)
-    : file_(file), caches_(caches) {}
+    InMemoryViewCaches& caches,
+    folly::CancellationToken cancellationToken)
+    : file_(file),
+      caches_(caches),
+      cancellationToken_(std::move(cancellationToken)) {}
 
 void InMemoryFileResult::batchFetchProperties(
     const std::vector<std::unique_ptr<FileResult>>& files) {
-  std::vector<folly::Future<folly::Unit>> readlinkFutures;
-  std::vector<folly::Future<folly::Unit>> sha1Futures;
+  startBatchFetchProperties(files).wait();
+}
+
+folly::SemiFuture<folly::Unit> InMemoryFileResult::startBatchFetchProperties(
+    const std::vector<std::unique_ptr<FileResult>>& files) {
+  std::vector<folly::Future<folly::Unit>> futures;
 
   // Since we may initiate some async work in the body of the function
   // below, we need to ensure that we wait for it to complete before
-  // we return from this scope, even if we are throwing an exception.
-  // If we fail to do so, the continuation on the futures that we
-  // schedule will access invalid memory and we'll all feel bad.
-  SCOPE_EXIT {
-    if (!readlinkFutures.empty()) {
-      folly::collectAll(readlinkFutures.begin(), readlinkFutures.end()).wait();
-    }
-    if (!sha1Futures.empty()) {
-      folly::collectAll(sha1Futures.begin(), sha1Futures.end()).wait();
-    }
+  // we throw an exception out of this scope. If we fail to do so, the
+  // continuation on the futures that we schedule will access invalid
+  // memory and we'll all feel bad.
+  SCOPE_FAIL {
+    folly::collectAll(futures.begin(), futures.end()).wait();
   };
 
   for (auto& f : files) {
@@ -108,7 +110,7 @@ void InMemoryFileResult::batchFetchProperties(
         SymlinkTargetCacheKey key{
             w_string::pathCat({dir, file->baseName()}), file->file_->otime};
 
-        readlinkFutures.emplace_back(
+        futures.emplace_back(
             caches_.symlinkTargetCache.get(key).thenTry(
                 [file](
                     folly::Try<std::shared_ptr<
@@ -125,7 +127,9 @@ void InMemoryFileResult::batchFetchProperties(
       }
     }
 
-    if (file->neededProperties() & FileResult::Property::ContentSha1) {
+    if (file->neededProperties() &
+        (FileResult::Property::ContentSha1 |
+         FileResult::Property::ContentBlake3)) {
       auto dir = file->dirName();
       dir.advance(file->caches_.contentHashCache.rootPath().size());
 
@@ -140,18 +144,38 @@ void InMemoryFileResult::batchFetchProperties(
           w_string::pathCat({dir, file->baseName()}),
           size_t(file->file_->stat.size),
           file->file_->stat.mtime};
+      ContentHashRequest request{
+          HashingExecutor::Priority::Interactive, file->cancellationToken_};
+
+      if (file->neededProperties() & FileResult::Property::ContentSha1) {
+        futures.emplace_back(
+            caches_.contentHashCache.get(key, request)
+                .thenTry([file](folly::Try<std::shared_ptr<
+                                    const ContentHashCache::Node>>&& result) {
+                  file->contentSha1_ =
+                      makeResultWith([&] { return result.value()->value(); });
+                }));
+      }
 
-      sha1Futures.emplace_back(caches_.contentHashCache.get(key).thenTry(
-          [file](
-              folly::Try<std::shared_ptr<const ContentHashCache::Node>>&&
-                  result) {
-            file->contentSha1_ =
-                makeResultWith([&] { return result.value()->value(); });
-          }));
+      if (file->neededProperties() & FileResult::Property::ContentBlake3) {
+        futures.emplace_back(
+            caches_.contentHashCache.getBlake3(key, request).thenTry(
+                [file](folly::Try<
+                       std::shared_ptr<const ContentHashCache::Blake3Node>>&&
+                           result) {
+                  file->contentBlake3_ =
+                      makeResultWith([&] { return result.value()->value(); });
+                }));
+      }
     }
 
     file->clearNeededProperties();
   }
+
+  if (futures.empty()) {
+    return folly::makeSemiFuture();
+  }
+  return folly::collectAll(futures.begin(), futures.end()).unit();
 }
 
 std::optional<FileInformation> InMemoryFileResult::stat() {
@@ -231,207 +255,42 @@ std::optional<FileResult::ContentHash> InMemoryFileResult::getContentSha1() {
   return contentSha1_.value();
 }
 
-ViewDatabase::ViewDatabase(const w_string& root_path)
-    : rootPath_{root_path},
-      rootDir_{std::make_unique<watchman_dir>(root_path, nullptr)} {}
-
-watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name, bool create) {
-  if (dir_name == rootPath_) {
-    return rootDir_.get();
-  }
-
-  const char* dir_component = dir_name.data();
-  const char* dir_end = dir_component + dir_name.size();
-
-  watchman_dir* dir = rootDir_.get();
-  dir_component += rootPath_.size() + 1; // Skip root path prefix
-
-  w_assert(dir_component <= dir_end, "impossible file name");
-
-  watchman_dir* parent;
-  while (true) {
-    auto sep = (const char*)memchr(dir_component, '/', dir_end - dir_component);
-    // Note: if sep is NULL it means that we're looking at the basename
-    // component of the input directory name, which is the terminal
-    // iteration of this search.
-
-    w_string_piece component(
-        dir_component, sep ? (sep - dir_component) : (dir_end - dir_component));
-
-    auto child = dir->getChildDir(component);
-
-    if (!child && !create) {
-      return nullptr;
-    }
-    if (!child && sep && create) {
-      // A component in the middle wasn't present.  Since we're in create
-      // mode, we know that the leaf must exist.  The assumption is that
-      // we have another pending item for the parent.  We'll create the
-      // parent dir now and our other machinery will populate its contents
-      // later.
-      w_string child_name(dir_component, (uint32_t)(sep - dir_component));
-
-      // Careful! dir->dirs is keyed by non-owning string pieces so the
-      // child_name MUST be stored or otherwise kept alive by the watchman_dir
-      // instance constructed below!
-      auto& new_child = dir->dirs[child_name];
-      new_child.reset(new watchman_dir(child_name, dir));
-
-      child = new_child.get();
-    }
-
-    parent = dir;
-    dir = child;
-
-    if (!sep) {
-      // We reached the end of the string
-      if (dir) {
-        // We found the dir
-        return dir;
-      }
-      // We need to create the dir
-      break;
-    }
-
-    // Skip to the next component for the next iteration
-    dir_component = sep + 1;
-  }
-
-  w_string child_name(dir_component, (uint32_t)(dir_end - dir_component));
-  // Careful! parent->dirs is keyed by non-owning string pieces so the
-  // child_name MUST be stored or otherwise kept alive by the watchman_dir
-  // instance constructed below!
-  auto& new_child = parent->dirs[child_name];
-  new_child.reset(new watchman_dir(child_name, parent));
-  return new_child.get();
-}
-
-const watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name) const {
-  if (dir_name == rootPath_) {
-    return rootDir_.get();
-  }
-
-  const char* dir_component = dir_name.data();
-  const char* dir_end = dir_component + dir_name.size();
-
-  watchman_dir* dir = rootDir_.get();
-  dir_component += rootPath_.size() + 1; // Skip root path prefix
-
-  w_assert(dir_component <= dir_end, "impossible file name");
-
-  while (true) {
-    auto sep = (const char*)memchr(dir_component, '/', dir_end - dir_component);
-    // Note: if sep is NULL it means that we're looking at the basename
-    // component of the input directory name, which is the terminal
-    // iteration of this search.
-
-    w_string_piece component(
-        dir_component, sep ? (sep - dir_component) : (dir_end - dir_component));
-
-    auto child = dir->getChildDir(component);
-    if (!child) {
-      return nullptr;
-    }
-
-    dir = child;
-
-    if (!sep) {
-      // We reached the end of the string
-      if (dir) {
-        // We found the dir
-        return dir;
-      }
-      // Does not exist
-      return nullptr;
-    }
-
-    // Skip to the next component for the next iteration
-    dir_component = sep + 1;
-  }
-
-  return nullptr;
-}
-
-watchman_file* ViewDatabase::getOrCreateChildFile(
-    watchman_dir* dir,
-    const w_string& file_name,
-    ClockStamp ctime) {
-  // file_name is typically a baseName slice; let's use it as-is
-  // to look up a child...
-  auto it = dir->files.find(file_name);
-  if (it != dir->files.end()) {
-    return it->second.get();
-  }
-
-  // ... but take the shorter string from inside the file that
-  // we create as the key.
-  auto file = watchman_file::make(file_name, dir);
-  auto& file_ptr = dir->files[file->getName()];
-  file_ptr = std::move(file);
-
-  file_ptr->ctime = ctime;
-
-  return file_ptr.get();
-}
-
-void ViewDatabase::markFileChanged(watchman_file* file, ClockStamp otime) {
-  file->otime = otime;
-
-  if (latestFile_ != file) {
-    // unlink from list
-    file->removeFromFileList();
-
-    // and move to the head
-    insertAtHeadOfFileList(file);
-  }
-}
-
-void ViewDatabase::markDirDeleted(
-    watchman_dir* dir,
-    ClockStamp otime,
-    bool recursive) {
-  if (!dir->last_check_existed) {
-    // If we know that it doesn't exist, return early
-    return;
-  }
-  dir->last_check_existed = false;
-
-  for (auto& it : dir->files) {
-    auto file = it.second.get();
-
-    if (file->exists) {
-      auto full_name = dir->getFullPathToChild(file->getName());
-      logf(DBG, "mark_deleted: {}\n", full_name);
-      file->exists = false;
-      markFileChanged(file, otime);
-    }
+std::optional<FileResult::Blake3Hash> InMemoryFileResult::getContentBlake3() {
+  if (!file_->exists) {
+    // Don't return hashes for files that we believe to be deleted.
+    throw std::system_error(
+        std::make_error_code(std::errc::no_such_file_or_directory));
   }
 
-  if (recursive) {
-    for (auto& it : dir->dirs) {
-      auto child = it.second.get();
-
-      markDirDeleted(child, otime, true);
-    }
+  if (!file_->stat.isFile()) {
+    // We only want to compute the hash for regular files
+    throw std::system_error(std::make_error_code(std::errc::is_a_directory));
   }
-}
 
-void ViewDatabase::insertAtHeadOfFileList(struct watchman_file* file) {
-  file->next = latestFile_;
-  if (file->next) {
-    file->next->prev = &file->next;
+  if (contentBlake3_.empty()) {
+    accessorNeedsProperties(FileResult::Property::ContentBlake3);
+    return std::nullopt;
   }
-  latestFile_ = file;
-  file->prev = &latestFile_;
+  return contentBlake3_.value();
 }
 
 InMemoryView::PendingChangeLogEntry::PendingChangeLogEntry(
+    w_string_piece rootPath,
     const PendingChange& pc,
     std::error_code errcode,
     const FileInformation& st) noexcept {
   this->now = pc.now;
   this->pending_flags = pc.flags.asRaw();
-  storeTruncatedTail(this->path_tail, pc.path);
+  w_string_piece path = pc.path;
+  if (path == rootPath) {
+    path = w_string_piece{};
+  } else if (
+      path.size() > rootPath.size() && path.startsWith(rootPath) &&
+      is_slash(path[rootPath.size()])) {
+    path = w_string_piece{
+        path.data() + rootPath.size() + 1, path.size() - rootPath.size() - 1};
+  }
+  storeTruncatedTail(this->path_tail, path);
 
   this->errcode = errcode.value();
   this->mode = st.mode;
@@ -444,6 +303,7 @@ json_ref InMemoryView::PendingChangeLogEntry::asJsonValue() const {
       {"now", json_integer(now.time_since_epoch().count())},
       {"pending_flags",
        typed_string_to_json(PendingFlags::raw(pending_flags).format())},
+      {"flags", json_integer(pending_flags)},
       {"path",
        w_string_to_json(w_string{path_tail, strnlen(path_tail, kPathLength)})},
       {"errcode", json_integer(errcode)},
@@ -461,9 +321,13 @@ InMemoryView::InMemoryView(
     : QueryableView{root_path, /*requiresCrawl=*/true},
       fileSystem_{fileSystem},
       config_(std::move(config)),
-      view_(std::in_place, root_path),
+      view_(
+          std::in_place,
+          root_path,
+          config_.getBool("case_insensitive_index", false)),
       rootNumber_(next_root_number++),
       rootPath_(root_path),
+      ageOutSliceDuration_(config_.getInt("gc_slice_ms", 5)),
       watcher_(std::move(watcher)),
       caches_(
           root_path,
@@ -491,6 +355,7 @@ InMemoryView::InMemoryView(
 InMemoryView::~InMemoryView() = default;
 
 ClockStamp InMemoryView::ageOutFile(
+    ViewDatabase& view,
     std::unordered_set<w_string>& dirs_to_erase,
     watchman_file* file) {
   auto parent = file->parent;
@@ -507,7 +372,7 @@ ClockStamp InMemoryView::ageOutFile(
   // Remove the entry from the containing file hash; this will free it.
   // We don't need to stop watching it, because we already stopped watching it
   // when we marked it as !exists.
-  parent->files.erase(file->getName());
+  view.eraseChildFile(file);
 
   return ageOutOtime;
 }
@@ -516,53 +381,103 @@ void InMemoryView::ageOut(
     int64_t& walked,
     int64_t& files,
     int64_t& dirs,
+    int64_t& slices,
     std::chrono::seconds minAge) {
-  files = 0;
   walked = 0;
-  std::unordered_set<w_string> dirs_to_erase;
+  files = 0;
+  dirs = 0;
+  slices = 0;
 
   auto now = std::chrono::system_clock::now();
   lastAgeOutTimestamp_ = now;
+
+  int64_t purged = 0;
+  while (true) {
+    ++slices;
+    if (ageOutSlice(now, minAge, walked, files, dirs, purged)) {
+      break;
+    }
+    // Let queries and the notify thread in before we take the lock again.
+    std::this_thread::yield();
+  }
+
+  if (files + dirs) {
+    logf(ERR, "aged {} files, {} dirs in {} slices\n", files, dirs, slices);
+    logf(DBG, "purged {} unused names\n", purged);
+  }
+}
+
+std::optional<NameTableStats> InMemoryView::getNameTableStats() const {
+  return view_.rlock()->getNameTableStats();
+}
+
+std::optional<int64_t> InMemoryView::getNumFiles() const {
+  return view_.rlock()->getNumFiles();
+}
+
+bool InMemoryView::ageOutSlice(
+    std::chrono::system_clock::time_point now,
+    std::chrono::seconds minAge,
+    int64_t& walked,
+    int64_t& files,
+    int64_t& dirs,
+    int64_t& purged) {
+  // Checking the clock for every file would dominate the cost of erasing
+  // it, so only check it every so often.
+  constexpr int64_t kFilesPerClockCheck = 64;
+
+  std::unordered_set<w_string> dirs_to_erase;
+  auto deadline = std::chrono::steady_clock::now() + ageOutSliceDuration_;
   auto view = view_.wlock();
 
-  watchman_file* file = view->getLatestFile();
-  watchman_file* prior = nullptr;
-  while (file) {
+  bool done = false;
+  int64_t sliceFiles = 0;
+  while (true) {
+    // Deleted files are ordered by their otime, so once we find one that
+    // is too young, all of the rest are too.
+    watchman_file* file = view->getOldestDeletedFile();
+    if (!file) {
+      done = true;
+      break;
+    }
     ++walked;
-    if (file->exists ||
-        std::chrono::system_clock::from_time_t(file->otime.timestamp) + minAge >
-            now) {
-      prior = file;
-      file = file->next;
-      continue;
+    if (std::chrono::system_clock::from_time_t(file->otime.timestamp) +
+            minAge >
+        now) {
+      done = true;
+      break;
     }
 
-    auto agedOtime = ageOutFile(dirs_to_erase, file);
+    auto agedOtime = ageOutFile(*view, dirs_to_erase, file);
 
-    // Revise tick for fresh instance reporting
+    // Revise tick for fresh instance reporting.  Files are aged out in
+    // tick order, so queries that run between slices see a tick that
+    // covers everything aged out so far.
     lastAgeOutTick_ = std::max(lastAgeOutTick_, agedOtime.ticks);
 
     files++;
-
-    // Go back to last good file node; we can't trust that the
-    // value of file->next saved before age_out_file is a valid
-    // file node as anything past that point may have also been
-    // aged out along with it.
-    file = prior;
+    if (++sliceFiles % kFilesPerClockCheck == 0 &&
+        std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
   }
 
+  // If we have corresponding dirs, remove them now that we have unlinked
+  // all of the associated file nodes.  This also frees any deleted files
+  // inside of them, which unlink themselves from the deleted list.
   for (auto& name : dirs_to_erase) {
     auto parent = view->resolveDir(name.dirName(), false);
     if (parent) {
-      parent->dirs.erase(name.baseName());
+      view->eraseChildDir(parent, name.baseName());
     }
   }
+  dirs += dirs_to_erase.size();
 
-  if (files + dirs_to_erase.size()) {
-    logf(ERR, "aged {} files, {} dirs\n", files, dirs_to_erase.size());
-  }
+  // Only the names erased in this slice are looked at, so this is bounded
+  // by the slice too.
+  purged += view->purgeNames();
 
-  dirs = dirs_to_erase.size();
+  return done;
 }
 
 void InMemoryView::timeGenerator(const Query* query, QueryContext* ctx) const {
@@ -572,6 +487,7 @@ void InMemoryView::timeGenerator(const Query* query, QueryContext* ctx) const {
 
   for (watchman_file* f = view->getLatestFile(); f; f = f->next) {
     ctx->bumpNumWalked();
+    ctx->checkCancelled();
     // Note that we use <= for the time comparisons in here so that we
     // report the things that changed inclusive of the boundary presented.
     // This is especially important for clients using the coarse unix
@@ -590,11 +506,20 @@ void InMemoryView::timeGenerator(const Query* query, QueryContext* ctx) const {
       continue;
     }
 
-    w_query_process_file(
-        query, ctx, std::make_unique<InMemoryFileResult>(f, caches_));
+    processFile(query, ctx, f);
   }
 }
 
+void InMemoryView::processFile(
+    const Query* query,
+    QueryContext* ctx,
+    const watchman_file* file) const {
+  InMemoryFileResult result{file, caches_, query->cancellationToken};
+  w_query_process_file(query, ctx, result, [&] {
+    return std::make_unique<InMemoryFileResult>(std::move(result));
+  });
+}
+
 void InMemoryView::pathGenerator(const Query* query, QueryContext* ctx) const {
   w_string_piece relative_root;
   struct watchman_file* f;
@@ -608,6 +533,16 @@ void InMemoryView::pathGenerator(const Query* query, QueryContext* ctx) const {
   auto view = view_.rlock();
   ctx->generationStarted();
 
+  bool ignoreCase = query->case_sensitive != CaseSensitivity::CaseSensitive &&
+      view->hasCaseFoldedIndex();
+
+  // The paths are grouped by their parent directory (see parse_paths), so
+  // consecutive paths can reuse the parent resolved for the previous one.
+  // Ignoring case, that can be several parents.
+  w_string lastDirName;
+  const watchman_dir* lastDir = nullptr;
+  std::vector<const watchman_dir*> lastDirs;
+
   for (const auto& path : *query->paths) {
     const watchman_dir* dir;
     w_string dir_name;
@@ -631,7 +566,27 @@ void InMemoryView::pathGenerator(const Query* query, QueryContext* ctx) const {
       continue;
     }
 
-    dir = view->resolveDir(dir_name);
+    if (dir_name.view() != lastDirName.view()) {
+      if (ignoreCase) {
+        lastDirs.clear();
+        view->resolveDirsIgnoringCase(
+            dir_name,
+            [&](const watchman_dir* parent) { lastDirs.push_back(parent); });
+      } else {
+        lastDir = view->resolveDir(dir_name);
+      }
+      lastDirName = std::move(dir_name);
+    }
+
+    if (ignoreCase) {
+      auto folded = full_name.piece().baseName().asLowerCase();
+      for (auto* parent : lastDirs) {
+        pathGeneratorIgnoringCase(query, ctx, parent, folded, path.depth);
+      }
+      continue;
+    }
+
+    dir = lastDir;
 
     if (!dir) {
       // Doesn't exist, and never has
@@ -645,8 +600,8 @@ void InMemoryView::pathGenerator(const Query* query, QueryContext* ctx) const {
       // If it's a file (but not an existent dir)
       if (f && (!f->exists || !f->stat.isDir())) {
         ctx->bumpNumWalked();
-        w_query_process_file(
-            query, ctx, std::make_unique<InMemoryFileResult>(f, caches_));
+        ctx->checkCancelled();
+        processFile(query, ctx, f);
         continue;
       }
     }
@@ -665,6 +620,37 @@ void InMemoryView::pathGenerator(const Query* query, QueryContext* ctx) const {
   }
 }
 
+void InMemoryView::pathGeneratorIgnoringCase(
+    const Query* query,
+    QueryContext* ctx,
+    const watchman_dir* parent,
+    const w_string& folded,
+    uint32_t depth) const {
+  // As above, a file takes precedence over a dir of the same name, but
+  // several files and dirs can match ignoring case.
+  std::vector<w_string_piece> processedFiles;
+  auto [filesBegin, filesEnd] = parent->getChildFilesIgnoringCase(folded);
+  for (auto it = filesBegin; it != filesEnd; ++it) {
+    auto f = it->second;
+    if (!f->exists || !f->stat.isDir()) {
+      ctx->bumpNumWalked();
+      ctx->checkCancelled();
+      processFile(query, ctx, f);
+      processedFiles.push_back(f->getName());
+    }
+  }
+
+  auto [dirsBegin, dirsEnd] = parent->getChildDirsIgnoringCase(folded);
+  for (auto it = dirsBegin; it != dirsEnd; ++it) {
+    auto dir = it->second;
+    if (std::find(
+            processedFiles.begin(), processedFiles.end(), dir->name.piece()) ==
+        processedFiles.end()) {
+      dirGenerator(query, ctx, dir, depth);
+    }
+  }
+}
+
 void InMemoryView::dirGenerator(
     const Query* query,
     QueryContext* ctx,
@@ -673,9 +659,9 @@ void InMemoryView::dirGenerator(
   for (auto& it : dir->files) {
     auto file = it.second.get();
     ctx->bumpNumWalked();
+    ctx->checkCancelled();
 
-    w_query_process_file(
-        query, ctx, std::make_unique<InMemoryFileResult>(file, caches_));
+    processFile(query, ctx, file);
   }
 
   if (depth > 0) {
@@ -713,6 +699,7 @@ void InMemoryView::globGeneratorDoublestar(
     auto file_name = file->getName();
 
     ctx->bumpNumWalked();
+    ctx->checkCancelled();
 
     if (!file->exists) {
       // Globs can only match files that exist
@@ -739,10 +726,7 @@ void InMemoryView::globGeneratorDoublestar(
               0) == WM_MATCH;
 
       if (matched) {
-        w_query_process_file(
-            ctx->query,
-            ctx,
-            std::make_unique<InMemoryFileResult>(file, caches_));
+        processFile(ctx->query, ctx, file);
         // No sense running multiple matches for this same file node
         // if this one succeeded.
         break;
@@ -774,22 +758,45 @@ void InMemoryView::globGeneratorTree(
     globGeneratorDoublestar(ctx, dir, node, nullptr, 0);
   }
 
+  bool caseSensitive =
+      ctx->query->case_sensitive == CaseSensitivity::CaseSensitive;
+
   for (const auto& child_node : node->children) {
     w_assert(!child_node->is_doublestar, "should not get here with ** glob");
 
+    // Case-insensitive literals can be looked up directly if the dir keeps
+    // an index of its children by lowercased name.
+    w_string folded;
+    bool lookupIgnoringCase =
+        !child_node->had_specials && !caseSensitive && dir->caseFolded;
+    if (lookupIgnoringCase) {
+      folded = w_string_piece{child_node->pattern}.asLowerCase();
+    }
+
     // If there are child dirs, consider them for recursion.
     // Note that we don't restrict this to !leaf because the user may have
     // set their globs list to something like ["some_dir", "some_dir/file"]
     // and we don't want to preclude matching the latter.
     if (!dir->dirs.empty()) {
       // Attempt direct lookup if possible
-      if (!child_node->had_specials &&
-          ctx->query->case_sensitive == CaseSensitivity::CaseSensitive) {
+      if (!child_node->had_specials && caseSensitive) {
         w_string_piece component(
             child_node->pattern.data(), child_node->pattern.size());
         const auto child_dir = dir->getChildDir(component);
 
         if (child_dir) {
+          globGeneratorTree(ctx, child_node.get(), child_dir);
+        }
+      } else if (lookupIgnoringCase) {
+        auto [begin, end] = dir->getChildDirsIgnoringCase(folded);
+        for (auto it = begin; it != end; ++it) {
+          const auto child_dir = it->second;
+
+          if (!child_dir->last_check_existed) {
+            // Globs can only match files in dirs that exist
+            continue;
+          }
+
           globGeneratorTree(ctx, child_node.get(), child_dir);
         }
       } else {
@@ -805,11 +812,7 @@ void InMemoryView::globGeneratorTree(
           if (wildmatch(
                   child_node->pattern.c_str(),
                   child_dir->name.c_str(),
-                  ctx->query->glob_flags |
-                      (ctx->query->case_sensitive ==
-                               CaseSensitivity::CaseSensitive
-                           ? 0
-                           : WM_CASEFOLD),
+                  ctx->query->glob_flags | (caseSensitive ? 0 : WM_CASEFOLD),
                   0) == WM_MATCH) {
             globGeneratorTree(ctx, child_node.get(), child_dir);
           }
@@ -820,20 +823,28 @@ void InMemoryView::globGeneratorTree(
     // If the node is a leaf we are in a position to match files.
     if (child_node->is_leaf && !dir->files.empty()) {
       // Attempt direct lookup if possible
-      if (!child_node->had_specials &&
-          ctx->query->case_sensitive == CaseSensitivity::CaseSensitive) {
+      if (!child_node->had_specials && caseSensitive) {
         w_string_piece component(
             child_node->pattern.data(), child_node->pattern.size());
         auto file = dir->getChildFile(component);
 
         if (file) {
           ctx->bumpNumWalked();
+          ctx->checkCancelled();
+          if (file->exists) {
+            // Globs can only match files that exist
+            processFile(ctx->query, ctx, file);
+          }
+        }
+      } else if (lookupIgnoringCase) {
+        auto [begin, end] = dir->getChildFilesIgnoringCase(folded);
+        for (auto it = begin; it != end; ++it) {
+          auto file = it->second;
+          ctx->bumpNumWalked();
+          ctx->checkCancelled();
           if (file->exists) {
             // Globs can only match files that exist
-            w_query_process_file(
-                ctx->query,
-                ctx,
-                std::make_unique<InMemoryFileResult>(file, caches_));
+            processFile(ctx->query, ctx, file);
           }
         }
       } else {
@@ -842,6 +853,7 @@ void InMemoryView::globGeneratorTree(
           auto file = it.second.get();
           auto file_name = file->getName();
           ctx->bumpNumWalked();
+          ctx->checkCancelled();
 
           if (!file->exists) {
             // Globs can only match files that exist
@@ -851,16 +863,9 @@ void InMemoryView::globGeneratorTree(
           if (wildmatch(
                   child_node->pattern.c_str(),
                   file_name.data(),
-                  ctx->query->glob_flags |
-                      (ctx->query->case_sensitive ==
-                               CaseSensitivity::CaseSensitive
-                           ? 0
-                           : WM_CASEFOLD),
+                  ctx->query->glob_flags | (caseSensitive ? 0 : WM_CASEFOLD),
                   0) == WM_MATCH) {
-            w_query_process_file(
-                ctx->query,
-                ctx,
-                std::make_unique<InMemoryFileResult>(file, caches_));
+            processFile(ctx->query, ctx, file);
           }
         }
       }
@@ -897,12 +902,12 @@ void InMemoryView::allFilesGenerator(const Query* query, QueryContext* ctx)
 
   for (f = view->getLatestFile(); f; f = f->next) {
     ctx->bumpNumWalked();
+    ctx->checkCancelled();
     if (!ctx->fileMatchesRelativeRoot(f)) {
       continue;
     }
 
-    w_query_process_file(
-        query, ctx, std::make_unique<InMemoryFileResult>(f, caches_));
+    processFile(query, ctx, f);
   }
 }
 
@@ -910,6 +915,14 @@ ClockPosition InMemoryView::getMostRecentRootNumberAndTickValue() const {
   return ClockPosition(rootNumber_, mostRecentTick_);
 }
 
+ClockPosition InMemoryView::getLastChangePosition() const {
+  // Every change to a file moves it to the head of the recency index, and
+  // cookie files are never added to the view.
+  auto view = view_.rlock();
+  auto* latest = view->getLatestFile();
+  return ClockPosition(rootNumber_, latest ? latest->otime.ticks : 0);
+}
+
 w_string InMemoryView::getCurrentClockString() const {
   char clockbuf[128];
   if (!clock_id_string(
@@ -1241,7 +1254,8 @@ void InMemoryView::warmContentCache() {
             f->stat.mtime};
 
         log(DBG, "warmContentCache: lookup ", key.relativePath, "\n");
-        auto f_2 = caches_.contentHashCache.get(key);
+        auto f_2 = caches_.contentHashCache.get(
+            key, ContentHashRequest{HashingExecutor::Priority::Background});
         if (syncContentCacheWarming_) {
           futures.emplace_back(std::move(f_2));
         }
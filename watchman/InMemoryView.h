@@ -6,6 +6,7 @@
  */
 
 #pragma once
+#include <folly/Function.h>
 #include <folly/Synchronized.h>
 #include <map>
 #include <memory>
@@ -14,15 +15,18 @@
 #include <utility>
 #include "watchman/ContentHash.h"
 #include "watchman/CookieSync.h"
+#include "watchman/NameTable.h"
 #include "watchman/PendingCollection.h"
 #include "watchman/PerfSample.h"
 #include "watchman/QueryableView.h"
 #include "watchman/Result.h"
 #include "watchman/RingBuffer.h"
 #include "watchman/SymlinkTargets.h"
+#include "watchman/ViewDatabase.h"
 #include "watchman/WatchmanConfig.h"
 #include "watchman/fs/DirHandle.h"
 #include "watchman/query/FileResult.h"
+#include "watchman/watchman_file.h"
 #include "watchman/watchman_string.h"
 #include "watchman/watchman_system.h"
 
@@ -49,7 +53,10 @@ struct InMemoryViewCaches {
 
 class InMemoryFileResult final : public FileResult {
  public:
-  InMemoryFileResult(const watchman_file* file, InMemoryViewCaches& caches);
+  InMemoryFileResult(
+      const watchman_file* file,
+      InMemoryViewCaches& caches,
+      folly::CancellationToken cancellationToken);
   std::optional<FileInformation> stat() override;
   std::optional<struct timespec> accessedTime() override;
   std::optional<struct timespec> modifiedTime() override;
@@ -62,78 +69,21 @@ class InMemoryFileResult final : public FileResult {
   std::optional<ClockStamp> ctime() override;
   std::optional<ClockStamp> otime() override;
   std::optional<FileResult::ContentHash> getContentSha1() override;
+  std::optional<FileResult::Blake3Hash> getContentBlake3() override;
   void batchFetchProperties(
       const std::vector<std::unique_ptr<FileResult>>& files) override;
+  folly::SemiFuture<folly::Unit> startBatchFetchProperties(
+      const std::vector<std::unique_ptr<FileResult>>& files) override;
 
  private:
   const watchman_file* file_;
   std::optional<w_string> dirName_;
   InMemoryViewCaches& caches_;
+  // From the query; passed along with content hash requests.
+  folly::CancellationToken cancellationToken_;
   std::optional<ResolvedSymlink> symlinkTarget_;
   Result<FileResult::ContentHash> contentSha1_;
-};
-
-/**
- * In-memory data structure representing Watchman's understanding of the watched
- * root. Files are ordered in a linked recency index as well as hierarchically
- * from the root.
- */
-class ViewDatabase {
- public:
-  explicit ViewDatabase(const w_string& root_path);
-
-  watchman_file* getLatestFile() const {
-    return latestFile_;
-  }
-
-  ino_t getRootInode() const {
-    return rootInode_;
-  }
-
-  void setRootInode(ino_t ino) {
-    rootInode_ = ino;
-  }
-
-  watchman_dir* resolveDir(const w_string& dirname, bool create);
-
-  const watchman_dir* resolveDir(const w_string& dirname) const;
-
-  /**
-   * Returns the direct child file named name if it already exists, else creates
-   * that entry and returns it.
-   */
-  watchman_file* getOrCreateChildFile(
-      watchman_dir* dir,
-      const w_string& file_name,
-      ClockStamp ctime);
-
-  /**
-   * Updates the otime for the file and bubbles it to the front of recency
-   * index.
-   */
-  void markFileChanged(watchman_file* file, ClockStamp otime);
-
-  /**
-   * Mark a directory as being removed from the view. Marks the contained set of
-   * files as deleted. If recursive is true, is recursively invoked on child
-   * dirs.
-   */
-  void markDirDeleted(watchman_dir* dir, ClockStamp otime, bool recursive);
-
- private:
-  void insertAtHeadOfFileList(struct watchman_file* file);
-
-  const w_string rootPath_;
-
-  /* the most recently changed file */
-  watchman_file* latestFile_ = nullptr;
-
-  std::unique_ptr<watchman_dir> rootDir_;
-
-  // Inode number for the root dir.  This is used to detect what should
-  // be impossible situations, but is needed in practice to workaround
-  // eg: BTRFS not delivering all events for subvolumes
-  ino_t rootInode_{0};
+  Result<FileResult::Blake3Hash> contentBlake3_;
 };
 
 /**
@@ -153,6 +103,7 @@ class InMemoryView final : public QueryableView {
   InMemoryView& operator=(InMemoryView&&) = delete;
 
   ClockPosition getMostRecentRootNumberAndTickValue() const override;
+  ClockPosition getLastChangePosition() const override;
   ClockTicks getLastAgeOutTickValue() const override;
   std::chrono::system_clock::time_point getLastAgeOutTimeStamp() const override;
   w_string getCurrentClockString() const override;
@@ -168,8 +119,12 @@ class InMemoryView final : public QueryableView {
       int64_t& walked,
       int64_t& files,
       int64_t& dirs,
+      int64_t& slices,
       std::chrono::seconds minAge) override;
 
+  std::optional<NameTableStats> getNameTableStats() const override;
+  std::optional<int64_t> getNumFiles() const override;
+
   folly::SemiFuture<folly::Unit> waitForSettle(
       std::chrono::milliseconds settle_period) override;
   CookieSync::SyncResult syncToNow(
@@ -232,15 +187,48 @@ class InMemoryView final : public QueryableView {
 
   // Returns the erased file's otime.
   ClockStamp ageOutFile(
+      ViewDatabase& view,
       std::unordered_set<w_string>& dirs_to_erase,
       watchman_file* file);
 
+  // Ages out deleted files, oldest first, while holding the view lock for
+  // no longer than ageOutSliceDuration_. Returns true once there are no
+  // more files older than minAge.
+  bool ageOutSlice(
+      std::chrono::system_clock::time_point now,
+      std::chrono::seconds minAge,
+      int64_t& walked,
+      int64_t& files,
+      int64_t& dirs,
+      int64_t& purged);
+
   // When a watcher is desynced, it sets the W_PENDING_IS_DESYNCED flag, and the
   // crawler will set these recursively. If one of these flag is set,
   // processPending will return IsDesynced::Yes and it is expected that the
   // caller will abort all pending cookies after processAllPending returns.
   enum class IsDesynced { Yes, No };
 
+  /**
+   * Passes file to w_query_process_file. It is only allocated on the heap if
+   * it matches or needs more data, so that walking files that don't match
+   * doesn't allocate.
+   */
+  void processFile(
+      const Query* query,
+      QueryContext* ctx,
+      const watchman_file* file) const;
+
+  /**
+   * Generates the children of parent whose names are folded ignoring case,
+   * for a case-insensitive path generator.
+   */
+  void pathGeneratorIgnoringCase(
+      const Query* query,
+      QueryContext* ctx,
+      const watchman_dir* parent,
+      const w_string& folded,
+      uint32_t depth) const;
+
   /** Recursively walks files under a specified dir */
   void dirGenerator(
       const Query* query,
@@ -387,6 +375,8 @@ class InMemoryView final : public QueryableView {
   // This is system_clock instead of steady_clock because it's compared with a
   // file's otime.
   std::chrono::system_clock::time_point lastAgeOutTimestamp_{};
+  // How long age out may hold the view lock before giving others a turn.
+  std::chrono::milliseconds ageOutSliceDuration_;
 
   using PendingSettles =
       std::multimap<std::chrono::milliseconds, folly::Promise<folly::Unit>>;
@@ -431,7 +421,10 @@ class InMemoryView final : public QueryableView {
     PendingChangeLogEntry() noexcept {
       // time_point is not noexcept so this can't be defaulted.
     }
-    explicit PendingChangeLogEntry(
+    // Paths under rootPath are stored relative to it, so that more of each
+    // path fits and logs can be replayed against another root.
+    PendingChangeLogEntry(
+        w_string_piece rootPath,
         const PendingChange& pc,
         std::error_code errcode,
         const FileInformation& st) noexcept;
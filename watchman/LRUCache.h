@@ -537,6 +537,23 @@ class LRUCache {
     return node;
   }
 
+  // Erase node if it is still the entry for its key; it may have been
+  // evicted or replaced since it was handed out.  node must have been
+  // obtained from a completed get() or set().
+  // Returns true if it was erased.
+  bool erase(const std::shared_ptr<const NodeType>& node) {
+    auto state = state_.wlock();
+    auto it = state->map.find(node->key_);
+    if (it == state->map.end() || it->second != node) {
+      return false;
+    }
+
+    whichQ(it->second.get(), state)->remove(it->second.get());
+    state->map.erase(it);
+    ++state->stats.cacheErase;
+    return true;
+  }
+
   // Erase the entry associated with key.
   // Returns the node if it was present, else nullptr.
   std::shared_ptr<const NodeType> erase(const KeyType& key) {
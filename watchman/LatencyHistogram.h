@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/lang/Bits.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "watchman/Serde.h"
+
+namespace watchman {
+
+/**
+ * Summary of a LatencyHistogram, suitable for returning from debug commands.
+ * All durations are in microseconds.
+ */
+struct LatencySummary : serde::Object {
+  int64_t count = 0;
+  int64_t mean_us = 0;
+  int64_t p50_us = 0;
+  int64_t p90_us = 0;
+  int64_t p99_us = 0;
+  int64_t max_us = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("count", count);
+    x("mean_us", mean_us);
+    x("p50_us", p50_us);
+    x("p90_us", p90_us);
+    x("p99_us", p99_us);
+    x("max_us", max_us);
+  }
+};
+
+/**
+ * Fixed-size, lock-free histogram of durations.
+ *
+ * Buckets are laid out HDR-style: each power-of-two range of microseconds
+ * is split into kSubBuckets linear sub-buckets, so reported percentiles are
+ * within 1/kSubBuckets of the true value while the whole histogram stays a
+ * few KB. Recording is a couple of relaxed atomic increments and is safe
+ * from any thread.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+  // Covers up to 2^38us, around three days.
+  static constexpr size_t kOctaves = 36;
+  static constexpr size_t kNumBuckets = kOctaves * kSubBuckets;
+
+  template <typename Rep, typename Period>
+  void record(std::chrono::duration<Rep, Period> elapsed) {
+    auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    recordMicros(us < 0 ? 0 : uint64_t(us));
+  }
+
+  void recordMicros(uint64_t us) {
+    buckets_[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(us, std::memory_order_relaxed);
+    auto prevMax = max_.load(std::memory_order_relaxed);
+    while (us > prevMax &&
+           !max_.compare_exchange_weak(
+               prevMax, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the upper bound, in microseconds, of the bucket containing the
+   * given percentile (0-100). Returns 0 if nothing has been recorded.
+   */
+  uint64_t percentileMicros(double pct) const {
+    std::array<uint64_t, kNumBuckets> snapshot;
+    uint64_t total = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      snapshot[i] = buckets_[i].load(std::memory_order_relaxed);
+      total += snapshot[i];
+    }
+    if (total == 0) {
+      return 0;
+    }
+
+    auto rank = uint64_t(pct / 100.0 * double(total));
+    if (rank >= total) {
+      rank = total - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      seen += snapshot[i];
+      if (seen > rank) {
+        auto upper = bucketUpperBound(i);
+        auto max = max_.load(std::memory_order_relaxed);
+        return upper < max ? upper : max;
+      }
+    }
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  LatencySummary summarize() const {
+    LatencySummary summary;
+    summary.count = int64_t(count());
+    if (summary.count > 0) {
+      auto sum = sum_.load(std::memory_order_relaxed);
+      summary.mean_us = int64_t(sum / uint64_t(summary.count));
+    }
+    summary.p50_us = int64_t(percentileMicros(50));
+    summary.p90_us = int64_t(percentileMicros(90));
+    summary.p99_us = int64_t(percentileMicros(99));
+    summary.max_us = int64_t(max_.load(std::memory_order_relaxed));
+    return summary;
+  }
+
+  /**
+   * Adds everything recorded in other to this histogram, as if each of its
+   * recordings had also been made here.
+   */
+  void merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      auto n = other.buckets_[i].load(std::memory_order_relaxed);
+      if (n) {
+        buckets_[i].fetch_add(n, std::memory_order_relaxed);
+      }
+    }
+    count_.fetch_add(other.count(), std::memory_order_relaxed);
+    sum_.fetch_add(
+        other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    auto otherMax = other.max_.load(std::memory_order_relaxed);
+    auto prevMax = max_.load(std::memory_order_relaxed);
+    while (otherMax > prevMax &&
+           !max_.compare_exchange_weak(
+               prevMax, otherMax, std::memory_order_relaxed)) {
+    }
+  }
+
+  /**
+   * Resets all counters. Concurrent recordings may be partially lost, which
+   * is acceptable for diagnostic data.
+   */
+  void clear() {
+    for (auto& bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  static size_t bucketIndex(uint64_t us) {
+    if (us < kSubBuckets) {
+      return size_t(us);
+    }
+    // The octave is the position of the highest set bit above the
+    // sub-bucket bits; the sub-bucket is the next kSubBucketBits bits.
+    size_t highBit = size_t(folly::findLastSet(us)) - 1;
+    size_t octave = highBit - kSubBucketBits + 1;
+    size_t sub = size_t(us >> (highBit - kSubBucketBits)) & (kSubBuckets - 1);
+    size_t index = octave * kSubBuckets + sub;
+    return index < kNumBuckets ? index : kNumBuckets - 1;
+  }
+
+  static uint64_t bucketUpperBound(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    size_t octave = index / kSubBuckets;
+    uint64_t sub = index % kSubBuckets;
+    size_t shift = octave - 1;
+    return ((kSubBuckets + sub + 1) << shift) - 1;
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+} // namespace watchman
@@ -7,6 +7,7 @@
 
 #include "watchman/Logging.h"
 
+#include <folly/ProducerConsumerQueue.h>
 #include <folly/ScopeGuard.h>
 #include <folly/ThreadLocal.h>
 #include <folly/debugging/symbolizer/Symbolizer.h>
@@ -17,9 +18,13 @@
 
 #include <fmt/core.h>
 #include <array>
+#include <chrono>
+#include <condition_variable>
 #include <limits>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <thread>
 
 #ifdef __APPLE__
 #include <pthread.h>
@@ -97,12 +102,328 @@ LogLevel logLabelToLevel(const w_string& label) {
   return getLevelMaps().labelToLevel.at(label);
 }
 
+namespace {
+
+struct LogRecord {
+  LogLevel level;
+  std::chrono::system_clock::time_point time;
+  w_string threadName;
+  w_string message;
+};
+
+// The log statements of one thread that are waiting for the writer.
+struct LogBuffer {
+  explicit LogBuffer(uint32_t size) : records{size} {}
+
+  // Single producer (the owning thread) and single consumer (whoever
+  // holds AsyncState::drainMutex).
+  folly::ProducerConsumerQueue<LogRecord> records;
+  // Only written by the owning thread, so they don't need atomic
+  // increments.
+  std::atomic<uint64_t> queued{0};
+  std::atomic<uint64_t> dropped{0};
+  // Set when the owning thread no longer uses this buffer. The writer
+  // forgets it once it has been drained.
+  std::atomic<bool> orphaned{false};
+  // Set while the owning thread may be writing a record, so that stopAsync
+  // can wait for it before the final drain.
+  std::atomic<bool> writing{false};
+};
+
+struct ThreadLogState {
+  // Identifies the AsyncState that buffer is registered with.
+  uint64_t owner{0};
+  std::shared_ptr<LogBuffer> buffer;
+  // Cached so that each record only has to take a reference to it.
+  w_string threadName;
+
+  ~ThreadLogState() {
+    if (buffer) {
+      buffer->orphaned.store(true, std::memory_order_release);
+    }
+  }
+};
+
+folly::ThreadLocal<ThreadLogState> threadLogState;
+
+// Set while this thread drains the buffers, which publishes to subscribers
+// that may log a fatal error. Flushing then would wait for itself.
+thread_local bool drainingOnThisThread = false;
+
+std::atomic<uint64_t> nextAsyncStateId{1};
+
+// How long the writer sleeps when nothing wakes it. Bounds the delay of a
+// record whose wakeup raced with the writer going to sleep.
+constexpr std::chrono::milliseconds kWriterInterval{50};
+
+} // namespace
+
+struct Log::AsyncState {
+  explicit AsyncState(uint32_t size) : bufferSize{size} {}
+
+  const uint64_t id{nextAsyncStateId.fetch_add(1)};
+  const uint32_t bufferSize;
+
+  // Taken when a thread logs for the first time, and by the writer.
+  std::mutex registryMutex;
+  std::vector<std::shared_ptr<LogBuffer>> buffers;
+  // Counts from buffers that have been forgotten.
+  uint64_t retiredQueued{0};
+  uint64_t retiredDropped{0};
+
+  // Only one thread may consume from the buffers at a time.
+  std::mutex drainMutex;
+  std::atomic<uint64_t> written{0};
+
+  // Set by loggers to wake the writer. Checked before it is set, so that
+  // a busy writer doesn't turn every log statement into a write to a
+  // shared cache line.
+  std::atomic<bool> pending{false};
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+  bool stopping{false};
+
+  std::thread writer;
+
+  std::shared_ptr<LogBuffer> registerThread() {
+    auto buffer = std::make_shared<LogBuffer>(bufferSize);
+    std::lock_guard<std::mutex> lock{registryMutex};
+    buffers.push_back(buffer);
+    return buffer;
+  }
+};
+
 Log::Log()
     : errorPub_(std::make_shared<Publisher>()),
       debugPub_(std::make_shared<Publisher>()) {
   setStdErrLoggingLevel(ERR);
 }
 
+Log::~Log() {
+  stopAsync();
+}
+
+void Log::startAsync(size_t bufferSize) {
+  if (async_) {
+    return;
+  }
+  // ProducerConsumerQueue holds one fewer than its size.
+  async_ = std::make_unique<AsyncState>(
+      std::max<uint32_t>(2, std::min<size_t>(bufferSize, UINT32_MAX - 1) + 1));
+  async_->writer = std::thread{[this] { runWriter(); }};
+  asyncEnabled_.store(true, std::memory_order_release);
+}
+
+void Log::stopAsync() {
+  // Sequentially consistent, paired with enqueueAsync: each logging thread
+  // either sees that async logging has stopped or is waited for below.
+  if (!async_ || !asyncEnabled_.exchange(false)) {
+    return;
+  }
+  {
+    // Wait for the records that are already on their way, so that the
+    // writer's final drain includes them.
+    std::lock_guard<std::mutex> lock{async_->registryMutex};
+    for (auto& buffer : async_->buffers) {
+      while (buffer->writing.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock{async_->wakeMutex};
+    async_->stopping = true;
+  }
+  async_->wake.notify_one();
+  async_->writer.join();
+}
+
+void Log::flush() {
+  if (asyncEnabled_.load(std::memory_order_acquire) && !drainingOnThisThread) {
+    drainAsync();
+  }
+}
+
+LogStats Log::getStats() const {
+  LogStats stats;
+  stats.async = asyncEnabled_.load(std::memory_order_acquire);
+  if (!async_) {
+    return stats;
+  }
+
+  std::lock_guard<std::mutex> lock{async_->registryMutex};
+  stats.threads = async_->buffers.size();
+  stats.queued = async_->retiredQueued;
+  stats.dropped = async_->retiredDropped;
+  for (auto& buffer : async_->buffers) {
+    stats.queued += buffer->queued.load(std::memory_order_relaxed);
+    stats.dropped += buffer->dropped.load(std::memory_order_relaxed);
+  }
+  stats.written = async_->written.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Log::publish(LogLevel level, w_string line) {
+  if (level <= FATAL) {
+    // Make sure that everything logged before the fatal error is written
+    // before we exit. If this thread is already draining, that is what it
+    // has written so far.
+    flush();
+  }
+
+  auto payload = json_object(
+      {{"log", typed_string_to_json(std::move(line))},
+       {"unilateral", json_true()},
+       {"level", typed_string_to_json(logLevelToLabel(level))}});
+
+  levelToPub(level).enqueue(std::move(payload));
+}
+
+void Log::enqueueAsync(LogLevel level, w_string message) {
+  auto& async = *async_;
+  auto& local = *threadLogState;
+  if (local.owner != async.id) {
+    if (local.buffer) {
+      local.buffer->orphaned.store(true, std::memory_order_release);
+    }
+    local.buffer = async.registerThread();
+    local.owner = async.id;
+  }
+  if (local.threadName == nullptr) {
+    local.threadName = w_string{getThreadName(), W_STRING_BYTE};
+  }
+
+  auto& buffer = *local.buffer;
+  // Sequentially consistent, paired with stopAsync: if async logging is
+  // still enabled here, stopAsync waits for this record before the writer
+  // drains for the last time.
+  buffer.writing.store(true);
+  if (!asyncEnabled_.load()) {
+    buffer.writing.store(false, std::memory_order_release);
+    char timebuf[64];
+    publish(
+        level,
+        w_string::build(
+            currentTimeString(timebuf, sizeof(timebuf)),
+            ": [",
+            local.threadName,
+            "] ",
+            message));
+    return;
+  }
+  bool written = buffer.records.write(LogRecord{
+      level,
+      std::chrono::system_clock::now(),
+      local.threadName,
+      std::move(message)});
+  auto& counter = written ? buffer.queued : buffer.dropped;
+  counter.store(
+      counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  buffer.writing.store(false, std::memory_order_release);
+  if (!written) {
+    return;
+  }
+
+  if (!async.pending.load(std::memory_order_relaxed) &&
+      !async.pending.exchange(true, std::memory_order_acq_rel)) {
+    async.wake.notify_one();
+  }
+}
+
+void Log::drainAsync() {
+  auto& async = *async_;
+  std::lock_guard<std::mutex> drainLock{async.drainMutex};
+  drainingOnThisThread = true;
+  SCOPE_EXIT {
+    drainingOnThisThread = false;
+  };
+  // Clear this before reading, so that anything logged while we drain
+  // wakes the writer again.
+  async.pending.store(false, std::memory_order_release);
+
+  // Each thread's records are already in order.
+  std::vector<std::vector<LogRecord>> runs;
+  {
+    std::lock_guard<std::mutex> lock{async.registryMutex};
+    auto it = async.buffers.begin();
+    while (it != async.buffers.end()) {
+      auto& buffer = **it;
+      // Check this first: once orphaned, nothing more will be written.
+      bool orphaned = buffer.orphaned.load(std::memory_order_acquire);
+
+      std::vector<LogRecord> run;
+      LogRecord record;
+      while (buffer.records.read(record)) {
+        run.push_back(std::move(record));
+      }
+      if (!run.empty()) {
+        runs.push_back(std::move(run));
+      }
+
+      if (orphaned) {
+        async.retiredQueued += buffer.queued.load(std::memory_order_relaxed);
+        async.retiredDropped += buffer.dropped.load(std::memory_order_relaxed);
+        it = async.buffers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Merge the threads' records by time, without reordering any one
+  // thread's records.
+  std::vector<size_t> next(runs.size(), 0);
+  while (true) {
+    std::optional<size_t> earliest;
+    for (size_t i = 0; i < runs.size(); ++i) {
+      if (next[i] < runs[i].size() &&
+          (!earliest ||
+           runs[i][next[i]].time < runs[*earliest][next[*earliest]].time)) {
+        earliest = i;
+      }
+    }
+    if (!earliest) {
+      break;
+    }
+
+    auto& record = runs[*earliest][next[*earliest]++];
+    auto time = record.time.time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(time);
+    timeval tv;
+    tv.tv_sec = seconds.count();
+    tv.tv_usec =
+        std::chrono::duration_cast<std::chrono::microseconds>(time - seconds)
+            .count();
+    char timebuf[64];
+    publish(
+        record.level,
+        w_string::build(
+            timeString(timebuf, sizeof(timebuf), tv),
+            ": [",
+            record.threadName,
+            "] ",
+            record.message));
+    async.written.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Log::runWriter() {
+  auto& async = *async_;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{async.wakeMutex};
+      async.wake.wait_for(lock, kWriterInterval, [&] {
+        return async.stopping || async.pending.load(std::memory_order_acquire);
+      });
+      if (async.stopping) {
+        break;
+      }
+    }
+    drainAsync();
+  }
+  drainAsync();
+}
+
 Log& getLog() {
   static Log log;
   return log;
@@ -144,6 +465,7 @@ const char* Log::setThreadName(std::string&& name) {
   }
 
   threadName->emplace(name);
+  threadLogState->threadName.reset();
   return threadName->value().c_str();
 }
 
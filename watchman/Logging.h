@@ -12,6 +12,7 @@
 #include <folly/portability/Windows.h> // For timeval. Replace this.
 
 #include "watchman/PubSub.h"
+#include "watchman/Serde.h"
 #include "watchman/watchman_preprocessor.h"
 #include "watchman/watchman_string.h"
 
@@ -22,6 +23,28 @@ enum LogLevel { ABORT = -2, FATAL = -1, OFF = 0, ERR = 1, DBG = 2 };
 const w_string& logLevelToLabel(LogLevel level);
 LogLevel logLabelToLevel(const w_string& label);
 
+struct LogStats : serde::Object {
+  // Whether log statements are handed off to the writer thread.
+  bool async = false;
+  // Threads with a log buffer.
+  int64_t threads = 0;
+  // Log statements handed off to the writer thread.
+  int64_t queued = 0;
+  // Log statements that the writer thread has published.
+  int64_t written = 0;
+  // Log statements thrown away because their thread's buffer was full.
+  int64_t dropped = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("async", async);
+    x("threads", threads);
+    x("queued", queued);
+    x("written", written);
+    x("dropped", dropped);
+  }
+};
+
 class Log {
  public:
   std::shared_ptr<Publisher::Subscriber> subscribe(
@@ -37,6 +60,30 @@ class Log {
 
   void setStdErrLoggingLevel(LogLevel level);
 
+  /**
+   * From now on, hand log statements off to a writer thread rather than
+   * publishing them on the logging thread. Each thread that logs gets its
+   * own buffer of bufferSize statements, and statements logged while that
+   * buffer is full are dropped and counted.
+   *
+   * Only the message is formatted on the logging thread: the timestamp,
+   * thread name, subscriber payload and writing to stderr are all left to
+   * the writer thread. FATAL and ABORT are always logged synchronously,
+   * after flushing everything logged before them, unless they are logged
+   * by a subscriber while the thread is already flushing.
+   */
+  void startAsync(size_t bufferSize);
+
+  // Stop the writer thread once it has written every statement handed off
+  // to it, including those being handed off as it stops. Logging is
+  // synchronous again after.
+  void stopAsync();
+
+  // Publish everything that has been handed off to the writer thread.
+  void flush();
+
+  LogStats getStats() const;
+
   // Build a string and log it
   template <typename... Args>
   void log(LogLevel level, Args&&... args) {
@@ -47,21 +94,20 @@ class Log {
       return;
     }
 
-    char timebuf[64];
+    if (level > FATAL && asyncEnabled_.load(std::memory_order_acquire)) {
+      enqueueAsync(level, w_string::build(std::forward<Args>(args)...));
+      return;
+    }
 
-    auto payload = json_object(
-        {{"log",
-          typed_string_to_json(
-              w_string::build(
-                  currentTimeString(timebuf, sizeof(timebuf)),
-                  ": [",
-                  getThreadName(),
-                  "] ",
-                  std::forward<Args>(args)...))},
-         {"unilateral", json_true()},
-         {"level", typed_string_to_json(logLevelToLabel(level))}});
-
-    pub.enqueue(std::move(payload));
+    char timebuf[64];
+    publish(
+        level,
+        w_string::build(
+            currentTimeString(timebuf, sizeof(timebuf)),
+            ": [",
+            getThreadName(),
+            "] ",
+            std::forward<Args>(args)...));
   }
 
   // Format a string and log it
@@ -74,28 +120,32 @@ class Log {
       return;
     }
 
+    if (level > FATAL && asyncEnabled_.load(std::memory_order_acquire)) {
+      enqueueAsync(
+          level, w_string::format(format_str, std::forward<Args>(args)...));
+      return;
+    }
+
     char timebuf[64];
 
     auto message =
         fmt::format(fmt::runtime(format_str), std::forward<Args>(args)...);
-    auto payload = json_object(
-        {{"log",
-          typed_string_to_json(
-              w_string::build(
-                  currentTimeString(timebuf, sizeof(timebuf)),
-                  ": [",
-                  getThreadName(),
-                  "] ",
-                  std::move(message)))},
-         {"unilateral", json_true()},
-         {"level", typed_string_to_json(logLevelToLabel(level))}});
-
-    pub.enqueue(std::move(payload));
+    publish(
+        level,
+        w_string::build(
+            currentTimeString(timebuf, sizeof(timebuf)),
+            ": [",
+            getThreadName(),
+            "] ",
+            std::move(message)));
   }
 
   Log();
+  ~Log();
 
  private:
+  struct AsyncState;
+
   std::shared_ptr<Publisher> errorPub_;
   std::shared_ptr<Publisher> debugPub_;
 
@@ -112,10 +162,21 @@ class Log {
   //    writing to stderr.
   folly::Synchronized<Subscribers, std::mutex> subscribers_;
 
+  // Set once async_ is ready for use, and cleared by stopAsync. async_
+  // itself lives as long as the Log.
+  std::atomic<bool> asyncEnabled_{false};
+  std::unique_ptr<AsyncState> async_;
+
   inline Publisher& levelToPub(LogLevel level) {
     return level == DBG ? *debugPub_ : *errorPub_;
   }
 
+  // Send a complete log line to the subscribers.
+  void publish(LogLevel level, w_string line);
+  void enqueueAsync(LogLevel level, w_string message);
+  void drainAsync();
+  void runWriter();
+
   void doLogToStdErr();
 };
 
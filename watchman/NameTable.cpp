@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/NameTable.h"
+
+namespace watchman {
+
+w_string NameTable::intern(w_string_piece name) {
+  ++lookups_;
+  auto it = names_.find(name);
+  if (it != names_.end()) {
+    ++hits_;
+    return it->second;
+  }
+
+  w_string interned{name.data(), name.size(), W_STRING_BYTE};
+  // Compute and cache the hash now, so that users of the name don't have
+  // to.
+  interned.hashValue();
+  names_.emplace(interned.piece(), interned);
+  bytes_ += interned.size();
+  return interned;
+}
+
+size_t NameTable::purge() {
+  size_t dropped = 0;
+  for (auto it = names_.begin(); it != names_.end();) {
+    if (it->second.isUnique()) {
+      bytes_ -= it->second.size();
+      it = names_.erase(it);
+      ++dropped;
+    } else {
+      ++it;
+    }
+  }
+  purged_ += dropped;
+  return dropped;
+}
+
+size_t NameTable::purge(std::vector<w_string>& candidates) {
+  size_t dropped = 0;
+  for (auto& candidate : candidates) {
+    auto it = names_.find(candidate.piece());
+    candidate.reset();
+    // A name listed more than once is only unique at its last listing.
+    if (it != names_.end() && it->second.isUnique()) {
+      bytes_ -= it->second.size();
+      names_.erase(it);
+      ++dropped;
+    }
+  }
+  candidates.clear();
+  purged_ += dropped;
+  return dropped;
+}
+
+NameTableStats NameTable::getStats() const {
+  NameTableStats stats;
+  stats.names = names_.size();
+  stats.bytes = bytes_;
+  stats.lookups = lookups_;
+  stats.hits = hits_;
+  stats.purged = purged_;
+  return stats;
+}
+
+} // namespace watchman
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "watchman/Serde.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+struct NameTableStats : serde::Object {
+  // Distinct names in the table, and their total length.
+  int64_t names = 0;
+  int64_t bytes = 0;
+  // Calls to intern(), and how many of them found the name already there.
+  int64_t lookups = 0;
+  int64_t hits = 0;
+  // Names dropped by purge() because nothing referenced them any more.
+  int64_t purged = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("names", names);
+    x("bytes", bytes);
+    x("lookups", lookups);
+    x("hits", hits);
+    x("purged", purged);
+  }
+};
+
+/**
+ * Stores each distinct path component once, so that the many files and
+ * dirs that share a name (BUCK, __init__.py, src, ...) share a single
+ * w_string rather than each holding their own copy.
+ *
+ * Interned strings have their hash computed up front, and equal interned
+ * strings are identical, so comparing them never touches their contents.
+ *
+ * Not thread safe: the ViewDatabase only uses it with its lock held.
+ */
+class NameTable {
+ public:
+  /**
+   * Returns the table's copy of name, adding it if this is the first time
+   * it has been seen.
+   */
+  w_string intern(w_string_piece name);
+
+  /**
+   * Drops the names that are referenced only by the table, eg: after the
+   * files that had them have been aged out. Returns how many were dropped.
+   */
+  size_t purge();
+
+  /**
+   * Like purge(), but only looks at the names in candidates, so that its
+   * cost doesn't depend on the size of the table. Releases and clears
+   * candidates first, so that they don't keep their names alive.
+   */
+  size_t purge(std::vector<w_string>& candidates);
+
+  size_t size() const {
+    return names_.size();
+  }
+
+  NameTableStats getStats() const;
+
+ private:
+  // Keys reference the contents of the values.
+  std::unordered_map<w_string_piece, w_string> names_;
+  size_t bytes_{0};
+  uint64_t lookups_{0};
+  uint64_t hits_{0};
+  uint64_t purged_{0};
+};
+
+} // namespace watchman
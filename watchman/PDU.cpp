@@ -137,7 +137,7 @@ std::optional<json_ref> PduBuffer::readJsonPdu(
 
   // buflen
   int r = (int)(nl - (buf + rpos));
-  auto res = json_loadb(buf + rpos, r, 0, jerr);
+  auto res = json_loadb_fast(buf + rpos, r, 0, jerr);
 
   // update read pos to look beyond this point
   rpos += r + 1;
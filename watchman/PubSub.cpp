@@ -18,7 +18,9 @@ Publisher::Subscriber::Subscriber(
     : serial_(0),
       publisher_(std::move(pub)),
       notify_(notify),
-      info_(std::move(info)) {}
+      info_(std::move(info)) {
+  publisher_->numSubscribers_.fetch_add(1, std::memory_order_acq_rel);
+}
 
 Publisher::Subscriber::~Subscriber() {
   // In the loop below we may own a reference to some other
@@ -30,6 +32,7 @@ Publisher::Subscriber::~Subscriber() {
   // the loop below until after we have released the wlock.
   std::vector<std::shared_ptr<Subscriber>> subscribers;
 
+  publisher_->numSubscribers_.fetch_sub(1, std::memory_order_acq_rel);
   {
     auto wlock = publisher_->state_.wlock();
     auto it = wlock->subscribers.begin();
@@ -113,10 +116,6 @@ std::shared_ptr<Publisher::Subscriber> Publisher::subscribe(
   return sub;
 }
 
-bool Publisher::hasSubscribers() const {
-  return !state_.rlock()->subscribers.empty();
-}
-
 void Publisher::state::collectGarbage() {
   if (items.empty()) {
     return;
@@ -11,6 +11,7 @@
 #include "watchman/watchman_string.h"
 #include "watchman/watchman_system.h"
 
+#include <atomic>
 #include <deque>
 #include <functional>
 #include <vector>
@@ -79,8 +80,11 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
 
   // Returns true if there are any subscribers.
   // This is racy and intended to be used to gate building a payload
-  // if there are no current subscribers.
-  bool hasSubscribers() const;
+  // if there are no current subscribers. Doesn't take any locks, so it
+  // is cheap enough to call on every log statement.
+  bool hasSubscribers() const {
+    return numSubscribers_.load(std::memory_order_acquire) != 0;
+  }
 
   // Enqueue a new item, but only if there are subscribers.
   // Returns true if the item was queued.
@@ -104,6 +108,8 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
     void enqueue(json_ref&& payload);
   };
   folly::Synchronized<state> state_;
+  // The number of live Subscriber objects.
+  std::atomic<size_t> numSubscribers_{0};
 
   friend class Subscriber;
 };
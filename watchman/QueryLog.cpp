@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/QueryLog.h"
+
+#include <fmt/core.h>
+#include "watchman/Logging.h"
+
+namespace watchman {
+
+json_ref QueryLogEntry::asJsonValue() const {
+  return json_object({
+      {"completed_ms",
+       json_integer(std::chrono::duration_cast<std::chrono::milliseconds>(
+                        completed.time_since_epoch())
+                        .count())},
+      {"command", typed_string_to_json(command, W_STRING_UNICODE)},
+      {"spec_hash", typed_string_to_json(fmt::format("{:016x}", spec_hash))},
+      {"client_pid", json_integer(client_pid)},
+      {"generator", typed_string_to_json(generator, W_STRING_UNICODE)},
+      {"total_us", json_integer(total_us)},
+      {"cookie_sync_us", json_integer(cookie_sync_us)},
+      {"view_lock_wait_us", json_integer(view_lock_wait_us)},
+      {"generation_us", json_integer(generation_us)},
+      {"render_us", json_integer(render_us)},
+      {"num_walked", json_integer(num_walked)},
+      {"num_results", json_integer(num_results)},
+      {"num_deduped", json_integer(num_deduped)},
+      {"fresh_instance", json_boolean(fresh_instance)},
+  });
+}
+
+QueryLog::QueryLog(
+    w_string rootPath,
+    uint32_t capacity,
+    std::chrono::milliseconds slowThreshold)
+    : rootPath_{std::move(rootPath)},
+      ring_{capacity},
+      slowThreshold_{slowThreshold} {}
+
+void QueryLog::record(const QueryLogEntry& entry) {
+  ring_.write(entry);
+
+  if (slowThreshold_.count() == 0 ||
+      entry.total_us < int64_t(slowThreshold_.count())) {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  auto last = lastDump_.load(std::memory_order_relaxed);
+  if (last != std::chrono::steady_clock::time_point{} &&
+      now - last < kMinDumpInterval) {
+    return;
+  }
+  // Only one of several concurrent slow queries needs to dump.
+  if (!lastDump_.compare_exchange_strong(
+          last, now, std::memory_order_relaxed)) {
+    return;
+  }
+  dump(fmt::format(
+      "slow {} ({}ms)", entry.command, entry.total_us / 1000));
+}
+
+void QueryLog::dump(std::string_view reason) const {
+  auto entries = readAll();
+  logf(
+      ERR,
+      "{}: dumping the {} most recent queries against {}\n",
+      reason,
+      entries.size(),
+      rootPath_);
+  for (auto& entry : entries) {
+    logf(
+        ERR,
+        "  {}\n",
+        json_dumps(entry.asJsonValue(), JSON_COMPACT | JSON_SORT_KEYS));
+  }
+}
+
+} // namespace watchman
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <vector>
+#include "watchman/RingBuffer.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * A summary of one completed query. Held by value in a lock-free ring
+ * buffer, so it must be trivially copyable: strings are truncated into
+ * fixed-size arrays.
+ */
+struct QueryLogEntry {
+  QueryLogEntry() noexcept {
+    // time_point is not noexcept so this can't be defaulted.
+  }
+
+  json_ref asJsonValue() const;
+
+  // Copies name into dest, truncating if necessary.
+  template <size_t N>
+  static void setName(char (&dest)[N], std::string_view name) {
+    auto len = std::min(name.size(), N - 1);
+    std::copy_n(name.data(), len, dest);
+    dest[len] = 0;
+  }
+
+  std::chrono::system_clock::time_point completed;
+  // Hash of the query as the client sent it, so that repeated queries can
+  // be correlated without storing them.
+  uint64_t spec_hash{0};
+  int64_t client_pid{0};
+
+  int64_t total_us{0};
+  int64_t cookie_sync_us{0};
+  int64_t view_lock_wait_us{0};
+  int64_t generation_us{0};
+  int64_t render_us{0};
+
+  int64_t num_walked{0};
+  int64_t num_results{0};
+  int64_t num_deduped{0};
+  bool fresh_instance{false};
+
+  char command[16]{};
+  char generator[48]{};
+};
+
+/**
+ * A flight recorder of the most recent queries against a root, reported by
+ * `watchman debug-query-log`.
+ *
+ * If a query takes longer than the slow query threshold, the whole buffer
+ * is written to the log so that there is a record of what led up to it
+ * even if nobody thinks to ask until later. Dumps are rate limited so that
+ * a run of slow queries doesn't flood the log.
+ */
+class QueryLog {
+ public:
+  /**
+   * A slowThreshold of zero disables dumping.
+   */
+  QueryLog(
+      w_string rootPath,
+      uint32_t capacity,
+      std::chrono::milliseconds slowThreshold);
+
+  void record(const QueryLogEntry& entry);
+
+  std::vector<QueryLogEntry> readAll() const {
+    return ring_.readAll();
+  }
+
+  void clear() {
+    ring_.clear();
+  }
+
+  // Writes the buffered entries to the log, oldest first.
+  void dump(std::string_view reason) const;
+
+  static constexpr std::chrono::seconds kMinDumpInterval{60};
+
+ private:
+  const w_string rootPath_;
+  RingBuffer<QueryLogEntry> ring_;
+  const std::chrono::microseconds slowThreshold_;
+  std::atomic<std::chrono::steady_clock::time_point> lastDump_{};
+};
+
+} // namespace watchman
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/QueryStats.h"
+
+namespace watchman {
+
+namespace {
+
+CountSummary summarizeCounts(const LatencyHistogram& histogram) {
+  // The histogram doesn't care whether it holds microseconds or anything
+  // else; only the names differ.
+  auto latency = histogram.summarize();
+  CountSummary summary;
+  summary.count = latency.count;
+  summary.mean = latency.mean_us;
+  summary.p50 = latency.p50_us;
+  summary.p90 = latency.p90_us;
+  summary.p99 = latency.p99_us;
+  summary.max = latency.max_us;
+  return summary;
+}
+
+} // namespace
+
+void QueryStats::PhaseHistograms::record(const Sample& sample) {
+  total.record(sample.total);
+  cookieSync.record(sample.cookieSync);
+  viewLockWait.record(sample.viewLockWait);
+  generation.record(sample.generation);
+  render.record(sample.render);
+  filesWalked.recordMicros(sample.filesWalked);
+  results.recordMicros(sample.results);
+}
+
+void QueryStats::PhaseHistograms::merge(const PhaseHistograms& other) {
+  total.merge(other.total);
+  cookieSync.merge(other.cookieSync);
+  viewLockWait.merge(other.viewLockWait);
+  generation.merge(other.generation);
+  render.merge(other.render);
+  filesWalked.merge(other.filesWalked);
+  results.merge(other.results);
+}
+
+void QueryStats::PhaseHistograms::clear() {
+  total.clear();
+  cookieSync.clear();
+  viewLockWait.clear();
+  generation.clear();
+  render.clear();
+  filesWalked.clear();
+  results.clear();
+}
+
+QueryPhaseSummary QueryStats::PhaseHistograms::summarize() const {
+  QueryPhaseSummary summary;
+  summary.total = total.summarize();
+  summary.cookie_sync = cookieSync.summarize();
+  summary.view_lock_wait = viewLockWait.summarize();
+  summary.generation = generation.summarize();
+  summary.render = render.summarize();
+  summary.files_walked = summarizeCounts(filesWalked);
+  summary.results = summarizeCounts(results);
+  return summary;
+}
+
+void QueryStats::Window::advance(Clock::time_point now) {
+  if (!start) {
+    start = now;
+    return;
+  }
+  auto age = now - *start;
+  if (age < length) {
+    return;
+  }
+  if (age < 2 * length) {
+    current ^= 1;
+    halves[current].clear();
+    *start += length;
+  } else {
+    // Idle for longer than the window; everything has expired.
+    halves[0].clear();
+    halves[1].clear();
+    start = now;
+  }
+}
+
+void QueryStats::Window::record(const Sample& sample, Clock::time_point now) {
+  advance(now);
+  halves[current].record(sample);
+}
+
+QueryPhaseSummary QueryStats::Window::summarize() const {
+  // Several KB, so keep it off the stack.
+  auto merged = std::make_unique<PhaseHistograms>();
+  merged->merge(halves[0]);
+  merged->merge(halves[1]);
+  return merged->summarize();
+}
+
+void QueryStats::record(
+    std::string_view command,
+    const Sample& sample,
+    Clock::time_point now) {
+  auto commands = commands_.wlock();
+  auto it = commands->find(command);
+  if (it == commands->end()) {
+    it = commands
+             ->emplace(std::string{command}, std::make_unique<CommandStats>())
+             .first;
+  }
+  auto& stats = *it->second;
+  stats.minute.record(sample, now);
+  stats.hour.record(sample, now);
+  stats.all.record(sample);
+}
+
+std::vector<QueryCommandStats> QueryStats::getStats(
+    Clock::time_point now) const {
+  std::vector<QueryCommandStats> result;
+  auto commands = commands_.wlock();
+  result.reserve(commands->size());
+  for (auto& [command, stats] : *commands) {
+    stats->minute.advance(now);
+    stats->hour.advance(now);
+
+    QueryCommandStats entry;
+    entry.command = command;
+    entry.last_minute = stats->minute.summarize();
+    entry.last_hour = stats->hour.summarize();
+    entry.all = stats->all.summarize();
+    result.push_back(std::move(entry));
+  }
+  return result;
+}
+
+} // namespace watchman
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "watchman/LatencyHistogram.h"
+#include "watchman/Serde.h"
+
+namespace watchman {
+
+/**
+ * Like LatencySummary, but for distributions of counts rather than
+ * durations.
+ */
+struct CountSummary : serde::Object {
+  int64_t count = 0;
+  int64_t mean = 0;
+  int64_t p50 = 0;
+  int64_t p90 = 0;
+  int64_t p99 = 0;
+  int64_t max = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("count", count);
+    x("mean", mean);
+    x("p50", p50);
+    x("p90", p90);
+    x("p99", p99);
+    x("max", max);
+  }
+};
+
+/**
+ * Distribution of each phase of query execution, along with the amount of
+ * work that the queries did, over some period of time.
+ */
+struct QueryPhaseSummary : serde::Object {
+  LatencySummary total;
+  LatencySummary cookie_sync;
+  LatencySummary view_lock_wait;
+  LatencySummary generation;
+  LatencySummary render;
+  CountSummary files_walked;
+  CountSummary results;
+
+  template <typename X>
+  void map(X& x) {
+    x("total", total);
+    x("cookie_sync", cookie_sync);
+    x("view_lock_wait", view_lock_wait);
+    x("generation", generation);
+    x("render", render);
+    x("files_walked", files_walked);
+    x("results", results);
+  }
+};
+
+struct QueryCommandStats : serde::Object {
+  std::string command;
+  // Covers between one and two minutes, depending on when the current
+  // minute started.
+  QueryPhaseSummary last_minute;
+  // Likewise, between one and two hours.
+  QueryPhaseSummary last_hour;
+  // Everything since the root was watched.
+  QueryPhaseSummary all;
+
+  template <typename X>
+  void map(X& x) {
+    x("command", command);
+    x("1m", last_minute);
+    x("1h", last_hour);
+    x("all", all);
+  }
+};
+
+/**
+ * Aggregates the per-phase timings of the queries run against a root,
+ * broken down by the command that ran them.
+ *
+ * Each command keeps histograms over two rolling windows as well as since
+ * it was first seen. A window is made of two halves: the current one, which
+ * receives new recordings, and the previous one. When the current half is
+ * older than the window length it becomes the previous half and the old
+ * previous half is cleared, so that the reported window always covers
+ * between one and two window lengths.
+ */
+class QueryStats {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Sample {
+    std::chrono::microseconds total{0};
+    std::chrono::microseconds cookieSync{0};
+    std::chrono::microseconds viewLockWait{0};
+    std::chrono::microseconds generation{0};
+    std::chrono::microseconds render{0};
+    uint64_t filesWalked{0};
+    uint64_t results{0};
+  };
+
+  static constexpr std::chrono::seconds kMinute{60};
+  static constexpr std::chrono::seconds kHour{3600};
+
+  void record(
+      std::string_view command,
+      const Sample& sample,
+      Clock::time_point now = Clock::now());
+
+  // Returns the stats for each command, ordered by command name.
+  std::vector<QueryCommandStats> getStats(
+      Clock::time_point now = Clock::now()) const;
+
+ private:
+  struct PhaseHistograms {
+    LatencyHistogram total;
+    LatencyHistogram cookieSync;
+    LatencyHistogram viewLockWait;
+    LatencyHistogram generation;
+    LatencyHistogram render;
+    LatencyHistogram filesWalked;
+    LatencyHistogram results;
+
+    void record(const Sample& sample);
+    void merge(const PhaseHistograms& other);
+    void clear();
+    QueryPhaseSummary summarize() const;
+  };
+
+  struct Window {
+    explicit Window(std::chrono::seconds length) : length{length} {}
+
+    // Rotates the halves so that the current one covers now.
+    void advance(Clock::time_point now);
+    void record(const Sample& sample, Clock::time_point now);
+    QueryPhaseSummary summarize() const;
+
+    const std::chrono::seconds length;
+    std::optional<Clock::time_point> start;
+    std::array<PhaseHistograms, 2> halves;
+    size_t current{0};
+  };
+
+  struct CommandStats {
+    Window minute{kMinute};
+    Window hour{kHour};
+    PhaseHistograms all;
+  };
+
+  // getStats has to rotate the windows as well, so both paths take the
+  // write lock. Recording happens once per query, so this is uncontended
+  // in practice.
+  mutable folly::Synchronized<
+      std::map<std::string, std::unique_ptr<CommandStats>, std::less<>>>
+      commands_;
+};
+
+} // namespace watchman
@@ -35,6 +35,10 @@ void QueryableView::allFilesGenerator(const Query*, QueryContext*) const {
   throw QueryExecError("allFilesGenerator not implemented");
 }
 
+ClockPosition QueryableView::getLastChangePosition() const {
+  return getMostRecentRootNumberAndTickValue();
+}
+
 ClockTicks QueryableView::getLastAgeOutTickValue() const {
   return 0;
 }
@@ -44,7 +48,19 @@ std::chrono::system_clock::time_point QueryableView::getLastAgeOutTimeStamp()
   return std::chrono::system_clock::time_point{};
 }
 
-void QueryableView::ageOut(int64_t&, int64_t&, int64_t&, std::chrono::seconds) {
+void QueryableView::ageOut(
+    int64_t&,
+    int64_t&,
+    int64_t&,
+    int64_t&,
+    std::chrono::seconds) {}
+
+std::optional<NameTableStats> QueryableView::getNameTableStats() const {
+  return std::nullopt;
+}
+
+std::optional<int64_t> QueryableView::getNumFiles() const {
+  return std::nullopt;
 }
 
 bool QueryableView::isVCSOperationInProgress() const {
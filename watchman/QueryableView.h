@@ -8,10 +8,12 @@
 #pragma once
 
 #include <folly/futures/Future.h>
+#include <optional>
 #include <vector>
 
 #include "watchman/Clock.h"
 #include "watchman/CookieSync.h"
+#include "watchman/NameTable.h"
 #include "watchman/PerfSample.h"
 #include "watchman/telemetry/LogEvent.h"
 #include "watchman/watchman_string.h"
@@ -49,6 +51,14 @@ class QueryableView : public std::enable_shared_from_this<QueryableView> {
   virtual void allFilesGenerator(const Query* query, QueryContext* ctx) const;
 
   virtual ClockPosition getMostRecentRootNumberAndTickValue() const = 0;
+
+  /**
+   * Returns the position at which the files in the view last changed.
+   * Unlike the current position, this doesn't move when the view ticks
+   * without any file changing, as it does when a cookie is processed.
+   * Views that can't tell return the current position.
+   */
+  virtual ClockPosition getLastChangePosition() const;
   virtual w_string getCurrentClockString() const = 0;
   virtual ClockTicks getLastAgeOutTickValue() const;
   virtual std::chrono::system_clock::time_point getLastAgeOutTimeStamp() const;
@@ -56,8 +66,21 @@ class QueryableView : public std::enable_shared_from_this<QueryableView> {
       int64_t& walked,
       int64_t& files,
       int64_t& dirs,
+      int64_t& slices,
       std::chrono::seconds minAge);
 
+  /**
+   * Returns the statistics of the table of interned file and dir names, if
+   * this view keeps one.
+   */
+  virtual std::optional<NameTableStats> getNameTableStats() const;
+
+  /**
+   * Returns how many files the view knows of, if that is cheap to find.
+   * Used to estimate what a query that walks every file costs.
+   */
+  virtual std::optional<int64_t> getNumFiles() const;
+
   virtual folly::SemiFuture<folly::Unit> waitForSettle(
       std::chrono::milliseconds settle_period) = 0;
   virtual CookieSync::SyncResult syncToNow(
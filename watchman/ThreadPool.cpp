@@ -10,6 +10,13 @@
 
 namespace watchman {
 
+namespace {
+// Identifies the pool and worker that the current thread belongs to, so
+// that tasks added from within the pool go onto the worker's own deque.
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+} // namespace
+
 ThreadPool& getThreadPool() {
   static ThreadPool pool;
   return pool;
@@ -29,29 +36,123 @@ void ThreadPool::start(size_t numWorkers, size_t maxItems) {
   }
   maxItems_ = maxItems;
 
+  for (auto i = 0U; i < numWorkers; ++i) {
+    workerState_.emplace_back(std::make_unique<Worker>());
+  }
+  numWorkers_.store(numWorkers, std::memory_order_release);
+
   for (auto i = 0U; i < numWorkers; ++i) {
     workers_.emplace_back([this, i]() noexcept {
       w_set_thread_name("ThreadPool-", i);
-      runWorker();
+      runWorker(i);
     });
   }
 }
 
-void ThreadPool::runWorker() {
+ThreadPool::Task* ThreadPool::takeInbox(Worker& worker, bool all) {
+  if (worker.inboxSize.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+
+  std::deque<Task*> taken;
+  {
+    std::unique_lock<std::mutex> lock(worker.inboxMutex);
+    if (worker.inbox.empty()) {
+      return nullptr;
+    }
+    if (all) {
+      taken.swap(worker.inbox);
+    } else {
+      taken.push_back(worker.inbox.front());
+      worker.inbox.pop_front();
+    }
+    worker.inboxSize.store(worker.inbox.size(), std::memory_order_relaxed);
+  }
+
+  // Run the oldest now, and move the rest to our deque where they can be
+  // stolen. Pushed newest first so that we pop them in arrival order.
+  auto* task = taken.front();
+  while (taken.size() > 1) {
+    worker.deque.push(taken.back());
+    taken.pop_back();
+  }
+  return task;
+}
+
+ThreadPool::Task* ThreadPool::findTask(size_t index) {
+  auto& self = *workerState_[index];
+  if (auto task = self.deque.pop()) {
+    return *task;
+  }
+  if (auto* task = takeInbox(self, true)) {
+    return task;
+  }
+
+  auto numWorkers = workerState_.size();
+  for (size_t i = 1; i < numWorkers; ++i) {
+    auto& victim = *workerState_[(index + i) % numWorkers];
+    if (auto task = victim.deque.steal()) {
+      self.steals.fetch_add(1, std::memory_order_relaxed);
+      return *task;
+    }
+  }
+  // Another worker is probably busy with a long task and hasn't yet
+  // emptied its inbox.
+  for (size_t i = 1; i < numWorkers; ++i) {
+    auto& victim = *workerState_[(index + i) % numWorkers];
+    if (auto* task = takeInbox(victim, false)) {
+      self.steals.fetch_add(1, std::memory_order_relaxed);
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::runTask(Task* task, Worker& worker) {
+  std::unique_ptr<Task> owned{task};
+  auto started = std::chrono::steady_clock::now();
+  queueLatency_.record(started - owned->enqueued);
+
+  owned->func();
+
+  runLatency_.record(std::chrono::steady_clock::now() - started);
+  worker.executed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ThreadPool::runWorker(size_t index) {
+  currentPool = this;
+  currentWorker = index;
+  auto& self = *workerState_[index];
+
   while (true) {
-    folly::Func task;
+    if (auto* task = findTask(index)) {
+      queued_.fetch_sub(1);
+      runTask(task, self);
+      continue;
+    }
 
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      condition_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
-      if (stopping_ && tasks_.empty()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // add() checks sleepers_ after bumping queued_, and we check queued_
+    // after bumping sleepers_, so at least one of us sees the other.
+    // Similarly, add() checks stopping_ after bumping queued_, so reading
+    // stopping_ before queued_ means that we never exit with a task that
+    // was successfully added still queued.
+    sleepers_.fetch_add(1);
+    bool stopping = stopping_.load();
+    if (queued_.load() == 0) {
+      if (stopping) {
+        sleepers_.fetch_sub(1);
         return;
       }
-      task = std::move(tasks_.front());
-      tasks_.pop_front();
+      condition_.wait(lock);
+    } else {
+      // A task is being added or was just taken by someone else; look
+      // again without hogging the CPU.
+      lock.unlock();
+      std::this_thread::yield();
+      lock.lock();
     }
-
-    task();
+    sleepers_.fetch_sub(1);
   }
 }
 
@@ -64,24 +165,61 @@ void ThreadPool::stop(bool join) {
 
   if (join) {
     for (auto& worker : workers_) {
-      worker.join();
+      if (worker.joinable()) {
+        worker.join();
+      }
     }
   }
 }
 
 void ThreadPool::add(folly::Func func) {
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (stopping_) {
-      throw std::runtime_error("cannot add tasks after pool has stopped");
-    }
-    if (tasks_.size() + 1 >= maxItems_) {
-      throw std::runtime_error("thread pool queue is full");
-    }
+  auto numWorkers = numWorkers_.load(std::memory_order_acquire);
+  if (numWorkers == 0) {
+    throw std::runtime_error("cannot add tasks before pool has started");
+  }
+  auto queued = queued_.fetch_add(1);
+  if (stopping_) {
+    queued_.fetch_sub(1);
+    throw std::runtime_error("cannot add tasks after pool has stopped");
+  }
+  if (queued + 1 >= maxItems_) {
+    queued_.fetch_sub(1);
+    throw std::runtime_error("thread pool queue is full");
+  }
 
-    tasks_.emplace_back(std::move(func));
+  auto* task = new Task{std::move(func), std::chrono::steady_clock::now()};
+  if (currentPool == this) {
+    workerState_[currentWorker]->deque.push(task);
+  } else {
+    injected_.fetch_add(1, std::memory_order_relaxed);
+    auto& worker = *workerState_
+        [nextInbox_.fetch_add(1, std::memory_order_relaxed) % numWorkers];
+    std::unique_lock<std::mutex> lock(worker.inboxMutex);
+    worker.inbox.push_back(task);
+    worker.inboxSize.store(worker.inbox.size(), std::memory_order_relaxed);
   }
 
-  condition_.notify_one();
+  if (sleepers_.load() > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.notify_one();
+  }
+}
+
+ThreadPoolStats ThreadPool::getStats() const {
+  ThreadPoolStats stats;
+  auto numWorkers = numWorkers_.load(std::memory_order_acquire);
+  stats.workers = int64_t(numWorkers);
+  stats.max_items = int64_t(maxItems_);
+  stats.queued = int64_t(queued_.load());
+  stats.injected = int64_t(injected_.load(std::memory_order_relaxed));
+  for (size_t i = 0; i < numWorkers; ++i) {
+    auto& worker = *workerState_[i];
+    stats.executed +=
+        int64_t(worker.executed.load(std::memory_order_relaxed));
+    stats.steals += int64_t(worker.steals.load(std::memory_order_relaxed));
+  }
+  stats.queue_latency = queueLatency_.summarize();
+  stats.run_latency = runLatency_.summarize();
+  return stats;
 }
 } // namespace watchman
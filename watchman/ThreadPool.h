@@ -7,16 +7,50 @@
 
 #pragma once
 #include <folly/Executor.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
+#include "watchman/LatencyHistogram.h"
+#include "watchman/Serde.h"
+#include "watchman/WorkStealingDeque.h"
 #include "watchman/watchman_system.h" // to avoid system header ordering issue on win32
 
 namespace watchman {
 
-// Almost the dumbest possible thread pool implementation.
+struct ThreadPoolStats : serde::Object {
+  int64_t workers = 0;
+  int64_t max_items = 0;
+  // Tasks that have been added but not yet picked up by a worker.
+  int64_t queued = 0;
+  int64_t executed = 0;
+  // Tasks added from threads outside of the pool.
+  int64_t injected = 0;
+  // Tasks taken from another worker's queue.
+  int64_t steals = 0;
+  // Time from add() until a worker started running the task.
+  LatencySummary queue_latency;
+  // Time spent running tasks.
+  LatencySummary run_latency;
+
+  template <typename X>
+  void map(X& x) {
+    x("workers", workers);
+    x("max_items", max_items);
+    x("queued", queued);
+    x("executed", executed);
+    x("injected", injected);
+    x("steals", steals);
+    x("queue_latency", queue_latency);
+    x("run_latency", run_latency);
+  }
+};
+
+// A fixed size, work-stealing thread pool.
 // This allows us to set an upper bound on the number of concurrent
 // tasks that are executed in the thread pool.  Contrast with
 // std::async which leaves it to the implementation to decide
@@ -24,6 +58,14 @@ namespace watchman {
 // thread pool with an unspecified number of threads.
 // Constraining the concurrency is important for watchman so
 // that we can limit the amount of I/O that we might induce.
+//
+// Each worker has its own queue. Tasks added by a worker (eg: future
+// continuations) go onto its own queue and are run most-recent-first,
+// while its data is still warm in cache. Tasks added from outside of the
+// pool are spread across small per-worker inboxes. An idle worker steals
+// the oldest task from another worker's queue without taking any locks,
+// so the workers never all contend on a single lock the way that they
+// would with a shared queue.
 
 class ThreadPool : public folly::Executor {
  public:
@@ -39,26 +81,64 @@ class ThreadPool : public folly::Executor {
   // pool.
   void start(size_t numWorkers, size_t maxItems);
 
-  // Request that the worker threads terminate.
+  // Request that the worker threads terminate once the queued
+  // tasks have been run.
   // If `join` is true, wait for the worker threads to terminate.
   void stop(bool join = true);
 
   // Run a function in the thread pool.
   // This queues up the function for asynchronous execution and
   // may return before func has been executed.
-  // If the thread pool has been stopped, throws a runtime_error.
+  // If the thread pool has been stopped, or the queue is full,
+  // throws a runtime_error.
   void add(folly::Func func) override;
 
+  ThreadPoolStats getStats() const;
+
  private:
+  struct Task {
+    folly::Func func;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  struct Worker {
+    WorkStealingDeque<Task*> deque;
+
+    // Tasks added from outside of the pool, which this worker moves
+    // onto its deque. Other workers only look here once there is
+    // nothing left to steal from the deques.
+    std::mutex inboxMutex;
+    std::deque<Task*> inbox;
+    std::atomic<size_t> inboxSize{0};
+
+    // Written only by the worker itself.
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> steals{0};
+  };
+
   std::vector<std::thread> workers_;
-  std::deque<folly::Func> tasks_;
+  // Fixed once start() has published numWorkers_.
+  std::vector<std::unique_ptr<Worker>> workerState_;
+  std::atomic<size_t> numWorkers_{0};
 
+  // Protects start/stop and the sleeping workers.
   std::mutex mutex_;
   std::condition_variable condition_;
-  bool stopping_{false};
-  size_t maxItems_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<size_t> sleepers_{0};
+
+  size_t maxItems_{0};
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> nextInbox_{0};
+  std::atomic<uint64_t> injected_{0};
+  LatencyHistogram queueLatency_;
+  LatencyHistogram runLatency_;
 
-  void runWorker();
+  void runWorker(size_t index);
+  // Returns the next task for worker index, or nullptr if none was found.
+  Task* findTask(size_t index);
+  Task* takeInbox(Worker& worker, bool all);
+  void runTask(Task* task, Worker& worker);
 };
 
 // Return a reference to the shared thread pool for the watchman process.
@@ -487,6 +487,7 @@ bool TriggerCommand::maybeSpawn(const std::shared_ptr<Root>& root) {
   // Triggers never need to sync explicitly; we are only dispatched
   // at settle points which are by definition sync'd to the present time
   query->sync_timeout = std::chrono::milliseconds(0);
+  query->command = "trigger";
   log(DBG, "assessing trigger ", triggername, "\n");
   try {
     auto res =
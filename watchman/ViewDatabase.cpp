@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/ViewDatabase.h"
+#include <cctype>
+#include <cstring>
+#include "watchman/Logging.h"
+
+namespace watchman {
+
+namespace {
+
+bool hasUpperCase(w_string_piece name) {
+  for (size_t i = 0; i < name.size(); ++i) {
+    auto c = static_cast<unsigned char>(name[i]);
+    if (tolower(c) != c) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lowercases name the way w_string_piece::asLowerCase and WM_CASEFOLD do,
+// without copying names that are already lowercase.
+w_string foldCase(const w_string& name) {
+  if (!hasUpperCase(name)) {
+    return name;
+  }
+  return name.piece().asLowerCase(name.type());
+}
+
+template <typename Map, typename Value>
+void eraseFromIndex(Map& index, const w_string& key, Value* value) {
+  auto [begin, end] = index.equal_range(key);
+  for (auto it = begin; it != end; ++it) {
+    if (it->second == value) {
+      index.erase(it);
+      return;
+    }
+  }
+}
+
+int64_t countFiles(const watchman_dir& dir) {
+  auto count = int64_t(dir.files.size());
+  for (auto& it : dir.dirs) {
+    count += countFiles(*it.second);
+  }
+  return count;
+}
+
+// Appends the names of dir and everything below it, including the case
+// folded ones, to names.
+void collectNames(const watchman_dir& dir, std::vector<w_string>& names) {
+  names.push_back(dir.name);
+  if (dir.caseFolded) {
+    names.push_back(foldCase(dir.name));
+  }
+  for (auto& it : dir.files) {
+    names.push_back(it.second->getName());
+    if (dir.caseFolded) {
+      names.push_back(foldCase(it.second->getName()));
+    }
+  }
+  for (auto& it : dir.dirs) {
+    collectNames(*it.second, names);
+  }
+}
+
+} // namespace
+
+ViewDatabase::ViewDatabase(const w_string& root_path, bool caseFoldedIndex)
+    : rootPath_{root_path},
+      caseFoldedIndex_{caseFoldedIndex},
+      deletedFiles_{&deletedFiles_, &deletedFiles_},
+      rootDir_{std::make_unique<watchman_dir>(root_path, nullptr)} {
+  if (caseFoldedIndex_) {
+    rootDir_->caseFolded = std::make_unique<watchman_dir::CaseFoldedIndex>();
+  }
+}
+
+w_string ViewDatabase::internFolded(const w_string& name) {
+  if (!hasUpperCase(name)) {
+    return name;
+  }
+  return names_.intern(name.piece().asLowerCase(name.type()));
+}
+
+watchman_dir* ViewDatabase::addChildDir(
+    watchman_dir* parent,
+    w_string_piece name) {
+  w_string child_name = names_.intern(name);
+
+  // Careful! parent->dirs is keyed by non-owning string pieces so the
+  // child_name MUST be stored or otherwise kept alive by the watchman_dir
+  // instance constructed below!
+  auto& new_child = parent->dirs[child_name];
+  new_child.reset(new watchman_dir(child_name, parent));
+  if (caseFoldedIndex_) {
+    new_child->caseFolded = std::make_unique<watchman_dir::CaseFoldedIndex>();
+    parent->caseFolded->dirs.emplace(internFolded(child_name), new_child.get());
+  }
+  return new_child.get();
+}
+
+void ViewDatabase::eraseChildFile(watchman_file* file) {
+  auto parent = file->parent;
+  if (parent->caseFolded) {
+    eraseFromIndex(parent->caseFolded->files, foldCase(file->name), file);
+  }
+  erasedNames_.push_back(file->getName());
+  if (parent->caseFolded) {
+    erasedNames_.push_back(foldCase(file->getName()));
+  }
+  parent->files.erase(file->getName());
+  --numFiles_;
+}
+
+void ViewDatabase::eraseChildDir(watchman_dir* parent, w_string_piece name) {
+  auto it = parent->dirs.find(name);
+  if (it == parent->dirs.end()) {
+    return;
+  }
+  if (parent->caseFolded) {
+    eraseFromIndex(
+        parent->caseFolded->dirs, foldCase(it->second->name), it->second.get());
+  }
+  numFiles_ -= countFiles(*it->second);
+  collectNames(*it->second, erasedNames_);
+  parent->dirs.erase(it);
+}
+
+watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name, bool create) {
+  if (dir_name == rootPath_) {
+    return rootDir_.get();
+  }
+
+  const char* dir_component = dir_name.data();
+  const char* dir_end = dir_component + dir_name.size();
+
+  watchman_dir* dir = rootDir_.get();
+  dir_component += rootPath_.size() + 1; // Skip root path prefix
+
+  w_assert(dir_component <= dir_end, "impossible file name");
+
+  watchman_dir* parent;
+  while (true) {
+    auto sep = (const char*)memchr(dir_component, '/', dir_end - dir_component);
+    // Note: if sep is NULL it means that we're looking at the basename
+    // component of the input directory name, which is the terminal
+    // iteration of this search.
+
+    w_string_piece component(
+        dir_component, sep ? (sep - dir_component) : (dir_end - dir_component));
+
+    auto child = dir->getChildDir(component);
+
+    if (!child && !create) {
+      return nullptr;
+    }
+    if (!child && sep && create) {
+      // A component in the middle wasn't present.  Since we're in create
+      // mode, we know that the leaf must exist.  The assumption is that
+      // we have another pending item for the parent.  We'll create the
+      // parent dir now and our other machinery will populate its contents
+      // later.
+      child = addChildDir(dir, component);
+    }
+
+    parent = dir;
+    dir = child;
+
+    if (!sep) {
+      // We reached the end of the string
+      if (dir) {
+        // We found the dir
+        return dir;
+      }
+      // We need to create the dir
+      break;
+    }
+
+    // Skip to the next component for the next iteration
+    dir_component = sep + 1;
+  }
+
+  return addChildDir(parent, w_string_piece{dir_component, dir_end});
+}
+
+const watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name) const {
+  if (dir_name == rootPath_) {
+    return rootDir_.get();
+  }
+
+  const char* dir_component = dir_name.data();
+  const char* dir_end = dir_component + dir_name.size();
+
+  watchman_dir* dir = rootDir_.get();
+  dir_component += rootPath_.size() + 1; // Skip root path prefix
+
+  w_assert(dir_component <= dir_end, "impossible file name");
+
+  while (true) {
+    auto sep = (const char*)memchr(dir_component, '/', dir_end - dir_component);
+    // Note: if sep is NULL it means that we're looking at the basename
+    // component of the input directory name, which is the terminal
+    // iteration of this search.
+
+    w_string_piece component(
+        dir_component, sep ? (sep - dir_component) : (dir_end - dir_component));
+
+    auto child = dir->getChildDir(component);
+    if (!child) {
+      return nullptr;
+    }
+
+    dir = child;
+
+    if (!sep) {
+      // We reached the end of the string
+      if (dir) {
+        // We found the dir
+        return dir;
+      }
+      // Does not exist
+      return nullptr;
+    }
+
+    // Skip to the next component for the next iteration
+    dir_component = sep + 1;
+  }
+
+  return nullptr;
+}
+
+void ViewDatabase::resolveDirsIgnoringCase(
+    const w_string& dir_name,
+    folly::FunctionRef<void(const watchman_dir*)> fn) const {
+  if (dir_name == rootPath_) {
+    fn(rootDir_.get());
+    return;
+  }
+
+  w_assert(dir_name.size() > rootPath_.size(), "impossible file name");
+  w_string_piece relative{
+      dir_name.data() + rootPath_.size() + 1,
+      dir_name.data() + dir_name.size()};
+  std::vector<w_string> components;
+  relative.asLowerCase(dir_name.type()).piece().split(components, '/');
+
+  // Several dirs can match each component, so this is a depth first walk.
+  auto resolve = [&](auto& self, const watchman_dir* dir, size_t index) {
+    if (index == components.size()) {
+      fn(dir);
+      return;
+    }
+    auto [begin, end] = dir->getChildDirsIgnoringCase(components[index]);
+    for (auto it = begin; it != end; ++it) {
+      self(self, it->second, index + 1);
+    }
+  };
+  resolve(resolve, rootDir_.get(), 0);
+}
+
+watchman_file* ViewDatabase::getOrCreateChildFile(
+    watchman_dir* dir,
+    const w_string& file_name,
+    ClockStamp ctime) {
+  // file_name is typically a baseName slice; let's use it as-is
+  // to look up a child...
+  auto it = dir->files.find(file_name);
+  if (it != dir->files.end()) {
+    return it->second.get();
+  }
+
+  // ... but key the new entry by the interned name that the file keeps.
+  auto file = watchman_file::make(names_.intern(file_name), dir);
+  auto& file_ptr = dir->files[file->getName()];
+  file_ptr = std::move(file);
+  ++numFiles_;
+  if (dir->caseFolded) {
+    dir->caseFolded->files.emplace(
+        internFolded(file_ptr->name), file_ptr.get());
+  }
+
+  file_ptr->ctime = ctime;
+
+  return file_ptr.get();
+}
+
+void ViewDatabase::markFileChanged(watchman_file* file, ClockStamp otime) {
+  file->otime = otime;
+
+  if (latestFile_ != file) {
+    // unlink from list
+    file->removeFromFileList();
+
+    // and move to the head
+    insertAtHeadOfFileList(file);
+  }
+
+  file->removeFromDeletedList();
+  if (!file->exists) {
+    file->deletedPrev = deletedFiles_.deletedPrev;
+    file->deletedNext = &deletedFiles_;
+    deletedFiles_.deletedPrev->deletedNext = file;
+    deletedFiles_.deletedPrev = file;
+  }
+}
+
+void ViewDatabase::markDirDeleted(
+    watchman_dir* dir,
+    ClockStamp otime,
+    bool recursive) {
+  if (!dir->last_check_existed) {
+    // If we know that it doesn't exist, return early
+    return;
+  }
+  dir->last_check_existed = false;
+
+  for (auto& it : dir->files) {
+    auto file = it.second.get();
+
+    if (file->exists) {
+      auto full_name = dir->getFullPathToChild(file->getName());
+      logf(DBG, "mark_deleted: {}\n", full_name);
+      file->exists = false;
+      markFileChanged(file, otime);
+    }
+  }
+
+  if (recursive) {
+    for (auto& it : dir->dirs) {
+      auto child = it.second.get();
+
+      markDirDeleted(child, otime, true);
+    }
+  }
+}
+
+void ViewDatabase::insertAtHeadOfFileList(struct watchman_file* file) {
+  file->next = latestFile_;
+  if (file->next) {
+    file->next->prev = &file->next;
+  }
+  latestFile_ = file;
+  file->prev = &latestFile_;
+}
+
+} // namespace watchman
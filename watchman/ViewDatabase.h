@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+#include <folly/Function.h>
+#include <memory>
+#include <vector>
+#include "watchman/NameTable.h"
+#include "watchman/watchman_dir.h"
+#include "watchman/watchman_file.h"
+#include "watchman/watchman_string.h"
+#include "watchman/watchman_system.h"
+
+namespace watchman {
+
+/**
+ * In-memory data structure representing Watchman's understanding of the watched
+ * root. Files are ordered in a linked recency index as well as hierarchically
+ * from the root.
+ */
+class ViewDatabase {
+ public:
+  /**
+   * If caseFoldedIndex is true, every dir keeps a CaseFoldedIndex of its
+   * children, so that case-insensitive queries can look them up by name.
+   */
+  explicit ViewDatabase(
+      const w_string& root_path,
+      bool caseFoldedIndex = false);
+
+  // Files link back to deletedFiles_, so it must not move.
+  ViewDatabase(const ViewDatabase&) = delete;
+  ViewDatabase& operator=(const ViewDatabase&) = delete;
+
+  watchman_file* getLatestFile() const {
+    return latestFile_;
+  }
+
+  /**
+   * Returns the file that has been deleted for the longest time, or
+   * nullptr if no files are known to be deleted. Files are ordered by
+   * when markFileChanged() was last called on them, so this is also the
+   * deleted file with the lowest otime ticks.
+   */
+  watchman_file* getOldestDeletedFile() const {
+    if (deletedFiles_.deletedNext == &deletedFiles_) {
+      return nullptr;
+    }
+    return static_cast<watchman_file*>(deletedFiles_.deletedNext);
+  }
+
+  ino_t getRootInode() const {
+    return rootInode_;
+  }
+
+  void setRootInode(ino_t ino) {
+    rootInode_ = ino;
+  }
+
+  watchman_dir* resolveDir(const w_string& dirname, bool create);
+
+  const watchman_dir* resolveDir(const w_string& dirname) const;
+
+  bool hasCaseFoldedIndex() const {
+    return caseFoldedIndex_;
+  }
+
+  /**
+   * Calls fn with each dir whose path is dirname ignoring the case of the
+   * components below the root. Requires the case folded index.
+   */
+  void resolveDirsIgnoringCase(
+      const w_string& dirname,
+      folly::FunctionRef<void(const watchman_dir*)> fn) const;
+
+  /**
+   * Returns the direct child file named name if it already exists, else creates
+   * that entry and returns it.
+   */
+  watchman_file* getOrCreateChildFile(
+      watchman_dir* dir,
+      const w_string& file_name,
+      ClockStamp ctime);
+
+  /**
+   * Updates the otime for the file and bubbles it to the front of recency
+   * index. Also moves the file to the end of the deleted files list if it
+   * doesn't exist, or removes it from that list if it does.
+   */
+  void markFileChanged(watchman_file* file, ClockStamp otime);
+
+  /**
+   * Mark a directory as being removed from the view. Marks the contained set of
+   * files as deleted. If recursive is true, is recursively invoked on child
+   * dirs.
+   */
+  void markDirDeleted(watchman_dir* dir, ClockStamp otime, bool recursive);
+
+  /**
+   * Removes the file from its parent dir, which frees it.
+   */
+  void eraseChildFile(watchman_file* file);
+
+  /**
+   * Removes the child dir named name from parent, which frees it along with
+   * everything below it.
+   */
+  void eraseChildDir(watchman_dir* parent, w_string_piece name);
+
+  /**
+   * Forgets the interned names that no file or dir uses any more, looking
+   * only at the names of the files and dirs erased since the last call.
+   * Returns how many were dropped.
+   */
+  size_t purgeNames() {
+    return names_.purge(erasedNames_);
+  }
+
+  NameTableStats getNameTableStats() const {
+    return names_.getStats();
+  }
+
+  /**
+   * Returns how many files, including deleted ones that have not yet aged
+   * out, are in the view.
+   */
+  int64_t getNumFiles() const {
+    return numFiles_;
+  }
+
+ private:
+  void insertAtHeadOfFileList(struct watchman_file* file);
+
+  // Creates a dir named name in parent, which must not already have one.
+  watchman_dir* addChildDir(watchman_dir* parent, w_string_piece name);
+
+  // Returns name lowercased, interned unless it already was lowercase.
+  w_string internFolded(const w_string& name);
+
+  const w_string rootPath_;
+  const bool caseFoldedIndex_;
+
+  // The names of every file and dir below the root.
+  NameTable names_;
+  // The names of the files and dirs erased since purgeNames() last ran.
+  std::vector<w_string> erasedNames_;
+
+  /* the most recently changed file */
+  watchman_file* latestFile_ = nullptr;
+
+  // Sentinel of the circular list of deleted files, oldest first.
+  // Declared before rootDir_ so that it outlives the files that link to it.
+  watchman_deleted_link deletedFiles_;
+
+  std::unique_ptr<watchman_dir> rootDir_;
+
+  int64_t numFiles_{0};
+
+  // Inode number for the root dir.  This is used to detect what should
+  // be impossible situations, but is needed in practice to workaround
+  // eg: BTRFS not delivering all events for subvolumes
+  ino_t rootInode_{0};
+};
+
+} // namespace watchman
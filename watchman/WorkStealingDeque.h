@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace watchman {
+
+/**
+ * A Chase-Lev work-stealing deque, following "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (Lê et al, PPoPP 2013).
+ *
+ * A single owner thread pushes and pops at the bottom, in LIFO order,
+ * without taking any locks. Any number of other threads may concurrently
+ * steal from the top, in FIFO order, with a single compare-and-swap.
+ *
+ * The buffer grows as needed. Buffers that have been outgrown are retained
+ * until the deque is destroyed, since a thief may still be reading from
+ * one; they sum to less than the size of the current buffer.
+ *
+ * T is stored in std::atomic, so it must be trivially copyable; in
+ * practice it is a pointer to the real work item.
+ */
+template <typename T>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+ public:
+  explicit WorkStealingDeque(size_t initialCapacity = 256)
+      : buffer_{new Buffer{roundUpPowerOfTwo(initialCapacity)}} {
+    retired_.emplace_back(buffer_.load(std::memory_order_relaxed));
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  // Owner only.
+  void push(T item) {
+    auto b = bottom_.load(std::memory_order_relaxed);
+    auto t = top_.load(std::memory_order_acquire);
+    auto* buffer = buffer_.load(std::memory_order_relaxed);
+    if (b - t > int64_t(buffer->capacity) - 1) {
+      buffer = grow(buffer, t, b);
+    }
+    buffer->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only. Takes the most recently pushed item.
+  std::optional<T> pop() {
+    auto b = bottom_.load(std::memory_order_relaxed) - 1;
+    auto* buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top_.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      // Empty.
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+
+    std::optional<T> item = buffer->get(b);
+    if (t == b) {
+      // This is the last item, so we race with thieves for it.
+      if (!top_.compare_exchange_strong(
+              t,
+              t + 1,
+              std::memory_order_seq_cst,
+              std::memory_order_relaxed)) {
+        item.reset();
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Any thread. Takes the least recently pushed item. Returns nullopt if
+  // the deque is empty or if another thread won the race for the item.
+  std::optional<T> steal() {
+    auto t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return std::nullopt;
+    }
+
+    // Acquire rather than consume, which compilers promote anyway.
+    auto* buffer = buffer_.load(std::memory_order_acquire);
+    T item = buffer->get(t);
+    if (!top_.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return std::nullopt;
+    }
+    return item;
+  }
+
+  // Any thread. Only a snapshot; the deque may change immediately.
+  size_t sizeApprox() const {
+    auto b = bottom_.load(std::memory_order_relaxed);
+    auto t = top_.load(std::memory_order_relaxed);
+    return b > t ? size_t(b - t) : 0;
+  }
+
+ private:
+  struct Buffer {
+    explicit Buffer(size_t cap)
+        : capacity{cap}, mask{cap - 1}, items{new std::atomic<T>[cap]} {}
+
+    T get(int64_t index) const {
+      return items[size_t(index) & mask].load(std::memory_order_relaxed);
+    }
+    void put(int64_t index, T item) {
+      items[size_t(index) & mask].store(item, std::memory_order_relaxed);
+    }
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<std::atomic<T>[]> items;
+  };
+
+  static size_t roundUpPowerOfTwo(size_t n) {
+    size_t cap = 1;
+    while (cap < n) {
+      cap <<= 1;
+    }
+    return cap;
+  }
+
+  Buffer* grow(Buffer* old, int64_t top, int64_t bottom) {
+    auto* bigger = new Buffer{old->capacity * 2};
+    retired_.emplace_back(bigger);
+    for (auto i = top; i < bottom; ++i) {
+      bigger->put(i, old->get(i));
+    }
+    buffer_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  // top_ and bottom_ are written by different threads, so keep them on
+  // separate cache lines.
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  alignas(64) std::atomic<Buffer*> buffer_;
+  // Every buffer ever allocated, including the current one. Owner only.
+  std::vector<std::unique_ptr<Buffer>> retired_;
+};
+
+} // namespace watchman
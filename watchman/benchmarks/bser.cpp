@@ -184,6 +184,20 @@ struct ParseBenchmark {
 template <std::vector<char> (*SynthesizeFn)()>
 std::vector<char> ParseBenchmark<SynthesizeFn>::data = SynthesizeFn();
 
+static std::vector<BserDocument> viewLeaks;
+
+template <std::vector<char> (*SynthesizeFn)()>
+struct ViewBenchmark {
+  static void run(benchmark::State& state) {
+    auto& data = ParseBenchmark<SynthesizeFn>::data;
+    viewLeaks.clear();
+
+    for (auto _ : state) {
+      viewLeaks.push_back(bunser_view(data.data(), data.data() + data.size()));
+    }
+  }
+};
+
 void bser_parse_predictable(benchmark::State& state) {
   ParseBenchmark<predictable_bser_data>::run(state);
 }
@@ -194,6 +208,16 @@ void bser_parse_unpredictable(benchmark::State& state) {
 }
 BENCHMARK(bser_parse_unpredictable);
 
+void bser_parse_view_predictable(benchmark::State& state) {
+  ViewBenchmark<predictable_bser_data>::run(state);
+}
+BENCHMARK(bser_parse_view_predictable);
+
+void bser_parse_view_unpredictable(benchmark::State& state) {
+  ViewBenchmark<unpredictable_bser_data>::run(state);
+}
+BENCHMARK(bser_parse_view_unpredictable);
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include <folly/FileUtil.h>
+#include <folly/testing/TestUtil.h>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include "watchman/Blake3.h"
+#include "watchman/ContentHash.h"
+#include "watchman/HashingExecutor.h"
+#include "watchman/fs/FileSystem.h"
+
+using namespace watchman;
+
+namespace {
+
+// Large enough that the parallel BLAKE3 path splits it into many subtrees.
+constexpr size_t kFileSize = 256 * 1024 * 1024;
+
+// Writes a file of random bytes once, shared by all of the benchmarks.
+// The first benchmark to run pays for faulting it into the page cache, so
+// they all measure hashing throughput rather than disk throughput.
+class HashInput {
+ public:
+  HashInput() : path_{(dir_.path() / "input").string()} {
+    std::mt19937_64 rng{0};
+    std::string data(kFileSize, '\0');
+    for (size_t i = 0; i + sizeof(uint64_t) <= data.size();
+         i += sizeof(uint64_t)) {
+      auto value = rng();
+      memcpy(&data[i], &value, sizeof(value));
+    }
+    folly::writeFile(data, path_.c_str());
+  }
+
+  const std::string& path() const {
+    return path_;
+  }
+
+  ContentHashCacheKey key() const {
+    auto info = getFileInformation(path_.c_str());
+    return ContentHashCacheKey{
+        w_string{"input"}, size_t(info.size), info.mtime};
+  }
+
+  w_string root() const {
+    return w_string{dir_.path().string()};
+  }
+
+ private:
+  folly::test::TemporaryDirectory dir_;
+  std::string path_;
+};
+
+HashInput& input() {
+  static HashInput input;
+  return input;
+}
+
+void sha1_file(benchmark::State& state) {
+  auto& in = input();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ContentHashCache::computeHashImmediate(in.path().c_str()));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(kFileSize));
+}
+BENCHMARK(sha1_file)->Unit(benchmark::kMillisecond);
+
+void blake3_file(benchmark::State& state) {
+  auto& in = input();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ContentHashCache::computeBlake3Immediate(in.path().c_str()));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(kFileSize));
+}
+BENCHMARK(blake3_file)->Unit(benchmark::kMillisecond);
+
+void blake3_file_parallel(benchmark::State& state) {
+  auto& in = input();
+  ContentHashCache cache{in.root(), 1, std::chrono::milliseconds{0}};
+  auto key = in.key();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cache.computeBlake3(key).get());
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(kFileSize));
+}
+BENCHMARK(blake3_file_parallel)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void blake3_memory(benchmark::State& state) {
+  std::string data(size_t(state.range(0)), 'x');
+  for (auto _ : state) {
+    Blake3 hasher;
+    hasher.update(data.data(), data.size());
+    benchmark::DoNotOptimize(hasher.finalize());
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(blake3_memory)->Arg(64)->Arg(4096)->Arg(1024 * 1024);
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  getHashingExecutor().start(
+      std::thread::hardware_concurrency(), 1024 * 1024, 4);
+  ::benchmark::RunSpecifiedBenchmarks();
+}
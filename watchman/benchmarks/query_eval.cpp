@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Measures how quickly query expressions are evaluated, comparing the
+// parsed expression tree with its QueryPlan. Each benchmark evaluates one
+// million files, drawn in turn from a pool of synthetic files. The
+// many_patterns benchmarks need watchman to be built with PCRE.
+
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include "watchman/query/Query.h"
+#include "watchman/query/QueryExpr.h"
+#include "watchman/query/QueryPlan.h"
+#include "watchman/query/TermRegistry.h"
+#include "watchman/test/lib/FakeFileResult.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+
+using namespace watchman;
+
+namespace {
+
+constexpr size_t kFilesPerIteration = 1000000;
+constexpr size_t kPoolSize = 4096;
+constexpr size_t kNumPatterns = 128;
+
+constexpr const char* kSuffixes[] = {"cpp", "h", "py", "txt", "json"};
+
+struct File {
+  std::unique_ptr<FakeFileResult> result;
+  w_string wholename;
+};
+
+class Context : public QueryContextBase {
+ public:
+  const w_string& getWholeName() override {
+    return *wholename;
+  }
+
+  const w_string* wholename{nullptr};
+};
+
+std::vector<File> makeFiles() {
+  std::vector<File> files;
+  files.reserve(kPoolSize);
+  for (size_t i = 0; i < kPoolSize; ++i) {
+    auto dir = fmt::format("dir{}/sub{}", i % 64, i % 7);
+    auto base =
+        fmt::format("file{}.{}", i, kSuffixes[i % std::size(kSuffixes)]);
+    FileInformation info;
+    // One in eight entries is a directory.
+    info.mode = i % 8 == 0 ? S_IFDIR : S_IFREG;
+    info.size = i % 1000;
+    files.push_back(File{
+        std::make_unique<FakeFileResult>(
+            w_string::build("/root/", dir), w_string{base}, info),
+        w_string::build(dir, "/", base)});
+  }
+  return files;
+}
+
+const std::vector<File>& getFiles() {
+  static const auto files = makeFiles();
+  return files;
+}
+
+// Evaluates the expression against kFilesPerIteration files per iteration,
+// either directly or through its plan.
+void evaluate(
+    benchmark::State& state,
+    const std::string& expression,
+    bool usePlan) {
+  auto json = json_loads(expression.c_str(), JSON_DECODE_ANY, nullptr);
+  Query query;
+  auto expr = parseQueryExpr(&query, *json);
+  QueryPlan plan{*expr};
+  auto& files = getFiles();
+  Context ctx;
+
+  for (auto _ : state) {
+    size_t matched = 0;
+    for (size_t i = 0; i < kFilesPerIteration; ++i) {
+      auto& file = files[i % files.size()];
+      ctx.wholename = &file.wholename;
+      auto result = usePlan ? plan.evaluate(&ctx, file.result.get())
+                            : expr->evaluate(&ctx, file.result.get());
+      matched += result.value_or(false);
+    }
+    benchmark::DoNotOptimize(matched);
+  }
+  state.SetItemsProcessed(
+      int64_t(state.iterations()) * int64_t(kFilesPerIteration));
+}
+
+// Written the way people tend to: the expensive term first.
+constexpr const char* kMatchThenType =
+    R"( ["allof", ["match", "**/sub3/*.cpp", "wholename"], ["type", "f"]] )";
+
+constexpr const char* kNestedSuffixes =
+    R"( ["allof", ["type", "f"],
+          ["anyof", ["match", "*.json"],
+            ["anyof", ["suffix", "h"], ["suffix", "cpp"]]],
+          ["not", ["dirname", "dir3"]]] )";
+
+constexpr const char* kConstantFolding =
+    R"( ["anyof", ["false"], ["allof", ["true"], ["suffix", "py"]]] )";
+
+// Like the lists of generated files kept by lint and codegen tools: an anyof
+// of many patterns, most of which match no file.
+std::string manyPatterns() {
+  std::string expression = R"(["anyof")";
+  for (size_t i = 0; i < kNumPatterns; ++i) {
+    switch (i % 4) {
+      case 0:
+        expression += fmt::format(R"(, ["match", "*.gen{}.cpp"])", i);
+        break;
+      case 1:
+        expression += fmt::format(R"(, ["imatch", "generated_{}_*"])", i);
+        break;
+      case 2:
+        expression += fmt::format(
+            R"(, ["match", "**/codegen{}/**", "wholename"])", i);
+        break;
+      case 3:
+        expression +=
+            fmt::format(R"(, ["pcre", "^dir{}/.*\\.lock$", "wholename"])", i);
+        break;
+    }
+  }
+  expression += "]";
+  return expression;
+}
+
+void match_then_type_tree(benchmark::State& state) {
+  evaluate(state, kMatchThenType, false);
+}
+BENCHMARK(match_then_type_tree)->Unit(benchmark::kMillisecond);
+
+void match_then_type_plan(benchmark::State& state) {
+  evaluate(state, kMatchThenType, true);
+}
+BENCHMARK(match_then_type_plan)->Unit(benchmark::kMillisecond);
+
+void nested_suffixes_tree(benchmark::State& state) {
+  evaluate(state, kNestedSuffixes, false);
+}
+BENCHMARK(nested_suffixes_tree)->Unit(benchmark::kMillisecond);
+
+void nested_suffixes_plan(benchmark::State& state) {
+  evaluate(state, kNestedSuffixes, true);
+}
+BENCHMARK(nested_suffixes_plan)->Unit(benchmark::kMillisecond);
+
+void constant_folding_tree(benchmark::State& state) {
+  evaluate(state, kConstantFolding, false);
+}
+BENCHMARK(constant_folding_tree)->Unit(benchmark::kMillisecond);
+
+void constant_folding_plan(benchmark::State& state) {
+  evaluate(state, kConstantFolding, true);
+}
+BENCHMARK(constant_folding_plan)->Unit(benchmark::kMillisecond);
+
+void many_patterns_tree(benchmark::State& state) {
+  evaluate(state, manyPatterns(), false);
+}
+BENCHMARK(many_patterns_tree)->Unit(benchmark::kMillisecond);
+
+void many_patterns_plan(benchmark::State& state) {
+  evaluate(state, manyPatterns(), true);
+}
+BENCHMARK(many_patterns_plan)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
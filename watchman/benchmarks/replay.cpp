@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Replays a recorded event storm through the InMemoryView's IO thread.
+//
+// A trace is the output of `watchman --no-pretty debug-watcher-info ROOT`
+// from a watchman configured with in_memory_view_ring_log_size. Each entry
+// of its processed paths log records a path the IO thread examined, the
+// pending flags it was queued with and what getFileInformation returned.
+// The paths and their metadata are applied to a FakeFileSystem in order,
+// so the replay measures watchman's own event processing without any
+// kernel or disk involvement, and can be repeated on any machine.
+//
+// Usage: replay [--batch=N] [--iterations=N] [--settle_ms=N] [--no-preload]
+//               TRACE.json
+//
+// --batch is the number of events handed to the IO thread at once. Paths
+// whose first recorded stat succeeded are assumed to have existed before
+// the storm, as after a checkout or build; --no-preload instead treats them
+// as newly created.
+
+#include <fmt/core.h>
+#include <folly/Conv.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "watchman/Cookie.h"
+#include "watchman/InMemoryView.h"
+#include "watchman/LatencyHistogram.h"
+#include "watchman/PendingCollection.h"
+#include "watchman/root/Root.h"
+#include "watchman/test/lib/FakeFileSystem.h"
+#include "watchman/test/lib/FakeWatcher.h"
+
+using namespace watchman;
+
+namespace {
+
+const w_string kRootPath{FAKEFS_ROOT "root"};
+
+struct Options {
+  size_t batch{1024};
+  size_t iterations{1};
+  int64_t settleMs{20};
+  bool preload{true};
+  std::string tracePath;
+};
+
+struct TraceEvent {
+  // Relative to the root.
+  std::string path;
+  PendingFlags flags;
+  // Whether getFileInformation succeeded, and if so what it returned.
+  bool exists{false};
+  FileInformation st;
+};
+
+struct Trace {
+  std::vector<TraceEvent> events;
+  size_t skippedCookies{0};
+  size_t skippedOutsideRoot{0};
+  size_t truncated{0};
+};
+
+// Finds the processed paths log in a debug-watcher-info response. A bare
+// array of entries is also accepted.
+json_ref findProcessedPaths(const json_ref& trace) {
+  if (trace.isArray()) {
+    return trace;
+  }
+  auto node = trace;
+  if (auto info = node.get_optional("watcher-debug-info")) {
+    node = *info;
+  }
+  if (auto view = node.get_optional("view")) {
+    node = *view;
+  }
+  auto paths = node.get_optional("processed_paths");
+  if (!paths || !paths->isArray()) {
+    throw std::runtime_error(
+        "trace has no processed_paths; is in_memory_view_ring_log_size set?");
+  }
+  return *paths;
+}
+
+Trace loadTrace(const std::string& tracePath) {
+  auto entries = findProcessedPaths(json_load_file(tracePath.c_str(), 0));
+
+  Trace trace;
+  for (auto& entry : entries.array()) {
+    auto path = std::string{entry.get("path").asString().view()};
+
+    auto slash = path.rfind('/');
+    auto basename = slash == std::string::npos
+        ? std::string_view{path}
+        : std::string_view{path}.substr(slash + 1);
+    if (basename.substr(0, kCookiePrefix.size()) == kCookiePrefix) {
+      ++trace.skippedCookies;
+      continue;
+    }
+    if (!path.empty() && (path[0] == '/' || path[0] == '\\')) {
+      // Either outside the root or recorded before paths were logged
+      // relative to it.
+      ++trace.skippedOutsideRoot;
+      continue;
+    }
+    if (path.substr(0, 3) == "...") {
+      // Only the tail of long paths is recorded. Drop the partial leading
+      // component and replay the rest from the root.
+      ++trace.truncated;
+      auto firstSlash = path.find('/');
+      if (firstSlash == std::string::npos) {
+        continue;
+      }
+      path = path.substr(firstSlash + 1);
+    }
+
+    TraceEvent event;
+    event.path = std::move(path);
+    event.flags = W_PENDING_VIA_NOTIFY;
+    if (auto flags = entry.get_optional("flags")) {
+      event.flags = PendingFlags::raw(
+          static_cast<PendingFlags::UnderlyingType>(flags->asInt()));
+    }
+    // A failed stat is recorded with a non-zero errcode, except for files
+    // that the parallel crawler found missing, which carry no metadata.
+    event.st.mode = static_cast<mode_t>(entry.get("mode").asInt());
+    event.st.size = static_cast<uint64_t>(entry.get("size").asInt());
+    event.st.mtime.tv_sec = static_cast<time_t>(entry.get("mtime").asInt());
+    event.exists = entry.get("errcode").asInt() == 0 && event.st.mode != 0;
+    trace.events.push_back(std::move(event));
+  }
+  return trace;
+}
+
+std::string absolutePath(const std::string& relative) {
+  if (relative.empty()) {
+    return std::string{kRootPath.view()};
+  }
+  return fmt::format("{}/{}", kRootPath.view(), relative);
+}
+
+void addParents(FakeFileSystem& fs, const std::string& relative) {
+  for (auto slash = relative.find('/'); slash != std::string::npos;
+       slash = relative.find('/', slash + 1)) {
+    fs.addNode(absolutePath(relative.substr(0, slash)).c_str(), fs.fakeDir());
+  }
+}
+
+void applyStat(FakeFileSystem& fs, const TraceEvent& event) {
+  if (event.path.empty()) {
+    // Events for the root itself only trigger a rescan of it.
+    return;
+  }
+  auto path = absolutePath(event.path);
+  if (!event.exists) {
+    try {
+      fs.removeRecursively(path.c_str());
+    } catch (const std::exception&) {
+      // Already gone, or never existed before the storm.
+    }
+    return;
+  }
+  addParents(fs, event.path);
+  auto fi = event.st.isDir() ? fs.fakeDir() : fs.fakeFile();
+  fi.mode = event.st.mode;
+  fi.size = event.st.size;
+  fi.mtime = event.st.mtime;
+  fs.addNode(path.c_str(), fi);
+}
+
+// Populates fs with the tree as it was before the first recorded event.
+void buildSnapshot(
+    FakeFileSystem& fs,
+    const Trace& trace,
+    const Options& options) {
+  fs.addNode(kRootPath.c_str(), fs.fakeDir());
+
+  std::unordered_map<std::string_view, const TraceEvent*> first;
+  for (auto& event : trace.events) {
+    first.emplace(event.path, &event);
+  }
+  for (auto& [path, event] : first) {
+    if (path.empty()) {
+      continue;
+    }
+    if (!event->exists) {
+      // Deleted during the storm, so it must have been there beforehand.
+      addParents(fs, event->path);
+      fs.addNode(absolutePath(event->path).c_str(), fs.fakeFile());
+    } else if (options.preload) {
+      applyStat(fs, *event);
+    }
+  }
+  // Anything with a recorded child was a directory, whatever was assumed
+  // about it above.
+  for (auto& [path, event] : first) {
+    addParents(fs, event->path);
+  }
+}
+
+struct IterationResult {
+  std::chrono::steady_clock::duration crawl{};
+  std::chrono::steady_clock::duration replay{};
+  std::chrono::steady_clock::duration settle{};
+};
+
+using Clock = std::chrono::steady_clock;
+
+IterationResult replayOnce(
+    const Trace& trace,
+    const Options& options,
+    LatencyHistogram& batchLatency) {
+  FakeFileSystem fs;
+  buildSnapshot(fs, trace, options);
+
+  Configuration config{
+      json_object({{"settle", json_integer(options.settleMs)}})};
+  auto watcher = std::make_shared<FakeWatcher>(fs);
+  auto view = std::make_shared<InMemoryView>(fs, kRootPath, config, watcher);
+  auto root = std::make_shared<Root>(
+      fs, kRootPath, "fs_type", w_string_to_json("{}"), config, view, [] {});
+  auto& pendingFromWatcher = view->unsafeAccessPendingFromWatcher();
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+
+  IterationResult result;
+  auto start = Clock::now();
+  pendingFromWatcher.lock()->ping();
+  view->stepIoThread(root, state, pendingFromWatcher);
+  result.crawl = Clock::now() - start;
+
+  for (size_t begin = 0; begin < trace.events.size(); begin += options.batch) {
+    auto end = std::min(begin + options.batch, trace.events.size());
+    {
+      auto now = std::chrono::system_clock::now();
+      auto pending = pendingFromWatcher.lock();
+      for (size_t i = begin; i < end; ++i) {
+        auto& event = trace.events[i];
+        applyStat(fs, event);
+        pending->add(w_string{absolutePath(event.path)}, now, event.flags);
+      }
+      pending->ping();
+    }
+
+    auto batchStart = Clock::now();
+    view->stepIoThread(root, state, pendingFromWatcher);
+    auto elapsed = Clock::now() - batchStart;
+    batchLatency.record(elapsed);
+    result.replay += elapsed;
+  }
+
+  // With nothing pending, this step waits out the settle period and then
+  // performs the settle actions, as the IO thread would once the storm has
+  // passed.
+  auto settleStart = Clock::now();
+  view->stepIoThread(root, state, pendingFromWatcher);
+  result.settle = Clock::now() - settleStart;
+
+  return result;
+}
+
+double toMillis(Clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  auto value = [](std::string_view arg, std::string_view flag)
+      -> std::optional<std::string_view> {
+    if (arg.substr(0, flag.size()) == flag) {
+      return arg.substr(flag.size());
+    }
+    return std::nullopt;
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg{argv[i]};
+    if (auto v = value(arg, "--batch=")) {
+      options.batch = std::max(folly::to<size_t>(*v), size_t(1));
+    } else if (auto v = value(arg, "--iterations=")) {
+      options.iterations = std::max(folly::to<size_t>(*v), size_t(1));
+    } else if (auto v = value(arg, "--settle_ms=")) {
+      options.settleMs = folly::to<int64_t>(*v);
+    } else if (arg == "--no-preload") {
+      options.preload = false;
+    } else if (arg.substr(0, 2) == "--" || !options.tracePath.empty()) {
+      throw std::invalid_argument(fmt::format("unexpected argument {}", arg));
+    } else {
+      options.tracePath = std::string{arg};
+    }
+  }
+  if (options.tracePath.empty()) {
+    throw std::invalid_argument("no trace file given");
+  }
+  return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  Trace trace;
+  try {
+    options = parseOptions(argc, argv);
+    trace = loadTrace(options.tracePath);
+  } catch (const std::exception& exc) {
+    fmt::print(
+        stderr,
+        "{}\nusage: {} [--batch=N] [--iterations=N] [--settle_ms=N] "
+        "[--no-preload] TRACE.json\n",
+        exc.what(),
+        argv[0]);
+    return 1;
+  }
+
+  fmt::print(
+      "{} events; skipped {} cookies and {} paths outside the root; "
+      "{} truncated paths replayed from their tail\n",
+      trace.events.size(),
+      trace.skippedCookies,
+      trace.skippedOutsideRoot,
+      trace.truncated);
+
+  LatencyHistogram batchLatency;
+  for (size_t i = 0; i < options.iterations; ++i) {
+    auto result = replayOnce(trace, options, batchLatency);
+    auto seconds = std::chrono::duration<double>(result.replay).count();
+    fmt::print(
+        "iteration {}: crawl {:.1f}ms, replay {:.1f}ms ({:.0f} events/sec), "
+        "settle {:.1f}ms\n",
+        i,
+        toMillis(result.crawl),
+        toMillis(result.replay),
+        seconds > 0 ? double(trace.events.size()) / seconds : 0.0,
+        toMillis(result.settle));
+  }
+
+  auto summary = batchLatency.summarize();
+  fmt::print(
+      "batches of {}: count {}, mean {}us, p50 {}us, p99 {}us, max {}us\n",
+      options.batch,
+      summary.count,
+      summary.mean_us,
+      summary.p50_us,
+      summary.p99_us,
+      summary.max_us);
+  return 0;
+}
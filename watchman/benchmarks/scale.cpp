@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// End-to-end benchmarks of the InMemoryView on large synthetic trees.
+//
+// Trees are built in a FakeFileSystem and watched with a FakeWatcher, so
+// these measure watchman's own crawl, event processing and query paths
+// without any kernel or disk involvement.
+//
+// By default each shape is built with 1M files. Pass
+// --scale_files=1000000,10000000 to choose other sizes; the larger trees
+// need several GB of memory.
+
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "watchman/InMemoryView.h"
+#include "watchman/Logging.h"
+#include "watchman/query/Query.h"
+#include "watchman/query/QueryContext.h"
+#include "watchman/query/parse.h"
+#include "watchman/root/Root.h"
+#include "watchman/test/lib/FakeFileSystem.h"
+#include "watchman/test/lib/FakeWatcher.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace watchman;
+
+namespace {
+
+struct TreeShape {
+  const char* name;
+  // Each directory holds this many files and subdirectories, until the
+  // requested number of files has been created.
+  size_t filesPerDir;
+  size_t dirsPerDir;
+};
+
+constexpr TreeShape kWide{"wide", 64, 16};
+constexpr TreeShape kDeep{"deep", 8, 2};
+
+// Files take one of these suffixes in turn, so that "**/*.h" matches a
+// quarter of them.
+constexpr const char* kSuffixes[] = {"cpp", "h", "py", "txt"};
+
+const w_string kRootPath{FAKEFS_ROOT "root"};
+
+// Resident set size of the process, or 0 where that isn't available.
+int64_t currentRssBytes() {
+#ifdef __linux__
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (!fp) {
+    return 0;
+  }
+  long size = 0;
+  long resident = 0;
+  auto matched = fscanf(fp, "%ld %ld", &size, &resident);
+  fclose(fp);
+  return matched == 2 ? int64_t(resident) * sysconf(_SC_PAGESIZE) : 0;
+#else
+  return 0;
+#endif
+}
+
+Configuration makeConfig() {
+  return Configuration{json_object()};
+}
+
+// A tree, its files in creation order, and a view that has crawled it.
+struct Fixture {
+  Fixture(const TreeShape& shape, size_t numFiles)
+      : shape{shape}, numFiles{numFiles} {
+    fs.addNode(kRootPath.c_str(), fs.fakeDir());
+
+    std::deque<std::string> dirs{std::string{kRootPath.view()}};
+    while (files.size() < numFiles) {
+      auto dir = std::move(dirs.front());
+      dirs.pop_front();
+      for (size_t i = 0; i < shape.filesPerDir && files.size() < numFiles;
+           ++i) {
+        auto suffix = kSuffixes[files.size() % std::size(kSuffixes)];
+        auto path = fmt::format("{}/f{}.{}", dir, i, suffix);
+        fs.addNode(path.c_str(), fs.fakeFile());
+        files.push_back(std::move(path));
+      }
+      for (size_t i = 0; i < shape.dirsPerDir; ++i) {
+        auto path = fmt::format("{}/d{}", dir, i);
+        fs.addNode(path.c_str(), fs.fakeDir());
+        dirs.push_back(std::move(path));
+      }
+    }
+
+    auto [v, r] = crawl(state);
+    view = std::move(v);
+    root = std::move(r);
+  }
+
+  // Builds a new view of the tree and performs its initial crawl.
+  std::pair<std::shared_ptr<InMemoryView>, std::shared_ptr<Root>> crawl(
+      InMemoryView::IoThreadState& state) {
+    auto config = makeConfig();
+    auto watcher = std::make_shared<FakeWatcher>(fs);
+    auto v = std::make_shared<InMemoryView>(fs, kRootPath, config, watcher);
+    auto r = std::make_shared<Root>(
+        fs, kRootPath, "fs_type", w_string_to_json("{}"), config, v, [] {});
+    v->unsafeAccessPendingFromWatcher().lock()->ping();
+    v->stepIoThread(r, state, v->unsafeAccessPendingFromWatcher());
+    return {std::move(v), std::move(r)};
+  }
+
+  // Changes the metadata of count files, starting after the ones changed
+  // last time, and queues a notification for each of them.
+  void changeFiles(size_t count) {
+    auto now = std::chrono::system_clock::now();
+    auto pending = view->unsafeAccessPendingFromWatcher().lock();
+    for (size_t i = 0; i < count; ++i) {
+      auto& path = files[nextChange++ % files.size()];
+      fs.updateMetadata(
+          path.c_str(), [](FileInformation& fi) { fi.size += 1; });
+      pending->add(w_string{path}, now, W_PENDING_VIA_NOTIFY);
+    }
+    pending->ping();
+  }
+
+  void processPending() {
+    view->stepIoThread(root, state, view->unsafeAccessPendingFromWatcher());
+  }
+
+  const TreeShape& shape;
+  const size_t numFiles;
+  FakeFileSystem fs;
+  std::vector<std::string> files;
+  std::shared_ptr<InMemoryView> view;
+  std::shared_ptr<Root> root;
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  size_t nextChange{0};
+};
+
+// Building a tree of millions of files takes a while, so each one is shared
+// by all of the benchmarks of that shape and size. They are registered in
+// order, so only the most recent tree is kept.
+std::unique_ptr<Fixture> currentFixture;
+
+Fixture& getFixture(const TreeShape& shape, size_t numFiles) {
+  // Each benchmark is passed its own copy of the shape, so compare names.
+  if (!currentFixture ||
+      std::string_view{currentFixture->shape.name} != shape.name ||
+      currentFixture->numFiles != numFiles) {
+    currentFixture.reset();
+    currentFixture = std::make_unique<Fixture>(shape, numFiles);
+  }
+  return *currentFixture;
+}
+
+using Clock = std::chrono::steady_clock;
+
+void setElapsed(benchmark::State& state, Clock::time_point start) {
+  state.SetIterationTime(
+      std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+void initial_crawl(
+    benchmark::State& state,
+    const TreeShape& shape,
+    size_t numFiles) {
+  auto& fixture = getFixture(shape, numFiles);
+  int64_t bytesPerFile = 0;
+  for (auto _ : state) {
+    auto rssBefore = currentRssBytes();
+    InMemoryView::IoThreadState ioState{std::chrono::minutes(5)};
+    auto start = Clock::now();
+    auto crawled = fixture.crawl(ioState);
+    setElapsed(state, start);
+    bytesPerFile = (currentRssBytes() - rssBefore) / int64_t(numFiles);
+    benchmark::DoNotOptimize(crawled);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(numFiles));
+  state.counters["bytes_per_file"] = double(bytesPerFile);
+}
+
+void event_storm(
+    benchmark::State& state,
+    const TreeShape& shape,
+    size_t numFiles) {
+  auto& fixture = getFixture(shape, numFiles);
+  // A large rebase or checkout touches a good fraction of the tree.
+  auto stormSize = numFiles / 10;
+  for (auto _ : state) {
+    fixture.changeFiles(stormSize);
+    auto start = Clock::now();
+    fixture.processPending();
+    setElapsed(state, start);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(stormSize));
+}
+
+// Runs the query's generators directly against the view, as
+// w_query_execute would after syncing.
+void runQuery(
+    benchmark::State& state,
+    Fixture& fixture,
+    const json_ref& spec,
+    void (InMemoryView::*generator)(const Query*, QueryContext*) const,
+    const std::function<void(QueryContext&)>& prepare = {}) {
+  auto query = parseQuery(fixture.root, spec);
+  int64_t results = 0;
+  int64_t walked = 0;
+  for (auto _ : state) {
+    auto start = Clock::now();
+    QueryContext ctx{query.get(), fixture.root, false};
+    if (prepare) {
+      prepare(ctx);
+    }
+    ((*fixture.view).*generator)(query.get(), &ctx);
+    setElapsed(state, start);
+    results = int64_t(ctx.resultsArray.size());
+    walked = ctx.getNumWalked();
+  }
+  state.counters["results"] = double(results);
+  state.counters["walked"] = double(walked);
+}
+
+void all_files_query(
+    benchmark::State& state,
+    const TreeShape& shape,
+    size_t numFiles) {
+  auto& fixture = getFixture(shape, numFiles);
+  runQuery(
+      state,
+      fixture,
+      json_object({{"fields", json_array({typed_string_to_json("name")})}}),
+      &InMemoryView::allFilesGenerator);
+}
+
+void time_query(
+    benchmark::State& state,
+    const TreeShape& shape,
+    size_t numFiles) {
+  auto& fixture = getFixture(shape, numFiles);
+  // The typical incremental query: what changed since a recent clock.
+  auto since = fixture.view->getMostRecentRootNumberAndTickValue().ticks;
+  fixture.changeFiles(std::max(numFiles / 1000, size_t(1)));
+  fixture.processPending();
+  runQuery(
+      state,
+      fixture,
+      json_object({{"fields", json_array({typed_string_to_json("name")})}}),
+      &InMemoryView::timeGenerator,
+      [since](QueryContext& ctx) {
+        ctx.since = QuerySince::Clock{false, since};
+      });
+}
+
+void glob_query(
+    benchmark::State& state,
+    const TreeShape& shape,
+    size_t numFiles) {
+  auto& fixture = getFixture(shape, numFiles);
+  runQuery(
+      state,
+      fixture,
+      json_object(
+          {{"glob", json_array({typed_string_to_json("**/*.h")})},
+           {"fields", json_array({typed_string_to_json("name")})}}),
+      &InMemoryView::globGenerator);
+}
+
+void registerBenchmarks(const TreeShape& shape, size_t numFiles) {
+  using Fn = void (*)(benchmark::State&, const TreeShape&, size_t);
+  const std::pair<const char*, Fn> benchmarks[] = {
+      {"initial_crawl", initial_crawl},
+      {"event_storm", event_storm},
+      {"all_files_query", all_files_query},
+      {"time_query", time_query},
+      {"glob_query", glob_query},
+  };
+  for (auto& [name, fn] : benchmarks) {
+    benchmark::RegisterBenchmark(
+        fmt::format("{}/{}/{}", name, shape.name, numFiles).c_str(),
+        fn,
+        shape,
+        numFiles)
+        ->UseManualTime()
+        ->Unit(benchmark::kMillisecond);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+
+  std::vector<size_t> sizes{1000000};
+  constexpr std::string_view kFilesFlag = "--scale_files=";
+  int out = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg{argv[i]};
+    if (arg.substr(0, kFilesFlag.size()) == kFilesFlag) {
+      sizes.clear();
+      std::vector<folly::StringPiece> values;
+      folly::split(',', arg.substr(kFilesFlag.size()), values);
+      for (auto value : values) {
+        sizes.push_back(folly::to<size_t>(value));
+      }
+    } else {
+      argv[out++] = argv[i];
+    }
+  }
+  argc = out;
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  for (auto size : sizes) {
+    registerBenchmarks(kWide, size);
+    registerBenchmarks(kDeep, size);
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  currentFixture.reset();
+}
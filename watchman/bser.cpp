@@ -10,6 +10,10 @@
 #include "watchman/thirdparty/jansson/jansson_private.h"
 
 #include <math.h>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
  * This defines a binary serialization of the JSON data objects in this
@@ -400,17 +404,17 @@ int w_bser_write_pdu(
 namespace {
 
 /**
- * Contains BserParser state. BSER is a simple format, so the only mutable state
- * is the current pointer.
+ * Reads the primitives of a BSER document. BSER is a simple format, so the
+ * only mutable state is the current pointer and the container depth.
  *
  * Terminology note:
  * "parse" means we know the current value type, so decode and return it.
  * "expect" means we don't know the current value type, but the document
  * requires it be a specific type.
  */
-class BserParser {
+class BserReader {
  public:
-  BserParser(const char* buf, const char* end)
+  BserReader(const char* buf, const char* end)
       : buf{buf}, start{buf}, end{end} {
     if (end < buf) {
       logf(
@@ -421,49 +425,7 @@ class BserParser {
     }
   }
 
-  json_ref expectValue() {
-    return parseValue(*ensure(1));
-  }
-
-  json_ref parseValue(char value_type) {
-    switch (value_type) {
-      case BSER_INT8:
-      case BSER_INT16:
-      case BSER_INT32:
-      case BSER_INT64:
-        return json_integer(parseInteger(value_type));
-
-      case BSER_BYTESTRING:
-      case BSER_UTF8STRING: {
-        std::string_view str = parseString();
-        return typed_string_to_json(
-            str.data(),
-            str.size(),
-            value_type == BSER_BYTESTRING ? W_STRING_BYTE : W_STRING_UNICODE);
-      }
-
-      case BSER_REAL: {
-        return json_real(parseReal());
-      }
-
-      case BSER_TRUE:
-        return json_true();
-      case BSER_FALSE:
-        return json_false();
-      case BSER_NULL:
-        return json_null();
-      case BSER_ARRAY:
-        return json_array(parseArray());
-      case BSER_TEMPLATE:
-        return parseTemplate();
-      case BSER_OBJECT:
-        return parseObject();
-      default:
-        throw BserParseError("invalid bser encoding type: {:02x}", value_type);
-    }
-  }
-
- private:
+ protected:
   /**
    * Ensures `needed` bytes remain in the document, and advances the `buf`
    * pointer. Returns the old `buf` with the assurance that up to `needed` bytes
@@ -483,6 +445,10 @@ class BserParser {
     return old;
   }
 
+  size_t remaining() const {
+    return end - buf;
+  }
+
   char expectType(std::initializer_list<char> types) {
     char type = *ensure(1);
     for (char expected : types) {
@@ -568,6 +534,72 @@ class BserParser {
     return parseString();
   }
 
+  struct BumpDepth {
+    explicit BumpDepth(size_t& depth) : depth{depth} {
+      if (++depth == kMaximumDepth) {
+        throw BserParseTooDeep{};
+      }
+    }
+    ~BumpDepth() {
+      --depth;
+    }
+
+    size_t& depth;
+  };
+
+  const char* buf;
+  const char* const start;
+  const char* const end;
+  size_t depth = 0;
+};
+
+class BserParser : public BserReader {
+ public:
+  using BserReader::BserReader;
+
+  json_ref expectValue() {
+    return parseValue(*ensure(1));
+  }
+
+  json_ref parseValue(char value_type) {
+    switch (value_type) {
+      case BSER_INT8:
+      case BSER_INT16:
+      case BSER_INT32:
+      case BSER_INT64:
+        return json_integer(parseInteger(value_type));
+
+      case BSER_BYTESTRING:
+      case BSER_UTF8STRING: {
+        std::string_view str = parseString();
+        return typed_string_to_json(
+            str.data(),
+            str.size(),
+            value_type == BSER_BYTESTRING ? W_STRING_BYTE : W_STRING_UNICODE);
+      }
+
+      case BSER_REAL: {
+        return json_real(parseReal());
+      }
+
+      case BSER_TRUE:
+        return json_true();
+      case BSER_FALSE:
+        return json_false();
+      case BSER_NULL:
+        return json_null();
+      case BSER_ARRAY:
+        return json_array(parseArray());
+      case BSER_TEMPLATE:
+        return parseTemplate();
+      case BSER_OBJECT:
+        return parseObject();
+      default:
+        throw BserParseError("invalid bser encoding type: {:02x}", value_type);
+    }
+  }
+
+ private:
   std::vector<json_ref> parseArray() {
     BumpDepth scope{depth};
 
@@ -598,12 +630,15 @@ class BserParser {
     }
 
     // Validate that all template keys are strings before entering the main
-    // loop.
+    // loop, and convert them to keys once rather than for every object.
+    std::vector<w_string> keys;
+    keys.reserve(templ.size());
     for (const auto& template_key : templ) {
       if (!template_key.isString()) {
         throw BserParseError(
             "template value must be string, was {}", template_key.type());
       }
+      keys.emplace_back(json_string_value(template_key));
     }
 
     // And the number of objects
@@ -614,16 +649,14 @@ class BserParser {
     limitedReservation(rv, element_count);
     for (size_t i = 0; i < element_count; ++i) {
       std::unordered_map<w_string, json_ref> item;
-      limitedReservation(item, templ.size());
-      for (const auto& template_key : templ) {
+      limitedReservation(item, keys.size());
+      for (const auto& key : keys) {
         char type = *ensure(1);
         if (type == BSER_SKIP) {
           continue;
         }
 
-        assert(template_key.isString());
-        item.insert_or_assign(
-            json_string_value(template_key), parseValue(type));
+        item.insert_or_assign(key, parseValue(type));
       }
 
       rv.push_back(json_object(std::move(item)));
@@ -656,27 +689,322 @@ class BserParser {
 
     return json_object(std::move(rv));
   }
+};
 
-  struct BumpDepth {
-    explicit BumpDepth(size_t& depth) : depth{depth} {
-      if (++depth == kMaximumDepth) {
-        throw BserParseTooDeep{};
+} // namespace
+
+/**
+ * Builds a BserDocument. Mirrors BserParser, including which documents it
+ * rejects, but fills in BserValues in the document's arena.
+ */
+class BserDocument::Parser : public BserReader {
+ public:
+  Parser(BserDocument& doc, const char* buf, const char* end)
+      : BserReader{buf, end}, doc_{doc} {}
+
+  void expectValue(BserValue& out) {
+    parseValue(*ensure(1), out);
+  }
+
+ private:
+  using Type = BserValue::Type;
+
+  void parseValue(char value_type, BserValue& out) {
+    switch (value_type) {
+      case BSER_INT8:
+      case BSER_INT16:
+      case BSER_INT32:
+      case BSER_INT64:
+        out.type_ = Type::Integer;
+        out.integer_ = parseInteger(value_type);
+        return;
+
+      case BSER_BYTESTRING:
+      case BSER_UTF8STRING:
+        setString(out, parseString(), value_type == BSER_UTF8STRING);
+        return;
+
+      case BSER_REAL:
+        out.type_ = Type::Real;
+        out.real_ = parseReal();
+        return;
+
+      case BSER_TRUE:
+        out.type_ = Type::True;
+        return;
+      case BSER_FALSE:
+        out.type_ = Type::False;
+        return;
+      case BSER_NULL:
+        out.type_ = Type::Null;
+        return;
+      case BSER_ARRAY:
+        parseArray(out);
+        return;
+      case BSER_TEMPLATE:
+        parseTemplate(out);
+        return;
+      case BSER_OBJECT:
+        parseObject(out);
+        return;
+      default:
+        throw BserParseError("invalid bser encoding type: {:02x}", value_type);
+    }
+  }
+
+  static void setString(BserValue& out, std::string_view str, bool unicode) {
+    out.type_ = Type::String;
+    out.unicode_ = unicode;
+    out.string_ = str.data();
+    out.size_ = uint32_t(str.size());
+  }
+
+  // Every value takes at least one byte, so a container can't have more
+  // values than there are bytes left. Checking before allocating them
+  // keeps a small, hostile document from asking for a huge arena.
+  BserValue* allocateValues(size_t count) {
+    if (count > remaining()) {
+      throw BserParseError(
+          "unexpected EOF at {}: expected at least {} remaining but total "
+          "document is {}",
+          buf - start,
+          count,
+          end - start);
+    }
+    return doc_.allocate(count);
+  }
+
+  void parseArray(BserValue& out) {
+    BumpDepth scope{depth};
+
+    size_t count = expectSize("array");
+    auto* items = allocateValues(count);
+    out.type_ = Type::Array;
+    out.items_ = items;
+    out.size_ = uint32_t(count);
+
+    size_t i = 0;
+    while (i < count) {
+      char type = *ensure(1);
+      switch (type) {
+        case BSER_INT8:
+          i += parseIntegerRun<int8_t>(type, items + i, count - i);
+          break;
+        case BSER_INT16:
+          i += parseIntegerRun<int16_t>(type, items + i, count - i);
+          break;
+        case BSER_INT32:
+          i += parseIntegerRun<int32_t>(type, items + i, count - i);
+          break;
+        case BSER_INT64:
+          i += parseIntegerRun<int64_t>(type, items + i, count - i);
+          break;
+        default:
+          parseValue(type, items[i++]);
       }
     }
-    ~BumpDepth() {
-      --depth;
+  }
+
+  /**
+   * Arrays of integers usually use the same width throughout, so decode a
+   * run of them without going back through parseValue. The type byte of
+   * the first has already been consumed. Returns how many were decoded.
+   */
+  template <typename T>
+  size_t parseIntegerRun(char type, BserValue* items, size_t max) {
+    constexpr size_t kStride = 1 + sizeof(T);
+    items[0].type_ = Type::Integer;
+    items[0].integer_ = parseInteger<T>();
+    size_t n = 1;
+
+#ifdef __SSE2__
+    if constexpr (sizeof(T) == 1) {
+      // Eight int8 values at a time: check that every even byte is the
+      // type, and then pick out the odd ones.
+      const __m128i types = _mm_set1_epi8(type);
+      while (max - n >= 8 && remaining() >= 16) {
+        __m128i chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+        auto matches = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, types));
+        if ((matches & 0x5555) != 0x5555) {
+          break;
+        }
+        for (size_t k = 0; k < 8; ++k) {
+          items[n + k].type_ = Type::Integer;
+          items[n + k].integer_ = static_cast<int8_t>(buf[2 * k + 1]);
+        }
+        buf += 16;
+        n += 8;
+      }
+    }
+#endif
+
+    while (n < max && remaining() >= kStride && *buf == type) {
+      T v;
+      memcpy(&v, buf + 1, sizeof(v));
+      buf += kStride;
+      items[n].type_ = Type::Integer;
+      items[n].integer_ = v;
+      ++n;
     }
+    return n;
+  }
 
-    size_t& depth;
-  };
+  void parseTemplate(BserValue& out) {
+    BumpDepth scope{depth};
 
-  const char* buf;
-  const char* const start;
-  const char* const end;
-  size_t depth = 0;
+    // Load in the property names template
+    BserValue templ;
+    expectType({BSER_ARRAY});
+    parseArray(templ);
+    if (templ.size() == 0) {
+      // To avoid "decompression bombs" -- small documents that expand into huge
+      // memory requirements -- require that templates have a non-empty key set.
+      throw BserParseError("templates require a non-empty key set");
+    }
+    for (size_t i = 0; i < templ.size(); ++i) {
+      if (templ[i].type() != Type::String) {
+        throw BserParseError(
+            "template value must be string, was {}",
+            templ[i].toJson().type());
+      }
+    }
+
+    size_t element_count = expectSize("template");
+    // Each value, even if skipped, takes at least one byte.
+    if (element_count > remaining() / templ.size()) {
+      throw BserParseError(
+          "unexpected EOF at {}: template of {} objects can't fit in the "
+          "remaining document",
+          buf - start,
+          element_count);
+    }
+
+    auto* rows = allocateValues(element_count);
+    out.type_ = Type::Array;
+    out.items_ = rows;
+    out.size_ = uint32_t(element_count);
+
+    for (size_t i = 0; i < element_count; ++i) {
+      auto* members = doc_.allocate(2 * templ.size());
+      size_t count = 0;
+      for (size_t k = 0; k < templ.size(); ++k) {
+        char type = *ensure(1);
+        if (type == BSER_SKIP) {
+          continue;
+        }
+        members[2 * count] = templ[k];
+        parseValue(type, members[2 * count + 1]);
+        ++count;
+      }
+
+      auto& row = rows[i];
+      row.type_ = Type::Object;
+      row.fromTemplate_ = true;
+      row.items_ = members;
+      row.size_ = uint32_t(count);
+    }
+  }
+
+  void parseObject(BserValue& out) {
+    BumpDepth scope{depth};
+
+    size_t element_count = expectSize("object");
+    auto* members = allocateValues(2 * element_count);
+    out.type_ = Type::Object;
+    out.items_ = members;
+    out.size_ = uint32_t(element_count);
+
+    for (size_t i = 0; i < element_count; i++) {
+      // Keys are always treated as bytes, like BserParser.
+      setString(members[2 * i], expectString(), false);
+      expectValue(members[2 * i + 1]);
+    }
+  }
+
+  BserDocument& doc_;
 };
 
-} // namespace
+std::string_view BserValue::keyAt(size_t i) const {
+  return items_[2 * i].asString();
+}
+
+const BserValue& BserValue::valueAt(size_t i) const {
+  return items_[2 * i + 1];
+}
+
+const BserValue* BserValue::get(std::string_view key) const {
+  // Agree with toJson about which of any duplicate keys wins.
+  for (size_t n = 0; n < size_; ++n) {
+    size_t i = fromTemplate_ ? size_ - 1 - n : n;
+    if (keyAt(i) == key) {
+      return &valueAt(i);
+    }
+  }
+  return nullptr;
+}
+
+json_ref BserValue::toJson() const {
+  switch (type_) {
+    case Type::Integer:
+      return json_integer(integer_);
+    case Type::Real:
+      return json_real(real_);
+    case Type::True:
+      return json_true();
+    case Type::False:
+      return json_false();
+    case Type::Null:
+      return json_null();
+    case Type::String:
+      return typed_string_to_json(
+          string_, size_, unicode_ ? W_STRING_UNICODE : W_STRING_BYTE);
+    case Type::Array: {
+      std::vector<json_ref> rv;
+      rv.reserve(size_);
+      for (size_t i = 0; i < size_; ++i) {
+        rv.push_back(items_[i].toJson());
+      }
+      return json_array(std::move(rv));
+    }
+    case Type::Object: {
+      std::unordered_map<w_string, json_ref> rv;
+      rv.reserve(size_);
+      for (size_t i = 0; i < size_; ++i) {
+        auto key = keyAt(i);
+        if (fromTemplate_) {
+          // bunser has always stopped template keys at the first NUL, and
+          // lets later duplicates win.
+          key = key.substr(0, key.find('\0'));
+          rv.insert_or_assign(
+              w_string{key.data(), key.size(), W_STRING_BYTE},
+              valueAt(i).toJson());
+        } else {
+          rv.emplace(
+              w_string{key.data(), key.size(), W_STRING_BYTE},
+              valueAt(i).toJson());
+        }
+      }
+      return json_object(std::move(rv));
+    }
+  }
+  abort();
+}
+
+BserValue* BserDocument::allocate(size_t count) {
+  if (count == 0) {
+    return nullptr;
+  }
+  if (count > blockSize_ - blockUsed_) {
+    size_t size = std::max(count, kBlockSize);
+    blocks_.push_back(std::make_unique<BserValue[]>(size));
+    blockSize_ = size;
+    blockUsed_ = 0;
+  }
+  auto* values = blocks_.back().get() + blockUsed_;
+  blockUsed_ += count;
+  return values;
+}
 
 std::optional<json_int_t>
 bunser_int(const char* buf, size_t avail, size_t* needed) {
@@ -734,3 +1062,12 @@ json_ref bunser(const char* buf, const char* end) {
   }
   return BserParser{buf, end}.expectValue();
 }
+
+BserDocument bunser_view(const char* buf, const char* end) {
+  if (buf >= end) {
+    throw BserParseError("document too short");
+  }
+  BserDocument doc;
+  BserDocument::Parser{doc, buf, end}.expectValue(doc.root_);
+  return doc;
+}
@@ -8,6 +8,10 @@
 #pragma once
 
 #include <fmt/core.h>
+#include <cassert>
+#include <memory>
+#include <string_view>
+#include <vector>
 #include "watchman/thirdparty/jansson/jansson.h"
 
 typedef struct bser_ctx {
@@ -80,3 +84,118 @@ bunser_int(const char* buf, size_t avail, size_t* needed);
  * Ignores any unused data at the end of the buffer.
  */
 json_ref bunser(const char* buf, const char* end);
+
+/**
+ * A value in a BserDocument. Strings reference the bytes of the encoded
+ * document, and arrays and objects reference values owned by the
+ * BserDocument, so a BserValue is only valid while both are alive.
+ */
+class BserValue {
+ public:
+  enum class Type : uint8_t {
+    Null,
+    True,
+    False,
+    Integer,
+    Real,
+    String,
+    Array,
+    Object,
+  };
+
+  Type type() const {
+    return type_;
+  }
+
+  json_int_t asInt() const {
+    assert(type_ == Type::Integer);
+    return integer_;
+  }
+
+  double asReal() const {
+    assert(type_ == Type::Real);
+    return real_;
+  }
+
+  std::string_view asString() const {
+    assert(type_ == Type::String);
+    return std::string_view{string_, size_};
+  }
+
+  // Whether a String was encoded as UTF-8 rather than as bytes.
+  bool isUnicode() const {
+    return unicode_;
+  }
+
+  // The number of elements of an Array, or of key/value pairs of an Object.
+  size_t size() const {
+    return size_;
+  }
+
+  const BserValue& operator[](size_t i) const {
+    assert(type_ == Type::Array && i < size_);
+    return items_[i];
+  }
+
+  std::string_view keyAt(size_t i) const;
+  const BserValue& valueAt(size_t i) const;
+
+  // Returns nullptr if this Object has no such key.
+  const BserValue* get(std::string_view key) const;
+
+  // Copies the value into the same json_ref that bunser would produce.
+  json_ref toJson() const;
+
+ private:
+  friend class BserDocument;
+
+  Type type_{Type::Null};
+  bool unicode_{false};
+  // Objects decoded from a template have different duplicate key rules.
+  bool fromTemplate_{false};
+  uint32_t size_{0};
+  union {
+    json_int_t integer_{0};
+    double real_;
+    const char* string_;
+    // Array elements, or Object keys and values, interleaved.
+    const BserValue* items_;
+  };
+};
+
+/**
+ * The result of bunser_view. Holds the values of the document in a few
+ * large blocks rather than allocating each one separately.
+ */
+class BserDocument {
+ public:
+  BserDocument(BserDocument&&) = default;
+  BserDocument& operator=(BserDocument&&) = default;
+
+  const BserValue& root() const {
+    return root_;
+  }
+
+ private:
+  class Parser;
+  friend BserDocument bunser_view(const char* buf, const char* end);
+
+  BserDocument() = default;
+
+  BserValue* allocate(size_t count);
+
+  static constexpr size_t kBlockSize = 1024;
+
+  BserValue root_;
+  std::vector<std::unique_ptr<BserValue[]>> blocks_;
+  size_t blockSize_{0};
+  size_t blockUsed_{0};
+};
+
+/**
+ * Like bunser, but decodes into a BserDocument without copying strings or
+ * allocating per value. Accepts and rejects the same documents as bunser.
+ *
+ * The buffer must outlive the returned document.
+ */
+BserDocument bunser_view(const char* buf, const char* end);
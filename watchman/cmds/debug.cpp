@@ -14,12 +14,16 @@
 #include <folly/system/Shell.h>
 
 #include "watchman/Client.h"
+#include "watchman/HashingExecutor.h"
 #include "watchman/InMemoryView.h"
 #include "watchman/LRUCache.h"
 #include "watchman/Logging.h"
 #include "watchman/Poison.h"
 #include "watchman/QueryableView.h"
+#include "watchman/ThreadPool.h"
 #include "watchman/root/Root.h"
+#include "watchman/root/watchlist.h"
+#include "watchman/scm/SCM.h"
 #include "watchman/watchman_cmd.h"
 
 namespace watchman {
@@ -296,12 +300,18 @@ struct DebugStatusCommand : PrettyCommand<DebugStatusCommand> {
   struct Response : BaseResponse {
     std::vector<RootDebugStatus> roots;
     std::vector<ClientDebugStatus> clients;
+    HashingExecutorStats content_hashing;
+    ThreadPoolStats thread_pool;
+    LogStats logging;
 
     template <typename X>
     void map(X& x) {
       BaseResponse::map(x);
       x("roots", roots);
       x("clients", clients);
+      x("content_hashing", content_hashing);
+      x("thread_pool", thread_pool);
+      x("logging", logging);
     }
   };
 
@@ -310,6 +320,9 @@ struct DebugStatusCommand : PrettyCommand<DebugStatusCommand> {
     res.version = w_string{PACKAGE_VERSION, W_STRING_UNICODE};
     res.roots = Root::getStatusForAllRoots();
     res.clients = UserClient::getStatusForAllClients();
+    res.content_hashing = getHashingExecutor().getStats();
+    res.thread_pool = getThreadPool().getStats();
+    res.logging = getLog().getStats();
     return res;
   }
 
@@ -382,6 +395,117 @@ struct DebugRootStatusCommand : TypedCommand<DebugRootStatusCommand> {
 };
 WATCHMAN_COMMAND(debug_root_status, DebugRootStatusCommand);
 
+struct DebugQueryStatsCommand : TypedCommand<DebugQueryStatsCommand> {
+  static constexpr std::string_view name = "debug-query-stats";
+  static constexpr CommandFlags flags = CMD_DAEMON;
+
+  // Reports on every watched root if none is given.
+  using Request = serde::Array<0, std::optional<w_string>>;
+
+  struct RootQueryStats : serde::Object {
+    w_string root;
+    std::vector<QueryCommandStats> commands;
+
+    template <typename X>
+    void map(X& x) {
+      x("root", root);
+      x("commands", commands);
+    }
+  };
+
+  struct Response : BaseResponse {
+    std::vector<RootQueryStats> roots;
+
+    template <typename X>
+    void map(X& x) {
+      BaseResponse::map(x);
+      x("roots", roots);
+    }
+  };
+
+  static Response handle(Client* client, const Request& req) {
+    Response res;
+    res.version = w_string{PACKAGE_VERSION, W_STRING_UNICODE};
+
+    std::vector<std::shared_ptr<Root>> roots;
+    if (auto& path = std::get<0>(req)) {
+      roots.push_back(resolveRootByName(client, path->c_str()));
+    } else {
+      auto map = watched_roots.rlock();
+      roots.reserve(map->size());
+      for (const auto& [_, root] : *map) {
+        roots.push_back(root);
+      }
+    }
+
+    for (auto& root : roots) {
+      RootQueryStats stats;
+      stats.root = root->root_path;
+      stats.commands = root->queryStats.getStats();
+      res.roots.push_back(std::move(stats));
+    }
+    return res;
+  }
+};
+WATCHMAN_COMMAND(debug_query_stats, DebugQueryStatsCommand);
+
+static UntypedResponse cmd_debug_query_log(
+    Client* client,
+    const json_ref& args) {
+  /* resolve the root */
+  if (json_array_size(args) != 2) {
+    throw ErrorResponse("wrong number of arguments for 'debug-query-log'");
+  }
+
+  auto root = resolveRoot(client, args);
+  if (!root->queryLog) {
+    throw ErrorResponse("the query log is disabled by query_log_size");
+  }
+
+  std::vector<json_ref> queries;
+  for (auto& entry : root->queryLog->readAll()) {
+    queries.push_back(entry.asJsonValue());
+  }
+
+  UntypedResponse resp;
+  resp.set("queries", json_array(std::move(queries)));
+  return resp;
+}
+W_CMD_REG(
+    "debug-query-log",
+    cmd_debug_query_log,
+    CMD_DAEMON,
+    w_cmd_realpath_root);
+
+struct DebugScmCommandServersCommand
+    : TypedCommand<DebugScmCommandServersCommand> {
+  static constexpr std::string_view name = "debug-scm-command-servers";
+  static constexpr CommandFlags flags = CMD_DAEMON;
+
+  using Request = serde::Array<1, w_string>;
+
+  struct Response : BaseResponse {
+    std::vector<CommandServerPoolStats> command_servers;
+
+    template <typename X>
+    void map(X& x) {
+      BaseResponse::map(x);
+      x("command_servers", command_servers);
+    }
+  };
+
+  static Response handle(Client* client, const Request& req) {
+    Response res;
+    res.version = w_string{PACKAGE_VERSION, W_STRING_UNICODE};
+    auto root = resolveRootByName(client, std::get<0>(req).c_str());
+    if (auto scm = root->view()->getSCM()) {
+      res.command_servers = scm->getCommandServerStats();
+    }
+    return res;
+  }
+};
+WATCHMAN_COMMAND(debug_scm_command_servers, DebugScmCommandServersCommand);
+
 static UntypedResponse cmd_debug_watcher_info(
     Client* clientbase,
     const json_ref& args) {
@@ -410,17 +534,24 @@ W_CMD_REG(
     CMD_DAEMON,
     nullptr);
 
+std::unordered_map<w_string, json_ref> cacheStatsFields(
+    const CacheStats& stats) {
+  return {
+      {w_string{"cacheHit"}, json_integer(stats.cacheHit)},
+      {w_string{"cacheShare"}, json_integer(stats.cacheShare)},
+      {w_string{"cacheMiss"}, json_integer(stats.cacheMiss)},
+      {w_string{"cacheEvict"}, json_integer(stats.cacheEvict)},
+      {w_string{"cacheStore"}, json_integer(stats.cacheStore)},
+      {w_string{"cacheLoad"}, json_integer(stats.cacheLoad)},
+      {w_string{"cacheErase"}, json_integer(stats.cacheErase)},
+      {w_string{"clearCount"}, json_integer(stats.clearCount)},
+      {w_string{"size"}, json_integer(stats.size)}};
+}
+
 void addCacheStats(UntypedResponse& resp, const CacheStats& stats) {
-  resp.set(
-      {{"cacheHit", json_integer(stats.cacheHit)},
-       {"cacheShare", json_integer(stats.cacheShare)},
-       {"cacheMiss", json_integer(stats.cacheMiss)},
-       {"cacheEvict", json_integer(stats.cacheEvict)},
-       {"cacheStore", json_integer(stats.cacheStore)},
-       {"cacheLoad", json_integer(stats.cacheLoad)},
-       {"cacheErase", json_integer(stats.cacheErase)},
-       {"clearCount", json_integer(stats.clearCount)},
-       {"size", json_integer(stats.size)}});
+  for (auto& [key, value] : cacheStatsFields(stats)) {
+    resp.insert_or_assign(key, value);
+  }
 }
 
 UntypedResponse debugContentHashCache(Client* client, const json_ref& args) {
@@ -436,9 +567,11 @@ UntypedResponse debugContentHashCache(Client* client, const json_ref& args) {
     throw ErrorResponse("root is not an InMemoryView watcher");
   }
 
-  auto stats = view->debugAccessCaches().contentHashCache.stats();
+  auto& cache = view->debugAccessCaches().contentHashCache;
   UntypedResponse resp;
-  addCacheStats(resp, stats);
+  // The top level fields describe the SHA-1 cache for compatibility.
+  addCacheStats(resp, cache.stats());
+  resp.set("blake3", json_object(cacheStatsFields(cache.blake3Stats())));
   return resp;
 }
 W_CMD_REG(
@@ -8,6 +8,7 @@
 #include "watchman/query/Query.h"
 #include "watchman/Client.h"
 #include "watchman/ClientContext.h"
+#include "watchman/DisconnectMonitor.h"
 #include "watchman/ProcessUtil.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
@@ -25,6 +26,7 @@ static UntypedResponse cmd_query(Client* client, const json_ref& args) {
   auto root = resolveRoot(client, args);
 
   const auto& query_spec = args.at(2);
+  checkPathFileAllowed(query_spec, client->client_is_owner);
   auto query = parseQuery(root, query_spec);
   auto clientPid = client->stm ? client->stm->getPeerProcessID() : 0;
   query->clientInfo.clientPid = clientPid;
@@ -36,6 +38,16 @@ static UntypedResponse cmd_query(Client* client, const json_ref& args) {
     query->sync_timeout = std::chrono::milliseconds(0);
   }
 
+  // Give up on the query, and on hashing files, for a client that has gone
+  // away.
+  folly::CancellationSource cancellation;
+  query->cancellationToken = cancellation.getToken();
+  DisconnectMonitor::Registration disconnectWatch;
+  if (client->stm) {
+    disconnectWatch = getDisconnectMonitor().watch(
+        client->stm->getFileDescriptor(), cancellation);
+  }
+
   auto res = w_query_execute(query.get(), root, nullptr, getInterface);
   UntypedResponse response;
   response.set(
@@ -7,6 +7,7 @@
 
 #include "watchman/Client.h"
 #include "watchman/ClientContext.h"
+#include "watchman/DisconnectMonitor.h"
 #include "watchman/ProcessUtil.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/eval.h"
@@ -41,6 +42,17 @@ static UntypedResponse cmd_since(Client* client, const json_ref& args) {
       ? std::make_optional(lookupProcessInfo(clientPid))
       : std::nullopt;
 
+  query->command = "since";
+
+  // Give up on the query for a client that has gone away.
+  folly::CancellationSource cancellation;
+  query->cancellationToken = cancellation.getToken();
+  DisconnectMonitor::Registration disconnectWatch;
+  if (client->stm) {
+    disconnectWatch = getDisconnectMonitor().watch(
+        client->stm->getFileDescriptor(), cancellation);
+  }
+
   auto res = w_query_execute(query.get(), root, nullptr, getInterface);
   UntypedResponse response;
   response.set(
@@ -13,6 +13,7 @@
 #include "watchman/MapUtil.h"
 #include "watchman/ProcessUtil.h"
 #include "watchman/QueryableView.h"
+#include "watchman/query/DeltaEncoding.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
@@ -240,6 +241,7 @@ std::optional<UntypedResponse> ClientSubscription::buildSubscriptionResults(
   // can use a short lock_timeout
   query->lock_timeout =
       uint32_t(root->config.getInt("subscription_lock_timeout_ms", 100));
+  query->command = "subscribe";
   logf(DBG, "running subscription {} {}\n", name, fmt::ptr(this));
 
   try {
@@ -287,10 +289,17 @@ std::optional<UntypedResponse> ClientSubscription::buildSubscriptionResults(
     }
     updateSubscriptionTicks(&res);
 
+    if (delta_encoding) {
+      response.set(
+          "files_delta",
+          w_string_to_json(encodeFilesDelta(
+              query->fieldList, res.resultsArray.results)));
+    } else {
+      response.set("files", std::move(res.resultsArray).toJson());
+    }
     response.set(
         {{"is_fresh_instance", json_boolean(res.isFreshInstance)},
          {"clock", res.clockAtStartOfQuery.toJson()},
-         {"files", std::move(res.resultsArray).toJson()},
          {"root", w_string_to_json(root->root_path)},
          {"subscription", w_string_to_json(name)},
          {"unilateral", json_true()}});
@@ -475,6 +484,8 @@ W_CMD_REG(
     CMD_DAEMON | CMD_ALLOW_ANY_USER,
     w_cmd_realpath_root);
 
+W_CAP_REG("subscribe-delta-encoding")
+
 /* subscribe /root subname {query}
  * Subscribes the client connection to the specified root. */
 static UntypedResponse cmd_subscribe(Client* clientbase, const json_ref& args) {
@@ -493,6 +504,7 @@ static UntypedResponse cmd_subscribe(Client* clientbase, const json_ref& args) {
 
   json_ref query_spec = args.at(3);
 
+  checkPathFileAllowed(query_spec, client->client_is_owner);
   auto query = parseQuery(root, query_spec);
   auto clientPid = client->stm ? client->stm->getPeerProcessID() : 0;
   query->clientInfo.clientPid = clientPid;
@@ -511,6 +523,26 @@ static UntypedResponse cmd_subscribe(Client* clientbase, const json_ref& args) {
     throw ErrorResponse("drop field must be an array of strings");
   }
 
+  bool delta_encoding = false;
+  if (auto encoding = query_spec.get_optional("encoding")) {
+    if (!encoding->isString()) {
+      throw ErrorResponse("encoding must be a string");
+    }
+    auto name = encoding->asString().view();
+    if (name == "delta") {
+      // The files are sent as a byte string, which JSON can't carry.
+      if (client->format.type != is_bser &&
+          client->format.type != is_bser_v2) {
+        throw ErrorResponse("the delta encoding requires the BSER protocol");
+      }
+      checkFilesDeltaFields(query->fieldList);
+      delta_encoding = true;
+    } else if (name != "files") {
+      throw ErrorResponse(
+          "encoding must be one of 'files' or 'delta', not '{}'", name);
+    }
+  }
+
   const std::vector<json_ref>* defer_array =
       defer_list ? &defer_list->array() : nullptr;
   const std::vector<json_ref>* drop_array =
@@ -539,6 +571,7 @@ static UntypedResponse cmd_subscribe(Client* clientbase, const json_ref& args) {
 
   sub->name = std::move(sub_name);
   sub->query = query;
+  sub->delta_encoding = delta_encoding;
 
   auto defer = query_spec.get_default("defer_vcs", json_true());
   if (!defer.isBool()) {
@@ -5,14 +5,30 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstdlib>
+#include <optional>
 #include "watchman/bser.h"
 
 extern "C" int LLVMFuzzerTestOneInput(void const* data, size_t size) {
   auto* d = reinterpret_cast<const char*>(data);
+  std::optional<json_ref> decoded;
   try {
-    bunser(d, d + size);
+    decoded = bunser(d, d + size);
   } catch (const BserParseError&) {
     // Caught parse errors are okay.
   }
+
+  // bunser_view must accept exactly the same documents, and decode them to
+  // the same values.
+  try {
+    auto view = bunser_view(d, d + size);
+    if (!decoded || !json_equal(*decoded, view.root().toJson())) {
+      abort();
+    }
+  } catch (const BserParseError&) {
+    if (decoded) {
+      abort();
+    }
+  }
   return 0;
 }
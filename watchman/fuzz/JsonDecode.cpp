@@ -5,13 +5,23 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstdlib>
 #include "watchman/thirdparty/jansson/jansson.h"
 
 extern "C" int LLVMFuzzerTestOneInput(void const* data, size_t size) {
   json_error_t err{};
+  json_error_t fastErr{};
   auto* d = reinterpret_cast<const char*>(data);
   try {
-    json_loadb(d, size, JSON_DECODE_ANY, &err);
+    auto expected = json_loadb(d, size, JSON_DECODE_ANY, &err);
+    auto actual = json_loadb_fast(d, size, JSON_DECODE_ANY, &fastErr);
+
+    // The fast decoder must accept exactly the same documents, and decode
+    // them to the same values.
+    if (expected.has_value() != actual.has_value() ||
+        (expected && !json_equal(*expected, *actual))) {
+      abort();
+    }
   } catch (std::exception&) {
     // Catchable exceptions are okay.
   }
@@ -112,6 +112,38 @@ class TestContentHash(WatchmanTestCase.WatchmanTestCase):
         )
         self.assertEqual(None, res["files"][0]["content.sha1hex"])
 
+    def test_blake3(self) -> None:
+        root = self.mkdtemp()
+
+        # BLAKE3 isn't in hashlib, so use a known digest
+        with open(os.path.join(root, "foo"), "wb") as f:
+            f.write(b"hello\n")
+        expect_hex = "8e4c7c1b99dbfd50e7a95185fead5ee1448fa904a2fdd778eaf5f2dbfd629a99"
+
+        self.watchmanCommand("watch", root)
+        self.assertFileList(root, ["foo"])
+
+        res = self.watchmanCommand(
+            "query",
+            root,
+            {"expression": ["name", "foo"], "fields": ["name", "content.blake3hex"]},
+        )
+        self.assertEqual(expect_hex, res["files"][0]["content.blake3hex"])
+
+        # The BLAKE3 hashes are cached separately from the SHA-1 hashes
+        stats = self.watchmanCommand("debug-contenthash", root)
+        self.assertEqual(stats["size"], 0)
+        self.assertEqual(stats["blake3"]["size"], 1)
+        self.assertEqual(stats["blake3"]["cacheStore"], 1)
+
+        os.mkdir(os.path.join(root, "dir"))
+        res = self.watchmanCommand(
+            "query",
+            root,
+            {"expression": ["name", "dir"], "fields": ["name", "content.blake3hex"]},
+        )
+        self.assertEqual(None, res["files"][0]["content.blake3hex"])
+
     def test_contentHashWarming(self) -> None:
         root = self.mkdtemp()
 
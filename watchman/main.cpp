@@ -17,6 +17,7 @@
 #include <folly/system/Shell.h>
 
 #include <stdio.h>
+#include <algorithm>
 #include <optional>
 
 #include "watchman/ChildProcess.h"
@@ -26,6 +27,7 @@
 #include "watchman/Command.h"
 #include "watchman/Connect.h"
 #include "watchman/GroupLookup.h"
+#include "watchman/HashingExecutor.h"
 #include "watchman/LogConfig.h"
 #include "watchman/Logging.h"
 #include "watchman/Options.h"
@@ -64,6 +66,8 @@ namespace {
 PduFormat server_format{is_bser, 0};
 /// How should output to stdout be encoded?
 PduFormat output_format{is_json_pretty, 0};
+/// The most log statements each thread may buffer, whatever the config says.
+constexpr json_int_t kMaxLogBufferSize = 1024 * 1024;
 } // namespace
 
 namespace {
@@ -198,11 +202,21 @@ std::optional<std::string> detect_starting_command(pid_t ppid) {
   }
 #endif
 
+  if (cfg_get_bool("log_async", false)) {
+    // Each thread allocates its buffer up front, so keep it sane.
+    getLog().startAsync(size_t(std::clamp<json_int_t>(
+        cfg_get_int("log_buffer_size", 4096), 1, kMaxLogBufferSize)));
+  }
+
   bool res = false;
   {
     watchman::getThreadPool().start(
         cfg_get_int("thread_pool_worker_threads", 16),
         cfg_get_int("thread_pool_max_items", 1024 * 1024));
+    watchman::getHashingExecutor().start(
+        cfg_get_int("content_hash_threads", 4),
+        cfg_get_int("content_hash_max_queued", 1024 * 1024),
+        cfg_get_int("content_hash_read_ahead", 4));
 
     ClockSpec::init();
     w_state_load();
@@ -215,6 +229,7 @@ std::optional<std::string> detect_starting_command(pid_t ppid) {
     cfg_shutdown();
   }
 
+  getLog().stopAsync();
   log(ERR, "Exiting from service with res=", res, "\n");
 
   if (res) {
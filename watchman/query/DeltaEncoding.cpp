@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/DeltaEncoding.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include "watchman/Errors.h"
+
+namespace watchman {
+
+namespace {
+
+enum class FieldKind {
+  Name,
+  // One byte, 0 or 1.
+  Flag,
+  // One byte, the letter the field renders as.
+  Letter,
+  Integer,
+  Double,
+};
+
+// Returns std::nullopt for the fields whose values have no fixed width.
+std::optional<FieldKind> fieldKind(std::string_view name) {
+  if (name == "name") {
+    return FieldKind::Name;
+  }
+  if (name == "exists" || name == "new") {
+    return FieldKind::Flag;
+  }
+  if (name == "type") {
+    return FieldKind::Letter;
+  }
+  if (name == "symlink_target" || name == "cclock" || name == "oclock" ||
+      name.substr(0, 8) == "content.") {
+    return std::nullopt;
+  }
+  if (name.size() > 2 && name.substr(name.size() - 2) == "_f") {
+    return FieldKind::Double;
+  }
+  return FieldKind::Integer;
+}
+
+size_t fieldWidth(FieldKind kind) {
+  switch (kind) {
+    case FieldKind::Name:
+      return 0;
+    case FieldKind::Flag:
+    case FieldKind::Letter:
+      return 1;
+    case FieldKind::Integer:
+    case FieldKind::Double:
+      return 8;
+  }
+  return 0;
+}
+
+void appendVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(char((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(char(value));
+}
+
+void appendLittleEndian(std::string& out, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back(char(value & 0xff));
+    value >>= 8;
+  }
+}
+
+void appendField(
+    std::string& out,
+    FieldKind kind,
+    const std::optional<json_ref>& value) {
+  bool present = value && !value->isNull();
+  switch (kind) {
+    case FieldKind::Name:
+      break;
+    case FieldKind::Flag:
+      out.push_back(present && value->isTrue() ? 1 : 0);
+      break;
+    case FieldKind::Letter:
+      out.push_back(
+          present && value->isString() && value->asString().size() > 0
+              ? value->asString().data()[0]
+              : 0);
+      break;
+    case FieldKind::Integer:
+      // Times in nanoseconds and inode numbers don't fit in a double.
+      if (present && value->isInt()) {
+        appendLittleEndian(out, uint64_t(value->asInt()));
+      } else {
+        appendLittleEndian(
+            out,
+            present && value->isNumber()
+                ? uint64_t(int64_t(json_number_value(*value)))
+                : 0);
+      }
+      break;
+    case FieldKind::Double: {
+      double number = present && value->isNumber()
+          ? json_number_value(*value)
+          : 0;
+      uint64_t bits;
+      static_assert(sizeof(bits) == sizeof(number));
+      memcpy(&bits, &number, sizeof(bits));
+      appendLittleEndian(out, bits);
+      break;
+    }
+  }
+}
+
+} // namespace
+
+void checkFilesDeltaFields(const QueryFieldList& fieldList) {
+  bool hasName = false;
+  for (auto* field : fieldList) {
+    auto kind = fieldKind(field->name.view());
+    if (!kind) {
+      QueryParseError::throwf(
+          "field '{}' cannot be delta encoded; its values have no fixed size",
+          field->name);
+    }
+    hasName = hasName || *kind == FieldKind::Name;
+  }
+  if (!hasName) {
+    throw QueryParseError("delta encoding requires the 'name' field");
+  }
+}
+
+size_t filesDeltaRecordSize(const QueryFieldList& fieldList) {
+  size_t size = 0;
+  for (auto* field : fieldList) {
+    if (auto kind = fieldKind(field->name.view())) {
+      size += fieldWidth(*kind);
+    }
+  }
+  return size;
+}
+
+w_string encodeFilesDelta(
+    const QueryFieldList& fieldList,
+    const std::vector<json_ref>& results) {
+  // With a single field, each result is its value rather than an object.
+  bool bareNames = fieldList.size() == 1;
+  auto nameOf = [&](const json_ref& result) -> std::string_view {
+    if (bareNames) {
+      return result.asString().view();
+    }
+    return result.get("name").asString().view();
+  };
+
+  std::vector<size_t> order(results.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return nameOf(results[a]) < nameOf(results[b]);
+  });
+
+  std::string out;
+  out.push_back(char(kFilesDeltaVersion));
+  appendVarint(out, results.size());
+
+  std::string_view previous;
+  for (auto i : order) {
+    auto name = nameOf(results[i]);
+    size_t shared = 0;
+    size_t limit = std::min(name.size(), previous.size());
+    while (shared < limit && name[shared] == previous[shared]) {
+      ++shared;
+    }
+    appendVarint(out, shared);
+    appendVarint(out, name.size() - shared);
+    out.append(name.substr(shared));
+    previous = name;
+  }
+
+  std::vector<FieldKind> kinds;
+  for (auto* field : fieldList) {
+    kinds.push_back(fieldKind(field->name.view()).value_or(FieldKind::Name));
+  }
+  out.reserve(out.size() + results.size() * filesDeltaRecordSize(fieldList));
+  for (auto i : order) {
+    auto& result = results[i];
+    for (size_t f = 0; f < fieldList.size(); ++f) {
+      if (kinds[f] == FieldKind::Name) {
+        continue;
+      }
+      appendField(
+          out,
+          kinds[f],
+          bareNames ? std::optional<json_ref>{}
+                    : result.get_optional(fieldList[f]->name.c_str()));
+    }
+  }
+
+  return w_string{out.data(), out.size(), W_STRING_BYTE};
+}
+
+} // namespace watchman
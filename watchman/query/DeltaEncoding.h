@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "watchman/query/Query.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+// The version of the format produced by encodeFilesDelta.
+constexpr uint8_t kFilesDeltaVersion = 1;
+
+/**
+ * Throws QueryParseError unless every field in fieldList can be packed
+ * into a fixed number of bytes by encodeFilesDelta, and "name" is one of
+ * them.
+ */
+void checkFilesDeltaFields(const QueryFieldList& fieldList);
+
+/**
+ * Returns how many bytes encodeFilesDelta packs the fields of each file
+ * into.
+ */
+size_t filesDeltaRecordSize(const QueryFieldList& fieldList);
+
+/**
+ * Encodes the rendered results of a query for fieldList into a compact
+ * byte string, for subscribers that want to know which files changed
+ * without decoding an object per file.
+ *
+ * All integers are little-endian. The string holds:
+ *
+ * - kFilesDeltaVersion, as a byte.
+ * - The number of files, as a varint.
+ * - The name of each file, sorted bytewise. Each name is front-coded
+ *   against the one before it: the length of the prefix they share, then
+ *   the length of the rest of the name, as varints, then the rest of the
+ *   name.
+ * - A record for each file, in the same order, of filesDeltaRecordSize
+ *   bytes. The record holds each field other than name, in the order they
+ *   were requested. exists and new are one byte, 0 or 1. type is one byte,
+ *   its letter. Fields ending in _f are doubles, and the rest are 64-bit
+ *   integers. Missing values are zero.
+ *
+ * Varints are unsigned LEB128.
+ */
+w_string encodeFilesDelta(
+    const QueryFieldList& fieldList,
+    const std::vector<json_ref>& results);
+
+} // namespace watchman
@@ -6,6 +6,7 @@
  */
 
 #include "watchman/query/FileResult.h"
+#include <stdexcept>
 
 namespace watchman {
 
@@ -19,4 +20,15 @@ std::optional<DType> FileResult::dtype() {
   return statInfo->dtype();
 }
 
+folly::SemiFuture<folly::Unit> FileResult::startBatchFetchProperties(
+    const std::vector<std::unique_ptr<FileResult>>& files) {
+  batchFetchProperties(files);
+  return folly::makeSemiFuture();
+}
+
+std::optional<FileResult::Blake3Hash> FileResult::getContentBlake3() {
+  throw std::runtime_error(
+      "content.blake3hex is not supported by this watcher");
+}
+
 } // namespace watchman
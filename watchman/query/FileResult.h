@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <folly/futures/Future.h>
 #include <optional>
 #include <vector>
 #include "watchman/Clock.h"
@@ -68,6 +69,11 @@ class FileResult {
   using ContentHash = std::array<uint8_t, 20>;
   virtual std::optional<ContentHash> getContentSha1() = 0;
 
+  // Returns the BLAKE3 hash of the file contents.
+  // The default implementation throws, for views that can't provide it.
+  using Blake3Hash = std::array<uint8_t, 32>;
+  virtual std::optional<Blake3Hash> getContentBlake3();
+
   // Maybe return the dtype.
   // Returns folly::none if the dtype is not currently known.
   // Returns DType::Unknown if we have dtype data but it doesn't
@@ -106,6 +112,8 @@ class FileResult {
     SymlinkTarget = 1 << 8,
     // Need full stat metadata
     FullFileInformation = 1 << 9,
+    // The getContentBlake3() method will be called
+    ContentBlake3 = 1 << 10,
   };
 
   // Perform a batch fetch to fill in some missing data.
@@ -127,6 +135,14 @@ class FileResult {
   virtual void batchFetchProperties(
       const std::vector<std::unique_ptr<FileResult>>& files) = 0;
 
+  // Like batchFetchProperties, but may return before the data has been
+  // fetched, so that the caller can carry on with other work. The returned
+  // future completes once it has been; until then the caller must keep
+  // the FileResults in `files` alive and not access them.
+  // The default implementation fetches the data before returning.
+  virtual folly::SemiFuture<folly::Unit> startBatchFetchProperties(
+      const std::vector<std::unique_ptr<FileResult>>& files);
+
  protected:
   // To be called by one of the FileResult accessors when it needs
   // to record which properties are required to satisfy the request.
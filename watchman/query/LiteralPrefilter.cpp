@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/LiteralPrefilter.h"
+#include <limits>
+#include <queue>
+
+namespace watchman {
+
+namespace {
+
+uint8_t fold(uint8_t c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A' + 'a';
+  }
+  if (c == '\\') {
+    return '/';
+  }
+  return c;
+}
+
+constexpr uint32_t kNoState = std::numeric_limits<uint32_t>::max();
+
+} // namespace
+
+LiteralPrefilter::LiteralPrefilter(const std::vector<std::string>& literals) {
+  if (literals.empty()) {
+    return;
+  }
+
+  std::array<uint8_t, 256> foldedClasses{};
+  numClasses_ = 1;
+  for (auto& literal : literals) {
+    for (char c : literal) {
+      auto& cls = foldedClasses[fold(uint8_t(c))];
+      if (cls == 0) {
+        cls = uint8_t(numClasses_++);
+      }
+    }
+  }
+  for (size_t c = 0; c < classes_.size(); ++c) {
+    classes_[c] = foldedClasses[fold(uint8_t(c))];
+  }
+
+  // Build the trie of the literals.
+  std::vector<uint32_t> next(numClasses_, kNoState);
+  std::vector<std::vector<uint32_t>> ends(1);
+  for (uint32_t id = 0; id < literals.size(); ++id) {
+    uint32_t state = 0;
+    for (char c : literals[id]) {
+      auto edge = state * numClasses_ + classes_[uint8_t(c)];
+      if (next[edge] == kNoState) {
+        next[edge] = uint32_t(ends.size());
+        ends.emplace_back();
+        next.resize(next.size() + numClasses_, kNoState);
+      }
+      state = next[edge];
+    }
+    ends[state].push_back(id);
+  }
+
+  // Turn it into an automaton, visiting states breadth first so that the
+  // state each one falls back to is complete before it is needed.
+  auto numStates = uint32_t(ends.size());
+  std::vector<uint32_t> fallback(numStates, 0);
+  std::queue<uint32_t> queue;
+  for (uint32_t cls = 0; cls < numClasses_; ++cls) {
+    auto& target = next[cls];
+    if (target == kNoState) {
+      target = 0;
+    } else {
+      queue.push(target);
+    }
+  }
+  while (!queue.empty()) {
+    auto state = queue.front();
+    queue.pop();
+    for (uint32_t cls = 0; cls < numClasses_; ++cls) {
+      auto& target = next[state * numClasses_ + cls];
+      auto viaFallback = next[fallback[state] * numClasses_ + cls];
+      if (target == kNoState) {
+        target = viaFallback;
+      } else {
+        fallback[target] = viaFallback;
+        auto& inherited = ends[viaFallback];
+        ends[target].insert(
+            ends[target].end(), inherited.begin(), inherited.end());
+        queue.push(target);
+      }
+    }
+  }
+
+  transitions_.resize(next.size());
+  for (size_t i = 0; i < next.size(); ++i) {
+    transitions_[i] = (next[i] << 1) | (ends[next[i]].empty() ? 0 : 1);
+  }
+  outputBegin_.reserve(numStates + 1);
+  for (auto& stateEnds : ends) {
+    outputBegin_.push_back(uint32_t(outputs_.size()));
+    outputs_.insert(outputs_.end(), stateEnds.begin(), stateEnds.end());
+  }
+  outputBegin_.push_back(uint32_t(outputs_.size()));
+}
+
+} // namespace watchman
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * Finds which of a set of literals occur in a string, in a single pass over
+ * it, using an Aho-Corasick automaton.
+ *
+ * Literals are compared ignoring ASCII case and treating '\' as '/', so a
+ * match means the string may match the pattern the literal came from, not
+ * that it does.
+ */
+class LiteralPrefilter {
+ public:
+  LiteralPrefilter() = default;
+
+  /**
+   * The index of each literal in `literals` is what forEachMatch reports
+   * when it is found. Literals must not be empty.
+   */
+  explicit LiteralPrefilter(const std::vector<std::string>& literals);
+
+  bool empty() const {
+    return transitions_.empty();
+  }
+
+  /**
+   * Calls fn with the index of each literal that occurs in subject, once
+   * per occurrence. Stops and returns true as soon as fn returns true.
+   */
+  template <typename Fn>
+  bool forEachMatch(w_string_piece subject, Fn&& fn) const {
+    if (empty()) {
+      return false;
+    }
+    uint32_t state = 0;
+    for (char c : subject) {
+      auto next = transitions_[state * numClasses_ + classes_[uint8_t(c)]];
+      state = next >> 1;
+      if (next & 1) {
+        for (auto i = outputBegin_[state]; i < outputBegin_[state + 1]; ++i) {
+          if (fn(outputs_[i])) {
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+ private:
+  // Maps each byte to the class of bytes that compare equal to it. Class 0
+  // holds the bytes that don't occur in any literal.
+  std::array<uint8_t, 256> classes_{};
+  uint32_t numClasses_{0};
+  // The state reached from each state on each class, shifted left by one,
+  // with the low bit set if the new state ends any literals.
+  std::vector<uint32_t> transitions_;
+  // The literals ending at state s are outputs_[outputBegin_[s]] up to
+  // outputs_[outputBegin_[s + 1]].
+  std::vector<uint32_t> outputBegin_;
+  std::vector<uint32_t> outputs_;
+};
+
+} // namespace watchman
@@ -112,6 +112,14 @@ std::optional<FileResult::ContentHash> LocalFileResult::getContentSha1() {
   return contentSha1_.value();
 }
 
+std::optional<FileResult::Blake3Hash> LocalFileResult::getContentBlake3() {
+  if (contentBlake3_.empty()) {
+    accessorNeedsProperties(FileResult::Property::ContentBlake3);
+    return std::nullopt;
+  }
+  return contentBlake3_.value();
+}
+
 void LocalFileResult::batchFetchProperties(
     const std::vector<std::unique_ptr<FileResult>>& files) {
   for (auto& f : files) {
@@ -138,6 +146,13 @@ void LocalFileResult::batchFetchProperties(
       });
     }
 
+    if (localFile->neededProperties() & FileResult::Property::ContentBlake3) {
+      localFile->contentBlake3_ = makeResultWith([&] {
+        return ContentHashCache::computeBlake3Immediate(
+            localFile->fullPath_.c_str());
+      });
+    }
+
     localFile->clearNeededProperties();
   }
 }
@@ -62,6 +62,8 @@ class LocalFileResult : public FileResult {
 
   // Returns the SHA-1 hash of the file contents
   std::optional<FileResult::ContentHash> getContentSha1() override;
+  // Returns the BLAKE3 hash of the file contents
+  std::optional<FileResult::Blake3Hash> getContentBlake3() override;
 
   void batchFetchProperties(
       const std::vector<std::unique_ptr<FileResult>>& files) override;
@@ -77,6 +79,7 @@ class LocalFileResult : public FileResult {
   CaseSensitivity caseSensitivity_;
   std::optional<ResolvedSymlink> symlinkTarget_;
   Result<FileResult::ContentHash> contentSha1_;
+  Result<FileResult::Blake3Hash> contentBlake3_;
 };
 
 } // namespace watchman
@@ -8,6 +8,7 @@
 #include "watchman/query/Query.h"
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/QueryExpr.h"
+#include "watchman/query/QueryPlan.h"
 
 namespace watchman {
 
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <folly/CancellationToken.h>
 #include <optional>
+#include <string_view>
 #include "watchman/ClientContext.h"
 #include "watchman/Clock.h"
 #include "watchman/fs/FileSystem.h"
@@ -20,6 +22,7 @@ class FileResult;
 struct GlobTree;
 struct QueryContext;
 class QueryExpr;
+class QueryPlan;
 
 struct QueryFieldRenderer {
   w_string name;
@@ -41,6 +44,13 @@ struct QueryPath {
   int depth;
 };
 
+enum class QueryPriority {
+  // A person is waiting for the results.
+  Interactive,
+  // Only run when no interactive query is waiting.
+  Batch,
+};
+
 struct Query {
   CaseSensitivity case_sensitive = CaseSensitivity::CaseInSensitive;
   bool fail_if_no_saved_state = false;
@@ -82,6 +92,12 @@ struct Query {
 
   uint32_t lock_timeout = 0;
 
+  // If set, the query is cancelled if it is still running this long after
+  // it started.
+  std::optional<std::chrono::milliseconds> deadline;
+
+  QueryPriority priority = QueryPriority::Interactive;
+
   // We can't (and mustn't!) evaluate the clockspec
   // fully until we execute query, because we have
   // to evaluate named cursors and determine fresh
@@ -89,16 +105,30 @@ struct Query {
   std::unique_ptr<ClockSpec> since_spec;
 
   std::unique_ptr<QueryExpr> expr;
+  // expr compiled for evaluation. Set whenever expr is.
+  std::unique_ptr<QueryPlan> plan;
 
   // The query that we parsed into this struct
   std::optional<json_ref> query_spec;
+  // Hash of query_spec for the root's query log, computed when the query is
+  // parsed so that a subscription doesn't serialize its spec on every run.
+  // Zero if the root has no query log.
+  uint64_t spec_hash{0};
 
   QueryFieldList fieldList;
 
   std::optional<w_string> request_id;
   std::optional<w_string> subscriptionName;
+  // The command that is running this query, for per-command statistics.
+  std::string_view command{"query"};
   ClientContext clientInfo{0, std::nullopt};
 
+  // Requested when the client that issued the query has disconnected.
+  // Expensive work done on its behalf, such as content hashing, checks this
+  // to avoid producing results that nobody will read, and the query itself
+  // stops with a QueryCancelledError; see QueryContext::checkCancelled().
+  folly::CancellationToken cancellationToken;
+
   bool alwaysIncludeDirectories{false};
 
   ~Query();
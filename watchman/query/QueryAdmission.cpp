@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryAdmission.h"
+#include <algorithm>
+#include <utility>
+#include <variant>
+#include "watchman/Errors.h"
+#include "watchman/query/GlobTree.h"
+
+namespace watchman {
+
+namespace {
+
+bool hasDoublestar(const GlobTree& node) {
+  if (!node.doublestar_children.empty()) {
+    return true;
+  }
+  return std::any_of(
+      node.children.begin(), node.children.end(), [](const auto& child) {
+        return hasDoublestar(*child);
+      });
+}
+
+} // namespace
+
+uint64_t estimateQueryCost(
+    const Query& query,
+    std::optional<int64_t> viewFiles,
+    bool sinceIsFresh) {
+  auto allFiles =
+      uint64_t(std::max<int64_t>(viewFiles.value_or(kAssumedViewFiles), 0));
+
+  bool sinceNarrows = query.since_spec &&
+      !std::holds_alternative<ClockSpec::Timestamp>(query.since_spec->spec) &&
+      !sinceIsFresh;
+  bool walksAll = !sinceNarrows && !query.paths && !query.glob_tree;
+  if (query.glob_tree && hasDoublestar(*query.glob_tree)) {
+    walksAll = true;
+  }
+
+  uint64_t files = 0;
+  if (query.paths) {
+    for (auto& path : *query.paths) {
+      if (path.name.empty()) {
+        // The root itself.
+        walksAll = true;
+      } else {
+        ++files;
+      }
+    }
+  }
+  if (walksAll) {
+    files = allFiles;
+  }
+
+  if (query.isFieldRequested("content.sha1hex") ||
+      query.isFieldRequested("content.blake3hex")) {
+    files *= kContentCostFactor;
+  }
+  return files;
+}
+
+QueryAdmissionController::Ticket::Ticket(Ticket&& other) noexcept
+    : controller_{std::exchange(other.controller_, nullptr)},
+      client_{other.client_} {}
+
+QueryAdmissionController::Ticket&
+QueryAdmissionController::Ticket::operator=(Ticket&& other) noexcept {
+  if (this != &other) {
+    if (controller_) {
+      controller_->release(client_);
+    }
+    controller_ = std::exchange(other.controller_, nullptr);
+    client_ = other.client_;
+  }
+  return *this;
+}
+
+QueryAdmissionController::Ticket::~Ticket() {
+  if (controller_) {
+    controller_->release(client_);
+  }
+}
+
+QueryAdmissionController::QueryAdmissionController(Limits limits)
+    : limits_{limits} {}
+
+bool QueryAdmissionController::hasCapacity(pid_t client) const {
+  if (limits_.maxConcurrent && running_ >= limits_.maxConcurrent) {
+    return false;
+  }
+  if (limits_.maxConcurrentPerClient) {
+    auto it = runningPerClient_.find(client);
+    if (it != runningPerClient_.end() &&
+        it->second >= limits_.maxConcurrentPerClient) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool QueryAdmissionController::isNext(
+    std::list<Waiter>::const_iterator waiter) const {
+  // A client at its own limit doesn't hold up the queries behind it.
+  for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+    if (hasCapacity(it->client)) {
+      return it == waiter;
+    }
+  }
+  return false;
+}
+
+QueryAdmissionController::Ticket QueryAdmissionController::admit(
+    pid_t client,
+    QueryPriority priority,
+    uint64_t cost,
+    std::optional<std::chrono::milliseconds> maxWait,
+    const folly::CancellationToken& cancellationToken) {
+  // Wakes the wait below if the caller gives up. Registered before the lock
+  // is taken, and so unregistered after it is released, because it takes
+  // the lock itself.
+  auto wake = [this] {
+    { std::lock_guard<std::mutex> lock{mutex_}; }
+    cond_.notify_all();
+  };
+  folly::CancellationCallback onCancel{cancellationToken, wake};
+  std::unique_lock<std::mutex> lock{mutex_};
+  if (cost < limits_.minCost) {
+    ++bypassed_;
+    return Ticket{};
+  }
+
+  auto position = queue_.end();
+  if (priority == QueryPriority::Interactive) {
+    position = std::find_if(queue_.begin(), queue_.end(), [](const Waiter& w) {
+      return w.priority == QueryPriority::Batch;
+    });
+  }
+  auto waiter = queue_.insert(position, Waiter{client, priority});
+
+  // The caller's limit only counts when it is the tighter one; running
+  // out of it isn't a rejection.
+  bool callerGaveUp = maxWait &&
+      (limits_.timeout.count() == 0 || *maxWait < limits_.timeout);
+  auto timeout = callerGaveUp ? *maxWait : limits_.timeout;
+
+  bool admitted = isNext(waiter);
+  if (!admitted) {
+    if (limits_.maxQueued && queue_.size() > limits_.maxQueued) {
+      queue_.erase(waiter);
+      ++rejected_;
+      QueryExecError::throwf(
+          "too many expensive queries are running; {} are already waiting, "
+          "and this query's estimated cost is {}",
+          queue_.size(),
+          cost);
+    }
+
+    auto ready = [&] {
+      return cancellationToken.isCancellationRequested() || isNext(waiter);
+    };
+    if (limits_.timeout.count() > 0 || maxWait) {
+      cond_.wait_for(lock, timeout, ready);
+    } else {
+      cond_.wait(lock, ready);
+    }
+    admitted =
+        !cancellationToken.isCancellationRequested() && isNext(waiter);
+    if (admitted) {
+      ++waited_;
+    }
+  }
+  queue_.erase(waiter);
+  // Whether or not we run, the queries behind us may now be able to.
+  cond_.notify_all();
+
+  if (!admitted && cancellationToken.isCancellationRequested()) {
+    QueryExecError::throwf(
+        "gave up waiting for other expensive queries to complete; the "
+        "query was cancelled");
+  }
+  if (!admitted) {
+    if (!callerGaveUp) {
+      ++rejected_;
+    }
+    QueryExecError::throwf(
+        "timed out after {}ms waiting for other expensive queries to "
+        "complete; this query's estimated cost is {}",
+        timeout.count(),
+        cost);
+  }
+
+  ++running_;
+  ++runningPerClient_[client];
+  ++admitted_;
+  return Ticket{this, client};
+}
+
+void QueryAdmissionController::release(pid_t client) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    --running_;
+    auto it = runningPerClient_.find(client);
+    if (--it->second == 0) {
+      runningPerClient_.erase(it);
+    }
+  }
+  cond_.notify_all();
+}
+
+QueryAdmissionStats QueryAdmissionController::getStats() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  QueryAdmissionStats stats;
+  stats.running = int64_t(running_);
+  stats.queued = int64_t(queue_.size());
+  stats.admitted = admitted_;
+  stats.bypassed = bypassed_;
+  stats.waited = waited_;
+  stats.rejected = rejected_;
+  return stats;
+}
+
+} // namespace watchman
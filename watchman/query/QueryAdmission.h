@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/CancellationToken.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "watchman/Serde.h"
+#include "watchman/query/Query.h"
+
+namespace watchman {
+
+// How many times more it costs to hash a file's contents than to walk it.
+constexpr uint64_t kContentCostFactor = 64;
+
+// How many files a view that can't count them is assumed to hold.
+constexpr int64_t kAssumedViewFiles = 1000000;
+
+/**
+ * Estimates the cost of running query against a view of viewFiles files,
+ * in units of files walked, before it runs.
+ *
+ * Queries that may walk the whole tree (those without a since clock, path
+ * or glob to narrow them, and ** globs) are assumed to walk viewFiles
+ * files, and each path is assumed to name a single file. Queries that hash
+ * the contents of the files they match cost kContentCostFactor times as
+ * much per file.
+ *
+ * Only a since clock that isn't a fresh instance narrows the walk, so
+ * sinceIsFresh must say whether it is. Timestamps can't be resolved
+ * without walking the view, so they narrow nothing either.
+ *
+ * If viewFiles is unknown, the view is assumed to hold kAssumedViewFiles.
+ */
+uint64_t estimateQueryCost(
+    const Query& query,
+    std::optional<int64_t> viewFiles,
+    bool sinceIsFresh);
+
+struct QueryAdmissionStats : serde::Object {
+  int64_t running = 0;
+  // Queries waiting for a turn to run.
+  int64_t queued = 0;
+  int64_t admitted = 0;
+  // Queries cheap enough to run without being limited.
+  int64_t bypassed = 0;
+  // Admitted queries that had to wait first.
+  int64_t waited = 0;
+  int64_t rejected = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("running", running);
+    x("queued", queued);
+    x("admitted", admitted);
+    x("bypassed", bypassed);
+    x("waited", waited);
+    x("rejected", rejected);
+  }
+};
+
+/**
+ * Limits how many expensive queries run against a root at once, overall
+ * and for each client, so that one client issuing full-tree content hash
+ * queries can't take the IO and hashing threads from everyone else.
+ *
+ * Queries over the limits queue, interactive ones ahead of batch ones, and
+ * are rejected if the queue is full or they wait too long.
+ */
+class QueryAdmissionController {
+ public:
+  struct Limits {
+    // Zero means unlimited.
+    size_t maxConcurrent{0};
+    size_t maxConcurrentPerClient{0};
+    size_t maxQueued{0};
+    // Queries estimated to cost less than this are always admitted.
+    uint64_t minCost{0};
+    // How long a query may wait to be admitted. Zero means forever.
+    std::chrono::milliseconds timeout{0};
+  };
+
+  /**
+   * Held while an admitted query runs.
+   */
+  class Ticket {
+   public:
+    Ticket() = default;
+    Ticket(Ticket&& other) noexcept;
+    Ticket& operator=(Ticket&& other) noexcept;
+    ~Ticket();
+
+   private:
+    friend class QueryAdmissionController;
+    Ticket(QueryAdmissionController* controller, pid_t client)
+        : controller_{controller}, client_{client} {}
+
+    QueryAdmissionController* controller_{nullptr};
+    pid_t client_{0};
+  };
+
+  explicit QueryAdmissionController(Limits limits);
+
+  /**
+   * Blocks until a query of the given cost from client may run, waiting no
+   * longer than maxWait, if given, even when the limits allow it to wait
+   * longer, and giving up as soon as cancellationToken is cancelled, so
+   * that a client that disconnects doesn't keep its place in the queue.
+   *
+   * Throws QueryExecError if the query is rejected, maxWait runs out or the
+   * wait is cancelled.
+   */
+  Ticket admit(
+      pid_t client,
+      QueryPriority priority,
+      uint64_t cost,
+      std::optional<std::chrono::milliseconds> maxWait = std::nullopt,
+      const folly::CancellationToken& cancellationToken = {});
+
+  QueryAdmissionStats getStats() const;
+
+ private:
+  struct Waiter {
+    pid_t client;
+    QueryPriority priority;
+  };
+
+  // Both require mutex_ to be held.
+  bool hasCapacity(pid_t client) const;
+  bool isNext(std::list<Waiter>::const_iterator waiter) const;
+
+  void release(pid_t client);
+
+  const Limits limits_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  size_t running_{0};
+  std::unordered_map<pid_t, size_t> runningPerClient_;
+  // Interactive queries first, each priority in arrival order.
+  std::list<Waiter> queue_;
+
+  int64_t admitted_{0};
+  int64_t bypassed_{0};
+  int64_t waited_{0};
+  int64_t rejected_{0};
+};
+
+} // namespace watchman
@@ -8,7 +8,9 @@
 #include "watchman/query/QueryContext.h"
 
 #include "folly/stop_watch.h"
+#include <algorithm>
 
+#include "watchman/Errors.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
@@ -19,7 +21,15 @@ using namespace watchman;
 
 namespace {
 
-constexpr size_t kMaximumRenderBatchSize = 1024;
+// Files whose data must be fetched are collected into batches of between
+// these sizes. See QueryContext::startFetch.
+constexpr size_t kMinimumFetchBatchSize = 256;
+constexpr size_t kInitialFetchBatchSize = 1024;
+constexpr size_t kMaximumFetchBatchSize = 20480;
+
+// How many batches of files to evaluate, and how many to render, may be
+// fetched at once.
+constexpr size_t kMaximumFetchesInFlight = 4;
 
 std::optional<json_ref> file_result_to_json(
     const QueryFieldList& fieldList,
@@ -50,7 +60,7 @@ void QueryContext::resetWholeName() {
 
 const w_string& QueryContext::getWholeName() {
   if (!wholename_) {
-    wholename_ = computeWholeName(file.get());
+    wholename_ = computeWholeName(file);
   }
   return *wholename_;
 }
@@ -104,7 +114,11 @@ bool QueryContext::fileMatchesRelativeRoot(const watchman_file* f) {
     return true;
   }
 
-  return dirMatchesRelativeRoot(f->parent->getFullPath());
+  if (f->parent != relativeRootDir_) {
+    relativeRootDir_ = f->parent;
+    relativeRootDirMatches_ = dirMatchesRelativeRoot(f->parent->getFullPath());
+  }
+  return relativeRootDirMatches_;
 }
 
 QueryContext::QueryContext(
@@ -114,32 +128,124 @@ QueryContext::QueryContext(
     : created(std::chrono::steady_clock::now()),
       query(q),
       root(root),
-      disableFreshInstance{disableFreshInstance} {}
-
-void QueryContext::addToEvalBatch(std::unique_ptr<FileResult>&& file) {
-  evalBatch_.emplace_back(std::move(file));
+      disableFreshInstance{disableFreshInstance},
+      fetchBatchSize_{kInitialFetchBatchSize} {
+  if (q->deadline) {
+    deadline_ = created + *q->deadline;
+  }
+}
 
-  // Find a balance between local memory usage, latency in fetching
-  // and the cost of fetching the data needed to re-evaluate this batch.
-  // TODO: maybe allow passing this number in via the query?
-  if (evalBatch_.size() >= 20480) {
-    fetchEvalBatchNow();
+QueryContext::~QueryContext() {
+  // If the query failed, fetches may still be filling in their files.
+  for (auto* inFlight : {&evalFetches_, &renderFetches_}) {
+    for (auto& fetch : *inFlight) {
+      std::move(fetch.fetched).wait();
+    }
   }
 }
 
-void QueryContext::fetchEvalBatchNow() {
-  if (evalBatch_.empty()) {
+void QueryContext::throwIfCancelled() {
+  const char* reason;
+  if (query->cancellationToken.isCancellationRequested()) {
+    reason = "the client disconnected";
+    root->cancelledQueries.disconnected.fetch_add(1, std::memory_order_relaxed);
+  } else if (deadline_ && std::chrono::steady_clock::now() >= *deadline_) {
+    reason = "its deadline passed";
+    root->cancelledQueries.deadlineExceeded.fetch_add(
+        1, std::memory_order_relaxed);
+  } else {
     return;
   }
+  root->cancelledQueries.filesWalked.fetch_add(
+      numWalked_, std::memory_order_relaxed);
+  throw QueryCancelledError{fmt::format(
+      "cancelled because {}, after walking {} files", reason, numWalked_)};
+}
+
+std::optional<std::chrono::milliseconds> QueryContext::timeUntilDeadline()
+    const {
+  if (!deadline_) {
+    return std::nullopt;
+  }
+  return std::max(
+      std::chrono::milliseconds{0},
+      std::chrono::ceil<std::chrono::milliseconds>(
+          *deadline_ - std::chrono::steady_clock::now()));
+}
+
+std::vector<std::unique_ptr<FileResult>> QueryContext::startFetch(
+    std::vector<std::unique_ptr<FileResult>>& batch,
+    std::deque<Fetch>& inFlight) {
   folly::stop_watch<std::chrono::microseconds> timer;
-  evalBatch_.front()->batchFetchProperties(evalBatch_);
+  Fetch fetch{std::move(batch), {}};
+  batch.clear();
+  fetch.fetched = fetch.files.front()->startBatchFetchProperties(fetch.files);
   edenFilePropertiesDurationUs.fetch_add(timer.elapsed().count());
+  ++numFetchBatches_;
+
+  // Find a balance between local memory usage, latency in fetching
+  // and the cost of fetching the data needed for this batch.
+  if (fetch.fetched.isReady()) {
+    // The data was fetched before it returned, so nothing overlaps the
+    // fetch; make as few of them as possible, and don't hold on to the
+    // files while other batches are fetched.
+    fetchBatchSize_ = kMaximumFetchBatchSize;
+    std::move(fetch.fetched).get();
+    return std::move(fetch.files);
+  }
+  inFlight.push_back(std::move(fetch));
+  if (inFlight.size() <= kMaximumFetchesInFlight) {
+    return {};
+  }
+
+  if (inFlight.front().fetched.isReady()) {
+    // Fetches are keeping up; smaller batches get their files processed
+    // sooner.
+    fetchBatchSize_ = std::max(kMinimumFetchBatchSize, fetchBatchSize_ / 2);
+  } else {
+    // We're about to wait for a fetch; keep more files in flight.
+    fetchBatchSize_ = std::min(kMaximumFetchBatchSize, fetchBatchSize_ * 2);
+  }
+  return finishFetch(inFlight);
+}
+
+std::vector<std::unique_ptr<FileResult>> QueryContext::finishFetch(
+    std::deque<Fetch>& inFlight) {
+  throwIfCancelled();
+  auto fetch = std::move(inFlight.front());
+  inFlight.pop_front();
 
-  auto toProcess = std::move(evalBatch_);
+  folly::stop_watch<std::chrono::microseconds> timer;
+  std::move(fetch.fetched).get();
+  auto waited = timer.elapsed();
+  fetchWait_ += waited;
+  edenFilePropertiesDurationUs.fetch_add(waited.count());
+
+  return std::move(fetch.files);
+}
 
-  for (auto& file : toProcess) {
+void QueryContext::processEvalBatch(
+    std::vector<std::unique_ptr<FileResult>> files) {
+  for (auto& file : files) {
     w_query_process_file(query, this, std::move(file));
   }
+}
+
+void QueryContext::addToEvalBatch(std::unique_ptr<FileResult>&& file) {
+  evalBatch_.emplace_back(std::move(file));
+
+  if (evalBatch_.size() >= fetchBatchSize_) {
+    processEvalBatch(startFetch(evalBatch_, evalFetches_));
+  }
+}
+
+void QueryContext::fetchEvalBatchNow() {
+  if (!evalBatch_.empty()) {
+    processEvalBatch(startFetch(evalBatch_, evalFetches_));
+  }
+  while (!evalFetches_.empty()) {
+    processEvalBatch(finishFetch(evalFetches_));
+  }
 
   w_assert(evalBatch_.empty(), "should have no files that NeedDataLoad");
 }
@@ -165,24 +271,14 @@ void QueryContext::maybeRender(std::unique_ptr<FileResult>&& file) {
 
 void QueryContext::addToRenderBatch(std::unique_ptr<FileResult>&& file) {
   renderBatch_.emplace_back(std::move(file));
-  // TODO: maybe allow passing this number in via the query?
-  if (renderBatch_.size() >= kMaximumRenderBatchSize) {
-    fetchRenderBatchNow();
+  if (renderBatch_.size() >= fetchBatchSize_) {
+    renderFetchedBatch(startFetch(renderBatch_, renderFetches_));
   }
 }
 
-bool QueryContext::fetchRenderBatchNow() {
-  if (renderBatch_.empty()) {
-    return true;
-  }
-
-  folly::stop_watch<std::chrono::microseconds> timer;
-  renderBatch_.front()->batchFetchProperties(renderBatch_);
-  edenFilePropertiesDurationUs.fetch_add(timer.elapsed().count());
-
-  auto toProcess = std::move(renderBatch_);
-
-  for (auto& file : toProcess) {
+void QueryContext::renderFetchedBatch(
+    std::vector<std::unique_ptr<FileResult>> files) {
+  for (auto& file : files) {
     auto maybeRendered = file_result_to_json(query->fieldList, file, this);
     if (maybeRendered.has_value()) {
       resultsArray.push_back(std::move(maybeRendered.value()));
@@ -190,6 +286,21 @@ bool QueryContext::fetchRenderBatchNow() {
       renderBatch_.emplace_back(std::move(file));
     }
   }
+}
+
+bool QueryContext::fetchRenderBatchNow() {
+  if (renderBatch_.empty() && renderFetches_.empty()) {
+    return true;
+  }
+
+  if (!renderBatch_.empty()) {
+    renderFetchedBatch(startFetch(renderBatch_, renderFetches_));
+  }
+  // Render each batch as soon as it arrives, while the later ones are
+  // still being fetched.
+  while (!renderFetches_.empty()) {
+    renderFetchedBatch(finishFetch(renderFetches_));
+  }
 
   return renderBatch_.empty();
 }
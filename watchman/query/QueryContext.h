@@ -7,12 +7,15 @@
 
 #pragma once
 
+#include <folly/futures/Future.h>
 #include <folly/stop_watch.h>
+#include <deque>
 #include <unordered_set>
 #include "watchman/Clock.h"
 #include "watchman/query/QueryExpr.h"
 #include "watchman/query/QueryResult.h"
 
+struct watchman_dir;
 struct watchman_file;
 
 namespace watchman {
@@ -23,6 +26,7 @@ class Root;
 
 enum class QueryContextState {
   NotStarted,
+  WaitingForAdmission,
   WaitingForCookieSync,
   WaitingForViewLock,
   Generating,
@@ -33,31 +37,37 @@ enum class QueryContextState {
 // Holds state for the execution of a query
 struct QueryContext : QueryContextBase {
   std::chrono::time_point<std::chrono::steady_clock> created;
-  folly::stop_watch<std::chrono::milliseconds> stopWatch;
+  folly::stop_watch<std::chrono::microseconds> stopWatch;
   std::atomic<QueryContextState> state{QueryContextState::NotStarted};
-  std::atomic<std::chrono::milliseconds> cookieSyncDuration{
-      std::chrono::milliseconds(0)};
-  std::atomic<std::chrono::milliseconds> viewLockWaitDuration{
-      std::chrono::milliseconds(0)};
-  std::atomic<std::chrono::milliseconds> generationDuration{
-      std::chrono::milliseconds(0)};
-  std::atomic<std::chrono::milliseconds> renderDuration{
-      std::chrono::milliseconds(0)};
+  std::atomic<std::chrono::microseconds> cookieSyncDuration{
+      std::chrono::microseconds(0)};
+  std::atomic<std::chrono::microseconds> viewLockWaitDuration{
+      std::chrono::microseconds(0)};
+  std::atomic<std::chrono::microseconds> generationDuration{
+      std::chrono::microseconds(0)};
+  std::atomic<std::chrono::microseconds> renderDuration{
+      std::chrono::microseconds(0)};
   std::atomic<int64_t> edenGlobFilesDurationUs{0};
   std::atomic<int64_t> edenChangedFilesDurationUs{0};
   std::atomic<int64_t> edenFilePropertiesDurationUs{0};
   std::atomic<int64_t> scmFilesChangedSinceMergebaseWithDurationUs{0};
+  // From estimateQueryCost(), if the root limits expensive queries.
+  std::atomic<uint64_t> estimatedCost{0};
   std::string generatorType;
   std::string freshInstanceCause;
 
   void generationStarted() {
     viewLockWaitDuration = stopWatch.lap();
     state = QueryContextState::Generating;
+    // The view may have changed since the last generator released it.
+    relativeRootDir_ = nullptr;
   }
 
   const Query* query;
   std::shared_ptr<Root> root;
-  std::unique_ptr<FileResult> file;
+  // The file being evaluated by w_query_process_file, if any. Owned by its
+  // caller.
+  FileResult* file{nullptr};
   QuerySince since;
 
   // Rendered results
@@ -87,7 +97,7 @@ struct QueryContext : QueryContextBase {
   QueryContext& operator=(const QueryContext&) = delete;
   QueryContext(QueryContext&&) = delete;
   QueryContext& operator=(QueryContext&&) = delete;
-  ~QueryContext() override = default;
+  ~QueryContext() override;
 
   // Increment numWalked_ by the specified amount
   inline void bumpNumWalked(int64_t amount = 1) {
@@ -98,6 +108,23 @@ struct QueryContext : QueryContextBase {
     return numWalked_;
   }
 
+  // Throws QueryCancelledError if the client that issued the query has
+  // disconnected or the query's deadline has passed. Only looks every
+  // kCancellationCheckInterval calls, so generators can call this for each
+  // file they walk.
+  void checkCancelled() {
+    if (++cancellationChecks_ % kCancellationCheckInterval == 0) {
+      throwIfCancelled();
+    }
+  }
+
+  // Like checkCancelled(), but looks on every call.
+  void throwIfCancelled();
+
+  // How long is left until the query's deadline, if it has one, rounded
+  // up to a whole millisecond. Zero once it has passed.
+  std::optional<std::chrono::milliseconds> timeUntilDeadline() const;
+
   void resetWholeName();
 
   /**
@@ -117,25 +144,41 @@ struct QueryContext : QueryContextBase {
 
   // Adds `file` to the currently accumulating batch of files
   // that require data to be loaded.
-  // If the batch is large enough, this will trigger `fetchEvalBatchNow()`.
+  // If the batch is large enough, this starts fetching its data, and
+  // generation carries on while it is fetched.
   // This is intended to be called for files that still having
   // their expression cause evaluated during w_query_process_file().
   void addToEvalBatch(std::unique_ptr<FileResult>&& file);
 
-  // Perform an immediate fetch of data for the items in the
-  // evalBatch_ set, and then re-evaluate each of them by passing
-  // them to w_query_process_file().
+  // Fetch the data for the items in the evalBatch_ set and any
+  // batches still being fetched, and then re-evaluate each of them by
+  // passing them to w_query_process_file().
   void fetchEvalBatchNow();
 
   void maybeRender(std::unique_ptr<FileResult>&& file);
   void addToRenderBatch(std::unique_ptr<FileResult>&& file);
 
-  // Perform a batch load of the items in the render batch,
-  // and attempt to render those items again.
+  // Perform a batch load of the items in the render batch and any
+  // batches still being fetched, and attempt to render those items again.
   // Returns true if the render batch is empty after rendering
   // the items, false if still more data is needed.
   bool fetchRenderBatchNow();
 
+  // How many files are collected before their data is fetched. Adjusted
+  // as the query runs: see startFetch().
+  size_t getFetchBatchSize() const {
+    return fetchBatchSize_;
+  }
+
+  uint64_t getNumFetchBatches() const {
+    return numFetchBatches_;
+  }
+
+  // Time spent waiting for batch fetches to complete.
+  std::chrono::microseconds getFetchWaitDuration() const {
+    return fetchWait_;
+  }
+
   w_string computeWholeName(FileResult* file) const;
 
   // Returns true if the filename associated with `f` matches
@@ -161,6 +204,37 @@ struct QueryContext : QueryContextBase {
   // Number of files considered as part of running this query
   int64_t numWalked_{0};
 
+  static constexpr uint32_t kCancellationCheckInterval = 256;
+  uint32_t cancellationChecks_{0};
+  std::optional<std::chrono::steady_clock::time_point> deadline_;
+
+  // The parent of the last file passed to fileMatchesRelativeRoot, and
+  // whether it matched. Files in the same dir are often adjacent in the
+  // recency index, so this saves building the path of most of them.
+  const watchman_dir* relativeRootDir_{nullptr};
+  bool relativeRootDirMatches_{false};
+
+  struct Fetch {
+    std::vector<std::unique_ptr<FileResult>> files;
+    folly::SemiFuture<folly::Unit> fetched;
+  };
+
+  // Starts fetching the data for batch, which is left empty. If the data
+  // was fetched before it returned, returns the batch's files. Otherwise,
+  // if that leaves too many fetches in flight, waits for the oldest and
+  // returns its files; otherwise returns an empty vector. Grows the batch
+  // size when fetches can't keep up and shrinks it when they can.
+  std::vector<std::unique_ptr<FileResult>> startFetch(
+      std::vector<std::unique_ptr<FileResult>>& batch,
+      std::deque<Fetch>& inFlight);
+
+  // Waits for the oldest fetch in inFlight and returns its files.
+  std::vector<std::unique_ptr<FileResult>> finishFetch(
+      std::deque<Fetch>& inFlight);
+
+  void processEvalBatch(std::vector<std::unique_ptr<FileResult>> files);
+  void renderFetchedBatch(std::vector<std::unique_ptr<FileResult>> files);
+
   // Files for which we encountered NeedMoreData and that we
   // will re-evaluate once we have enough of them accumulated
   // to batch fetch the required data
@@ -171,6 +245,14 @@ struct QueryContext : QueryContextBase {
   // expression and are just pending data to be loaded
   // for rendering the result fields.
   std::vector<std::unique_ptr<FileResult>> renderBatch_;
+
+  // Batches whose data is being fetched, oldest first.
+  std::deque<Fetch> evalFetches_;
+  std::deque<Fetch> renderFetches_;
+
+  size_t fetchBatchSize_;
+  uint64_t numFetchBatches_{0};
+  std::chrono::microseconds fetchWait_{0};
 };
 
 } // namespace watchman
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <optional>
+#include <string>
 #include <vector>
 #include "watchman/Clock.h"
 #include "watchman/fs/FileDescriptor.h"
@@ -17,6 +18,7 @@ namespace watchman {
 
 using EvaluateResult = std::optional<bool>;
 class FileResult;
+class QueryPlanBuilder;
 
 class QueryContextBase {
  public:
@@ -43,6 +45,36 @@ enum AggregateOp {
   AllOf,
 };
 
+/**
+ * A rough ranking of how expensive a term is to evaluate against one file.
+ * The terms of allof and anyof are evaluated cheapest first, so that cheap
+ * terms can spare the evaluation of expensive ones.
+ */
+enum class EvaluationCost : uint8_t {
+  // Doesn't look at the file.
+  Constant,
+  // Looks at the basename of the file.
+  BaseName,
+  // Looks at metadata, which some views have to fetch.
+  Metadata,
+  // Looks at the name relative to the root, which is built on demand.
+  WholeName,
+  // Runs a pattern matcher.
+  Pattern,
+};
+
+/**
+ * Describes a term that matches a pattern against the name of a file.
+ */
+struct RequiredLiteral {
+  // Whether the pattern applies to the wholename rather than the basename.
+  bool wholename;
+  // A string that every matching name contains, or empty if the pattern
+  // doesn't require one. Only ASCII, and it may differ from the name in the
+  // case of its letters and the direction of its slashes.
+  std::string literal;
+};
+
 /**
  * Describes which part of a simple suffix expression
  */
@@ -53,6 +85,30 @@ class QueryExpr {
   virtual ~QueryExpr() = default;
   virtual EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) = 0;
 
+  /**
+   * How expensive this expression is to evaluate. Terms whose cost varies
+   * report their worst case.
+   */
+  virtual EvaluationCost evaluationCost() const {
+    return EvaluationCost::Pattern;
+  }
+
+  /**
+   * Adds this expression to a QueryPlan. Most terms are evaluated as they
+   * are and don't need to override this; allof, anyof, not and the
+   * constants describe themselves so that the plan can simplify them.
+   */
+  virtual void addToPlan(QueryPlanBuilder& builder);
+
+  /**
+   * Pattern matching terms return the literal that the names they match
+   * contain, so that an anyof of many patterns only runs the ones that can
+   * match. Such terms must only look at the name, and never need data.
+   */
+  virtual std::optional<RequiredLiteral> requiredLiteral() const {
+    return std::nullopt;
+  }
+
   // If OTHER can be aggregated with THIS, returns a new expression instance
   // representing the combined state.  Op provides information on the containing
   // query and can be used to determine how aggregation is done.
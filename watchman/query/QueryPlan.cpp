@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryPlan.h"
+#include <folly/lang/Assume.h>
+#include <algorithm>
+#include <iterator>
+#include "watchman/query/FileResult.h"
+#include "watchman/query/LiteralPrefilter.h"
+
+namespace watchman {
+
+namespace {
+
+// Below this many patterns, running each of them is about as fast as
+// looking for their literals.
+constexpr size_t kMinPatternSetTerms = 4;
+
+} // namespace
+
+/**
+ * An anyof of pattern matching terms, which only evaluates the terms whose
+ * required literal occurs in the name. Terms that don't require a literal
+ * are always evaluated, after the others.
+ *
+ * Like the pcre term, this keeps scratch state for the evaluation, which
+ * must not run concurrently for the same plan.
+ */
+class QueryPlan::PatternSet {
+ public:
+  explicit PatternSet(
+      std::vector<std::pair<QueryExpr*, RequiredLiteral>> terms) {
+    std::vector<std::string> baseNameLiterals;
+    std::vector<std::string> wholeNameLiterals;
+    for (auto& [term, required] : terms) {
+      if (required.literal.empty()) {
+        unfiltered_.push_back(term);
+      } else if (required.wholename) {
+        wholeName_.terms.push_back(term);
+        wholeNameLiterals.push_back(std::move(required.literal));
+      } else {
+        baseName_.terms.push_back(term);
+        baseNameLiterals.push_back(std::move(required.literal));
+      }
+    }
+    baseName_.prefilter = LiteralPrefilter{baseNameLiterals};
+    wholeName_.prefilter = LiteralPrefilter{wholeNameLiterals};
+    wholeName_.offset = uint32_t(baseName_.terms.size());
+    triedIn_.resize(baseName_.terms.size() + wholeName_.terms.size());
+  }
+
+  size_t size() const {
+    return baseName_.terms.size() + wholeName_.terms.size() +
+        unfiltered_.size();
+  }
+
+  EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) const {
+    if (++generation_ == 0) {
+      std::fill(triedIn_.begin(), triedIn_.end(), 0);
+      generation_ = 1;
+    }
+    if (matchAny(baseName_, file->baseName(), ctx, file)) {
+      return true;
+    }
+    if (!wholeName_.terms.empty() &&
+        matchAny(wholeName_, ctx->getWholeName(), ctx, file)) {
+      return true;
+    }
+    for (auto* term : unfiltered_) {
+      if (term->evaluate(ctx, file) == true) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  struct Scope {
+    LiteralPrefilter prefilter;
+    // Indexed by the ids the prefilter reports.
+    std::vector<QueryExpr*> terms;
+    // Where the entries of these terms start in triedIn_.
+    uint32_t offset{0};
+  };
+
+  bool matchAny(
+      const Scope& scope,
+      w_string_piece name,
+      QueryContextBase* ctx,
+      FileResult* file) const {
+    return scope.prefilter.forEachMatch(name, [&](uint32_t id) {
+      // A literal can occur more than once in the name, but each term only
+      // needs to be evaluated once.
+      auto& tried = triedIn_[scope.offset + id];
+      if (tried == generation_) {
+        return false;
+      }
+      tried = generation_;
+      return scope.terms[id]->evaluate(ctx, file) == true;
+    });
+  }
+
+  Scope baseName_;
+  Scope wholeName_;
+  std::vector<QueryExpr*> unfiltered_;
+  // The generation in which each filtered term was last evaluated.
+  mutable std::vector<uint32_t> triedIn_;
+  mutable uint32_t generation_{0};
+};
+
+void QueryExpr::addToPlan(QueryPlanBuilder& builder) {
+  builder.addTerm(*this);
+}
+
+QueryPlan::QueryPlan(QueryExpr& expr) {
+  QueryPlanBuilder builder;
+  expr.addToPlan(builder);
+  *this = std::move(builder).build();
+}
+
+QueryPlan::QueryPlan(QueryPlan&&) noexcept = default;
+QueryPlan& QueryPlan::operator=(QueryPlan&&) noexcept = default;
+QueryPlan::~QueryPlan() = default;
+
+size_t QueryPlan::numTerms() const {
+  size_t terms = 0;
+  for (auto& node : nodes_) {
+    if (node.op == Op::Term) {
+      ++terms;
+    } else if (node.op == Op::PatternSet) {
+      terms += node.patternSet->size();
+    }
+  }
+  return terms;
+}
+
+EvaluateResult QueryPlan::evaluate(
+    const Node* node,
+    QueryContextBase* ctx,
+    FileResult* file) {
+  switch (node->op) {
+    case Op::Term:
+      return node->expr->evaluate(ctx, file);
+    case Op::True:
+      return true;
+    case Op::False:
+      return false;
+    case Op::Not: {
+      auto res = evaluate(node + 1, ctx, file);
+      if (!res.has_value()) {
+        return res;
+      }
+      return !*res;
+    }
+    case Op::AllOf:
+    case Op::AnyOf: {
+      // allof stops at the first term that doesn't match, and anyof at the
+      // first that does, even if earlier terms need more data.
+      bool allof = node->op == Op::AllOf;
+      bool needData = false;
+      const Node* end = node + node->size;
+      for (const Node* child = node + 1; child < end; child += child->size) {
+        auto res = evaluate(child, ctx, file);
+        if (!res.has_value()) {
+          needData = true;
+        } else if (*res != allof) {
+          return *res;
+        }
+      }
+      if (needData) {
+        return std::nullopt;
+      }
+      return allof;
+    }
+    case Op::PatternSet:
+      return node->patternSet->evaluate(ctx, file);
+  }
+  folly::assume_unreachable();
+}
+
+QueryPlanBuilder::QueryPlanBuilder() = default;
+QueryPlanBuilder::~QueryPlanBuilder() = default;
+
+std::vector<QueryPlan::Node> QueryPlanBuilder::compile(QueryExpr& expr) {
+  QueryPlanBuilder builder;
+  expr.addToPlan(builder);
+  std::move(
+      builder.patternSets_.begin(),
+      builder.patternSets_.end(),
+      std::back_inserter(patternSets_));
+  return std::move(builder.nodes_);
+}
+
+void QueryPlanBuilder::addTerm(QueryExpr& expr) {
+  nodes_.push_back(Node{Op::Term, expr.evaluationCost(), 1, &expr});
+}
+
+void QueryPlanBuilder::addConstant(bool value) {
+  nodes_.push_back(
+      Node{value ? Op::True : Op::False, EvaluationCost::Constant, 1, nullptr});
+}
+
+void QueryPlanBuilder::addNot(QueryExpr& expr) {
+  auto operand = compile(expr);
+  switch (operand.front().op) {
+    case Op::True:
+      addConstant(false);
+      return;
+    case Op::False:
+      addConstant(true);
+      return;
+    case Op::Not:
+      nodes_.insert(nodes_.end(), operand.begin() + 1, operand.end());
+      return;
+    default:
+      nodes_.push_back(Node{
+          Op::Not,
+          operand.front().cost,
+          uint32_t(operand.size() + 1),
+          nullptr});
+      nodes_.insert(nodes_.end(), operand.begin(), operand.end());
+  }
+}
+
+void QueryPlanBuilder::addList(
+    AggregateOp aggregateOp,
+    const std::vector<std::unique_ptr<QueryExpr>>& exprs) {
+  bool allof = aggregateOp == AggregateOp::AllOf;
+  auto op = allof ? Op::AllOf : Op::AnyOf;
+
+  std::vector<std::vector<Node>> operands;
+  auto addOperand = [&](std::vector<Node>::const_iterator begin) {
+    operands.emplace_back(begin, begin + begin->size);
+  };
+
+  for (auto& expr : exprs) {
+    auto operand = compile(*expr);
+    auto& head = operand.front();
+    if (head.op == Op::True || head.op == Op::False) {
+      if ((head.op == Op::True) == allof) {
+        // true doesn't change the result of allof, nor false of anyof.
+        continue;
+      }
+      // false decides allof, and true decides anyof.
+      addConstant(!allof);
+      return;
+    }
+    if (head.op == op) {
+      for (auto it = operand.cbegin() + 1; it != operand.cend();
+           it += it->size) {
+        addOperand(it);
+      }
+      continue;
+    }
+    addOperand(operand.cbegin());
+  }
+
+  if (!allof) {
+    groupPatterns(operands);
+  }
+
+  if (operands.empty()) {
+    addConstant(allof);
+    return;
+  }
+  if (operands.size() == 1) {
+    nodes_.insert(nodes_.end(), operands[0].begin(), operands[0].end());
+    return;
+  }
+
+  std::stable_sort(
+      operands.begin(), operands.end(), [](const auto& a, const auto& b) {
+        return a.front().cost < b.front().cost;
+      });
+
+  uint32_t size = 1;
+  for (auto& operand : operands) {
+    size += uint32_t(operand.size());
+  }
+  // Every operand may need to be evaluated.
+  nodes_.push_back(Node{op, operands.back().front().cost, size, nullptr});
+  for (auto& operand : operands) {
+    nodes_.insert(nodes_.end(), operand.begin(), operand.end());
+  }
+}
+
+void QueryPlanBuilder::groupPatterns(
+    std::vector<std::vector<Node>>& operands) {
+  std::vector<std::optional<RequiredLiteral>> required;
+  size_t numPatterns = 0;
+  bool anyLiteral = false;
+  for (auto& operand : operands) {
+    auto& head = operand.front();
+    auto& literal = required.emplace_back(
+        head.op == Op::Term ? head.expr->requiredLiteral() : std::nullopt);
+    if (literal) {
+      ++numPatterns;
+      anyLiteral |= !literal->literal.empty();
+    }
+  }
+  if (numPatterns < kMinPatternSetTerms || !anyLiteral) {
+    return;
+  }
+
+  std::vector<std::pair<QueryExpr*, RequiredLiteral>> patterns;
+  std::vector<std::vector<Node>> others;
+  for (size_t i = 0; i < operands.size(); ++i) {
+    if (required[i]) {
+      patterns.emplace_back(operands[i].front().expr, std::move(*required[i]));
+    } else {
+      others.push_back(std::move(operands[i]));
+    }
+  }
+  auto& set = patternSets_.emplace_back(
+      std::make_unique<QueryPlan::PatternSet>(std::move(patterns)));
+  others.push_back({Node{
+      Op::PatternSet, EvaluationCost::Pattern, 1, nullptr, set.get()}});
+  operands = std::move(others);
+}
+
+QueryPlan QueryPlanBuilder::build() && {
+  QueryPlan plan;
+  plan.nodes_ = std::move(nodes_);
+  plan.patternSets_ = std::move(patternSets_);
+  return plan;
+}
+
+} // namespace watchman
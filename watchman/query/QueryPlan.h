@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "watchman/query/QueryExpr.h"
+
+namespace watchman {
+
+/**
+ * A query expression compiled for evaluation against many files.
+ *
+ * The expression tree is flattened into a single array in prefix order,
+ * with each allof, anyof and not followed by its operands. While compiling:
+ * - nested lists of the same kind are merged into their parent
+ * - true and false are folded into the lists and negations that use them
+ * - double negations and single-term lists are removed
+ * - the terms of each list are ordered by their EvaluationCost, keeping
+ *   the order the query gave them within each cost
+ * - anyof lists of many pattern matching terms are grouped into a set that
+ *   finds the literals those patterns require in one pass over the name,
+ *   and then only runs the patterns that can match
+ *
+ * The result of evaluating the plan is always the same as evaluating the
+ * expression, including whether more data is needed, but cheap terms can
+ * short-circuit expensive ones and the compound terms cost no virtual
+ * calls. The plan refers to the terms of the expression, which must
+ * outlive it.
+ */
+class QueryPlan {
+ public:
+  explicit QueryPlan(QueryExpr& expr);
+  QueryPlan(QueryPlan&&) noexcept;
+  QueryPlan& operator=(QueryPlan&&) noexcept;
+  ~QueryPlan();
+
+  EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) const {
+    return evaluate(nodes_.data(), ctx, file);
+  }
+
+  /**
+   * The number of terms left after simplification, not counting allof,
+   * anyof and not.
+   */
+  size_t numTerms() const;
+
+ private:
+  friend class QueryPlanBuilder;
+  class PatternSet;
+
+  enum class Op : uint8_t {
+    Term,
+    True,
+    False,
+    Not,
+    AllOf,
+    AnyOf,
+    PatternSet,
+  };
+
+  struct Node {
+    Op op;
+    EvaluationCost cost;
+    // The number of nodes in the subtree rooted at this one, including
+    // itself. The next sibling is at this + size.
+    uint32_t size;
+    QueryExpr* expr;
+    const PatternSet* patternSet = nullptr;
+  };
+
+  QueryPlan() = default;
+
+  static EvaluateResult
+  evaluate(const Node* node, QueryContextBase* ctx, FileResult* file);
+
+  std::vector<Node> nodes_;
+  std::vector<std::unique_ptr<PatternSet>> patternSets_;
+};
+
+/**
+ * Builds the nodes of a QueryPlan. Each call adds the subtree for one
+ * expression.
+ */
+class QueryPlanBuilder {
+ public:
+  QueryPlanBuilder();
+  ~QueryPlanBuilder();
+
+  void addTerm(QueryExpr& expr);
+  void addConstant(bool value);
+  void addNot(QueryExpr& expr);
+  void addList(
+      AggregateOp op,
+      const std::vector<std::unique_ptr<QueryExpr>>& exprs);
+
+  QueryPlan build() &&;
+
+ private:
+  using Node = QueryPlan::Node;
+  using Op = QueryPlan::Op;
+
+  // Compiles expr on its own, keeping any pattern sets it creates.
+  std::vector<Node> compile(QueryExpr& expr);
+  void groupPatterns(std::vector<std::vector<Node>>& operands);
+
+  std::vector<Node> nodes_;
+  std::vector<std::unique_ptr<QueryPlan::PatternSet>> patternSets_;
+};
+
+} // namespace watchman
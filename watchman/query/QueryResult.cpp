@@ -22,9 +22,19 @@ json_ref QueryDebugInfo::render() const {
   for (auto& fn : cookieFileNames) {
     arr.push_back(w_string_to_json(fn));
   }
-  return json_object({
+  auto info = json_object({
       {"cookie_files", json_array(std::move(arr))},
   });
+  if (numFetchBatches > 0) {
+    info.set(
+        "fetch",
+        json_object({
+            {"batches", json_integer(numFetchBatches)},
+            {"batch_size", json_integer(fetchBatchSize)},
+            {"wait_us", json_integer(fetchWait.count())},
+        }));
+  }
+  return info;
 }
 
 } // namespace watchman
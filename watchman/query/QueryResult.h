@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <unordered_set>
 #include <vector>
 #include "watchman/Clock.h"
@@ -18,6 +19,13 @@ namespace watchman {
 struct QueryDebugInfo {
   std::vector<w_string> cookieFileNames;
 
+  // Batches of files whose data was fetched to evaluate or render them,
+  // the batch size the query finished with, and the time spent waiting
+  // for those fetches.
+  uint64_t numFetchBatches{0};
+  size_t fetchBatchSize{0};
+  std::chrono::microseconds fetchWait{0};
+
   json_ref render() const;
 };
 
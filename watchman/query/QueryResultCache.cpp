@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryResultCache.h"
+#include <algorithm>
+#include "watchman/query/Query.h"
+
+namespace watchman {
+
+QueryResultCache::QueryResultCache(size_t maxResults)
+    : maxResults_{maxResults} {}
+
+std::optional<std::string> QueryResultCache::canonicalSpec(
+    const Query& query) {
+  if (!query.query_spec || !query.query_spec->isObject() ||
+      query.bench_iterations > 0) {
+    return std::nullopt;
+  }
+  // The spec names the path file, but its contents can change.
+  if (query.query_spec->get_optional("path_file")) {
+    return std::nullopt;
+  }
+  if (auto* since = query.since_spec.get()) {
+    // Evaluating a named cursor moves it, and the SCM can change without
+    // the view ticking.
+    if (std::holds_alternative<ClockSpec::NamedCursor>(since->spec) ||
+        since->hasScmParams()) {
+      return std::nullopt;
+    }
+  }
+
+  // The request id is only used for logging, so don't let it stop
+  // otherwise identical queries from sharing results.
+  auto fields = query.query_spec->object();
+  fields.erase(w_string{"request_id"});
+  std::string spec{query.command};
+  spec.push_back(' ');
+  spec += json_dumps(
+      json_object(std::move(fields)), JSON_COMPACT | JSON_SORT_KEYS);
+  return spec;
+}
+
+QueryResultCache::Lookup QueryResultCache::lookup(
+    const Key& key,
+    const folly::CancellationToken& cancellationToken,
+    std::optional<std::chrono::milliseconds> maxWait) {
+  std::shared_ptr<Promise> promise;
+  {
+    auto state = state_.wlock();
+    auto [it, inserted] = state->entries.try_emplace(key.spec);
+    auto& entry = it->second;
+    if (!inserted && entry.position.rootNumber == key.position.rootNumber &&
+        entry.position.ticks == key.position.ticks &&
+        entry.lastAgeOutTick == key.lastAgeOutTick) {
+      if (entry.value) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        state->lru.splice(state->lru.end(), state->lru, entry.lruPosition);
+        return Lookup{entry.value, std::nullopt};
+      }
+      promise = entry.pending;
+    } else {
+      // Either there's no entry, or it is for an older position and will
+      // never be used again.
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      forget(*state, entry);
+      entry.position = key.position;
+      entry.lastAgeOutTick = key.lastAgeOutTick;
+      entry.value.reset();
+      entry.pending = std::make_shared<Promise>();
+      return Lookup{nullptr, Fill{*this, key, entry.pending}};
+    }
+  }
+
+  shared_.fetch_add(1, std::memory_order_relaxed);
+  // Wait for the query to finish, looking every so often whether our
+  // caller has given up on its own.
+  auto future = promise->getSemiFuture();
+  auto giveUpAt = maxWait ? std::chrono::steady_clock::now() + *maxWait
+                          : std::chrono::steady_clock::time_point::max();
+  while (!future.isReady()) {
+    auto now = std::chrono::steady_clock::now();
+    if (cancellationToken.isCancellationRequested() || now >= giveUpAt) {
+      return Lookup{};
+    }
+    future.wait(std::min<std::chrono::steady_clock::duration>(
+        kWaitCheckInterval, giveUpAt - now));
+  }
+
+  auto result = std::move(future).getTry();
+  if (result.hasValue() && result.value()) {
+    return Lookup{std::move(result.value()), std::nullopt};
+  }
+  // The query we were waiting for failed or could not be cached; run it
+  // ourselves, without caching it.
+  return Lookup{};
+}
+
+void QueryResultCache::store(
+    const Key& key,
+    const std::shared_ptr<Promise>& promise,
+    std::shared_ptr<const Value> value) {
+  {
+    auto state = state_.wlock();
+    auto it = state->entries.find(key.spec);
+    // A query at a later position may have replaced our entry.
+    if (it != state->entries.end() && it->second.pending == promise) {
+      auto& entry = it->second;
+      size_t size = value ? value->resultsArray.results.size() : 0;
+      size_t weight = 1 + size + key.spec.size() / kSpecBytesPerResult;
+      if (!value || weight > maxResults_) {
+        state->entries.erase(it);
+      } else {
+        while (state->weight + weight > maxResults_ && !state->lru.empty()) {
+          auto victim = state->entries.find(state->lru.front());
+          forget(*state, victim->second);
+          state->entries.erase(victim);
+          evicted_.fetch_add(1, std::memory_order_relaxed);
+        }
+        entry.value = value;
+        entry.pending.reset();
+        entry.lruPosition = state->lru.insert(state->lru.end(), key.spec);
+        entry.weight = weight;
+        state->results += size;
+        state->weight += weight;
+      }
+    }
+  }
+  promise->setValue(std::move(value));
+}
+
+void QueryResultCache::forget(State& state, Entry& entry) {
+  if (entry.value) {
+    state.lru.erase(entry.lruPosition);
+    state.results -= entry.value->resultsArray.results.size();
+    state.weight -= entry.weight;
+  }
+}
+
+QueryResultCacheStats QueryResultCache::getStats() const {
+  QueryResultCacheStats stats;
+  {
+    auto state = state_.rlock();
+    stats.entries = int64_t(state->lru.size());
+    stats.results = int64_t(state->results);
+  }
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.shared = shared_.load(std::memory_order_relaxed);
+  stats.evicted = evicted_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+QueryResultCache::Fill::Fill(
+    QueryResultCache& cache,
+    Key key,
+    std::shared_ptr<Promise> promise)
+    : cache_{&cache}, key_{std::move(key)}, promise_{std::move(promise)} {}
+
+QueryResultCache::Fill::~Fill() {
+  if (promise_) {
+    cache_->store(key_, promise_, nullptr);
+  }
+}
+
+void QueryResultCache::Fill::store(Value value) {
+  auto promise = std::move(promise_);
+  cache_->store(key_, promise, std::make_shared<const Value>(std::move(value)));
+}
+
+} // namespace watchman
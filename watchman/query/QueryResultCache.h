@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/CancellationToken.h>
+#include <folly/Synchronized.h>
+#include <folly/futures/SharedPromise.h>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "watchman/Clock.h"
+#include "watchman/Serde.h"
+#include "watchman/query/QueryResult.h"
+
+namespace watchman {
+
+struct Query;
+
+struct QueryResultCacheStats : serde::Object {
+  int64_t entries = 0;
+  // Total number of files held across all entries.
+  int64_t results = 0;
+  int64_t hits = 0;
+  int64_t misses = 0;
+  // Lookups that waited for an identical query that was already running.
+  int64_t shared = 0;
+  int64_t evicted = 0;
+
+  template <typename X>
+  void map(X& x) {
+    x("entries", entries);
+    x("results", results);
+    x("hits", hits);
+    x("misses", misses);
+    x("shared", shared);
+    x("evicted", evicted);
+  }
+};
+
+/**
+ * Remembers the rendered results of recent queries against a root, so that
+ * a query identical to one that already ran since the files in the view
+ * last changed can be answered without walking the view again.
+ *
+ * Only the most recent position is kept for each query: once the files
+ * have changed, the older results can never be returned again. Entries are
+ * keyed on QueryableView::getLastChangePosition() rather than the current
+ * position, so the ticks of cookie syncs don't stop queries that run one
+ * after another from sharing results.
+ *
+ * When identical queries arrive together, the first one to miss runs and
+ * the others wait for it and share its results.
+ *
+ * The cache is bounded by the total weight of its entries. An entry weighs
+ * one, plus one for each file it holds, plus one for every
+ * kSpecBytesPerResult bytes of its spec, so that entries with no results
+ * still count. Entries heavier than the bound are never cached, and least
+ * recently used entries are evicted to make room for new ones.
+ */
+class QueryResultCache {
+ public:
+  struct Key {
+    // From canonicalSpec().
+    std::string spec;
+    // From QueryableView::getLastChangePosition().
+    ClockPosition position;
+    ClockTicks lastAgeOutTick{0};
+  };
+
+  struct Value {
+    bool isFreshInstance{false};
+    RenderResult resultsArray;
+  };
+
+ private:
+  using Promise = folly::SharedPromise<std::shared_ptr<const Value>>;
+
+ public:
+  /**
+   * Held by the query that missed, which is expected to either store its
+   * results or, by destroying the Fill, give up and let any waiters run
+   * the query themselves.
+   */
+  class Fill {
+   public:
+    Fill(Fill&&) = default;
+    Fill& operator=(Fill&&) = delete;
+    ~Fill();
+
+    void store(Value value);
+
+   private:
+    friend class QueryResultCache;
+    Fill(QueryResultCache& cache, Key key, std::shared_ptr<Promise> promise);
+
+    QueryResultCache* cache_;
+    Key key_;
+    std::shared_ptr<Promise> promise_;
+  };
+
+  struct Lookup {
+    // Set if the results were cached or computed by an identical query.
+    std::shared_ptr<const Value> value;
+    // Set if the caller should run the query and store its results.
+    std::optional<Fill> fill;
+  };
+
+  // Roughly the size of a rendered result.
+  static constexpr size_t kSpecBytesPerResult = 64;
+
+  // How often a lookup waiting for an identical query looks whether its
+  // caller has been cancelled.
+  static constexpr std::chrono::milliseconds kWaitCheckInterval{100};
+
+  explicit QueryResultCache(size_t maxResults);
+
+  /**
+   * Returns the key that identifies query, or std::nullopt if the results
+   * of query depend on more than the state of the view and so cannot be
+   * reused.
+   */
+  static std::optional<std::string> canonicalSpec(const Query& query);
+
+  /**
+   * Blocks if an identical query at the same position is already running,
+   * until it finishes, cancellationToken is cancelled, or maxWait, if given,
+   * runs out. In the last two cases neither value nor fill is set.
+   */
+  Lookup lookup(
+      const Key& key,
+      const folly::CancellationToken& cancellationToken = {},
+      std::optional<std::chrono::milliseconds> maxWait = std::nullopt);
+
+  QueryResultCacheStats getStats() const;
+
+ private:
+  struct Entry {
+    ClockPosition position;
+    ClockTicks lastAgeOutTick{0};
+    // Exactly one of these is set.
+    std::shared_ptr<const Value> value;
+    std::shared_ptr<Promise> pending;
+    // Only entries with a value are in the eviction order.
+    std::list<std::string>::iterator lruPosition;
+    size_t weight{0};
+  };
+
+  struct State {
+    std::unordered_map<std::string, Entry> entries;
+    // Least recently used first.
+    std::list<std::string> lru;
+    size_t results{0};
+    size_t weight{0};
+  };
+
+  void store(
+      const Key& key,
+      const std::shared_ptr<Promise>& promise,
+      std::shared_ptr<const Value> value);
+  // Drops entry from the eviction order and the results and weight counts.
+  void forget(State& state, Entry& entry);
+
+  const size_t maxResults_;
+  folly::Synchronized<State> state_;
+
+  std::atomic<int64_t> hits_{0};
+  std::atomic<int64_t> misses_{0};
+  std::atomic<int64_t> shared_{0};
+  std::atomic<int64_t> evicted_{0};
+};
+
+} // namespace watchman
@@ -7,6 +7,7 @@
 
 #include "watchman/Errors.h"
 #include "watchman/query/QueryExpr.h"
+#include "watchman/query/QueryPlan.h"
 #include "watchman/query/TermRegistry.h"
 
 #include <memory>
@@ -33,6 +34,10 @@ class NotExpr : public QueryExpr {
     return !*res;
   }
 
+  void addToPlan(QueryPlanBuilder& builder) override {
+    builder.addNot(*expr);
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query* query, const json_ref& term) {
     /* rigidly require ["not", expr] */
     if (!term.isArray() || json_array_size(term) != 2) {
@@ -82,6 +87,14 @@ class TrueExpr : public QueryExpr {
     return true;
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Constant;
+  }
+
+  void addToPlan(QueryPlanBuilder& builder) override {
+    builder.addConstant(true);
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref&) {
     return std::make_unique<TrueExpr>();
   }
@@ -113,6 +126,14 @@ class FalseExpr : public QueryExpr {
     return false;
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Constant;
+  }
+
+  void addToPlan(QueryPlanBuilder& builder) override {
+    builder.addConstant(false);
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref&) {
     return std::make_unique<FalseExpr>();
   }
@@ -180,6 +201,10 @@ class ListExpr : public QueryExpr {
     return allof;
   }
 
+  void addToPlan(QueryPlanBuilder& builder) override {
+    builder.addList(allof ? AggregateOp::AllOf : AggregateOp::AnyOf, exprs);
+  }
+
   static std::unique_ptr<QueryExpr>
   parse(Query* query, const json_ref& term, bool allof) {
     std::vector<std::unique_ptr<QueryExpr>> list;
@@ -25,6 +25,10 @@ class ExistsExpr : public QueryExpr {
     return std::make_unique<ExistsExpr>();
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Metadata;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // `exists` doesn't constrain the path.
@@ -78,6 +82,10 @@ class EmptyExpr : public QueryExpr {
     return std::make_unique<EmptyExpr>();
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Metadata;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // `empty` doesn't constrain the path.
@@ -9,6 +9,7 @@
 
 #include <fmt/chrono.h>
 #include <folly/ScopeGuard.h>
+#include <algorithm>
 
 #include "eden/common/utils/ProcessInfoCache.h"
 #include "watchman/ClientContext.h"
@@ -20,7 +21,10 @@
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/LocalFileResult.h"
 #include "watchman/query/Query.h"
+#include "watchman/query/QueryAdmission.h"
 #include "watchman/query/QueryContext.h"
+#include "watchman/query/QueryPlan.h"
+#include "watchman/query/QueryResultCache.h"
 #include "watchman/root/Root.h"
 #include "watchman/saved_state/SavedStateInterface.h"
 #include "watchman/scm/SCM.h"
@@ -58,12 +62,21 @@ void w_query_process_file(
     const Query* query,
     QueryContext* ctx,
     std::unique_ptr<FileResult> file) {
+  auto* raw = file.get();
+  w_query_process_file(query, ctx, *raw, [&] { return std::move(file); });
+}
+
+void w_query_process_file(
+    const Query* query,
+    QueryContext* ctx,
+    FileResult& file,
+    folly::FunctionRef<std::unique_ptr<FileResult>()> moveToHeap) {
   // TODO: Should this be implicit by assigning a file to the QueryContext? It
   // could be cleared when resetting the file.
   ctx->resetWholeName();
-  ctx->file = std::move(file);
+  ctx->file = &file;
   SCOPE_EXIT {
-    ctx->file.reset();
+    ctx->file = nullptr;
   };
 
   // For fresh instances, only return files that currently exist
@@ -75,10 +88,10 @@ void w_query_process_file(
   if (!ctx->disableFreshInstance &&
       std::holds_alternative<QuerySince::Clock>(ctx->since.since) &&
       std::get<QuerySince::Clock>(ctx->since.since).is_fresh_instance) {
-    auto exists = ctx->file->exists();
+    auto exists = file.exists();
     if (!exists.has_value()) {
       // Reconsider this one later
-      ctx->addToEvalBatch(std::move(ctx->file));
+      ctx->addToEvalBatch(moveToHeap());
       return;
     }
     if (!exists.value()) {
@@ -88,12 +101,12 @@ void w_query_process_file(
 
   // We produce an output for this file if there is no expression,
   // or if the expression matched.
-  if (query->expr) {
-    auto match = query->expr->evaluate(ctx, ctx->file.get());
+  if (query->plan) {
+    auto match = query->plan->evaluate(ctx, &file);
 
     if (!match.has_value()) {
       // Reconsider this one later
-      ctx->addToEvalBatch(std::move(ctx->file));
+      ctx->addToEvalBatch(moveToHeap());
       return;
     } else if (!*match) {
       return;
@@ -111,7 +124,7 @@ void w_query_process_file(
     }
   }
 
-  auto logPrefixes = getUnconditionalLogFilePrefixes();
+  const auto& logPrefixes = getUnconditionalLogFilePrefixes();
   if (!logPrefixes.empty()) {
     auto name = ctx->getWholeName();
     for (auto& prefix : logPrefixes) {
@@ -121,13 +134,23 @@ void w_query_process_file(
     }
   }
 
-  ctx->maybeRender(std::move(ctx->file));
+  ctx->maybeRender(moveToHeap());
+}
+
+// Records which generators ran, for the query log. Views that have their
+// own notion of generator, such as Eden, overwrite this.
+static void noteGenerator(QueryContext* ctx, std::string_view name) {
+  if (!ctx->generatorType.empty()) {
+    ctx->generatorType.push_back('+');
+  }
+  ctx->generatorType.append(name);
 }
 
 void time_generator(
     const Query* query,
     const std::shared_ptr<Root>& root,
     QueryContext* ctx) {
+  noteGenerator(ctx, "time");
   root->view()->timeGenerator(query, ctx);
 }
 
@@ -144,11 +167,13 @@ static void default_generators(
   }
 
   if (query->paths.has_value()) {
+    noteGenerator(ctx, "path");
     root->view()->pathGenerator(query, ctx);
     generated = true;
   }
 
   if (query->glob_tree) {
+    noteGenerator(ctx, "glob");
     root->view()->globGenerator(query, ctx);
     generated = true;
   }
@@ -156,6 +181,7 @@ static void default_generators(
   // And finally, if there were no other generators, we walk all known
   // files
   if (!generated) {
+    noteGenerator(ctx, "all_files");
     root->view()->allFilesGenerator(query, ctx);
   }
 }
@@ -276,7 +302,9 @@ static void execute_common(
           ctx->scmFilesChangedSinceMergebaseWithDurationUs.load(
               std::memory_order_relaxed);
       queryExecute->generation_duration_ms =
-          ctx->generationDuration.load().count();
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              ctx->generationDuration.load())
+              .count();
       if (!ctx->generatorType.empty()) {
         queryExecute->generator = ctx->generatorType;
       }
@@ -314,6 +342,11 @@ QueryResult w_query_execute(
   ClockSpec resultClock(ClockPosition{});
   bool disableFreshInstance{false};
   auto requestId = query->request_id;
+  // Queries run with a custom generator produce results that depend on
+  // more than the query itself.
+  auto cacheSpec = root->queryResultCache && !generator
+      ? QueryResultCache::canonicalSpec(*query)
+      : std::nullopt;
 
   QueryExecute queryExecute;
   PerfSample sample("query_execute");
@@ -458,6 +491,36 @@ QueryResult w_query_execute(
   SCOPE_EXIT {
     root->queries.wlock()->erase(&ctx);
   };
+
+  QueryAdmissionController::Ticket admissionTicket;
+  if (root->queryAdmission) {
+    // Counting the files in the view takes the view lock, so only estimate
+    // the cost of queries that may be limited by it.
+    auto view = root->view();
+    bool sinceIsFresh = query->since_spec &&
+        query->since_spec->isFreshInstance(
+            view->getMostRecentRootNumberAndTickValue(),
+            view->getLastAgeOutTickValue(),
+            &root->inner.cursors);
+    ctx.estimatedCost =
+        estimateQueryCost(*query, view->getNumFiles(), sinceIsFresh);
+    ctx.state = QueryContextState::WaitingForAdmission;
+    try {
+      admissionTicket = root->queryAdmission->admit(
+          query->clientInfo.clientPid,
+          query->priority,
+          ctx.estimatedCost,
+          ctx.timeUntilDeadline(),
+          query->cancellationToken);
+    } catch (const QueryExecError&) {
+      // If the wait was cut short by the deadline or the client going
+      // away, say so.
+      ctx.throwIfCancelled();
+      throw;
+    }
+    ctx.throwIfCancelled();
+  }
+
   if (query->settle_timeouts) {
     auto future = root->waitForSettle(query->settle_timeouts->settle_period);
     try {
@@ -470,15 +533,24 @@ QueryResult w_query_execute(
     }
   }
   if (query->sync_timeout.count()) {
+    ctx.throwIfCancelled();
+    auto syncTimeout = query->sync_timeout;
+    if (auto remaining = ctx.timeUntilDeadline()) {
+      // A zero timeout would not sync at all.
+      syncTimeout = std::clamp(
+          *remaining, std::chrono::milliseconds{1}, query->sync_timeout);
+    }
     ctx.state = QueryContextState::WaitingForCookieSync;
     ctx.stopWatch.reset();
     try {
-      auto result = root->syncToNow(query->sync_timeout, query->clientInfo);
+      auto result = root->syncToNow(syncTimeout, query->clientInfo);
       res.debugInfo.cookieFileNames = std::move(result.cookieFileNames);
     } catch (const std::exception& exc) {
+      ctx.throwIfCancelled();
       QueryExecError::throwf("synchronization failed: {}", exc.what());
     }
     ctx.cookieSyncDuration = ctx.stopWatch.lap();
+    ctx.throwIfCancelled();
   }
 
   /* The first stage of execution is generation.
@@ -497,6 +569,22 @@ QueryResult w_query_execute(
   ctx.lastAgeOutTickValueAtStartOfQuery =
       root->view()->getLastAgeOutTickValue();
 
+  std::shared_ptr<const QueryResultCache::Value> cached;
+  std::optional<QueryResultCache::Fill> cacheFill;
+  if (cacheSpec) {
+    auto lookup = root->queryResultCache->lookup(
+        QueryResultCache::Key{
+            std::move(*cacheSpec),
+            root->view()->getLastChangePosition(),
+            ctx.lastAgeOutTickValueAtStartOfQuery},
+        query->cancellationToken,
+        ctx.timeUntilDeadline());
+    cached = std::move(lookup.value);
+    cacheFill = std::move(lookup.fill);
+    // The wait for an identical query stops early if ours is cancelled.
+    ctx.throwIfCancelled();
+  }
+
   // Copy in any scm parameters
   res.clockAtStartOfQuery = resultClock;
   // then update the clock position portion
@@ -521,18 +609,65 @@ QueryResult w_query_execute(
     }
   }
 
-  if (query->bench_iterations > 0) {
-    for (uint32_t i = 0; i < query->bench_iterations; ++i) {
-      QueryContext c{query, root, ctx.disableFreshInstance};
-      QueryResult r;
-      c.clockAtStartOfQuery = ctx.clockAtStartOfQuery;
-      c.since = ctx.since;
-      execute_common(&c, nullptr, nullptr, &r, generator, query->clientInfo);
+  if (cached) {
+    ctx.generatorType = "result_cache";
+    ctx.state = QueryContextState::Completed;
+    res.isFreshInstance = cached->isFreshInstance;
+    res.resultsArray = cached->resultsArray;
+  } else {
+    if (query->bench_iterations > 0) {
+      for (uint32_t i = 0; i < query->bench_iterations; ++i) {
+        QueryContext c{query, root, ctx.disableFreshInstance};
+        QueryResult r;
+        c.clockAtStartOfQuery = ctx.clockAtStartOfQuery;
+        c.since = ctx.since;
+        execute_common(&c, nullptr, nullptr, &r, generator, query->clientInfo);
+      }
+    }
+
+    execute_common(
+        &ctx, &queryExecute, &sample, &res, generator, query->clientInfo);
+    res.debugInfo.numFetchBatches = ctx.getNumFetchBatches();
+    res.debugInfo.fetchBatchSize = ctx.getFetchBatchSize();
+    res.debugInfo.fetchWait = ctx.getFetchWaitDuration();
+
+    // Results rendered for a client that went away may be missing the
+    // fields whose computation was abandoned.
+    if (cacheFill && !query->cancellationToken.isCancellationRequested()) {
+      cacheFill->store(
+          QueryResultCache::Value{res.isFreshInstance, res.resultsArray});
     }
   }
 
-  execute_common(
-      &ctx, &queryExecute, &sample, &res, generator, query->clientInfo);
+  QueryStats::Sample stats;
+  stats.total = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - ctx.created);
+  stats.cookieSync = ctx.cookieSyncDuration.load();
+  stats.viewLockWait = ctx.viewLockWaitDuration.load();
+  stats.generation = ctx.generationDuration.load();
+  stats.render = ctx.renderDuration.load();
+  stats.filesWalked = uint64_t(ctx.getNumWalked());
+  stats.results = res.resultsArray.results.size();
+  root->queryStats.record(query->command, stats);
+
+  if (root->queryLog) {
+    QueryLogEntry entry;
+    entry.completed = std::chrono::system_clock::now();
+    entry.spec_hash = query->spec_hash;
+    entry.client_pid = query->clientInfo.clientPid;
+    entry.total_us = stats.total.count();
+    entry.cookie_sync_us = stats.cookieSync.count();
+    entry.view_lock_wait_us = stats.viewLockWait.count();
+    entry.generation_us = stats.generation.count();
+    entry.render_us = stats.render.count();
+    entry.num_walked = ctx.getNumWalked();
+    entry.num_results = int64_t(stats.results);
+    entry.num_deduped = ctx.num_deduped;
+    entry.fresh_instance = res.isFreshInstance;
+    QueryLogEntry::setName(entry.command, query->command);
+    QueryLogEntry::setName(entry.generator, ctx.generatorType);
+    root->queryLog->record(entry);
+  }
   return res;
 }
 
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <folly/Function.h>
 #include <functional>
 #include <memory>
 #include "watchman/query/FileResult.h"
@@ -47,6 +48,16 @@ void w_query_process_file(
     watchman::QueryContext* ctx,
     std::unique_ptr<watchman::FileResult> file);
 
+// As above, but for a file that the generator owns, typically on its stack.
+// Most files that a query walks don't match, so this saves allocating each
+// of them: moveToHeap is only called to take ownership of file if it
+// matches, or if more data must be fetched before it can be evaluated.
+void w_query_process_file(
+    const watchman::Query* query,
+    watchman::QueryContext* ctx,
+    watchman::FileResult& file,
+    folly::FunctionRef<std::unique_ptr<watchman::FileResult>()> moveToHeap);
+
 void time_generator(
     const watchman::Query* query,
     const std::shared_ptr<watchman::Root>& root,
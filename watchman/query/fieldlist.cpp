@@ -32,14 +32,18 @@ std::optional<json_ref> make_symlink(FileResult* file, const QueryContext*) {
   }
 }
 
-std::optional<json_ref> make_sha1_hex(FileResult* file, const QueryContext*) {
+// Renders the content hash returned by getHash(file) as a hex string
+template <typename GetHash>
+std::optional<json_ref> make_content_hash_hex(
+    FileResult* file,
+    GetHash getHash) {
   try {
-    auto hash = file->getContentSha1();
+    auto hash = getHash(file);
     if (!hash.has_value()) {
       // Need to load it still
       return std::nullopt;
     }
-    char buf[40];
+    char buf[std::tuple_size_v<typename decltype(hash)::value_type> * 2];
     static const char* hexDigit = "0123456789abcdef";
     for (size_t i = 0; i < hash->size(); ++i) {
       auto& digit = (*hash)[i];
@@ -66,6 +70,18 @@ std::optional<json_ref> make_sha1_hex(FileResult* file, const QueryContext*) {
   }
 }
 
+std::optional<json_ref> make_sha1_hex(FileResult* file, const QueryContext*) {
+  return make_content_hash_hex(
+      file, [](FileResult* f) { return f->getContentSha1(); });
+}
+
+std::optional<json_ref> make_blake3_hex(
+    FileResult* file,
+    const QueryContext*) {
+  return make_content_hash_hex(
+      file, [](FileResult* f) { return f->getContentBlake3(); });
+}
+
 std::optional<json_ref> make_size(FileResult* file, const QueryContext*) {
   auto size = file->size();
   if (!size.has_value()) {
@@ -293,6 +309,7 @@ std::unordered_map<w_string, QueryFieldRenderer> build_defs() {
       {"cclock", make_cclock},
       {"type", make_type_field},
       {"content.sha1hex", make_sha1_hex},
+      {"content.blake3hex", make_blake3_hex},
   };
   std::unordered_map<w_string, QueryFieldRenderer> map;
   for (auto& def : defs) {
@@ -123,6 +123,10 @@ class SizeExpr : public QueryExpr {
     return std::make_unique<SizeExpr>(comp);
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Metadata;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // `size` doesn't constrain the path.
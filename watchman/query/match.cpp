@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include "GlobEscaping.h"
 #include "watchman/CommandRegistry.h"
 #include "watchman/Errors.h"
@@ -57,6 +58,98 @@ w_string_piece trimGlobAfterDoubleStar(w_string_piece pattern) {
   }
   return pattern;
 }
+
+/// Returns the longest literal that every name matching the given glob
+/// \param pattern contains, or an empty string if there isn't one.
+std::string requiredGlobLiteral(std::string_view pattern, bool noescape) {
+  std::string longest;
+  std::string run;
+  auto endRun = [&] {
+    if (run.size() > longest.size()) {
+      longest = run;
+    }
+    run.clear();
+  };
+
+  size_t pos = 0;
+  while (pos < pattern.size()) {
+    char c = pattern[pos];
+    switch (c) {
+      case '*': {
+        size_t stars = 0;
+        while (pos < pattern.size() && pattern[pos] == '*') {
+          ++stars;
+          ++pos;
+        }
+        if (stars > 1) {
+          // `**/` can match no directories at all, so the slashes around
+          // it aren't required.
+          if (!run.empty() && run.back() == '/') {
+            run.pop_back();
+          }
+          while (pos < pattern.size() && pattern[pos] == '/') {
+            ++pos;
+          }
+        }
+        endRun();
+        continue;
+      }
+      case '?':
+        endRun();
+        ++pos;
+        continue;
+      case '[':
+        endRun();
+        ++pos;
+        if (pos < pattern.size() &&
+            (pattern[pos] == '!' || pattern[pos] == '^')) {
+          ++pos;
+        }
+        // A leading ']' is part of the class.
+        if (pos < pattern.size() && pattern[pos] == ']') {
+          ++pos;
+        }
+        while (pos < pattern.size() && pattern[pos] != ']') {
+          if (pattern[pos] == '\\') {
+            ++pos;
+          } else if (pattern.substr(pos, 2) == "[:") {
+            auto end = pattern.find(":]", pos + 2);
+            if (end == std::string_view::npos) {
+              return std::string{};
+            }
+            pos = end + 1;
+          }
+          ++pos;
+        }
+        if (pos >= pattern.size()) {
+          // Malformed; let wildmatch decide what it means.
+          return std::string{};
+        }
+        ++pos;
+        continue;
+      case '\\':
+        if (!noescape) {
+          ++pos;
+          if (pos >= pattern.size()) {
+            return std::string{};
+          }
+          c = pattern[pos];
+        }
+        break;
+    }
+    if (static_cast<unsigned char>(c) >= 0x80) {
+      // Case folding of non-ASCII characters is left to the matcher.
+      endRun();
+    } else if (c == '/' && !run.empty() && run.back() == '/') {
+      // Repeated slashes in the pattern match a single one.
+    } else {
+      run.push_back(c);
+    }
+    ++pos;
+  }
+  endRun();
+  return longest;
+}
 } // namespace
 class WildMatchExpr : public QueryExpr {
   std::string pattern;
@@ -64,6 +157,8 @@ class WildMatchExpr : public QueryExpr {
   bool wholename;
   bool noescape;
   bool includedotfiles;
+  // Derived from the above once, rather than for every file.
+  int flags;
 
  public:
   WildMatchExpr(
@@ -76,7 +171,12 @@ class WildMatchExpr : public QueryExpr {
         caseSensitive(caseSensitive),
         wholename(wholename),
         noescape(noescape),
-        includedotfiles(includedotfiles) {}
+        includedotfiles(includedotfiles),
+        flags(
+            (includedotfiles ? 0 : WM_PERIOD) | (noescape ? WM_NOESCAPE : 0) |
+            (wholename ? WM_PATHNAME : 0) |
+            (caseSensitive == CaseSensitivity::CaseInSensitive ? WM_CASEFOLD
+                                                               : 0)) {}
 
   EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
     w_string_piece str;
@@ -94,15 +194,7 @@ class WildMatchExpr : public QueryExpr {
     str = normBuf;
 #endif
 
-    res =
-        wildmatch(
-            pattern.c_str(),
-            str.data(),
-            (includedotfiles ? 0 : WM_PERIOD) | (noescape ? WM_NOESCAPE : 0) |
-                (wholename ? WM_PATHNAME : 0) |
-                (caseSensitive == CaseSensitivity::CaseInSensitive ? WM_CASEFOLD
-                                                                   : 0),
-            0) == WM_MATCH;
+    res = wildmatch(pattern.c_str(), str.data(), flags, 0) == WM_MATCH;
 
     return res;
   }
@@ -182,6 +274,14 @@ class WildMatchExpr : public QueryExpr {
     return parse(query, term, CaseSensitivity::CaseInSensitive);
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Pattern;
+  }
+
+  std::optional<RequiredLiteral> requiredLiteral() const override {
+    return RequiredLiteral{wholename, requiredGlobLiteral(pattern, noescape)};
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity outputCaseSensitive) const override {
     if (caseSensitive == CaseSensitivity::CaseInSensitive &&
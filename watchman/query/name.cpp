@@ -151,6 +151,10 @@ class NameExpr : public QueryExpr {
     return parse(query, term, CaseSensitivity::CaseInSensitive);
   }
 
+  EvaluationCost evaluationCost() const override {
+    return wholename ? EvaluationCost::WholeName : EvaluationCost::BaseName;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity outputCaseSensitive) const override {
     if (caseSensitive == CaseSensitivity::CaseInSensitive &&
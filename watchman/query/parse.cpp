@@ -6,12 +6,20 @@
  */
 
 #include <fmt/core.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
 
 #include "watchman/CommandRegistry.h"
 #include "watchman/Errors.h"
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/QueryExpr.h"
+#include "watchman/query/QueryPlan.h"
 #include "watchman/query/TermRegistry.h"
 #include "watchman/query/parse.h"
 #include "watchman/root/Root.h"
@@ -36,52 +44,130 @@ bool parse_since(Query* res, const json_ref& query) {
   throw QueryParseError("invalid value for 'since'");
 }
 
-bool parse_paths(Query* res, const json_ref& query) {
-  size_t i;
+W_CAP_REG("path_file")
 
-  auto paths = query.get_optional("path");
-  if (!paths) {
-    return true;
+// The largest `path_file` we'll read; over a million typical paths.
+constexpr size_t kMaxPathFileSize = 128 * 1024 * 1024;
+
+/**
+ * Appends the paths listed in the file named by `path_file`, one per line,
+ * each with unlimited depth. The file is read rather than mapped, so that
+ * another process truncating it while we split it can't crash the server.
+ */
+void parse_path_file(std::vector<QueryPath>& res_paths, const json_ref& file) {
+  if (!file.isString()) {
+    throw QueryParseError("'path_file' must be a string");
+  }
+  auto name = json_to_w_string(file);
+  if (!name.piece().pathIsAbsolute()) {
+    QueryParseError::throwf("'path_file' `{}` must be an absolute path", name);
   }
 
-  if (!paths->isArray()) {
-    throw QueryParseError("'path' must be an array");
+  std::string contents;
+  if (!folly::readFile(name.c_str(), contents, kMaxPathFileSize + 1)) {
+    QueryParseError::throwf(
+        "unable to read 'path_file' `{}`: {}",
+        name,
+        folly::errnoStr(errno));
+  }
+  if (contents.size() > kMaxPathFileSize) {
+    QueryParseError::throwf(
+        "'path_file' `{}` is larger than {} bytes", name, kMaxPathFileSize);
   }
 
-  auto size = json_array_size(*paths);
+  std::string_view remaining{contents};
+  while (!remaining.empty()) {
+    auto newline = remaining.find('\n');
+    auto line = remaining.substr(0, newline);
+    remaining.remove_prefix(
+        newline == std::string_view::npos ? remaining.size() : newline + 1);
 
-  res->paths.emplace();
-  std::vector<QueryPath>& res_paths = *res->paths;
-  res_paths.resize(size);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (!line.empty()) {
+      res_paths.push_back(QueryPath{w_string{line}.normalizeSeparators(), -1});
+    }
+  }
+}
+
+} // namespace
 
-  for (i = 0; i < size; i++) {
-    const auto& ele = paths->at(i);
-    w_string name;
+void checkPathFileAllowed(const json_ref& query, bool clientIsOwner) {
+  // The server reads the file as its own user, so other users could use it
+  // to find out what that user can read.
+  if (!clientIsOwner && query.get_optional("path_file")) {
+    throw QueryParseError(
+        "'path_file' may only be used by the user running the watchman "
+        "server; list the paths in 'path' instead");
+  }
+}
 
-    res_paths[i].depth = -1;
+void parse_paths(Query* res, const json_ref& query) {
+  auto paths = query.get_optional("path");
+  auto path_file = query.get_optional("path_file");
+  if (!paths && !path_file) {
+    return;
+  }
+
+  if (paths && !paths->isArray()) {
+    throw QueryParseError("'path' must be an array");
+  }
 
-    if (ele.isString()) {
-      name = json_to_w_string(ele);
-    } else if (ele.isObject()) {
-      name = json_to_w_string(ele.get("path"));
+  res->paths.emplace();
+  std::vector<QueryPath>& res_paths = *res->paths;
 
-      auto depth = ele.get("depth");
-      if (!depth.isInt()) {
-        throw QueryParseError("path.depth must be an integer");
+  if (paths) {
+    auto size = json_array_size(*paths);
+    res_paths.reserve(size);
+
+    for (size_t i = 0; i < size; i++) {
+      const auto& ele = paths->at(i);
+      w_string name;
+      int depth = -1;
+
+      if (ele.isString()) {
+        name = json_to_w_string(ele);
+      } else if (ele.isObject()) {
+        name = json_to_w_string(ele.get("path"));
+
+        auto depth_ref = ele.get("depth");
+        if (!depth_ref.isInt()) {
+          throw QueryParseError("path.depth must be an integer");
+        }
+
+        depth = depth_ref.asInt();
+      } else {
+        throw QueryParseError(
+            "expected object with 'path' and 'depth' properties");
       }
 
-      res_paths[i].depth = depth.asInt();
-    } else {
-      throw QueryParseError(
-          "expected object with 'path' and 'depth' properties");
+      res_paths.push_back(QueryPath{name.normalizeSeparators(), depth});
     }
+  }
 
-    res_paths[i].name = name.normalizeSeparators();
+  if (path_file) {
+    parse_path_file(res_paths, *path_file);
   }
 
-  return true;
+  // Group the paths by their parent directory, so that the path generator
+  // only has to resolve each directory once.
+  std::stable_sort(
+      res_paths.begin(),
+      res_paths.end(),
+      [](const QueryPath& a, const QueryPath& b) {
+        auto aDir = a.name.piece().dirName().view();
+        auto bDir = b.name.piece().dirName().view();
+        if (aDir != bDir) {
+          return aDir < bDir;
+        }
+        return a.name.piece().baseName().view() <
+            b.name.piece().baseName().view();
+      });
 }
 
+namespace {
+
 W_CAP_REG("relative_root")
 
 void parse_relative_root(
@@ -119,6 +205,7 @@ void parse_query_expression(Query* res, const json_ref& query) {
   }
 
   res->expr = parseQueryExpr(res, *exp);
+  res->plan = std::make_unique<QueryPlan>(*res->expr);
 }
 
 void parse_request_id(Query* res, const json_ref& query) {
@@ -177,6 +264,19 @@ void parse_sync(Query* res, const json_ref& query) {
       parse_nonnegative_integer("sync_timeout", sync_timeout)};
 }
 
+W_CAP_REG("deadline_ms")
+
+void parse_deadline(Query* res, const json_ref& query) {
+  auto deadline = query.get_optional("deadline_ms");
+  if (!deadline) {
+    return;
+  }
+  auto value = parse_nonnegative_integer("deadline_ms", *deadline);
+  if (value > 0) {
+    res->deadline = std::chrono::milliseconds{value};
+  }
+}
+
 void parse_lock_timeout(Query* res, const json_ref& query) {
   auto lock_timeout = query.get_default(
       "lock_timeout",
@@ -198,6 +298,28 @@ void parse_lock_timeout(Query* res, const json_ref& query) {
   res->lock_timeout = value;
 }
 
+W_CAP_REG("query_priority")
+
+void parse_priority(Query* res, const json_ref& query) {
+  auto priority = query.get_optional("priority");
+  if (!priority) {
+    return;
+  }
+  if (!priority->isString()) {
+    throw QueryParseError("'priority' must be a string");
+  }
+
+  auto name = json_to_w_string(*priority);
+  if (name == "interactive") {
+    res->priority = QueryPriority::Interactive;
+  } else if (name == "batch") {
+    res->priority = QueryPriority::Batch;
+  } else {
+    QueryParseError::throwf(
+        "'priority' must be \"interactive\" or \"batch\", not `{}`", name);
+  }
+}
+
 bool parse_bool_param(
     const json_ref& query,
     const char* name,
@@ -274,6 +396,8 @@ std::shared_ptr<Query> parseQuery(
   parse_sync(res, query);
   parse_dedup(res, query);
   parse_lock_timeout(res, query);
+  parse_deadline(res, query);
+  parse_priority(res, query);
   parse_relative_root(root, res, query);
   parse_empty_on_fresh_instance(res, query);
   parse_fail_if_no_saved_state(res, query);
@@ -299,6 +423,12 @@ std::shared_ptr<Query> parseQuery(
   parse_field_list(query.get_optional("fields"), &res->fieldList);
 
   res->query_spec = query;
+  if (root->queryLog) {
+    // Sort the keys so that equal specs hash the same, whatever order the
+    // client sent them in.
+    res->spec_hash = std::hash<std::string>{}(
+        json_dumps(query, JSON_COMPACT | JSON_SORT_KEYS));
+  }
 
   return result;
 }
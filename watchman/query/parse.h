@@ -41,6 +41,13 @@ void parse_field_list(
 json_ref field_list_to_json_name_array(
     const watchman::QueryFieldList& fieldList);
 
+/**
+ * Throws QueryParseError if query names a `path_file` but was sent by a
+ * client that is not the owner of the server.
+ */
+void checkPathFileAllowed(const json_ref& query, bool clientIsOwner);
+
+void parse_paths(watchman::Query* res, const json_ref& query);
 void parse_suffixes(watchman::Query* res, const json_ref& query);
 void parse_globs(watchman::Query* res, const json_ref& query);
 
@@ -6,7 +6,12 @@
  */
 
 #include <fmt/core.h>
+#include <algorithm>
+#include <cctype>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
 #include "watchman/Errors.h"
 #include "watchman/fs/FileSystem.h"
 #include "watchman/query/FileResult.h"
@@ -20,14 +25,209 @@
 
 using namespace watchman;
 
+namespace {
+
+/// Returns the length of the `{n}`, `{n,}`, `{,m}` or `{n,m}` quantifier at
+/// the start of \param str and whether it allows zero repetitions, or
+/// nullopt if it isn't a quantifier.
+std::optional<std::pair<size_t, bool>> parseBraceQuantifier(
+    std::string_view str) {
+  auto end = str.find('}');
+  if (end == std::string_view::npos) {
+    return std::nullopt;
+  }
+  auto body = str.substr(1, end - 1);
+  auto comma = body.find(',');
+  auto min = body.substr(0, comma);
+  auto max = comma == std::string_view::npos ? std::string_view{}
+                                             : body.substr(comma + 1);
+  auto isNumber = [](std::string_view s) {
+    return std::all_of(s.begin(), s.end(), [](char c) {
+      return c >= '0' && c <= '9';
+    });
+  };
+  if ((min.empty() && max.empty()) || !isNumber(min) || !isNumber(max)) {
+    return std::nullopt;
+  }
+  bool allowsZero = std::all_of(
+      min.begin(), min.end(), [](char c) { return c == '0'; });
+  return std::make_pair(end + 1, allowsZero);
+}
+
+/// Returns the longest literal that every string matching the regular
+/// expression \param pattern contains, or an empty string if there isn't
+/// one. Only literals outside of groups count, and any construct that isn't
+/// well understood here gives up on the whole pattern.
+std::string requiredRegexLiteral(std::string_view pattern) {
+  std::string longest;
+  std::string run;
+  auto endRun = [&] {
+    if (run.size() > longest.size()) {
+      longest = run;
+    }
+    run.clear();
+  };
+  // Escapes that match a class of characters or an assertion, rather than a
+  // literal.
+  constexpr std::string_view kClassEscapes = "dDwWsShHvVRXNbBAzZGK";
+
+  size_t depth = 0;
+  size_t pos = 0;
+  while (pos < pattern.size()) {
+    char c = pattern[pos];
+    bool literal = false;
+    switch (c) {
+      case '\\':
+        if (++pos >= pattern.size()) {
+          return std::string{};
+        }
+        c = pattern[pos];
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+          // Other escapes, like \x{..}, \p{..}, \Q..\E and backreferences,
+          // have a syntax of their own.
+          if (kClassEscapes.find(c) == std::string_view::npos ||
+              (c == 'N' && pos + 1 < pattern.size() &&
+               pattern[pos + 1] == '{')) {
+            return std::string{};
+          }
+        } else {
+          literal = true;
+        }
+        ++pos;
+        break;
+      case '[': {
+        ++pos;
+        if (pos < pattern.size() && pattern[pos] == '^') {
+          ++pos;
+        }
+        if (pos < pattern.size() && pattern[pos] == ']') {
+          ++pos;
+        }
+        while (pos < pattern.size() && pattern[pos] != ']') {
+          if (pattern[pos] == '\\') {
+            ++pos;
+          } else if (pattern.substr(pos, 2) == "[:") {
+            auto end = pattern.find(":]", pos + 2);
+            if (end == std::string_view::npos) {
+              return std::string{};
+            }
+            pos = end + 1;
+          }
+          ++pos;
+        }
+        if (pos >= pattern.size()) {
+          return std::string{};
+        }
+        ++pos;
+        break;
+      }
+      case '(':
+        if (pattern.substr(pos, 2) == "(*") {
+          // Verbs such as (*UTF) can change how case is folded.
+          return std::string{};
+        }
+        if (pattern.substr(pos, 2) == "(?") {
+          // Option settings such as (?x) change how the rest of the pattern
+          // is read; the other (? constructs are groups.
+          auto kind = pos + 2 < pattern.size() ? pattern[pos + 2] : '\0';
+          if (kind == '#' || std::isalpha(static_cast<unsigned char>(kind)) ||
+              kind == '-' || kind == '^') {
+            return std::string{};
+          }
+        }
+        if (depth == 0) {
+          endRun();
+        }
+        ++depth;
+        ++pos;
+        break;
+      case ')':
+        if (depth == 0) {
+          return std::string{};
+        }
+        --depth;
+        ++pos;
+        break;
+      case '|':
+        if (depth == 0) {
+          return std::string{};
+        }
+        ++pos;
+        break;
+      case '?':
+      case '*':
+      case '+':
+      case '{': {
+        size_t length = 1;
+        bool allowsZero = c != '+';
+        if (c == '{') {
+          auto quantifier = parseBraceQuantifier(pattern.substr(pos));
+          if (!quantifier) {
+            // A '{' that doesn't start a quantifier is a literal.
+            literal = true;
+            ++pos;
+            break;
+          }
+          std::tie(length, allowsZero) = *quantifier;
+        }
+        if (depth == 0) {
+          if (allowsZero && !run.empty()) {
+            run.pop_back();
+          }
+          endRun();
+        }
+        pos += length;
+        // Lazy and possessive quantifiers.
+        if (pos < pattern.size() &&
+            (pattern[pos] == '?' || pattern[pos] == '+')) {
+          ++pos;
+        }
+        continue;
+      }
+      case '.':
+      case '^':
+      case '$':
+        ++pos;
+        break;
+      default:
+        literal = true;
+        ++pos;
+        break;
+    }
+    if (depth > 0 || c == ')') {
+      continue;
+    }
+    if (literal && static_cast<unsigned char>(c) < 0x80) {
+      run.push_back(c);
+    } else {
+      endRun();
+    }
+  }
+  if (depth > 0) {
+    return std::string{};
+  }
+  endRun();
+  return longest;
+}
+
+} // namespace
+
 class PcreExpr : public QueryExpr {
   pcre2_code* re;
   pcre2_match_data* matchData;
   bool wholename;
+  std::string pattern;
 
  public:
-  explicit PcreExpr(pcre2_code* re, pcre2_match_data* matchData, bool wholename)
-      : re(re), matchData(matchData), wholename(wholename) {}
+  explicit PcreExpr(
+      pcre2_code* re,
+      pcre2_match_data* matchData,
+      bool wholename,
+      std::string pattern)
+      : re(re),
+        matchData(matchData),
+        wholename(wholename),
+        pattern(std::move(pattern)) {}
 
   ~PcreExpr() override {
     if (re) {
@@ -48,8 +248,6 @@ class PcreExpr : public QueryExpr {
       str = file->baseName();
     }
 
-    logf(ERR, "NAME: {}\n", str);
-
     rc = pcre2_match(
         re,
         reinterpret_cast<const unsigned char*>(str.data()),
@@ -58,7 +256,6 @@ class PcreExpr : public QueryExpr {
         0,
         matchData,
         nullptr);
-    logf(ERR, "RC: {}\n", rc);
     // Errors are either PCRE2_ERROR_NOMATCH or non actionable. Thus only match
     // when we get a positive return value.
     return rc >= 0;
@@ -97,8 +294,6 @@ class PcreExpr : public QueryExpr {
           fmt::format("Invalid scope '{}' for {} expression", scope, which));
     }
 
-    logf(ERR, "PATTERN: {}\n", pattern);
-
     auto re = pcre2_compile(
         reinterpret_cast<const unsigned char*>(pattern),
         PCRE2_ZERO_TERMINATED,
@@ -125,13 +320,17 @@ class PcreExpr : public QueryExpr {
               pattern));
     }
 
+    // pcre2_match uses the JIT compiled code when there is some. Where JIT
+    // isn't supported this fails, and the pattern is interpreted.
+    pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
+
     auto matchData = pcre2_match_data_create_from_pattern(re, nullptr);
     if (!matchData) {
       throw std::bad_alloc();
     }
 
     return std::make_unique<PcreExpr>(
-        re, matchData, !strcmp(scope, "wholename"));
+        re, matchData, !strcmp(scope, "wholename"), pattern);
   }
   static std::unique_ptr<QueryExpr> parsePcre(
       Query* query,
@@ -144,6 +343,14 @@ class PcreExpr : public QueryExpr {
     return parse(query, term, CaseSensitivity::CaseInSensitive);
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Pattern;
+  }
+
+  std::optional<RequiredLiteral> requiredLiteral() const override {
+    return RequiredLiteral{wholename, requiredRegexLiteral(pattern)};
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // We could, in principle, try to reverse-engineer the expression into a
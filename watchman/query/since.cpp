@@ -161,6 +161,10 @@ class SinceExpr : public QueryExpr {
     return std::make_unique<SinceExpr>(std::move(spec), selected_field);
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Metadata;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // `since` doesn't constrain the path.
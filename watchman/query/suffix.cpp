@@ -91,6 +91,10 @@ class SuffixExpr : public QueryExpr {
     return std::make_unique<SuffixExpr>(std::move(suffixSet));
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::BaseName;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // We mostly care about prefix bounds that help us skip fetching information
@@ -103,6 +103,10 @@ class TypeExpr : public QueryExpr {
     return std::make_unique<TypeExpr>(arg);
   }
 
+  EvaluationCost evaluationCost() const override {
+    return EvaluationCost::Metadata;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // `type` doesn't constrain the path.
@@ -15,10 +15,14 @@
 #include "watchman/IgnoreSet.h"
 #include "watchman/PendingCollection.h"
 #include "watchman/PubSub.h"
+#include "watchman/QueryLog.h"
+#include "watchman/QueryStats.h"
 #include "watchman/QueryableView.h"
 #include "watchman/Serde.h"
 #include "watchman/WatchmanConfig.h"
 #include "watchman/fs/FileSystem.h"
+#include "watchman/query/QueryAdmission.h"
+#include "watchman/query/QueryResultCache.h"
 #include "watchman/thirdparty/jansson/jansson.h"
 #include "watchman/watchman_string.h"
 
@@ -141,6 +145,7 @@ struct RootQueryInfo : serde::Object {
   int64_t generation_duration_milliseconds;
   int64_t render_duration_milliseconds;
   int64_t view_lock_wait_duration_milliseconds;
+  int64_t estimated_cost = 0;
   w_string state;
   int64_t client_pid;
   std::optional<w_string> request_id;
@@ -155,6 +160,7 @@ struct RootQueryInfo : serde::Object {
     x("render-duration-milliseconds", render_duration_milliseconds);
     x("view-lock-wait-duration-milliseconds",
       view_lock_wait_duration_milliseconds);
+    x("estimated-cost", estimated_cost);
     x("state", state);
     x("client-pid", client_pid);
     x("request-id", request_id);
@@ -179,6 +185,14 @@ struct RootDebugStatus : serde::Object {
   bool cancelled;
   bool enable_parallel_crawl;
   w_string crawl_status;
+  int64_t pruned_dirs = 0;
+  int64_t pruned_files = 0;
+  int64_t cancelled_queries_disconnected = 0;
+  int64_t cancelled_queries_deadline = 0;
+  int64_t cancelled_queries_files_walked = 0;
+  std::optional<NameTableStats> name_table;
+  std::optional<QueryResultCacheStats> query_result_cache;
+  std::optional<QueryAdmissionStats> query_admission;
 
   template <typename X>
   void map(X& x) {
@@ -196,6 +210,14 @@ struct RootDebugStatus : serde::Object {
     x("cancelled", cancelled);
     x("crawl-status", crawl_status);
     x("enable_parallel_crawl", enable_parallel_crawl);
+    x("pruned_dirs", pruned_dirs);
+    x("pruned_files", pruned_files);
+    x("cancelled_queries_disconnected", cancelled_queries_disconnected);
+    x("cancelled_queries_deadline", cancelled_queries_deadline);
+    x("cancelled_queries_files_walked", cancelled_queries_files_walked);
+    x("name_table", name_table);
+    x("query_result_cache", query_result_cache);
+    x("query_admission", query_admission);
   }
 };
 
@@ -268,6 +290,23 @@ class Root : public RootConfig, public std::enable_shared_from_this<Root> {
   // Why we failed to watch
   std::optional<w_string> failure_reason;
 
+  // How many times a dir or file was left out of the view because it
+  // matched ignore_globs. Nothing below a pruned dir is counted.
+  struct PrunedCounts {
+    std::atomic<int64_t> dirs{0};
+    std::atomic<int64_t> files{0};
+  };
+  mutable PrunedCounts pruned;
+
+  // How many queries were cancelled, and how many files they had walked
+  // when they were.
+  struct CancelledQueryCounts {
+    std::atomic<int64_t> disconnected{0};
+    std::atomic<int64_t> deadlineExceeded{0};
+    std::atomic<int64_t> filesWalked{0};
+  };
+  mutable CancelledQueryCounts cancelledQueries;
+
   // State transition counter to allow identification of concurrent state
   // transitions
   std::atomic<uint32_t> stateTransCount{0};
@@ -306,6 +345,23 @@ class Root : public RootConfig, public std::enable_shared_from_this<Root> {
   // are not changed by the query exection.
   folly::Synchronized<std::unordered_set<QueryContext*>> queries;
 
+  // Per-command, per-phase timings of the queries that have completed
+  // against this root. Reported by `watchman debug-query-stats`.
+  QueryStats queryStats;
+
+  // The most recent queries against this root, reported by
+  // `watchman debug-query-log`. Null if query_log_size is 0.
+  std::unique_ptr<QueryLog> queryLog;
+
+  // Results of recent queries, shared with identical queries that run
+  // before the view next changes. Null if query_result_cache_max_results
+  // is 0.
+  std::unique_ptr<QueryResultCache> queryResultCache;
+
+  // Limits how many expensive queries run at once. Null if neither
+  // query_max_concurrent nor query_max_concurrent_per_client is set.
+  std::unique_ptr<QueryAdmissionController> queryAdmission;
+
   /**
    * Returns the view with which this Root was constructed.
    */
@@ -27,7 +27,9 @@ void Root::considerAgeOut() {
 }
 
 void Root::performAgeOut(std::chrono::seconds min_age) {
-  // Find deleted nodes older than the gc_age setting.
+  // Find deleted nodes older than the gc_age setting.  Only deleted nodes
+  // are examined, and the view lock is released every gc_slice_ms so that
+  // queries aren't held up for the duration.
   // This is particularly useful in cases where your tree observes a
   // large number of creates and deletes for many unique filenames in
   // a given dir (eg: temporary/randomized filenames generated as part
@@ -37,7 +39,8 @@ void Root::performAgeOut(std::chrono::seconds min_age) {
   int64_t walked = 0;
   int64_t files = 0;
   int64_t dirs = 0;
-  view()->ageOut(walked, files, dirs, std::chrono::seconds(min_age));
+  int64_t slices = 0;
+  view()->ageOut(walked, files, dirs, slices, std::chrono::seconds(min_age));
 
   // Age out cursors too.
   {
@@ -59,7 +62,8 @@ void Root::performAgeOut(std::chrono::seconds min_age) {
         json_object(
             {{"walked", json_integer(walked)},
              {"files", json_integer(files)},
-             {"dirs", json_integer(dirs)}}));
+             {"dirs", json_integer(dirs)},
+             {"slices", json_integer(slices)}}));
 
     sample.add_root_metadata(root_metadata);
     sample.log();
@@ -78,6 +82,7 @@ void Root::performAgeOut(std::chrono::seconds min_age) {
     ageOut.walked = walked;
     ageOut.files = files;
     ageOut.dirs = dirs;
+    ageOut.slices = slices;
     getLogger()->logEvent(ageOut);
   }
 }
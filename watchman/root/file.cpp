@@ -24,29 +24,29 @@ void watchman_file::removeFromFileList() {
   }
 }
 
-/* We embed our name string in the tail end of the struct that we're
- * allocating here.  This turns out to be more memory efficient due
- * to the way that the allocator bins sizeof(watchman_file); there's
- * a bit of unusable space after the end of the structure that happens
- * to be about the right size to fit a typical filename.
- * Embedding the name in the end allows us to make the most of this
- * memory and free up the separate heap allocation for file_name.
+void watchman_deleted_link::removeFromDeletedList() {
+  if (deletedNext) {
+    deletedNext->deletedPrev = deletedPrev;
+    deletedPrev->deletedNext = deletedNext;
+    deletedPrev = nullptr;
+    deletedNext = nullptr;
+  }
+}
+
+/* The name is referenced rather than copied, so that files with the same
+ * name can share it; see NameTable.
  */
 std::unique_ptr<watchman_file, watchman_dir::Deleter> watchman_file::make(
     const w_string& name,
     watchman_dir* parent) {
-  auto file = (watchman_file*)calloc(
-      1, sizeof(watchman_file) + sizeof(uint32_t) + name.size() + 1);
+  auto file = (watchman_file*)calloc(1, sizeof(watchman_file));
+  if (!file) {
+    throw std::bad_alloc{};
+  }
   std::unique_ptr<watchman_file, watchman_dir::Deleter> filePtr(
       file, watchman_dir::Deleter());
 
-  auto lenPtr = (uint32_t*)(file + 1);
-  *lenPtr = name.size();
-
-  auto data = (char*)(lenPtr + 1);
-  memcpy(data, name.data(), name.size());
-  data[name.size()] = 0;
-
+  new (&file->name) w_string{name};
   file->parent = parent;
   file->exists = true;
 
@@ -55,6 +55,7 @@ std::unique_ptr<watchman_file, watchman_dir::Deleter> watchman_file::make(
 
 watchman_file::~watchman_file() {
   removeFromFileList();
+  removeFromDeletedList();
 }
 
 void free_file_node(struct watchman_file* file) {
@@ -7,6 +7,7 @@
 
 #include <fmt/core.h>
 #include <folly/String.h>
+#include <algorithm>
 #include "watchman/Logging.h"
 #include "watchman/QueryableView.h"
 #include "watchman/TriggerCommand.h"
@@ -218,6 +219,27 @@ IgnoreSet computeIgnoreSet(
     }
   }
 
+  if (auto globs = config.get("ignore_globs")) {
+    if (!globs->isArray()) {
+      logf(ERR, "ignore_globs must be an array of strings\n");
+    } else {
+      for (auto& jglob : globs->array()) {
+        if (!jglob.isString()) {
+          logf(ERR, "ignore_globs must be an array of strings\n");
+          continue;
+        }
+
+        auto pattern = json_to_w_string(jglob);
+        try {
+          result.addGlob(root_path, pattern.view());
+          logf(DBG, "ignoring paths matching {}\n", pattern);
+        } catch (const std::domain_error& e) {
+          logf(ERR, "ignore_globs: {}\n", e.what());
+        }
+      }
+    }
+  }
+
   auto ignores = getIgnoreVcs(config);
   for (auto& jignore : ignores.array()) {
     if (!jignore.isString()) {
@@ -277,6 +299,36 @@ Root::Root(
 
   inner.last_cmd_timestamp = std::chrono::steady_clock::now();
 
+  if (auto queryLogSize = config.getInt("query_log_size", 256);
+      queryLogSize > 0) {
+    queryLog = std::make_unique<QueryLog>(
+        root_path,
+        uint32_t(queryLogSize),
+        std::chrono::milliseconds(config.getInt("query_log_slow_ms", 0)));
+  }
+
+  if (auto maxResults = config.getInt("query_result_cache_max_results", 0);
+      maxResults > 0) {
+    queryResultCache = std::make_unique<QueryResultCache>(size_t(maxResults));
+  }
+
+  // Negative limits are treated as zero: no limit.
+  auto getLimit = [&](const char* name, json_int_t defval) {
+    return size_t(std::max<json_int_t>(config.getInt(name, defval), 0));
+  };
+  QueryAdmissionController::Limits admissionLimits;
+  admissionLimits.maxConcurrent = getLimit("query_max_concurrent", 0);
+  admissionLimits.maxConcurrentPerClient =
+      getLimit("query_max_concurrent_per_client", 0);
+  if (admissionLimits.maxConcurrent || admissionLimits.maxConcurrentPerClient) {
+    admissionLimits.maxQueued = getLimit("query_max_queued", 64);
+    admissionLimits.minCost = getLimit("query_admission_min_cost", 100000);
+    admissionLimits.timeout = std::chrono::milliseconds(
+        getLimit("query_admission_timeout_ms", 60000));
+    queryAdmission =
+        std::make_unique<QueryAdmissionController>(admissionLimits);
+  }
+
   if (!view_->requiresCrawl) {
     // This watcher can resolve queries without needing a crawl.
     inner.done_initial = true;
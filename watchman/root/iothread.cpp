@@ -343,6 +343,7 @@ InMemoryView::IsDesynced InMemoryView::processAllPending(
       // processed paths log.
       processedPaths_->write(
           PendingChangeLogEntry{
+              rootPath_,
               PendingChange{
                   pendingCookie,
                   std::chrono::system_clock::now(),
@@ -500,6 +501,14 @@ void InMemoryView::crawler(
   logf(
       DBG, "opendir({}) recursive={} stat_all={}\n", path, recursive, stat_all);
 
+  // statPath won't have created a dir that matches ignore_globs, but the
+  // watcher may still ask us to crawl one that it was already watching.
+  // Don't add a watch for it.
+  if (root->ignore.isIgnoredByGlob(path, true)) {
+    logf(DBG, "{} matches ignore_globs rules\n", path);
+    return;
+  }
+
   /* Start watching and open the dir for crawling.
    * Whether we open the dir prior to watching or after is watcher specific,
    * so the operations are rolled together in our abstraction */
@@ -632,6 +641,10 @@ class CrawlerFileSystem : public FileSystem {
         !root_->cookies.isCookieDir(fullPath)) {
       return nullptr;
     }
+    // statPath has already counted it.
+    if (root_->ignore.isIgnoredByGlob(fullPath, true)) {
+      return nullptr;
+    }
     // Use watcher->startWatchDir to ensure side effects are applied
     // in the right order (ex. inotify_add_watch before opendir).
     // This requires startWatchDir to be thread-safe.
@@ -898,13 +911,24 @@ void InMemoryView::statPath(
   }
 
   if (processedPaths_) {
-    processedPaths_->write(PendingChangeLogEntry{pending, errcode, st});
+    processedPaths_->write(
+        PendingChangeLogEntry{rootPath_, pending, errcode, st});
   }
   if (fullCrawlStatCount_) {
     // Not using loaded value - load can be relaxed - no need for acq_rel
     fullCrawlStatCount_->fetch_add(1, std::memory_order_release);
   }
 
+  // If it's gone, we can't know whether it was a dir, but if we have a node
+  // for it then it can't have matched before.
+  bool mayBeDir = errcode ? file == nullptr : st.isDir();
+  if (root.ignore.isIgnoredByGlob(path, mayBeDir)) {
+    logf(DBG, "{} matches ignore_globs rules\n", path);
+    auto& counter = mayBeDir ? root.pruned.dirs : root.pruned.files;
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
   if (errcode == error_code::no_such_file_or_directory ||
       errcode == error_code::not_a_directory) {
     /* it's not there, update our state */
@@ -23,4 +23,19 @@ TEST(RootTest, IgnoreSet_includes_ignore_vcs_if_no_ignore_dirs) {
   EXPECT_TRUE(ignores.isIgnoreVCS(w_string{"root/.hg"}));
 }
 
+TEST(RootTest, IgnoreSet_skips_invalid_ignore_globs) {
+  json_ref val = json_object({
+      {"ignore_globs",
+       json_array(
+           {w_string_to_json("!keep"),
+            json_integer(1),
+            w_string_to_json("node_modules")})},
+  });
+  Configuration config(val);
+
+  auto ignores = computeIgnoreSet(w_string{"root"}, config);
+  EXPECT_TRUE(ignores.isIgnoredByGlob("root/a/node_modules", true));
+  EXPECT_FALSE(ignores.isIgnoredByGlob("root/keep", true));
+}
+
 } // namespace
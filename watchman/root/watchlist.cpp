@@ -190,6 +190,9 @@ RootDebugStatus Root::getStatus() const {
         case QueryContextState::NotStarted:
           queryState = "NotStarted";
           break;
+        case QueryContextState::WaitingForAdmission:
+          queryState = "WaitingForAdmission";
+          break;
         case QueryContextState::WaitingForCookieSync:
           queryState = "WaitingForCookieSync";
           break;
@@ -211,13 +214,18 @@ RootDebugStatus Root::getStatus() const {
       info.elapsed_milliseconds =
           std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
               .count();
+      auto toMillis = [](std::chrono::microseconds us) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(us)
+            .count();
+      };
       info.cookie_sync_duration_milliseconds =
-          ctx->cookieSyncDuration.load().count();
+          toMillis(ctx->cookieSyncDuration.load());
       info.generation_duration_milliseconds =
-          ctx->generationDuration.load().count();
-      info.render_duration_milliseconds = ctx->renderDuration.load().count();
+          toMillis(ctx->generationDuration.load());
+      info.render_duration_milliseconds = toMillis(ctx->renderDuration.load());
       info.view_lock_wait_duration_milliseconds =
-          ctx->viewLockWaitDuration.load().count();
+          toMillis(ctx->viewLockWaitDuration.load());
+      info.estimated_cost = int64_t(ctx->estimatedCost.load());
       info.state = queryState;
       info.client_pid = ctx->query->clientInfo.clientPid;
       info.request_id = ctx->query->request_id;
@@ -257,6 +265,21 @@ RootDebugStatus Root::getStatus() const {
   obj.cancelled = inner.cancelled;
   obj.crawl_status = w_string{crawl_status.data(), crawl_status.size()};
   obj.enable_parallel_crawl = enable_parallel_crawl;
+  obj.pruned_dirs = pruned.dirs.load(std::memory_order_relaxed);
+  obj.pruned_files = pruned.files.load(std::memory_order_relaxed);
+  obj.cancelled_queries_disconnected =
+      cancelledQueries.disconnected.load(std::memory_order_relaxed);
+  obj.cancelled_queries_deadline =
+      cancelledQueries.deadlineExceeded.load(std::memory_order_relaxed);
+  obj.cancelled_queries_files_walked =
+      cancelledQueries.filesWalked.load(std::memory_order_relaxed);
+  obj.name_table = view()->getNameTableStats();
+  if (queryResultCache) {
+    obj.query_result_cache = queryResultCache->getStats();
+  }
+  if (queryAdmission) {
+    obj.query_admission = queryAdmission->getStats();
+  }
   return obj;
 }
 
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/scm/CommandServer.h"
+#include <fmt/core.h>
+#include <folly/String.h>
+#include "watchman/Logging.h"
+#include "watchman/scm/SCM.h"
+
+namespace watchman {
+
+namespace {
+
+constexpr std::string_view kRunCommand{"runcommand\n"};
+constexpr size_t kReadChunkSize = 64 * 1024;
+
+std::string encodeBigEndian32(uint32_t value) {
+  std::string result(4, '\0');
+  result[0] = char((value >> 24) & 0xff);
+  result[1] = char((value >> 16) & 0xff);
+  result[2] = char((value >> 8) & 0xff);
+  result[3] = char(value & 0xff);
+  return result;
+}
+
+uint32_t decodeBigEndian32(std::string_view bytes) {
+  auto b = reinterpret_cast<const unsigned char*>(bytes.data());
+  return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) |
+      (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+} // namespace
+
+PipeCommandServer::PipeCommandServer(
+    std::vector<std::string_view> cmdline,
+    ChildProcess::Options options) {
+#ifdef _WIN32
+  (void)cmdline;
+  (void)options;
+  SCMError::throwf("command servers are not supported on this platform");
+#else
+  options.pipeStdin();
+  options.pipeStdout();
+  proc_ = std::make_unique<ChildProcess>(cmdline, std::move(options));
+  stdin_ = proc_->takePipe(STDIN_FILENO);
+  stdout_ = proc_->takePipe(STDOUT_FILENO);
+  stdin_->write.setNonBlock();
+  stdout_->read.setNonBlock();
+#endif
+}
+
+PipeCommandServer::~PipeCommandServer() {
+  if (!proc_) {
+    return;
+  }
+  // Closing stdin is enough for well-behaved servers to exit, but we may be
+  // discarding one that is wedged, so don't rely on it.
+  stdin_.reset();
+  stdout_.reset();
+  proc_->kill();
+  try {
+    proc_->wait();
+  } catch (const std::exception& exc) {
+    log(ERR, "failed to reap command server: ", exc.what(), "\n");
+  }
+}
+
+void PipeCommandServer::waitForFd(
+    const FileDescriptor& fd,
+    bool forWrite,
+    Deadline deadline) {
+#ifdef _WIN32
+  (void)fd;
+  (void)forWrite;
+  (void)deadline;
+  SCMError::throwf("command servers are not supported on this platform");
+#else
+  while (true) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      SCMError::throwf("timed out waiting for command server");
+    }
+
+    pollfd pfd;
+    pfd.fd = fd.system_handle();
+    pfd.events = forWrite ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    auto r = ::poll(&pfd, 1, int(remaining.count()));
+    if (r > 0) {
+      return;
+    }
+    if (r < 0 && errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(), "poll");
+    }
+  }
+#endif
+}
+
+void PipeCommandServer::writeAll(std::string_view data, Deadline deadline) {
+  while (!data.empty()) {
+    waitForFd(stdin_->write, true, deadline);
+    auto res = stdin_->write.write(data.data(), int(data.size()));
+    if (res.hasError()) {
+      if (res.error() == std::errc::resource_unavailable_try_again ||
+          res.error() == std::errc::interrupted) {
+        continue;
+      }
+      throw std::system_error(res.error(), "write to command server");
+    }
+    data.remove_prefix(size_t(res.value()));
+  }
+}
+
+void PipeCommandServer::fillBuffer(Deadline deadline) {
+  char buf[kReadChunkSize];
+  while (true) {
+    waitForFd(stdout_->read, false, deadline);
+    auto res = stdout_->read.read(buf, sizeof(buf));
+    if (res.hasError()) {
+      if (res.error() == std::errc::resource_unavailable_try_again ||
+          res.error() == std::errc::interrupted) {
+        continue;
+      }
+      throw std::system_error(res.error(), "read from command server");
+    }
+    if (res.value() == 0) {
+      SCMError::throwf("command server exited unexpectedly");
+    }
+    buffer_.append(buf, size_t(res.value()));
+    return;
+  }
+}
+
+std::string PipeCommandServer::readExactly(size_t size, Deadline deadline) {
+  while (buffer_.size() < size) {
+    fillBuffer(deadline);
+  }
+  std::string result = buffer_.substr(0, size);
+  buffer_.erase(0, size);
+  return result;
+}
+
+std::string PipeCommandServer::readLine(Deadline deadline) {
+  size_t searched = 0;
+  while (true) {
+    auto eol = buffer_.find('\n', searched);
+    if (eol != std::string::npos) {
+      std::string line = buffer_.substr(0, eol);
+      buffer_.erase(0, eol + 1);
+      return line;
+    }
+    searched = buffer_.size();
+    fillBuffer(deadline);
+  }
+}
+
+HgCommandServer::HgCommandServer(
+    std::string_view hgPath,
+    ChildProcess::Options options,
+    std::chrono::milliseconds helloTimeout)
+    : PipeCommandServer(
+          {hgPath,
+           "serve",
+           "--cmdserver",
+           "pipe",
+           "--config",
+           "ui.interactive=False"},
+          std::move(options)) {
+  // The server announces itself and its capabilities on the output channel
+  // before accepting any commands.
+  auto hello = readMessage(std::chrono::steady_clock::now() + helloTimeout);
+  if (hello.channel != 'o' ||
+      hello.data.find("runcommand") == std::string::npos) {
+    SCMError::throwf(
+        "unexpected hello from hg command server: {}",
+        folly::cEscape<std::string>(hello.data));
+  }
+}
+
+HgCommandServer::Message HgCommandServer::readMessage(Deadline deadline) {
+  auto header = readExactly(5, deadline);
+  Message msg;
+  msg.channel = header[0];
+  auto length = decodeBigEndian32(std::string_view{header}.substr(1));
+  // Input channels carry the requested size in the length field and have
+  // no payload.
+  if (msg.channel != 'I' && msg.channel != 'L') {
+    msg.data = readExactly(length, deadline);
+  }
+  return msg;
+}
+
+CommandServerResult HgCommandServer::run(
+    const std::vector<std::string>& args,
+    std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+
+  auto payload = folly::join('\0', args);
+  std::string request{kRunCommand};
+  request.append(encodeBigEndian32(uint32_t(payload.size())));
+  request.append(payload);
+  writeAll(request, deadline);
+
+  std::string output;
+  std::string error;
+  while (true) {
+    auto msg = readMessage(deadline);
+    switch (msg.channel) {
+      case 'o':
+        output.append(msg.data);
+        break;
+      case 'e':
+        error.append(msg.data);
+        break;
+      case 'r':
+        if (msg.data.size() != 4) {
+          SCMError::throwf(
+              "malformed result from hg command server: {} bytes",
+              msg.data.size());
+        }
+        return CommandServerResult{
+            int(decodeBigEndian32(msg.data)),
+            w_string{output},
+            w_string{error}};
+      case 'I':
+      case 'L':
+        // We never have input to provide; a zero length reply is EOF.
+        writeAll(encodeBigEndian32(0), deadline);
+        break;
+      default:
+        // Upper case channels are mandatory and we can't handle them;
+        // lower case channels may be safely ignored.
+        if (msg.channel >= 'A' && msg.channel <= 'Z') {
+          SCMError::throwf(
+              "unsupported channel '{}' from hg command server", msg.channel);
+        }
+        break;
+    }
+  }
+}
+
+GitBatchCheckServer::GitBatchCheckServer(
+    std::string_view gitPath,
+    ChildProcess::Options options)
+    : PipeCommandServer(
+          {gitPath, "cat-file", "--batch-check"},
+          std::move(options)) {}
+
+CommandServerResult GitBatchCheckServer::run(
+    const std::vector<std::string>& args,
+    std::chrono::milliseconds timeout) {
+  if (args.size() != 1 || args[0].find('\n') != std::string::npos) {
+    SCMError::throwf("git batch-check requests take a single revision");
+  }
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  writeAll(args[0] + "\n", deadline);
+
+  auto line = readLine(deadline);
+  // Unresolvable names are echoed back with a status word instead of an
+  // object id, eg: "nope missing" or "abc ambiguous".
+  std::string_view lineView{line};
+  auto sep = lineView.rfind(' ');
+  if (sep != std::string_view::npos) {
+    auto word = lineView.substr(sep + 1);
+    if (word == "missing" || word == "ambiguous") {
+      return CommandServerResult{1, w_string{}, w_string{lineView}};
+    }
+  }
+  return CommandServerResult{0, w_string{lineView}, w_string{}};
+}
+
+CommandServerPool::CommandServerPool(
+    w_string name,
+    Factory factory,
+    size_t maxServers,
+    std::chrono::milliseconds timeout)
+    : name_{std::move(name)},
+      factory_{std::move(factory)},
+      maxServers_{maxServers},
+      timeout_{timeout} {}
+
+std::unique_ptr<CommandServer> CommandServerPool::acquire() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  if (!cond_.wait_for(lock, timeout_, [this] {
+        return !idle_.empty() || live_ < maxServers_;
+      })) {
+    SCMError::throwf("timed out waiting for a free {} command server", name_);
+  }
+
+  ++requests_;
+  if (!idle_.empty()) {
+    auto server = std::move(idle_.back());
+    idle_.pop_back();
+    return server;
+  }
+
+  ++live_;
+  ++spawned_;
+  lock.unlock();
+  try {
+    return factory_();
+  } catch (const std::exception& exc) {
+    discard();
+    SCMError::throwf(
+        "failed to start {} command server: {}", name_, exc.what());
+  }
+}
+
+void CommandServerPool::release(std::unique_ptr<CommandServer> server) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    idle_.push_back(std::move(server));
+  }
+  cond_.notify_one();
+}
+
+void CommandServerPool::discard() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    --live_;
+    ++failures_;
+  }
+  cond_.notify_one();
+}
+
+CommandServerResult CommandServerPool::run(
+    const std::vector<std::string>& args) {
+  auto server = acquire();
+  auto start = std::chrono::steady_clock::now();
+
+  CommandServerResult result;
+  try {
+    result = server->run(args, timeout_);
+  } catch (const std::exception& exc) {
+    log(ERR,
+        name_,
+        " command server failed, replacing it: ",
+        exc.what(),
+        "\n");
+    server.reset();
+    discard();
+    SCMError::throwf("{} command server failed: {}", name_, exc.what());
+  }
+
+  latency_.record(std::chrono::steady_clock::now() - start);
+  release(std::move(server));
+  return result;
+}
+
+CommandServerPoolStats CommandServerPool::getStats() const {
+  CommandServerPoolStats stats;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stats.name = name_;
+    stats.max_servers = int64_t(maxServers_);
+    stats.live = int64_t(live_);
+    stats.idle = int64_t(idle_.size());
+    stats.requests = int64_t(requests_);
+    stats.failures = int64_t(failures_);
+    stats.spawned = int64_t(spawned_);
+  }
+  stats.latency = latency_.summarize();
+  return stats;
+}
+
+} // namespace watchman
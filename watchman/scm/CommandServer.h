@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "watchman/ChildProcess.h"
+#include "watchman/LatencyHistogram.h"
+#include "watchman/Serde.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+struct CommandServerResult {
+  // The exit status reported by the server for this request.
+  int status{0};
+  w_string output;
+  w_string error;
+};
+
+/**
+ * A long-lived helper process that can answer many SCM requests without
+ * paying interpreter startup for each one.
+ *
+ * A server handles one request at a time. If run() throws, the server is
+ * in an unknown state and must be discarded; CommandServerPool takes care
+ * of that.
+ */
+class CommandServer {
+ public:
+  virtual ~CommandServer() = default;
+
+  virtual CommandServerResult run(
+      const std::vector<std::string>& args,
+      std::chrono::milliseconds timeout) = 0;
+};
+
+/**
+ * Base for servers that converse with a child over its stdin and stdout.
+ * Reads and writes are bounded by a deadline so that a wedged child
+ * surfaces as an SCMError rather than blocking the caller forever.
+ *
+ * The options passed in must not configure stdin or stdout; they are
+ * piped here.
+ */
+class PipeCommandServer : public CommandServer {
+ public:
+  ~PipeCommandServer() override;
+
+ protected:
+  PipeCommandServer(
+      std::vector<std::string_view> cmdline,
+      ChildProcess::Options options);
+
+  using Deadline = std::chrono::steady_clock::time_point;
+
+  void writeAll(std::string_view data, Deadline deadline);
+  std::string readExactly(size_t size, Deadline deadline);
+  std::string readLine(Deadline deadline);
+
+ private:
+  // Waits until fd is ready for reading or writing, or throws on timeout.
+  void waitForFd(const FileDescriptor& fd, bool forWrite, Deadline deadline);
+  // Appends at least one byte from stdout to buffer_.
+  void fillBuffer(Deadline deadline);
+
+  std::unique_ptr<ChildProcess> proc_;
+  std::unique_ptr<Pipe> stdin_;
+  std::unique_ptr<Pipe> stdout_;
+  // Bytes read from stdout but not yet consumed.
+  std::string buffer_;
+};
+
+/**
+ * Speaks the Mercurial command server protocol with
+ * `hg serve --cmdserver pipe`. Requests are hg arguments, not including
+ * the executable name.
+ */
+class HgCommandServer : public PipeCommandServer {
+ public:
+  HgCommandServer(
+      std::string_view hgPath,
+      ChildProcess::Options options,
+      std::chrono::milliseconds helloTimeout);
+
+  CommandServerResult run(
+      const std::vector<std::string>& args,
+      std::chrono::milliseconds timeout) override;
+
+ private:
+  struct Message {
+    char channel;
+    std::string data;
+  };
+  Message readMessage(Deadline deadline);
+};
+
+/**
+ * Resolves revisions through a `git cat-file --batch-check` process.
+ * Each request is a single revision expression and the output is git's
+ * "<oid> <type> <size>" line. Unknown revisions yield a non-zero status.
+ */
+class GitBatchCheckServer : public PipeCommandServer {
+ public:
+  GitBatchCheckServer(std::string_view gitPath, ChildProcess::Options options);
+
+  CommandServerResult run(
+      const std::vector<std::string>& args,
+      std::chrono::milliseconds timeout) override;
+};
+
+struct CommandServerPoolStats : serde::Object {
+  w_string name;
+  int64_t max_servers = 0;
+  int64_t live = 0;
+  int64_t idle = 0;
+  int64_t requests = 0;
+  int64_t failures = 0;
+  int64_t spawned = 0;
+  LatencySummary latency;
+
+  template <typename X>
+  void map(X& x) {
+    x("name", name);
+    x("max_servers", max_servers);
+    x("live", live);
+    x("idle", idle);
+    x("requests", requests);
+    x("failures", failures);
+    x("spawned", spawned);
+    x("latency", latency);
+  }
+};
+
+/**
+ * Maintains up to maxServers CommandServers for a repository and hands
+ * each request to an idle one, spawning on demand. Servers that fail or
+ * time out are discarded and replaced on the next request.
+ *
+ * Failures, including timing out while waiting for a free server, are
+ * reported by throwing SCMError; callers are expected to fall back to
+ * spawning a one-shot process. A request that the server ran but that
+ * failed is not an error here; inspect CommandServerResult::status.
+ */
+class CommandServerPool {
+ public:
+  using Factory = std::function<std::unique_ptr<CommandServer>()>;
+
+  CommandServerPool(
+      w_string name,
+      Factory factory,
+      size_t maxServers,
+      std::chrono::milliseconds timeout);
+
+  CommandServerResult run(const std::vector<std::string>& args);
+
+  CommandServerPoolStats getStats() const;
+
+ private:
+  std::unique_ptr<CommandServer> acquire();
+  void release(std::unique_ptr<CommandServer> server);
+  void discard();
+
+  const w_string name_;
+  const Factory factory_;
+  const size_t maxServers_;
+  const std::chrono::milliseconds timeout_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<CommandServer>> idle_;
+  size_t live_{0};
+  uint64_t requests_{0};
+  uint64_t failures_{0};
+  uint64_t spawned_{0};
+
+  LatencyHistogram latency_;
+};
+
+} // namespace watchman
@@ -13,6 +13,8 @@
 #include "watchman/CommandRegistry.h"
 #include "watchman/Logging.h"
 #include "watchman/fs/FileSystem.h"
+#include "watchman/scm/CommandServer.h"
+#include "watchman/scm/GitState.h"
 
 // Capability indicating support for the git SCM
 W_CAP_REG("scm-git")
@@ -71,6 +73,7 @@ namespace watchman {
 
 Git::Git(w_string_piece rootPath, w_string_piece scmRoot)
     : SCM(rootPath, scmRoot),
+      gitDir_(fmt::format("{}/.git", getSCMRoot())),
       indexPath_(fmt::format("{}/.git/index", getSCMRoot())),
       commitsPrior_(Configuration(), "scm_git_commits_prior", 32, 10),
       mergeBases_(Configuration(), "scm_git_mergebase", 32, 10),
@@ -78,7 +81,50 @@ Git::Git(w_string_piece rootPath, w_string_piece scmRoot)
           Configuration(),
           "scm_git_files_since_mergebase",
           32,
-          10) {}
+          10) {
+  auto numServers = cfg_get_int("scm_git_command_servers", 0);
+  if (numServers > 0) {
+    auto timeout = std::chrono::milliseconds(
+        cfg_get_int("scm_command_server_timeout_ms", 30000));
+    commandServers_ = std::make_unique<CommandServerPool>(
+        w_string{"git"},
+        [this] {
+          ChildProcess::Options opt;
+          opt.nullStderr();
+          opt.chdir(getRootPath());
+          return std::make_unique<GitBatchCheckServer>(
+              gitExecutablePath(), std::move(opt));
+        },
+        size_t(numServers),
+        timeout);
+  }
+}
+
+Git::~Git() = default;
+
+std::vector<CommandServerPoolStats> Git::getCommandServerStats() const {
+  if (!commandServers_) {
+    return {};
+  }
+  return {commandServers_->getStats()};
+}
+
+std::optional<w_string> Git::resolveCommit(w_string_piece commitId) const {
+  if (!commandServers_) {
+    return std::nullopt;
+  }
+  try {
+    auto result =
+        commandServers_->run({fmt::format("{}^{{commit}}", commitId)});
+    if (result.status == 0) {
+      auto line = result.output.view();
+      return w_string{line.substr(0, line.find(' '))};
+    }
+  } catch (const SCMError& exc) {
+    log(DBG, "unable to resolve ", commitId, " via git: ", exc.what(), "\n");
+  }
+  return std::nullopt;
+}
 
 ChildProcess::Options Git::makeGitOptions(
     const std::optional<w_string>& requestId) const {
@@ -107,11 +153,56 @@ struct timespec Git::getIndexMtime() const {
   }
 }
 
+std::string Git::getHeadKey() const {
+  // The merge base only depends on HEAD, so key on the resolved commit when
+  // we can read it directly. Failing that, the index checksum only changes
+  // when the index content does, unlike its mtime which is bumped by every
+  // `git status` that refreshes stat info.
+  if (auto head = resolveGitHead(gitDir_)) {
+    return fmt::format("head:{}", *head);
+  }
+  if (auto index = readGitIndexHeader(indexPath_.c_str());
+      index && !index->checksum.empty()) {
+    return fmt::format("index:{}", index->checksum);
+  }
+  auto mtime = getIndexMtime();
+  return fmt::format("{}:{}", mtime.tv_sec, mtime.tv_nsec);
+}
+
 w_string Git::mergeBaseWith(
     w_string_piece commitId,
     const std::optional<w_string>& requestId) const {
-  auto mtime = getIndexMtime();
-  auto key = fmt::format("{}:{}:{}", commitId, mtime.tv_sec, mtime.tv_nsec);
+  // Checked here, rather than by the command server, so that bad input
+  // doesn't cost us a healthy server.
+  auto revision = commitId.view();
+  if (revision.empty() || revision.find('\n') != std::string_view::npos ||
+      revision.find('\0') != std::string_view::npos) {
+    SCMError::throwf("invalid revision `{}`", commitId);
+  }
+
+  // The merge base of HEAD with itself is trivially known without
+  // asking git.
+  auto head = resolveGitHead(gitDir_);
+  if (head && (commitId == "HEAD" || commitId == *head)) {
+    return *head;
+  }
+
+  // A commit hash already names where it points. Anything else is
+  // resolved through a pooled server, which is much cheaper than computing
+  // the merge base, so that the cache is keyed on where the branch
+  // actually points.
+  std::optional<w_string> resolved;
+  if (isCommitHex(revision)) {
+    resolved = commitId.asWString();
+  } else {
+    resolved = resolveCommit(commitId);
+    if (head && resolved && *resolved == *head) {
+      return *head;
+    }
+  }
+
+  auto key = fmt::format(
+      "{}:{}", resolved ? resolved->piece() : commitId, getHeadKey());
   auto commit = std::string{commitId.view()};
 
   return mergeBases_
@@ -187,9 +278,7 @@ std::vector<w_string> Git::getCommitsPriorToAndIncluding(
     w_string_piece commitId,
     int numCommits,
     const std::optional<w_string>& requestId) const {
-  auto mtime = getIndexMtime();
-  auto key = fmt::format(
-      "{}:{}:{}:{}", commitId, numCommits, mtime.tv_sec, mtime.tv_nsec);
+  auto key = fmt::format("{}:{}:{}", commitId, numCommits, getHeadKey());
   auto commitCopy = std::string{commitId.view()};
 
   return commitsPrior_
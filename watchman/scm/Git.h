@@ -11,6 +11,7 @@
 #include <vector>
 #include "watchman/ChildProcess.h"
 #include "watchman/LRUCache.h"
+#include "watchman/scm/CommandServer.h"
 #include "watchman/scm/SCM.h"
 
 namespace watchman {
@@ -18,6 +19,7 @@ namespace watchman {
 class Git : public SCM {
  public:
   Git(w_string_piece rootPath, w_string_piece scmRoot);
+  ~Git() override;
   w_string mergeBaseWith(
       w_string_piece commitId,
       const std::optional<w_string>& requestId = std::nullopt) const override;
@@ -33,17 +35,29 @@ class Git : public SCM {
       w_string_piece commitId,
       int numCommits,
       const std::optional<w_string>& requestId = std::nullopt) const override;
+  std::vector<CommandServerPoolStats> getCommandServerStats() const override;
 
  private:
+  std::string gitDir_;
   std::string indexPath_;
   mutable LRUCache<std::string, std::vector<w_string>> commitsPrior_;
   mutable LRUCache<std::string, w_string> mergeBases_;
   mutable LRUCache<std::string, std::vector<w_string>>
       filesChangedSinceMergeBaseWith_;
 
+  // Persistent `git cat-file --batch-check` processes, if enabled via the
+  // scm_git_command_servers config option.
+  std::unique_ptr<CommandServerPool> commandServers_;
+
+  // Resolves commitId to a full hash using the command servers.
+  // Returns nullopt if they are disabled or the name is unknown.
+  std::optional<w_string> resolveCommit(w_string_piece commitId) const;
+
   ChildProcess::Options makeGitOptions(
       const std::optional<w_string>& requestId) const;
   struct timespec getIndexMtime() const;
+  // Returns a cache key fragment that changes when HEAD moves.
+  std::string getHeadKey() const;
 };
 
 } // namespace watchman
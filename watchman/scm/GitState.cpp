@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/scm/GitState.h"
+#include <fmt/core.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/Range.h>
+#include <folly/String.h>
+#include <folly/portability/SysStat.h>
+#include <algorithm>
+#include "watchman/Logging.h"
+#include "watchman/scm/SCM.h"
+
+namespace watchman {
+
+namespace {
+
+constexpr std::string_view kIndexSignature{"DIRC"};
+constexpr size_t kIndexHeaderLen = 12;
+constexpr size_t kIndexChecksumLen = 20;
+constexpr size_t kCommitHexLen = 40;
+constexpr std::string_view kSymrefPrefix{"ref: "};
+// Bounds the number of symbolic refs we'll chase before giving up.
+constexpr int kMaxSymrefDepth = 5;
+
+uint32_t readBigEndian32(std::string_view bytes) {
+  auto b = reinterpret_cast<const unsigned char*>(bytes.data());
+  return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) |
+      (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+std::string_view trimTrailingNewline(std::string_view str) {
+  while (!str.empty() && (str.back() == '\n' || str.back() == '\r')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+// Looks up refName in the packed-refs file, which has lines of the form
+// "<hex> <refname>", interspersed with "^<hex>" peel lines and comments.
+std::optional<w_string> lookupPackedRef(
+    w_string_piece gitDir,
+    std::string_view refName) {
+  std::string contents;
+  if (!folly::readFile(
+          fmt::format("{}/packed-refs", gitDir).c_str(), contents)) {
+    return std::nullopt;
+  }
+
+  std::string_view remaining{contents};
+  while (!remaining.empty()) {
+    auto eol = remaining.find('\n');
+    auto line = trimTrailingNewline(remaining.substr(0, eol));
+    remaining = eol == std::string_view::npos ? std::string_view{}
+                                              : remaining.substr(eol + 1);
+
+    if (line.size() > kCommitHexLen + 1 && line[kCommitHexLen] == ' ' &&
+        line.substr(kCommitHexLen + 1) == refName) {
+      auto hex = line.substr(0, kCommitHexLen);
+      if (isCommitHex(hex)) {
+        return w_string{hex};
+      }
+      return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+bool isCommitHex(std::string_view str) {
+  return str.size() == kCommitHexLen &&
+      std::all_of(str.begin(), str.end(), [](char c) {
+           return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+         });
+}
+
+GitIndexHeader parseGitIndexHeader(
+    std::string_view header,
+    std::string_view trailer) {
+  if (header.size() < kIndexHeaderLen) {
+    SCMError::throwf("git index header is truncated: {} bytes", header.size());
+  }
+  if (header.substr(0, kIndexSignature.size()) != kIndexSignature) {
+    SCMError::throwf("git index has an invalid signature");
+  }
+
+  GitIndexHeader result;
+  result.version = readBigEndian32(header.substr(4, 4));
+  result.numEntries = readBigEndian32(header.substr(8, 4));
+  if (result.version < 2 || result.version > 4) {
+    SCMError::throwf("unsupported git index version {}", result.version);
+  }
+
+  if (trailer.size() >= kIndexChecksumLen) {
+    trailer = trailer.substr(trailer.size() - kIndexChecksumLen);
+    if (!std::all_of(
+            trailer.begin(), trailer.end(), [](char c) { return c == 0; })) {
+      result.checksum = w_string{folly::hexlify(
+          folly::ByteRange{
+              reinterpret_cast<const unsigned char*>(trailer.data()),
+              trailer.size()})};
+    }
+  }
+  return result;
+}
+
+std::optional<GitIndexHeader> readGitIndexHeader(const char* path) {
+  try {
+    folly::File file{path};
+    std::string header(kIndexHeaderLen, '\0');
+    if (folly::readFull(file.fd(), header.data(), header.size()) !=
+        ssize_t(header.size())) {
+      return std::nullopt;
+    }
+
+    struct stat st;
+    if (fstat(file.fd(), &st) != 0 ||
+        size_t(st.st_size) < kIndexHeaderLen + kIndexChecksumLen) {
+      return std::nullopt;
+    }
+    std::string trailer(kIndexChecksumLen, '\0');
+    if (folly::preadFull(
+            file.fd(),
+            trailer.data(),
+            trailer.size(),
+            st.st_size - kIndexChecksumLen) != ssize_t(trailer.size())) {
+      return std::nullopt;
+    }
+
+    return parseGitIndexHeader(header, trailer);
+  } catch (const std::exception& exc) {
+    log(DBG, "unable to read git index ", path, ": ", exc.what(), "\n");
+    return std::nullopt;
+  }
+}
+
+std::optional<w_string> resolveGitHead(w_string_piece gitDir) {
+  std::string refName{"HEAD"};
+  for (int depth = 0; depth < kMaxSymrefDepth; ++depth) {
+    std::string contents;
+    if (!folly::readFile(
+            fmt::format("{}/{}", gitDir, refName).c_str(), contents)) {
+      // Not a loose ref; it may only exist in packed-refs.
+      return lookupPackedRef(gitDir, refName);
+    }
+
+    std::string_view value = trimTrailingNewline(contents);
+    if (value.substr(0, kSymrefPrefix.size()) == kSymrefPrefix) {
+      refName = std::string{value.substr(kSymrefPrefix.size())};
+      if (refName.compare(0, 5, "refs/") != 0 ||
+          refName.find("..") != std::string::npos) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    if (isCommitHex(value)) {
+      return w_string{value};
+    }
+    return std::nullopt;
+  }
+  return std::nullopt;
+}
+
+} // namespace watchman
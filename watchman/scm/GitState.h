@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * The fixed-size header and trailing checksum of `.git/index`.
+ *
+ * git writes a hash of the entire index as its last bytes, so the
+ * checksum changes exactly when the index content changes, unlike the
+ * mtime which is bumped by every `git status` that refreshes stat info.
+ */
+struct GitIndexHeader {
+  uint32_t version{0};
+  uint32_t numEntries{0};
+  // Hex of the trailing checksum. Empty when the repo has
+  // `index.skipHash` enabled and git wrote a null trailer.
+  w_string checksum;
+};
+
+/**
+ * Parses the 12 byte index header and, given the final bytes of the file,
+ * the checksum. Throws SCMError if the header is malformed.
+ */
+GitIndexHeader parseGitIndexHeader(
+    std::string_view header,
+    std::string_view trailer);
+
+/**
+ * Reads the header and checksum of the index at `path`.
+ * Returns nullopt if it cannot be read or parsed.
+ */
+std::optional<GitIndexHeader> readGitIndexHeader(const char* path);
+
+/**
+ * Returns true if str is a full, lowercase, 40 character commit hash.
+ */
+bool isCommitHex(std::string_view str);
+
+/**
+ * Resolves HEAD in `gitDir` to a 40 character commit hash by following
+ * symbolic refs through loose ref files and `packed-refs`, as
+ * `git rev-parse HEAD` would.
+ * Returns nullopt if HEAD cannot be resolved locally (eg: unborn branch,
+ * worktree indirection, or a layout we don't understand); callers are
+ * expected to fall back to running `git`.
+ */
+std::optional<w_string> resolveGitHead(w_string_piece gitDir);
+
+} // namespace watchman
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/scm/HgDirState.h"
+#include <folly/FileUtil.h>
+#include <folly/Range.h>
+#include <folly/String.h>
+#include <algorithm>
+#include "watchman/Logging.h"
+#include "watchman/scm/SCM.h"
+
+namespace watchman {
+
+namespace {
+
+// The v2 docket identifies itself with this marker; v1 has no marker and
+// starts directly with the parents.
+constexpr std::string_view kDirStateV2Marker{"dirstate-v2\n"};
+
+// Node ids are 20 bytes, but the v2 docket reserves 32 bytes per parent
+// to leave room for longer hashes.
+constexpr size_t kNodeLen = 20;
+constexpr size_t kV1ParentLen = 20;
+constexpr size_t kV2ParentLen = 32;
+
+// Enough to hold the v2 marker and both padded parents.
+constexpr size_t kHeaderReadLen = 12 + 2 * kV2ParentLen;
+
+w_string nodeToHex(std::string_view node) {
+  if (std::all_of(node.begin(), node.end(), [](char c) { return c == 0; })) {
+    // The null node; report it as absent.
+    return w_string();
+  }
+  return w_string{folly::hexlify(
+      folly::ByteRange{
+          reinterpret_cast<const unsigned char*>(node.data()), node.size()})};
+}
+
+} // namespace
+
+HgDirStateParents parseHgDirStateParents(std::string_view contents) {
+  size_t offset = 0;
+  size_t stride = kV1ParentLen;
+  if (contents.substr(0, kDirStateV2Marker.size()) == kDirStateV2Marker) {
+    offset = kDirStateV2Marker.size();
+    stride = kV2ParentLen;
+  }
+
+  if (contents.size() < offset + stride + kNodeLen) {
+    SCMError::throwf(
+        "dirstate is too short to contain parents: {} bytes", contents.size());
+  }
+
+  HgDirStateParents parents;
+  parents.p1 = nodeToHex(contents.substr(offset, kNodeLen));
+  parents.p2 = nodeToHex(contents.substr(offset + stride, kNodeLen));
+  if (parents.p1.empty()) {
+    SCMError::throwf("dirstate has a null first parent");
+  }
+  return parents;
+}
+
+std::optional<HgDirStateParents> readHgDirStateParents(const char* path) {
+  std::string contents;
+  if (!folly::readFile(path, contents, kHeaderReadLen)) {
+    return std::nullopt;
+  }
+  try {
+    return parseHgDirStateParents(contents);
+  } catch (const SCMError& exc) {
+    log(DBG, "unable to parse ", path, ": ", exc.what(), "\n");
+    return std::nullopt;
+  }
+}
+
+} // namespace watchman
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * The working copy parents recorded in the header of `.hg/dirstate`.
+ *
+ * Both the v1 dirstate file and the v2 docket start with the parent
+ * nodes, so we can learn the current commit without spawning `hg`.
+ */
+struct HgDirStateParents {
+  // 40 character hex node of the first parent.
+  w_string p1;
+  // 40 character hex node of the second parent, or empty if the
+  // working copy is not in the middle of a merge.
+  w_string p2;
+};
+
+/**
+ * Parses the leading bytes of a dirstate (v1) or dirstate docket (v2).
+ * Throws SCMError if the contents are too short to hold the parents.
+ */
+HgDirStateParents parseHgDirStateParents(std::string_view contents);
+
+/**
+ * Reads the parents from the dirstate file at `path`.
+ * Returns nullopt if the file cannot be read or parsed; callers are
+ * expected to fall back to asking `hg` in that case.
+ */
+std::optional<HgDirStateParents> readHgDirStateParents(const char* path);
+
+} // namespace watchman
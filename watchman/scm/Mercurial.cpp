@@ -16,6 +16,8 @@
 #include "watchman/CommandRegistry.h"
 #include "watchman/Logging.h"
 #include "watchman/fs/FileSystem.h"
+#include "watchman/scm/CommandServer.h"
+#include "watchman/scm/HgDirState.h"
 #include "watchman/sockname.h"
 
 // Capability indicating support for the mercurial SCM
@@ -42,10 +44,50 @@ struct MercurialResult {
   w_string output;
 };
 
+[[noreturn]] void throwMercurialError(
+    const std::vector<std::string_view>& cmdline,
+    std::string_view description,
+    std::string output,
+    std::string error) {
+  replaceEmbeddedNulls(output);
+  replaceEmbeddedNulls(error);
+  SCMError::throwf(
+      "failed to {}\ncmd = {}\nstdout = {}\nstderr = {}",
+      description,
+      folly::join(" ", cmdline),
+      output,
+      error);
+}
+
+// Runs hg, preferring a pooled command server when one is available and
+// falling back to spawning a fresh process if the pool can't serve us.
 MercurialResult runMercurial(
     std::vector<std::string_view> cmdline,
     ChildProcess::Options options,
-    std::string_view description) {
+    std::string_view description,
+    CommandServerPool* servers = nullptr) {
+  if (servers) {
+    // The command server was started with the executable; send only the
+    // arguments.
+    std::vector<std::string> args{cmdline.begin() + 1, cmdline.end()};
+    std::optional<CommandServerResult> result;
+    try {
+      result = servers->run(args);
+    } catch (const SCMError& exc) {
+      log(DBG, "falling back to spawning hg: ", exc.what(), "\n");
+    }
+    if (result) {
+      if (result->status) {
+        throwMercurialError(
+            cmdline,
+            description,
+            std::string{result->output.view()},
+            std::string{result->error.view()});
+      }
+      return MercurialResult{std::move(result->output)};
+    }
+  }
+
   ChildProcess proc{cmdline, std::move(options)};
   auto outputs = proc.communicate();
   auto status = proc.wait();
@@ -54,14 +96,7 @@ MercurialResult runMercurial(
         std::string{outputs.first ? outputs.first->view() : std::string_view{}};
     auto error = std::string{
         outputs.second ? outputs.second->view() : std::string_view{}};
-    replaceEmbeddedNulls(output);
-    replaceEmbeddedNulls(error);
-    SCMError::throwf(
-        "failed to {}\ncmd = {}\nstdout = {}\nstderr = {}",
-        description,
-        folly::join(" ", cmdline),
-        output,
-        error);
+    throwMercurialError(cmdline, description, output, error);
   }
 
   if (outputs.first) {
@@ -77,6 +112,15 @@ namespace watchman {
 
 ChildProcess::Options Mercurial::makeHgOptions(
     const std::optional<w_string>& requestId) const {
+  auto opt = makeHgEnvironmentOptions(requestId);
+  opt.nullStdin();
+  opt.pipeStdout();
+  opt.pipeStderr();
+  return opt;
+}
+
+ChildProcess::Options Mercurial::makeHgEnvironmentOptions(
+    const std::optional<w_string>& requestId) const {
   ChildProcess::Options opt;
   // Ensure that the hgrc doesn't mess with the behavior
   // of the commands that we're runing.
@@ -117,14 +161,21 @@ ChildProcess::Options Mercurial::makeHgOptions(
   // rather than whatever is hardcoded in its config.
   opt.environment().set("WATCHMAN_SOCK", get_sock_name_legacy());
 
-  opt.nullStdin();
-  opt.pipeStdout();
-  opt.pipeStderr();
   opt.chdir(getRootPath());
 
   return opt;
 }
 
+CommandServerPool* Mercurial::commandServers(
+    const std::optional<w_string>& requestId) const {
+  // Pooled servers were started without a request id in their environment,
+  // so requests that carry one must spawn hg to propagate it.
+  if (requestId && !requestId->empty()) {
+    return nullptr;
+  }
+  return commandServers_.get();
+}
+
 Mercurial::Mercurial(w_string_piece rootPath, w_string_piece scmRoot)
     : SCM(rootPath, scmRoot),
       dirStatePath_(fmt::format("{}/.hg/dirstate", getSCMRoot())),
@@ -134,7 +185,33 @@ Mercurial::Mercurial(w_string_piece rootPath, w_string_piece scmRoot)
           Configuration(),
           "scm_hg_files_since_mergebase",
           32,
-          10) {}
+          10) {
+  auto numServers = cfg_get_int("scm_hg_command_servers", 0);
+  if (numServers > 0) {
+    auto timeout = std::chrono::milliseconds(
+        cfg_get_int("scm_command_server_timeout_ms", 30000));
+    commandServers_ = std::make_unique<CommandServerPool>(
+        w_string{"hg"},
+        [this, timeout] {
+          // Errors are reported over the command server protocol.
+          auto opt = makeHgEnvironmentOptions(std::nullopt);
+          opt.nullStderr();
+          return std::make_unique<HgCommandServer>(
+              hgExecutablePath(), std::move(opt), timeout);
+        },
+        size_t(numServers),
+        timeout);
+  }
+}
+
+Mercurial::~Mercurial() = default;
+
+std::vector<CommandServerPoolStats> Mercurial::getCommandServerStats() const {
+  if (!commandServers_) {
+    return {};
+  }
+  return {commandServers_->getStats()};
+}
 
 struct timespec Mercurial::getDirStateMtime() const {
   try {
@@ -152,11 +229,30 @@ struct timespec Mercurial::getDirStateMtime() const {
   }
 }
 
+std::string Mercurial::getDirStateKey() const {
+  // hg rewrites the dirstate for reasons that don't move the working copy
+  // (eg: `hg status` refreshing cached stat info), so prefer keying on the
+  // parents recorded in it and only fall back to the mtime if we can't
+  // read them.
+  if (auto parents = readHgDirStateParents(dirStatePath_.c_str())) {
+    return fmt::format("{}:{}", parents->p1, parents->p2);
+  }
+  auto mtime = getDirStateMtime();
+  return fmt::format("{}:{}", mtime.tv_sec, mtime.tv_nsec);
+}
+
 w_string Mercurial::mergeBaseWith(
     w_string_piece commitId,
     const std::optional<w_string>& requestId) const {
-  auto mtime = getDirStateMtime();
-  auto key = fmt::format("{}:{}:{}", commitId, mtime.tv_sec, mtime.tv_nsec);
+  if (auto parents = readHgDirStateParents(dirStatePath_.c_str())) {
+    // The merge base of the working copy parent with itself is trivially
+    // known without asking hg.
+    if (commitId == "." || commitId == parents->p1) {
+      return parents->p1;
+    }
+  }
+
+  auto key = fmt::format("{}:{}", commitId, getDirStateKey());
   auto commit = std::string{commitId.view()};
 
   return mergeBases_
@@ -169,7 +265,8 @@ w_string Mercurial::mergeBaseWith(
               result = runMercurial(
                   {hgExecutablePath(), "log", "-T", "{node}", "-r", revset},
                   makeHgOptions(requestId),
-                  "query for the merge base");
+                  "query for the merge base",
+                  commandServers(requestId));
 
             } else {
               result = runMercurial(
@@ -182,7 +279,8 @@ w_string Mercurial::mergeBaseWith(
                    "--config",
                    "ui.autopullcommits=false"},
                   makeHgOptions(requestId),
-                  "query for the merge base");
+                  "query for the merge base",
+                  commandServers(requestId));
             }
 
             if (result.output.empty()) {
@@ -233,7 +331,8 @@ std::vector<w_string> Mercurial::getFilesChangedSinceMergeBaseWith(
                    // relative to the cwd (set to root path above).
                    ""},
                   makeHgOptions(requestId),
-                  "query for files changed since merge base");
+                  "query for files changed since merge base",
+                  commandServers(requestId));
             } else {
               result = runMercurial(
                   {hgExecutablePath(),
@@ -248,7 +347,8 @@ std::vector<w_string> Mercurial::getFilesChangedSinceMergeBaseWith(
                    // relative to the cwd (set to root path above).
                    ""},
                   makeHgOptions(requestId),
-                  "query for files changed since merge base");
+                  "query for files changed since merge base",
+                  commandServers(requestId));
             }
             std::vector<w_string> lines;
             result.output.piece().split(lines, '\n');
@@ -270,7 +370,8 @@ time_point<system_clock> Mercurial::getCommitDate(
        "-T",
        "{date}\n"},
       makeHgOptions(requestId),
-      "get commit date");
+      "get commit date",
+      commandServers(requestId));
   return Mercurial::convertCommitDate(result.output.c_str());
 }
 
@@ -290,9 +391,7 @@ std::vector<w_string> Mercurial::getCommitsPriorToAndIncluding(
     w_string_piece commitId,
     int numCommits,
     const std::optional<w_string>& requestId) const {
-  auto mtime = getDirStateMtime();
-  auto key = fmt::format(
-      "{}:{}:{}:{}", commitId, numCommits, mtime.tv_sec, mtime.tv_nsec);
+  auto key = fmt::format("{}:{}:{}", commitId, numCommits, getDirStateKey());
   auto commitCopy = std::string{commitId.view()};
 
   return commitsPrior_
@@ -311,7 +410,8 @@ std::vector<w_string> Mercurial::getCommitsPriorToAndIncluding(
                  "-T",
                  "{node}\n"},
                 makeHgOptions(requestId),
-                "get prior commits");
+                "get prior commits",
+                commandServers(requestId));
 
             std::vector<w_string> lines;
             w_string_piece(result.output).split(lines, '\n');
@@ -336,7 +436,8 @@ w_string Mercurial::translateCommitToLocal(
        "--config",
        "megarepo.cross-repo-lookup-behavior=equivalent"},
       makeHgOptions(requestId),
-      "translate commit to local equivalent");
+      "translate commit to local equivalent",
+      commandServers(requestId));
 
   if (result.output.empty()) {
     return commitId.asWString();
@@ -11,6 +11,7 @@
 #include <string>
 #include "watchman/ChildProcess.h"
 #include "watchman/LRUCache.h"
+#include "watchman/scm/CommandServer.h"
 #include "watchman/scm/SCM.h"
 
 namespace watchman {
@@ -18,6 +19,7 @@ namespace watchman {
 class Mercurial : public SCM {
  public:
   Mercurial(w_string_piece rootPath, w_string_piece scmRoot);
+  ~Mercurial() override;
   w_string mergeBaseWith(
       w_string_piece commitId,
       const std::optional<w_string>& requestId = std::nullopt) const override;
@@ -38,6 +40,7 @@ class Mercurial : public SCM {
   w_string translateCommitToLocal(
       w_string_piece commitId,
       const std::optional<w_string>& requestId = std::nullopt) const override;
+  std::vector<CommandServerPoolStats> getCommandServerStats() const override;
 
  private:
   std::string dirStatePath_;
@@ -46,10 +49,25 @@ class Mercurial : public SCM {
   mutable LRUCache<std::string, std::vector<w_string>>
       filesChangedSinceMergeBaseWith_;
 
+  // Persistent `hg serve --cmdserver` processes, if enabled via the
+  // scm_hg_command_servers config option.
+  std::unique_ptr<CommandServerPool> commandServers_;
+
   // Returns options for invoking hg
   ChildProcess::Options makeHgOptions(
       const std::optional<w_string>& requestId) const;
+  // Returns options with the environment and cwd for hg, but without
+  // configuring stdio.
+  ChildProcess::Options makeHgEnvironmentOptions(
+      const std::optional<w_string>& requestId) const;
+  // Returns the pool to run this request on, or nullptr if it must spawn
+  // a fresh hg process.
+  CommandServerPool* commandServers(
+      const std::optional<w_string>& requestId) const;
   struct timespec getDirStateMtime() const;
+  // Returns a cache key fragment that changes when the working copy
+  // parents change.
+  std::string getDirStateKey() const;
 };
 
 } // namespace watchman
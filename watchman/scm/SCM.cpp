@@ -30,6 +30,10 @@ const w_string& SCM::getSCMRoot() const {
   return scmRoot_;
 }
 
+std::vector<CommandServerPoolStats> SCM::getCommandServerStats() const {
+  return {};
+}
+
 std::optional<w_string> findFileInDirTree(
     w_string_piece rootPath,
     std::initializer_list<w_string_piece> candidates) {
@@ -11,6 +11,7 @@
 #include <optional>
 #include <vector>
 #include "watchman/Errors.h"
+#include "watchman/scm/CommandServer.h"
 #include "watchman/watchman_string.h"
 #include "watchman/watchman_system.h"
 
@@ -93,6 +94,10 @@ class SCM {
       w_string_piece commitId,
       const std::optional<w_string>& requestId = std::nullopt) const;
 
+  // Returns statistics for any persistent helper processes used to answer
+  // SCM queries.
+  virtual std::vector<CommandServerPoolStats> getCommandServerStats() const;
+
  private:
   w_string rootPath_;
   w_string scmRoot_;
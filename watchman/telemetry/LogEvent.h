@@ -126,12 +126,14 @@ struct AgeOut : public WatchmanEvent {
   int64_t walked = 0;
   int64_t files = 0;
   int64_t dirs = 0;
+  int64_t slices = 0;
 
   void populate(DynamicEvent& event) const override {
     WatchmanEvent::populate(event);
     event.addInt("walked", walked);
     event.addInt("files", files);
     event.addInt("dirs", dirs);
+    event.addInt("slices", slices);
   }
 
   const char* getType() const override {
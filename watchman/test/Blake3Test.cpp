@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/Blake3.h"
+#include <folly/String.h>
+#include <folly/portability/GTest.h>
+#include <string>
+#include <vector>
+
+using namespace watchman;
+
+namespace {
+
+std::string hexHash(const Blake3::Hash& hash) {
+  return folly::hexlify(
+      folly::ByteRange{hash.data(), hash.data() + hash.size()});
+}
+
+// The input used by the official BLAKE3 test vectors.
+std::vector<uint8_t> testInput(size_t len) {
+  std::vector<uint8_t> input(len);
+  for (size_t i = 0; i < len; ++i) {
+    input[i] = uint8_t(i % 251);
+  }
+  return input;
+}
+
+std::string hashOf(const std::vector<uint8_t>& input) {
+  Blake3 hasher;
+  hasher.update(input.data(), input.size());
+  return hexHash(hasher.finalize());
+}
+
+} // namespace
+
+TEST(Blake3, test_vectors) {
+  std::vector<std::pair<size_t, std::string>> vectors = {
+      {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+      {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+      {1024,
+       "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+      {102400,
+       "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+  };
+  for (auto& [len, expected] : vectors) {
+    EXPECT_EQ(expected, hashOf(testInput(len))) << "input length " << len;
+  }
+
+  Blake3 abc;
+  abc.update("abc", 3);
+  EXPECT_EQ(
+      "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85",
+      hexHash(abc.finalize()));
+}
+
+TEST(Blake3, incremental_updates_match) {
+  auto input = testInput(10000);
+  Blake3 hasher;
+  size_t offset = 0;
+  for (size_t step = 1; offset < input.size(); ++step) {
+    auto len = std::min(step * 7, input.size() - offset);
+    hasher.update(input.data() + offset, len);
+    offset += len;
+  }
+  EXPECT_EQ(hashOf(input), hexHash(hasher.finalize()));
+}
+
+TEST(Blake3, subtrees_match_sequential) {
+  for (size_t log2Chunks = 0; log2Chunks < 4; ++log2Chunks) {
+    size_t subtreeSize = Blake3::kChunkLen << log2Chunks;
+    for (size_t len : {size_t(1),
+                       subtreeSize,
+                       subtreeSize + 1,
+                       3 * subtreeSize,
+                       5 * subtreeSize + 17}) {
+      auto input = testInput(len);
+
+      // Mirror ContentHashCache: the last byte always goes to update().
+      size_t numSubtrees = (len - 1) / subtreeSize;
+      Blake3 hasher;
+      for (size_t i = 0; i < numSubtrees; ++i) {
+        Blake3::Subtree subtree{uint64_t(i) << log2Chunks, log2Chunks};
+        subtree.update(input.data() + i * subtreeSize, subtreeSize);
+        hasher.appendSubtree(subtree.finalize(), log2Chunks);
+      }
+      hasher.update(
+          input.data() + numSubtrees * subtreeSize,
+          len - numSubtrees * subtreeSize);
+
+      EXPECT_EQ(hashOf(input), hexHash(hasher.finalize()))
+          << "log2Chunks " << log2Chunks << " length " << len;
+    }
+  }
+}
+
+TEST(Blake3, rejects_unaligned_subtrees) {
+  EXPECT_THROW((Blake3::Subtree{1, 1}), std::logic_error);
+
+  Blake3 hasher;
+  hasher.update("x", 1);
+  Blake3::Subtree subtree{0, 0};
+  auto input = testInput(Blake3::kChunkLen);
+  subtree.update(input.data(), input.size());
+  EXPECT_THROW(hasher.appendSubtree(subtree.finalize(), 0), std::logic_error);
+}
@@ -167,6 +167,11 @@ void check_roundtrip(
   EXPECT_TRUE(json_equal(expected.value(), decoded))
       << "round-tripped json_equal: " << jdump;
   EXPECT_EQ(jdump, input) << "round-tripped";
+
+  auto view = bunser_view(dump_buf->data(), end);
+  EXPECT_TRUE(json_equal(decoded, view.root().toJson()))
+      << "viewed json_equal: "
+      << json_dumps(view.root().toJson(), JSON_ENCODE_ANY | JSON_SORT_KEYS);
 }
 
 void check_serialization(
@@ -485,10 +490,19 @@ TEST(Bser, fuzz_examples) {
       auto data = allocator(input.size());
       memcpy(data.get(), input.data(), input.size());
 
+      std::optional<json_ref> decoded;
       try {
-        bunser(data.get(), data.get() + input.size());
+        decoded = bunser(data.get(), data.get() + input.size());
       } catch (const BserParseError&) {
       }
+
+      try {
+        auto view = bunser_view(data.get(), data.get() + input.size());
+        ASSERT_TRUE(decoded) << "only bunser_view accepted the input";
+        EXPECT_TRUE(json_equal(*decoded, view.root().toJson()));
+      } catch (const BserParseError&) {
+        EXPECT_FALSE(decoded) << "only bunser accepted the input";
+      }
     }
   }
 }
@@ -502,6 +516,59 @@ TEST(Bser, detect_array_stack_overflow) {
     str += rec;
   }
   EXPECT_THROW((bunser(str.data(), str.data() + str.size())), BserParseTooDeep);
+  EXPECT_THROW(
+      (bunser_view(str.data(), str.data() + str.size())), BserParseTooDeep);
+}
+
+TEST(Bser, view_references_the_document) {
+  // {"name": "fred", "sizes": [1, 2, ..., 20, 1000], "ok": true}
+  std::string doc = S("\x01\x03\x03"
+                      "\x02\x03\x04name\x0d\x03\x04"
+                      "fred"
+                      "\x02\x03\x05sizes\x00\x03\x15");
+  for (int i = 1; i <= 20; ++i) {
+    doc += S("\x03");
+    doc += static_cast<char>(i);
+  }
+  doc += S("\x04\xe8\x03");
+  doc += S("\x02\x03\x02ok\x08");
+
+  auto view = bunser_view(doc.data(), doc.data() + doc.size());
+  const auto& root = view.root();
+  ASSERT_EQ(BserValue::Type::Object, root.type());
+  EXPECT_EQ(3, root.size());
+  EXPECT_EQ("name", root.keyAt(0));
+  EXPECT_EQ(nullptr, root.get("missing"));
+
+  const auto* name = root.get("name");
+  ASSERT_NE(nullptr, name);
+  EXPECT_EQ("fred", name->asString());
+  EXPECT_TRUE(name->isUnicode());
+  // Strings are not copied out of the document.
+  EXPECT_GE(name->asString().data(), doc.data());
+  EXPECT_LT(name->asString().data(), doc.data() + doc.size());
+
+  const auto* sizes = root.get("sizes");
+  ASSERT_NE(nullptr, sizes);
+  ASSERT_EQ(21, sizes->size());
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(i + 1, (*sizes)[i].asInt());
+  }
+  EXPECT_EQ(1000, (*sizes)[20].asInt());
+
+  EXPECT_EQ(BserValue::Type::True, root.get("ok")->type());
+}
+
+TEST(Bser, view_rejects_oversized_containers_before_allocating) {
+  // An array that claims four billion elements but has none.
+  auto doc = S("\x00\x06\xff\xff\xff\xff\x00\x00\x00\x00");
+  EXPECT_THROW(
+      bunser_view(doc.data(), doc.data() + doc.size()), BserParseError);
+
+  // A template that claims four billion rows of one key each.
+  doc = S("\x0b\x00\x03\x01\x02\x03\x01k\x05\xff\xff\xff\x7f\x08");
+  EXPECT_THROW(
+      bunser_view(doc.data(), doc.data() + doc.size()), BserParseError);
 }
 
 } // namespace
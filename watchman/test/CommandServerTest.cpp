@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fmt/core.h>
+#include <folly/FileUtil.h>
+#include <folly/portability/GTest.h>
+#include <folly/testing/TestUtil.h>
+#include <thread>
+#include "watchman/ChildProcess.h"
+#include "watchman/scm/CommandServer.h"
+#include "watchman/scm/SCM.h"
+
+using folly::test::TemporaryDirectory;
+using namespace watchman;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Runs git in dir and returns its stdout with the trailing newline removed.
+std::string runGit(const std::string& dir, std::vector<std::string_view> args) {
+  ChildProcess::Options opts;
+  opts.nullStdin();
+  opts.pipeStdout();
+  opts.nullStderr();
+  opts.chdir(dir);
+  opts.environment().set(
+      {{"GIT_AUTHOR_NAME", "watchman"},
+       {"GIT_AUTHOR_EMAIL", "watchman@example.com"},
+       {"GIT_COMMITTER_NAME", "watchman"},
+       {"GIT_COMMITTER_EMAIL", "watchman@example.com"}});
+  args.insert(args.begin(), "git");
+  ChildProcess proc{args, std::move(opts)};
+  auto outputs = proc.communicate();
+  if (proc.wait() != 0) {
+    throw std::runtime_error("git failed");
+  }
+  std::string output{outputs.first ? outputs.first->view() : ""};
+  while (!output.empty() && output.back() == '\n') {
+    output.pop_back();
+  }
+  return output;
+}
+
+class CommandServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+#ifdef _WIN32
+    GTEST_SKIP() << "command servers are not supported on Windows";
+#endif
+    repo_ = dir_.path().string();
+    try {
+      runGit(repo_, {"init", "-q"});
+    } catch (const std::exception&) {
+      GTEST_SKIP() << "git is not available";
+    }
+    folly::writeFile(std::string{"hello\n"}, (repo_ + "/a.txt").c_str());
+    runGit(repo_, {"add", "a.txt"});
+    runGit(repo_, {"commit", "-q", "-m", "first"});
+    head_ = runGit(repo_, {"rev-parse", "HEAD"});
+  }
+
+  CommandServerPool makePool(size_t maxServers) {
+    return CommandServerPool{
+        w_string{"git"},
+        [this] {
+          ChildProcess::Options opts;
+          opts.nullStderr();
+          opts.chdir(repo_);
+          return std::make_unique<GitBatchCheckServer>(
+              "git", std::move(opts));
+        },
+        maxServers,
+        10s};
+  }
+
+  TemporaryDirectory dir_;
+  std::string repo_;
+  std::string head_;
+};
+
+} // namespace
+
+TEST_F(CommandServerTest, resolves_revisions) {
+  auto pool = makePool(1);
+
+  auto result = pool.run({"HEAD^{commit}"});
+  EXPECT_EQ(0, result.status);
+  EXPECT_EQ(
+      fmt::format("{} commit", head_), result.output.view().substr(0, 47));
+
+  auto missing = pool.run({"no-such-branch"});
+  EXPECT_NE(0, missing.status);
+}
+
+TEST_F(CommandServerTest, reuses_server) {
+  auto pool = makePool(2);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(0, pool.run({"HEAD"}).status);
+  }
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(10, stats.requests);
+  EXPECT_EQ(1, stats.spawned);
+  EXPECT_EQ(0, stats.failures);
+  EXPECT_EQ(10, stats.latency.count);
+}
+
+TEST_F(CommandServerTest, concurrent_requests_are_bounded) {
+  auto pool = makePool(2);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 25; ++i) {
+        EXPECT_EQ(0, pool.run({"HEAD"}).status);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(100, stats.requests);
+  EXPECT_LE(stats.spawned, 2);
+  EXPECT_LE(stats.live, 2);
+}
+
+TEST_F(CommandServerTest, replaces_failed_server) {
+  auto pool = makePool(1);
+  EXPECT_EQ(0, pool.run({"HEAD"}).status);
+
+  // Malformed requests make the server unusable and it is discarded.
+  EXPECT_THROW(pool.run({"two\nlines"}), SCMError);
+  EXPECT_EQ(0, pool.getStats().live);
+
+  EXPECT_EQ(0, pool.run({"HEAD"}).status);
+  auto stats = pool.getStats();
+  EXPECT_EQ(2, stats.spawned);
+  EXPECT_EQ(1, stats.failures);
+}
+
+TEST_F(CommandServerTest, failed_spawn_is_reported) {
+  CommandServerPool pool{
+      w_string{"broken"},
+      []() -> std::unique_ptr<CommandServer> {
+        throw std::runtime_error("no server for you");
+      },
+      1,
+      1s};
+  EXPECT_THROW(pool.run({"HEAD"}), SCMError);
+  // The slot is released so later requests can try again.
+  EXPECT_THROW(pool.run({"HEAD"}), SCMError);
+  EXPECT_EQ(0, pool.getStats().live);
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/DeltaEncoding.h"
+#include <folly/portability/GTest.h>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include "watchman/Errors.h"
+
+using namespace watchman;
+
+namespace {
+
+// Only the names of the fields are looked at, so they don't need
+// renderers.
+QueryFieldList makeFields(std::initializer_list<const char*> names) {
+  static std::unordered_map<std::string, QueryFieldRenderer> fields;
+  QueryFieldList fieldList;
+  for (auto* name : names) {
+    auto it =
+        fields.try_emplace(name, QueryFieldRenderer{w_string{name}, nullptr})
+            .first;
+    fieldList.push_back(&it->second);
+  }
+  return fieldList;
+}
+
+struct Reader {
+  std::string_view data;
+  size_t pos = 0;
+
+  uint8_t byte() {
+    return uint8_t(data.at(pos++));
+  }
+
+  uint64_t varint() {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+      auto b = byte();
+      value |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        return value;
+      }
+    }
+  }
+
+  uint64_t littleEndian() {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value |= uint64_t(byte()) << (i * 8);
+    }
+    return value;
+  }
+
+  std::vector<std::string> names() {
+    EXPECT_EQ(kFilesDeltaVersion, byte());
+    std::vector<std::string> result(varint());
+    std::string previous;
+    for (auto& name : result) {
+      auto shared = varint();
+      auto rest = varint();
+      name = previous.substr(0, shared) + std::string{data.substr(pos, rest)};
+      pos += rest;
+      previous = name;
+    }
+    return result;
+  }
+};
+
+} // namespace
+
+TEST(DeltaEncodingTest, names_are_sorted_and_front_coded) {
+  auto fieldList = makeFields({"name"});
+  std::vector<json_ref> results{
+      w_string_to_json("src/b.c"),
+      w_string_to_json("src/a.c"),
+      w_string_to_json("README"),
+  };
+  auto encoded = encodeFilesDelta(fieldList, results);
+
+  Reader reader{encoded.view()};
+  EXPECT_EQ(
+      (std::vector<std::string>{"README", "src/a.c", "src/b.c"}),
+      reader.names());
+  // Only "b.c" is sent for the last name.
+  EXPECT_EQ(1 + 1 + (2 + 6) + (2 + 7) + (2 + 3), encoded.size());
+  EXPECT_EQ(encoded.size(), reader.pos);
+}
+
+TEST(DeltaEncodingTest, fields_are_packed_in_fixed_size_records) {
+  auto fieldList = makeFields({"exists", "name", "size", "type", "mtime_f"});
+  EXPECT_EQ(1 + 8 + 1 + 8, filesDeltaRecordSize(fieldList));
+
+  std::vector<json_ref> results{
+      json_object(
+          {{"name", w_string_to_json("z")},
+           {"exists", json_true()},
+           {"size", json_integer(300)},
+           {"type", w_string_to_json("f")},
+           {"mtime_f", json_real(1.5)}}),
+      json_object(
+          {{"name", w_string_to_json("a")},
+           {"exists", json_false()},
+           {"size", json_null()},
+           {"type", w_string_to_json("d")},
+           {"mtime_f", json_real(0.25)}}),
+  };
+  auto encoded = encodeFilesDelta(fieldList, results);
+
+  Reader reader{encoded.view()};
+  EXPECT_EQ((std::vector<std::string>{"a", "z"}), reader.names());
+
+  auto readDouble = [&] {
+    auto bits = reader.littleEndian();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  };
+
+  EXPECT_EQ(0, reader.byte());
+  EXPECT_EQ(0, reader.littleEndian());
+  EXPECT_EQ('d', reader.byte());
+  EXPECT_EQ(0.25, readDouble());
+
+  EXPECT_EQ(1, reader.byte());
+  EXPECT_EQ(300, reader.littleEndian());
+  EXPECT_EQ('f', reader.byte());
+  EXPECT_EQ(1.5, readDouble());
+
+  EXPECT_EQ(encoded.size(), reader.pos);
+}
+
+TEST(DeltaEncodingTest, integers_keep_every_bit) {
+  auto fieldList = makeFields({"name", "mtime_ns", "ino"});
+  // Neither fits in a double.
+  int64_t mtime = 1700000000123456789;
+  int64_t ino = (int64_t(1) << 62) + 1;
+  std::vector<json_ref> results{json_object(
+      {{"name", w_string_to_json("a")},
+       {"mtime_ns", json_integer(mtime)},
+       {"ino", json_integer(ino)}})};
+  auto encoded = encodeFilesDelta(fieldList, results);
+
+  Reader reader{encoded.view()};
+  reader.names();
+  EXPECT_EQ(uint64_t(mtime), reader.littleEndian());
+  EXPECT_EQ(uint64_t(ino), reader.littleEndian());
+}
+
+TEST(DeltaEncodingTest, only_fixed_size_fields_are_allowed) {
+  checkFilesDeltaFields(makeFields({"name", "new", "mtime_ms", "ino"}));
+  EXPECT_THROW(
+      checkFilesDeltaFields(makeFields({"name", "content.sha1hex"})),
+      QueryParseError);
+  EXPECT_THROW(
+      checkFilesDeltaFields(makeFields({"name", "symlink_target"})),
+      QueryParseError);
+  EXPECT_THROW(checkFilesDeltaFields(makeFields({"size"})), QueryParseError);
+}
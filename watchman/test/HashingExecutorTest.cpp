@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include "watchman/HashingExecutor.h"
+
+using namespace watchman;
+
+namespace {
+
+using Priority = HashingExecutor::Priority;
+
+// Occupies the single worker of an executor until release() is called, so
+// that tests can build up a queue behind it.
+class Blocker {
+ public:
+  explicit Blocker(HashingExecutor& executor) {
+    EXPECT_TRUE(executor.add(
+        Priority::Interactive,
+        HashingExecutor::Task{[this](bool) {
+          started_.set_value();
+          release_.get_future().wait();
+        }}));
+    started_.get_future().wait();
+  }
+
+  void release() {
+    release_.set_value();
+  }
+
+ private:
+  std::promise<void> started_;
+  std::promise<void> release_;
+};
+
+} // namespace
+
+TEST(HashingExecutorTest, rejects_when_not_running) {
+  HashingExecutor executor;
+  EXPECT_FALSE(executor.isRunning());
+  EXPECT_FALSE(executor.add(Priority::Interactive, {[](bool) {}}));
+
+  executor.start(1, 16, 0);
+  EXPECT_TRUE(executor.isRunning());
+  executor.stop();
+  EXPECT_FALSE(executor.isRunning());
+  EXPECT_FALSE(executor.add(Priority::Interactive, {[](bool) {}}));
+  EXPECT_EQ(2, executor.getStats().rejected);
+}
+
+TEST(HashingExecutorTest, rejects_when_full) {
+  HashingExecutor executor;
+  executor.start(1, 2, 0);
+  Blocker blocker{executor};
+
+  EXPECT_TRUE(executor.add(Priority::Background, {[](bool) {}}));
+  EXPECT_TRUE(executor.add(Priority::Background, {[](bool) {}}));
+  EXPECT_FALSE(executor.add(Priority::Interactive, {[](bool) {}}));
+
+  blocker.release();
+  executor.stop();
+  auto stats = executor.getStats();
+  EXPECT_EQ(3, stats.completed);
+  EXPECT_EQ(1, stats.rejected);
+}
+
+TEST(HashingExecutorTest, interactive_runs_before_background) {
+  HashingExecutor executor;
+  executor.start(1, 16, 0);
+  Blocker blocker{executor};
+
+  std::vector<std::string> order;
+  executor.add(
+      Priority::Background, {[&](bool) { order.push_back("background"); }});
+  executor.add(
+      Priority::Interactive, {[&](bool) { order.push_back("interactive"); }});
+
+  blocker.release();
+  executor.stop();
+  EXPECT_EQ((std::vector<std::string>{"interactive", "background"}), order);
+}
+
+TEST(HashingExecutorTest, cancelled_tasks_are_told) {
+  HashingExecutor executor;
+  executor.start(1, 16, 0);
+
+  std::promise<bool> wasCancelled;
+  executor.add(
+      Priority::Interactive,
+      {[&](bool cancelled) { wasCancelled.set_value(cancelled); },
+       [] { return true; }});
+  EXPECT_TRUE(wasCancelled.get_future().get());
+
+  executor.stop();
+  EXPECT_EQ(1, executor.getStats().cancelled);
+}
+
+TEST(HashingExecutorTest, reads_ahead_of_queued_tasks) {
+  HashingExecutor executor;
+  executor.start(1, 16, 2);
+  Blocker blocker{executor};
+
+  std::atomic<int> readAhead{0};
+  for (int i = 0; i < 4; ++i) {
+    executor.add(
+        Priority::Background,
+        {[](bool) {}, nullptr, [&] { readAhead++; }});
+  }
+
+  blocker.release();
+  executor.stop();
+  // The first task starts reading immediately, but everything queued
+  // behind it is read ahead exactly once.
+  EXPECT_EQ(3, readAhead.load());
+  EXPECT_EQ(3, executor.getStats().read_ahead);
+}
+
+TEST(HashingExecutorTest, runs_on_all_workers) {
+  HashingExecutor executor;
+  executor.start(4, 16, 0);
+
+  // Each task waits until all four are running at once, which can only
+  // happen if they are spread across all of the workers.
+  std::atomic<int> running{0};
+  std::vector<std::future<void>> done;
+  for (int i = 0; i < 4; ++i) {
+    auto promise = std::make_shared<std::promise<void>>();
+    done.push_back(promise->get_future());
+    executor.add(Priority::Interactive, {[&running, promise](bool) {
+                   running++;
+                   while (running.load() < 4) {
+                     std::this_thread::yield();
+                   }
+                   promise->set_value();
+                 }});
+  }
+  for (auto& future : done) {
+    future.wait();
+  }
+
+  executor.stop();
+  auto stats = executor.getStats();
+  EXPECT_EQ(4, stats.workers);
+  EXPECT_EQ(4, stats.completed);
+}
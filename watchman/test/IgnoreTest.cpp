@@ -108,6 +108,88 @@ TEST(Ignore, correctness) {
   run_correctness_test(&state, tests, sizeof(tests) / sizeof(tests[0]));
 }
 
+TEST(Ignore, globs) {
+  IgnoreSet state;
+  w_string root{"/root", W_STRING_UNICODE};
+  for (auto pattern :
+       {"node_modules",
+        "**/target",
+        "/buck-out",
+        "build/out",
+        "out/",
+        "gen/**",
+        "*.egg-info",
+        "src/*/generated",
+        "**/cache/*.tmp"}) {
+    state.addGlob(root, pattern);
+  }
+  EXPECT_THROW(state.addGlob(root, "!keep"), std::domain_error);
+  EXPECT_THROW(state.addGlob(root, "/"), std::domain_error);
+
+  static const struct {
+    const char* path;
+    bool isDir;
+    bool ignored;
+  } tests[] = {
+      {"/root/node_modules", true, true},
+      {"/root/a/b/node_modules", true, true},
+      {"/root/a/node_modules_x", true, false},
+      {"/root/a/target", false, true},
+      {"/root/buck-out", true, true},
+      {"/root/a/buck-out", true, false},
+      {"/root/build/out", true, true},
+      {"/root/a/build/out", false, false},
+      {"/root/a/out", true, true},
+      {"/root/a/out", false, false},
+      {"/root/gen", true, true},
+      {"/root/gen", false, false},
+      {"/root/a/gen", true, false},
+      {"/root/foo.egg-info", true, true},
+      {"/root/a/foo.egg-info", false, true},
+      {"/root/src/x/generated", true, true},
+      {"/root/src/x/y/generated", true, false},
+      {"/root/cache/a.tmp", false, true},
+      {"/root/a/b/cache/a.tmp", false, true},
+      {"/root/a/b/cache/a.txt", false, false},
+      {"/root", true, false},
+      {"/rootnode_modules", true, false},
+      {"/other/node_modules", true, false},
+  };
+  for (auto& test : tests) {
+    EXPECT_EQ(
+        test.ignored,
+        state.isIgnoredByGlob(test.path, test.isDir))
+        << test.path;
+  }
+
+  // isIgnored also considers the parents, but only knows whether they are
+  // dirs.
+  EXPECT_TRUE(state.isIgnored("/root/a/node_modules/x/y", 24));
+  EXPECT_TRUE(state.isIgnored("/root/a/out/x", 13));
+  EXPECT_FALSE(state.isIgnored("/root/a/out", 11));
+  EXPECT_FALSE(state.isIgnored("/root/a/src/x", 13));
+}
+
+TEST(Ignore, parents_are_rematched_when_globs_change) {
+  w_string root{"/root", W_STRING_UNICODE};
+  IgnoreSet state;
+  state.addGlob(root, "*.tmp");
+  EXPECT_FALSE(state.isIgnored("/root/a/b/x", 11));
+  EXPECT_FALSE(state.isIgnored("/root/a/b/y", 11));
+
+  // The answer for /root/a/b must not outlive the globs it was found with,
+  // nor be shared with another set.
+  state.addGlob(root, "a/*");
+  EXPECT_TRUE(state.isIgnored("/root/a/b/x", 11));
+  EXPECT_TRUE(state.isIgnored("/root/a/b/y", 11));
+
+  IgnoreSet other;
+  other.addGlob(root, "*.tmp");
+  EXPECT_FALSE(other.isIgnored("/root/a/b/x", 11));
+  EXPECT_TRUE(other.isIgnored("/root/a/b.tmp/x", 15));
+  EXPECT_TRUE(state.isIgnored("/root/a/b/x", 11));
+}
+
 // Load up the words data file and build a list of strings from that list.
 // Each of those strings is prefixed with the supplied string.
 // If there are fewer than limit entries available in the data file, we will
@@ -6,12 +6,19 @@
  */
 
 #include "watchman/InMemoryView.h"
+#include <folly/FileUtil.h>
 #include <folly/executors/ManualExecutor.h>
 #include <folly/portability/GTest.h>
+#include <folly/testing/TestUtil.h>
+#include <set>
+#include <string>
+#include <thread>
+#include "watchman/Errors.h"
 #include "watchman/fs/FSDetect.h"
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/QueryContext.h"
+#include "watchman/query/parse.h"
 #include "watchman/root/Root.h"
 #include "watchman/test/lib/FakeFileSystem.h"
 #include "watchman/test/lib/FakeWatcher.h"
@@ -23,9 +30,13 @@ namespace {
 
 using namespace watchman;
 
-Configuration getConfiguration(bool usePwalk) {
+Configuration getConfiguration(
+    bool usePwalk,
+    bool caseInsensitiveIndex = false) {
   json_ref json = json_object();
   json_object_set(json, "enable_parallel_crawl", json_boolean(usePwalk));
+  json_object_set(
+      json, "case_insensitive_index", json_boolean(caseInsensitiveIndex));
   return Configuration{std::move(json)};
 }
 
@@ -67,6 +78,8 @@ TEST_P(InMemoryViewTest, drive_initial_crawl) {
 
   // This will perform the initial crawl.
   EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+  // Dirs are also files in their parent.
+  EXPECT_EQ(2, view->getNumFiles().value_or(0));
 
   Query query;
   query.fieldList.add("name");
@@ -524,6 +537,244 @@ TEST_P(InMemoryViewTest, directory_removal_does_not_report_parent) {
   // notification from the watcher for that directory.
 }
 
+TEST_P(InMemoryViewTest, age_out_only_walks_deleted_files) {
+  fs.defineContents({
+      FAKEFS_ROOT "root/dir/a.txt",
+      FAKEFS_ROOT "root/dir/b.txt",
+      FAKEFS_ROOT "root/dir/c.txt",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  auto notify = [&](const char* path) {
+    pending.lock()->add(path, {}, W_PENDING_VIA_NOTIFY);
+    pending.lock()->ping();
+    EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+  };
+
+  fs.removeRecursively(FAKEFS_ROOT "root/dir/a.txt");
+  notify(FAKEFS_ROOT "root/dir/a.txt");
+  fs.removeRecursively(FAKEFS_ROOT "root/dir/b.txt");
+  notify(FAKEFS_ROOT "root/dir/b.txt");
+
+  // b.txt comes back, so it is no longer a candidate for age out.
+  fs.defineContents({FAKEFS_ROOT "root/dir/b.txt"});
+  notify(FAKEFS_ROOT "root/dir/b.txt");
+
+  {
+    const auto& viewdb = view->unsafeAccessViewDatabase();
+    auto* oldest = viewdb.getOldestDeletedFile();
+    ASSERT_NE(nullptr, oldest);
+    EXPECT_EQ("a.txt", oldest->getName().view());
+  }
+
+  int64_t walked = 0;
+  int64_t files = 0;
+  int64_t dirs = 0;
+  int64_t slices = 0;
+
+  // Nothing has been deleted for long enough yet.
+  view->ageOut(walked, files, dirs, slices, std::chrono::hours(1));
+  EXPECT_EQ(1, walked);
+  EXPECT_EQ(0, files);
+  EXPECT_EQ(1, slices);
+
+  view->ageOut(walked, files, dirs, slices, std::chrono::seconds(0));
+  EXPECT_EQ(1, walked);
+  EXPECT_EQ(1, files);
+  EXPECT_EQ(0, dirs);
+  EXPECT_EQ(nullptr, view->unsafeAccessViewDatabase().getOldestDeletedFile());
+
+  Query query;
+  query.fieldList.add("name");
+  query.paths.emplace();
+  query.paths->emplace_back(QueryPath{"dir", 1});
+
+  QueryContext ctx{&query, root, false};
+  view->pathGenerator(&query, &ctx);
+
+  std::set<std::string> names;
+  for (size_t i = 0; i < ctx.resultsArray.size(); ++i) {
+    names.insert(ctx.resultsArray.at(i).asCString());
+  }
+  EXPECT_EQ(0, names.count("dir/a.txt"));
+  EXPECT_EQ(1, names.count("dir/b.txt"));
+  EXPECT_EQ(1, names.count("dir/c.txt"));
+}
+
+TEST_P(InMemoryViewTest, case_insensitive_queries_use_the_folded_index) {
+  Configuration foldingConfig = getConfiguration(GetParam(), true);
+  auto foldingView =
+      std::make_shared<InMemoryView>(fs, root_path, foldingConfig, watcher);
+  PendingCollection& foldingPending =
+      foldingView->unsafeAccessPendingFromWatcher();
+  foldingPending.lock()->ping();
+
+  fs.defineContents({
+      FAKEFS_ROOT "root/Foo/Bar.txt",
+      FAKEFS_ROOT "root/Foo/baz.txt",
+      FAKEFS_ROOT "root/other/Bar.txt",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs,
+      root_path,
+      "fs_type",
+      w_string_to_json("{}"),
+      foldingConfig,
+      foldingView,
+      [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(
+      Continue::Continue,
+      foldingView->stepIoThread(root, state, foldingPending));
+  EXPECT_TRUE(foldingView->unsafeAccessViewDatabase().hasCaseFoldedIndex());
+
+  Query pathQuery;
+  pathQuery.case_sensitive = CaseSensitivity::CaseInSensitive;
+  pathQuery.fieldList.add("name");
+  pathQuery.paths.emplace();
+  pathQuery.paths->emplace_back(QueryPath{"foo/bar.TXT", 0});
+  // Reuses the parent resolved for the previous path.
+  pathQuery.paths->emplace_back(QueryPath{"foo/BAZ.txt", 0});
+
+  QueryContext pathCtx{&pathQuery, root, false};
+  foldingView->pathGenerator(&pathQuery, &pathCtx);
+  ASSERT_EQ(2, pathCtx.resultsArray.size());
+  EXPECT_STREQ("Foo/Bar.txt", pathCtx.resultsArray.at(0).asCString());
+  EXPECT_STREQ("Foo/baz.txt", pathCtx.resultsArray.at(1).asCString());
+
+  Query globQuery;
+  globQuery.case_sensitive = CaseSensitivity::CaseInSensitive;
+  globQuery.fieldList.add("name");
+  parse_globs(
+      &globQuery,
+      json_object({{"glob", json_array({w_string_to_json("FOO/*.TXT")})}}));
+
+  QueryContext globCtx{&globQuery, root, false};
+  foldingView->globGenerator(&globQuery, &globCtx);
+  std::set<std::string> names;
+  for (size_t i = 0; i < globCtx.resultsArray.size(); ++i) {
+    names.insert(globCtx.resultsArray.at(i).asCString());
+  }
+  EXPECT_EQ((std::set<std::string>{"Foo/Bar.txt", "Foo/baz.txt"}), names);
+
+  // Case sensitive queries still require an exact match.
+  Query exactQuery;
+  exactQuery.case_sensitive = CaseSensitivity::CaseSensitive;
+  exactQuery.fieldList.add("name");
+  exactQuery.paths.emplace();
+  exactQuery.paths->emplace_back(QueryPath{"foo/bar.TXT", 0});
+
+  QueryContext exactCtx{&exactQuery, root, false};
+  foldingView->pathGenerator(&exactQuery, &exactCtx);
+  EXPECT_EQ(0, exactCtx.resultsArray.size());
+}
+
+TEST_P(InMemoryViewTest, path_file_lists_paths_to_generate) {
+  fs.defineContents({
+      FAKEFS_ROOT "root/a/x.txt",
+      FAKEFS_ROOT "root/a/y.txt",
+      FAKEFS_ROOT "root/b/z.txt",
+      FAKEFS_ROOT "root/c.txt",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  folly::test::TemporaryFile pathFile;
+  std::string contents = "b/z.txt\r\na/y.txt\n\nmissing/q.txt\na/x.txt";
+  ASSERT_EQ(
+      ssize_t(contents.size()),
+      folly::writeFull(pathFile.fd(), contents.data(), contents.size()));
+
+  Query query;
+  query.fieldList.add("name");
+  auto pathFileName = pathFile.path().string();
+  parse_paths(
+      &query,
+      json_object({{"path_file", typed_string_to_json(pathFileName)}}));
+
+  // Sorted so that paths in the same directory are adjacent.
+  ASSERT_TRUE(query.paths);
+  std::vector<std::string> names;
+  for (auto& path : *query.paths) {
+    EXPECT_EQ(-1, path.depth);
+    names.emplace_back(path.name.view());
+  }
+  EXPECT_EQ(
+      (std::vector<std::string>{
+          "a/x.txt", "a/y.txt", "b/z.txt", "missing/q.txt"}),
+      names);
+
+  QueryContext ctx{&query, root, false};
+  view->pathGenerator(&query, &ctx);
+  ASSERT_EQ(3, ctx.resultsArray.size());
+  EXPECT_STREQ("a/x.txt", ctx.resultsArray.at(0).asCString());
+  EXPECT_STREQ("a/y.txt", ctx.resultsArray.at(1).asCString());
+  EXPECT_STREQ("b/z.txt", ctx.resultsArray.at(2).asCString());
+}
+
+TEST(PathFileTest, only_the_owner_may_use_a_path_file) {
+  auto spec = json_object({{"path_file", typed_string_to_json("/etc/hosts")}});
+  checkPathFileAllowed(spec, true);
+  EXPECT_THROW(checkPathFileAllowed(spec, false), QueryParseError);
+  checkPathFileAllowed(json_object({{"path", json_array({})}}), false);
+}
+
+TEST_P(InMemoryViewTest, cancelled_queries_stop_walking) {
+  for (int i = 0; i < 1000; ++i) {
+    auto path = fmt::format(FAKEFS_ROOT "root/dir/file{}.txt", i);
+    fs.addNode(path.c_str(), fs.fakeFile());
+  }
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  Query query;
+  query.fieldList.add("name");
+  query.paths.emplace();
+  query.paths->emplace_back(QueryPath{"", -1});
+
+  folly::CancellationSource cancellation;
+  query.cancellationToken = cancellation.getToken();
+  cancellation.requestCancellation();
+
+  QueryContext disconnectedCtx{&query, root, false};
+  EXPECT_THROW(
+      view->pathGenerator(&query, &disconnectedCtx), QueryCancelledError);
+  // Cancellation is checked periodically, not for every file.
+  EXPECT_LT(disconnectedCtx.getNumWalked(), 1000);
+  EXPECT_EQ(1, root->cancelledQueries.disconnected.load());
+  EXPECT_EQ(
+      disconnectedCtx.getNumWalked(),
+      root->cancelledQueries.filesWalked.load());
+
+  query.cancellationToken = folly::CancellationToken{};
+  query.deadline = std::chrono::milliseconds{1};
+  QueryContext lateCtx{&query, root, false};
+  std::this_thread::sleep_for(std::chrono::milliseconds{2});
+  EXPECT_THROW(view->pathGenerator(&query, &lateCtx), QueryCancelledError);
+  EXPECT_EQ(1, root->cancelledQueries.deadlineExceeded.load());
+
+  query.deadline = std::chrono::minutes{1};
+  QueryContext ctx{&query, root, false};
+  view->pathGenerator(&query, &ctx);
+  // The dir itself, and its files.
+  EXPECT_EQ(1001, ctx.resultsArray.size());
+}
+
 INSTANTIATE_TEST_CASE_P(
     InMemoryViewTests,
     InMemoryViewTest,
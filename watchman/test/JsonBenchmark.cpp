@@ -6,6 +6,7 @@
  */
 
 #include <benchmark/benchmark.h>
+#include <fmt/core.h>
 #include "watchman/thirdparty/jansson/jansson.h"
 
 namespace {
@@ -75,6 +76,47 @@ void decode_doubles(benchmark::State& state) {
 
 BENCHMARK(decode_doubles);
 
+// A query with a long list of paths, as sent by build tools.
+std::string encode_path_query() {
+  constexpr size_t N = 10000;
+
+  std::vector<json_ref> paths;
+  paths.reserve(N);
+  for (size_t i = 0; i < N; ++i) {
+    paths.push_back(typed_string_to_json(
+        fmt::format("some/deeply/nested/dir{}/file{}.cpp", i % 100, i)));
+  }
+
+  json_ref query = json_object({
+      {"expression", json_array({typed_string_to_json("exists")})},
+      {"fields", json_array({typed_string_to_json("name")})},
+      {"path", json_array(std::move(paths))},
+  });
+  return json_dumps(query, JSON_COMPACT);
+}
+
+void decode_path_query(benchmark::State& state) {
+  auto encoded = encode_path_query();
+
+  for (auto _ : state) {
+    json_error_t err;
+    benchmark::DoNotOptimize(
+        json_loadb(encoded.data(), encoded.size(), 0, &err));
+  }
+}
+BENCHMARK(decode_path_query);
+
+void decode_path_query_fast(benchmark::State& state) {
+  auto encoded = encode_path_query();
+
+  for (auto _ : state) {
+    json_error_t err;
+    benchmark::DoNotOptimize(
+        json_loadb_fast(encoded.data(), encoded.size(), 0, &err));
+  }
+}
+BENCHMARK(decode_path_query_fast);
+
 } // namespace
 
 BENCHMARK_MAIN();
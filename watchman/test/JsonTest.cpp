@@ -62,4 +62,89 @@ TEST(JsonTest, too_deep_parse_tree) {
   json_loads(document.c_str(), JSON_DECODE_ANY, &err);
 }
 
+void expect_fast_load_matches(const std::string& document, size_t flags) {
+  SCOPED_TRACE(document);
+  json_error_t expectedErr;
+  auto expected =
+      json_loadb(document.data(), document.size(), flags, &expectedErr);
+  json_error_t actualErr;
+  auto actual =
+      json_loadb_fast(document.data(), document.size(), flags, &actualErr);
+
+  ASSERT_EQ(expected.has_value(), actual.has_value());
+  if (expected) {
+    EXPECT_TRUE(json_equal(*expected, *actual));
+  }
+  EXPECT_STREQ(expectedErr.text, actualErr.text);
+  EXPECT_EQ(expectedErr.line, actualErr.line);
+  EXPECT_EQ(expectedErr.column, actualErr.column);
+  EXPECT_EQ(expectedErr.position, actualErr.position);
+}
+
+TEST(JsonTest, fast_load_matches_json_loadb) {
+  const char* documents[] = {
+      // Accepted
+      R"({"a": [1, -0, 2.5, -3e10, true, false, null], "b": {}})",
+      R"(["tab\there", "\"quoted\"", "back\\slash\\", "\/", "\b\f\n\r"])",
+      R"(["\u00e9\u20AC", "\ud83d\ude00"])",
+      "[\"caf\xc3\xa9\"]",
+      R"([9223372036854775807, -9223372036854775808, 1E+2, 0.5e-3])",
+      R"({"dup": 1, "dup": 2})",
+      " \t[\r\n1 ]\n",
+      R"("scalar")",
+      "12",
+      // Rejected
+      "",
+      "[",
+      "[1,]",
+      "[1 2]",
+      "[01]",
+      "[1.]",
+      "[tru]",
+      "[\"unterminated]",
+      "[\"bad \\x escape\"]",
+      "[\"\\u12\"]",
+      "[\"\\ud83d\"]",
+      "[\"\\u0000\"]",
+      "[\"new\nline\"]",
+      "[\"\xff\"]",
+      R"({"": 1})",
+      R"({"a" 1})",
+      "[9223372036854775808]",
+      "[1] [2]",
+  };
+  for (auto* document : documents) {
+    expect_fast_load_matches(document, 0);
+    expect_fast_load_matches(document, JSON_DECODE_ANY);
+  }
+}
+
+TEST(JsonTest, fast_load_spans_blocks) {
+  // Long enough that strings, escapes and numbers cross the 64 byte blocks
+  // that the input is indexed in.
+  std::string document = "[";
+  for (int i = 0; i < 200; ++i) {
+    if (i) {
+      document += ",";
+    }
+    document += fmt::format(
+        R"({{"name": "dir{}/file\\{}\".txt", "size": {}}})",
+        i,
+        std::string(i % 7, 'x'),
+        i * 12345);
+  }
+  document += "]";
+  expect_fast_load_matches(document, 0);
+
+  json_error_t err;
+  auto result = json_loadb_fast(document.data(), document.size(), 0, &err);
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(200, json_array_size(*result));
+}
+
+TEST(JsonTest, fast_load_too_deep_parse_tree) {
+  expect_fast_load_matches(std::string(1000, '[') + std::string(1000, ']'), 0);
+  expect_fast_load_matches(std::string(999, '[') + std::string(999, ']'), 0);
+}
+
 } // namespace
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include "watchman/query/LiteralPrefilter.h"
+#include "watchman/query/Query.h"
+#include "watchman/query/QueryExpr.h"
+#include "watchman/query/TermRegistry.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+
+using namespace watchman;
+using namespace testing;
+
+namespace {
+
+std::vector<uint32_t> findAll(
+    const LiteralPrefilter& prefilter,
+    w_string_piece subject) {
+  std::vector<uint32_t> found;
+  prefilter.forEachMatch(subject, [&](uint32_t id) {
+    found.push_back(id);
+    return false;
+  });
+  return found;
+}
+
+std::optional<std::string> required_literal(const char* expression) {
+  json_error_t err{};
+  auto json = json_loads(expression, JSON_DECODE_ANY, &err);
+  if (!json.has_value()) {
+    ADD_FAILURE() << "JSON parse error in fixture: " << err.text;
+    return std::nullopt;
+  }
+  Query query;
+  auto required = parseQueryExpr(&query, *json)->requiredLiteral();
+  if (!required) {
+    return std::nullopt;
+  }
+  return required->literal;
+}
+
+} // namespace
+
+TEST(LiteralPrefilterTest, finds_overlapping_literals) {
+  LiteralPrefilter prefilter{{"he", "she", "his", "hers"}};
+  EXPECT_THAT(findAll(prefilter, "ushers"), ElementsAre(1, 0, 3));
+  EXPECT_THAT(findAll(prefilter, "this"), ElementsAre(2));
+  EXPECT_THAT(findAll(prefilter, "nothing"), IsEmpty());
+}
+
+TEST(LiteralPrefilterTest, reports_each_occurrence) {
+  LiteralPrefilter prefilter{{"ab", "ab"}};
+  EXPECT_THAT(findAll(prefilter, "abab"), ElementsAre(0, 1, 0, 1));
+}
+
+TEST(LiteralPrefilterTest, ignores_case_and_slash_direction) {
+  LiteralPrefilter prefilter{{"src/Foo", ".CPP"}};
+  EXPECT_THAT(findAll(prefilter, "SRC\\fOO.cpp"), ElementsAre(0, 1));
+}
+
+TEST(LiteralPrefilterTest, stops_when_asked) {
+  LiteralPrefilter prefilter{{"a", "b"}};
+  std::vector<uint32_t> found;
+  EXPECT_TRUE(prefilter.forEachMatch("xaby", [&](uint32_t id) {
+    found.push_back(id);
+    return true;
+  }));
+  EXPECT_THAT(found, ElementsAre(0));
+}
+
+TEST(LiteralPrefilterTest, empty_prefilter_finds_nothing) {
+  LiteralPrefilter prefilter;
+  EXPECT_TRUE(prefilter.empty());
+  EXPECT_THAT(findAll(prefilter, "anything"), IsEmpty());
+}
+
+TEST(LiteralPrefilterTest, match_requires_its_longest_literal) {
+  EXPECT_EQ(".cpp", required_literal(R"( ["match", "*.cpp"] )"));
+  EXPECT_EQ("test_", required_literal(R"( ["match", "src/**/test_*.py"] )"));
+  EXPECT_EQ("foo", required_literal(R"( ["match", "**/foo/**"] )"));
+  EXPECT_EQ("ghij", required_literal(R"( ["match", "[abc]def?ghij"] )"));
+  EXPECT_EQ("a*bc", required_literal(R"( ["match", "a\\*bc"] )"));
+  EXPECT_EQ("a/b", required_literal(R"( ["match", "a//b", "wholename"] )"));
+  EXPECT_EQ("", required_literal(R"( ["match", "*"] )"));
+  EXPECT_EQ("", required_literal(R"( ["match", "foo[bar"] )"));
+}
+
+TEST(LiteralPrefilterTest, pcre_requires_its_longest_literal) {
+  EXPECT_EQ("src/", required_literal(R"( ["pcre", "^src/.*\\.cpp$"] )"));
+  EXPECT_EQ("_test.py", required_literal(R"( ["pcre", "\\d+_test\\.py"] )"));
+  EXPECT_EQ("foo", required_literal(R"( ["pcre", "foo(bar)?baz"] )"));
+  EXPECT_EQ("yz", required_literal(R"( ["pcre", "x{0,2}yz"] )"));
+  // Alternatives and inline options are not analyzed.
+  EXPECT_EQ("", required_literal(R"( ["pcre", "foo|bar"] )"));
+  EXPECT_EQ("", required_literal(R"( ["pcre", "(?x) f o o"] )"));
+}
+
+TEST(LiteralPrefilterTest, other_terms_have_no_literal) {
+  EXPECT_EQ(std::nullopt, required_literal(R"( ["suffix", "cpp"] )"));
+  EXPECT_EQ(std::nullopt, required_literal(R"( ["type", "f"] )"));
+}
@@ -6,6 +6,9 @@
  */
 
 #include <folly/portability/GTest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "watchman/Logging.h"
 
 using namespace watchman;
@@ -30,5 +33,118 @@ TEST(Log, logging) {
   EXPECT_TRUE(logged);
 }
 
+TEST(Log, async_logging) {
+  Log log;
+  std::atomic<int> notified{0};
+  auto sub = log.subscribe(DBG, [&notified]() { notified++; });
+
+  log.startAsync(1024);
+  log.logf(DBG, "first {}\n", 1);
+  log.log(DBG, "second ", 2, "\n");
+  log.flush();
+
+  std::vector<std::shared_ptr<const watchman::Publisher::Item>> pending;
+  sub->getPending(pending);
+  ASSERT_EQ(2, pending.size());
+  auto first = json_to_w_string(pending[0]->payload.get("log"));
+  auto second = json_to_w_string(pending[1]->payload.get("log"));
+  EXPECT_TRUE(first.piece().contains("first 1"));
+  EXPECT_TRUE(second.piece().contains("second 2"));
+  EXPECT_EQ(2, notified.load());
+
+  auto stats = log.getStats();
+  EXPECT_TRUE(stats.async);
+  EXPECT_EQ(1, stats.threads);
+  EXPECT_EQ(2, stats.queued);
+  EXPECT_EQ(2, stats.written);
+  EXPECT_EQ(0, stats.dropped);
+
+  log.stopAsync();
+  EXPECT_FALSE(log.getStats().async);
+}
+
+TEST(Log, async_logging_drops_when_full) {
+  Log log;
+  auto sub = log.subscribe(DBG, nullptr);
+
+  constexpr int kCount = 10000;
+  log.startAsync(4);
+  for (int i = 0; i < kCount; ++i) {
+    log.logf(DBG, "{}\n", i);
+  }
+  log.flush();
+
+  // The writer may keep up with some of them, but every statement is
+  // either written or counted as dropped.
+  auto stats = log.getStats();
+  EXPECT_EQ(kCount, stats.queued + stats.dropped);
+  EXPECT_EQ(stats.queued, stats.written);
+
+  std::vector<std::shared_ptr<const watchman::Publisher::Item>> pending;
+  sub->getPending(pending);
+  EXPECT_EQ(stats.written, pending.size());
+}
+
+TEST(Log, stop_async_writes_statements_logged_while_it_stops) {
+  Log log;
+  log.setStdErrLoggingLevel(OFF);
+  auto sub = log.subscribe(DBG, nullptr);
+
+  constexpr int kThreads = 4;
+  constexpr int kCount = 1000;
+  log.startAsync(kCount);
+  std::atomic<int> started{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      ++started;
+      for (int i = 0; i < kCount; ++i) {
+        log.logf(DBG, "{}\n", i);
+      }
+    });
+  }
+  while (started.load() < kThreads) {
+    std::this_thread::yield();
+  }
+  log.stopAsync();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Whether they were handed off or logged after it stopped, none are lost.
+  auto stats = log.getStats();
+  EXPECT_EQ(0, stats.dropped);
+  EXPECT_EQ(stats.queued, stats.written);
+  std::vector<std::shared_ptr<const watchman::Publisher::Item>> pending;
+  sub->getPending(pending);
+  EXPECT_EQ(kThreads * kCount, pending.size());
+}
+
+TEST(Log, fatal_while_draining_does_not_wait_for_itself) {
+  Log log;
+  // Writing a fatal error to stderr would exit.
+  log.setStdErrLoggingLevel(OFF);
+  auto errors = log.subscribe(ERR, nullptr);
+  std::atomic<bool> fatalLogged{false};
+  auto sub = log.subscribe(DBG, [&] {
+    if (!fatalLogged.exchange(true)) {
+      log.log(FATAL, "fatal\n");
+    }
+  });
+
+  log.startAsync(16);
+  log.log(DBG, "debug\n");
+  log.flush();
+  log.stopAsync();
+
+  EXPECT_TRUE(fatalLogged.load());
+  std::vector<std::shared_ptr<const watchman::Publisher::Item>> pending;
+  errors->getPending(pending);
+  ASSERT_EQ(1, pending.size());
+  EXPECT_TRUE(json_to_w_string(pending[0]->payload.get("log"))
+                  .piece()
+                  .contains("fatal"));
+}
+
 /* vim:ts=2:sw=2:et:
  */
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include "watchman/NameTable.h"
+#include "watchman/watchman_dir.h"
+#include "watchman/watchman_file.h"
+
+using namespace watchman;
+
+TEST(NameTableTest, equal_names_share_storage) {
+  NameTable table;
+  std::string buck = "BUCK";
+  auto a = table.intern(w_string_piece{buck.data(), buck.size()});
+  auto b = table.intern("BUCK");
+  auto c = table.intern("src");
+
+  EXPECT_EQ("BUCK", a);
+  EXPECT_EQ(a.data(), b.data());
+  EXPECT_NE(a.data(), c.data());
+
+  auto stats = table.getStats();
+  EXPECT_EQ(2, stats.names);
+  EXPECT_EQ(7, stats.bytes);
+  EXPECT_EQ(3, stats.lookups);
+  EXPECT_EQ(1, stats.hits);
+}
+
+TEST(NameTableTest, purge_drops_only_unused_names) {
+  NameTable table;
+  auto kept = table.intern("kept");
+  table.intern("dropped");
+  EXPECT_EQ(2, table.size());
+
+  EXPECT_EQ(1, table.purge());
+  EXPECT_EQ(1, table.size());
+  EXPECT_EQ(kept.data(), table.intern("kept").data());
+
+  auto stats = table.getStats();
+  EXPECT_EQ(4, stats.bytes);
+  EXPECT_EQ(1, stats.purged);
+}
+
+TEST(NameTableTest, purge_can_look_at_only_some_names) {
+  NameTable table;
+  table.intern("unlisted");
+  auto kept = table.intern("kept");
+  std::vector<w_string> candidates{
+      table.intern("released"), table.intern("released"), kept};
+
+  // The candidates themselves don't keep their names alive.
+  EXPECT_EQ(1, table.purge(candidates));
+  EXPECT_TRUE(candidates.empty());
+  EXPECT_EQ(2, table.size());
+  // Only a full purge finds the unlisted name.
+  EXPECT_EQ(1, table.purge());
+  EXPECT_EQ(kept.data(), table.intern("kept").data());
+}
+
+TEST(NameTableTest, files_reference_the_interned_name) {
+  NameTable table;
+  watchman_dir dir{w_string{"/root"}, nullptr};
+  auto first = watchman_file::make(table.intern("index.ts"), &dir);
+  auto second = watchman_file::make(table.intern("index.ts"), &dir);
+
+  EXPECT_EQ("index.ts", first->getName());
+  EXPECT_EQ(first->getName().data(), second->getName().data());
+
+  // The files keep the name alive until they are freed.
+  EXPECT_EQ(0, table.purge());
+  first.reset();
+  second.reset();
+  EXPECT_EQ(1, table.purge());
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryAdmission.h"
+#include <folly/portability/GTest.h>
+#include <thread>
+#include <vector>
+#include "watchman/Errors.h"
+
+using namespace watchman;
+using namespace std::chrono_literals;
+
+namespace {
+
+QueryAdmissionController::Limits makeLimits(
+    size_t maxConcurrent,
+    size_t maxConcurrentPerClient,
+    size_t maxQueued) {
+  QueryAdmissionController::Limits limits;
+  limits.maxConcurrent = maxConcurrent;
+  limits.maxConcurrentPerClient = maxConcurrentPerClient;
+  limits.maxQueued = maxQueued;
+  limits.minCost = 100;
+  limits.timeout = 60s;
+  return limits;
+}
+
+void waitForQueued(const QueryAdmissionController& controller, int64_t n) {
+  while (controller.getStats().queued != n) {
+    std::this_thread::yield();
+  }
+}
+
+} // namespace
+
+TEST(QueryAdmissionTest, estimates_files_walked) {
+  Query walkAll;
+  EXPECT_EQ(1000, estimateQueryCost(walkAll, 1000, false));
+  // The view doesn't know how many files it has.
+  EXPECT_EQ(
+      kAssumedViewFiles, estimateQueryCost(walkAll, std::nullopt, false));
+
+  Query paths;
+  paths.paths.emplace();
+  paths.paths->push_back(QueryPath{w_string{"src/a.c"}, -1});
+  paths.paths->push_back(QueryPath{w_string{"src/b.c"}, -1});
+  EXPECT_EQ(2, estimateQueryCost(paths, 1000, false));
+  paths.paths->push_back(QueryPath{w_string{""}, -1});
+  EXPECT_EQ(1000, estimateQueryCost(paths, 1000, false));
+
+  // Only the name of a field is looked at, so its renderer isn't needed.
+  QueryFieldRenderer sha1{w_string{"content.sha1hex"}, nullptr};
+  Query hashes;
+  hashes.fieldList.push_back(&sha1);
+  EXPECT_EQ(1000 * kContentCostFactor, estimateQueryCost(hashes, 1000, false));
+}
+
+TEST(QueryAdmissionTest, only_a_current_since_clock_narrows_the_walk) {
+  Query since;
+  since.since_spec = ClockSpec::parseOptionalClockSpec(
+      typed_string_to_json("c:123:1:2:3", W_STRING_UNICODE));
+  EXPECT_EQ(0, estimateQueryCost(since, 1000, false));
+  EXPECT_EQ(1000, estimateQueryCost(since, 1000, true));
+
+  // How many files changed since a time can't be known without walking.
+  Query timestamp;
+  timestamp.since_spec = ClockSpec::parseOptionalClockSpec(json_integer(1));
+  EXPECT_EQ(1000, estimateQueryCost(timestamp, 1000, false));
+}
+
+TEST(QueryAdmissionTest, cheap_queries_are_not_limited) {
+  QueryAdmissionController controller{makeLimits(1, 0, 0)};
+  auto expensive = controller.admit(1, QueryPriority::Interactive, 100);
+  auto cheap = controller.admit(1, QueryPriority::Interactive, 99);
+
+  auto stats = controller.getStats();
+  EXPECT_EQ(1, stats.running);
+  EXPECT_EQ(1, stats.admitted);
+  EXPECT_EQ(1, stats.bypassed);
+}
+
+TEST(QueryAdmissionTest, rejects_when_the_queue_is_full) {
+  QueryAdmissionController controller{makeLimits(1, 0, 1)};
+  std::optional<QueryAdmissionController::Ticket> running =
+      controller.admit(1, QueryPriority::Interactive, 100);
+  std::thread queued{
+      [&] { controller.admit(2, QueryPriority::Interactive, 100); }};
+  waitForQueued(controller, 1);
+
+  EXPECT_THROW(
+      controller.admit(3, QueryPriority::Interactive, 100), QueryExecError);
+  EXPECT_EQ(1, controller.getStats().rejected);
+
+  running.reset();
+  queued.join();
+}
+
+TEST(QueryAdmissionTest, zero_means_unlimited) {
+  auto limits = makeLimits(1, 0, 0);
+  limits.timeout = 0ms;
+  QueryAdmissionController controller{limits};
+  std::optional<QueryAdmissionController::Ticket> running =
+      controller.admit(1, QueryPriority::Interactive, 100);
+  std::vector<std::thread> queued;
+  for (pid_t client = 2; client < 5; ++client) {
+    queued.emplace_back(
+        [&, client] { controller.admit(client, QueryPriority::Batch, 100); });
+  }
+  waitForQueued(controller, 3);
+
+  running.reset();
+  for (auto& thread : queued) {
+    thread.join();
+  }
+  auto stats = controller.getStats();
+  EXPECT_EQ(0, stats.rejected);
+  EXPECT_EQ(3, stats.waited);
+}
+
+TEST(QueryAdmissionTest, limits_each_client) {
+  auto limits = makeLimits(0, 1, 1);
+  limits.timeout = 1ms;
+  QueryAdmissionController controller{limits};
+  auto first = controller.admit(1, QueryPriority::Interactive, 100);
+  // Another client isn't held back by the first.
+  auto other = controller.admit(2, QueryPriority::Interactive, 100);
+  EXPECT_THROW(
+      controller.admit(1, QueryPriority::Interactive, 100), QueryExecError);
+}
+
+TEST(QueryAdmissionTest, callers_may_wait_less_than_the_timeout) {
+  QueryAdmissionController controller{makeLimits(1, 0, 1)};
+  auto running = controller.admit(1, QueryPriority::Interactive, 100);
+  // The limits would let it wait a minute.
+  EXPECT_THROW(
+      controller.admit(2, QueryPriority::Interactive, 100, 1ms),
+      QueryExecError);
+
+  auto stats = controller.getStats();
+  EXPECT_EQ(0, stats.queued);
+  // Giving up isn't counted as being rejected.
+  EXPECT_EQ(0, stats.rejected);
+}
+
+TEST(QueryAdmissionTest, interactive_queries_run_before_batch_ones) {
+  QueryAdmissionController controller{makeLimits(1, 0, 2)};
+  std::optional<QueryAdmissionController::Ticket> running =
+      controller.admit(1, QueryPriority::Interactive, 100);
+
+  std::vector<pid_t> order;
+  std::mutex orderMutex;
+  auto run = [&](pid_t client, QueryPriority priority) {
+    return std::thread{[&, client, priority] {
+      auto ticket = controller.admit(client, priority, 100);
+      std::lock_guard<std::mutex> lock{orderMutex};
+      order.push_back(client);
+    }};
+  };
+
+  auto batch = run(2, QueryPriority::Batch);
+  waitForQueued(controller, 1);
+  auto interactive = run(3, QueryPriority::Interactive);
+  waitForQueued(controller, 2);
+
+  running.reset();
+  batch.join();
+  interactive.join();
+
+  EXPECT_EQ((std::vector<pid_t>{3, 2}), order);
+  auto stats = controller.getStats();
+  EXPECT_EQ(0, stats.running);
+  EXPECT_EQ(0, stats.queued);
+  EXPECT_EQ(2, stats.waited);
+}
+
+TEST(QueryAdmissionTest, cancelled_queries_leave_the_queue) {
+  auto limits = makeLimits(1, 0, 1);
+  // With no timeout, only the cancellation ends the wait.
+  limits.timeout = 0ms;
+  QueryAdmissionController controller{limits};
+  auto running = controller.admit(1, QueryPriority::Interactive, 100);
+
+  folly::CancellationSource source;
+  std::thread queued{[&] {
+    EXPECT_THROW(
+        controller.admit(
+            2,
+            QueryPriority::Interactive,
+            100,
+            std::nullopt,
+            source.getToken()),
+        QueryExecError);
+  }};
+  waitForQueued(controller, 1);
+  source.requestCancellation();
+  queued.join();
+
+  auto stats = controller.getStats();
+  EXPECT_EQ(0, stats.queued);
+  EXPECT_EQ(0, stats.waited);
+  EXPECT_EQ(0, stats.rejected);
+
+  // Nor does a query that was cancelled before it arrived take a place.
+  EXPECT_THROW(
+      controller.admit(
+          3, QueryPriority::Interactive, 100, std::nullopt, source.getToken()),
+      QueryExecError);
+  EXPECT_EQ(0, controller.getStats().queued);
+}
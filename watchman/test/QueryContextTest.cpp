@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryContext.h"
+#include <folly/futures/Future.h>
+#include <folly/portability/GTest.h>
+#include <deque>
+#include "watchman/InMemoryView.h"
+#include "watchman/query/Query.h"
+#include "watchman/query/QueryResult.h"
+#include "watchman/root/Root.h"
+#include "watchman/test/lib/FakeFileSystem.h"
+#include "watchman/test/lib/FakeWatcher.h"
+
+namespace {
+
+using namespace watchman;
+
+// Decides how the fetches started by FetchingFileResult complete.
+struct Fetcher {
+  enum Mode {
+    // The data is fetched before startBatchFetchProperties returns.
+    Ready,
+    // The data is fetched once the caller waits for it.
+    Deferred,
+    // The data is fetched when the test calls complete().
+    Manual,
+  };
+
+  struct Pending {
+    std::vector<FileResult*> files;
+    folly::Promise<folly::Unit> promise;
+  };
+
+  explicit Fetcher(Mode mode) : mode{mode} {}
+
+  // Completes the oldest fetch started in Manual mode.
+  void complete();
+
+  Mode mode;
+  size_t numFetches{0};
+  std::deque<Pending> pending;
+};
+
+// A FileResult whose size is only known once it has been fetched.
+class FetchingFileResult final : public FileResult {
+ public:
+  FetchingFileResult(w_string dirName, w_string baseName, Fetcher& fetcher)
+      : dirName_{std::move(dirName)},
+        baseName_{std::move(baseName)},
+        fetcher_{fetcher} {}
+
+  std::optional<FileInformation> stat() override {
+    return std::nullopt;
+  }
+  std::optional<struct timespec> accessedTime() override {
+    return std::nullopt;
+  }
+  std::optional<struct timespec> modifiedTime() override {
+    return std::nullopt;
+  }
+  std::optional<struct timespec> changedTime() override {
+    return std::nullopt;
+  }
+  std::optional<size_t> size() override {
+    if (!loaded_) {
+      accessorNeedsProperties(FileResult::Size);
+      return std::nullopt;
+    }
+    return 42;
+  }
+  w_string_piece baseName() override {
+    return baseName_;
+  }
+  w_string_piece dirName() override {
+    return dirName_;
+  }
+  std::optional<bool> exists() override {
+    return true;
+  }
+  std::optional<ResolvedSymlink> readLink() override {
+    return NotSymlink{};
+  }
+  std::optional<ClockStamp> ctime() override {
+    return std::nullopt;
+  }
+  std::optional<ClockStamp> otime() override {
+    return std::nullopt;
+  }
+  std::optional<FileResult::ContentHash> getContentSha1() override {
+    return std::nullopt;
+  }
+
+  static void markLoaded(const std::vector<FileResult*>& files) {
+    for (auto* file : files) {
+      auto* fetching = static_cast<FetchingFileResult*>(file);
+      fetching->loaded_ = true;
+      fetching->clearNeededProperties();
+    }
+  }
+
+  void batchFetchProperties(
+      const std::vector<std::unique_ptr<FileResult>>& files) override {
+    std::vector<FileResult*> raw;
+    for (auto& file : files) {
+      raw.push_back(file.get());
+    }
+    markLoaded(raw);
+  }
+
+  folly::SemiFuture<folly::Unit> startBatchFetchProperties(
+      const std::vector<std::unique_ptr<FileResult>>& files) override {
+    ++fetcher_.numFetches;
+    std::vector<FileResult*> raw;
+    for (auto& file : files) {
+      raw.push_back(file.get());
+    }
+    switch (fetcher_.mode) {
+      case Fetcher::Ready:
+        markLoaded(raw);
+        return folly::makeSemiFuture();
+      case Fetcher::Deferred:
+        return folly::makeSemiFuture().deferValue(
+            [raw = std::move(raw)](folly::Unit) { markLoaded(raw); });
+      case Fetcher::Manual:
+        break;
+    }
+    auto& pending = fetcher_.pending.emplace_back();
+    pending.files = std::move(raw);
+    return pending.promise.getSemiFuture();
+  }
+
+ private:
+  w_string dirName_;
+  w_string baseName_;
+  Fetcher& fetcher_;
+  bool loaded_{false};
+};
+
+void Fetcher::complete() {
+  auto next = std::move(pending.front());
+  pending.pop_front();
+  FetchingFileResult::markLoaded(next.files);
+  next.promise.setValue();
+}
+
+class QueryContextTest : public testing::Test {
+ public:
+  const w_string root_path{FAKEFS_ROOT "root"};
+
+  FakeFileSystem fs;
+  Configuration config;
+  std::shared_ptr<FakeWatcher> watcher = std::make_shared<FakeWatcher>(fs);
+  std::shared_ptr<InMemoryView> view =
+      std::make_shared<InMemoryView>(fs, root_path, config, watcher);
+  std::shared_ptr<Root> root;
+  Query query;
+
+  QueryContextTest() {
+    fs.defineContents({FAKEFS_ROOT "root"});
+    root = std::make_shared<Root>(
+        fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+    query.fieldList.add("name");
+    query.fieldList.add("size");
+  }
+
+  // Hands `count` files that need their size fetched to ctx for rendering.
+  void render(QueryContext& ctx, Fetcher& fetcher, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      ctx.maybeRender(std::make_unique<FetchingFileResult>(
+          root_path, w_string::build("file", nextFile_++), fetcher));
+    }
+  }
+
+ private:
+  size_t nextFile_{0};
+};
+
+TEST_F(QueryContextTest, ready_fetches_are_rendered_straight_away) {
+  Fetcher fetcher{Fetcher::Ready};
+  QueryContext ctx{&query, root, false};
+  auto batchSize = ctx.getFetchBatchSize();
+
+  render(ctx, fetcher, batchSize);
+  EXPECT_EQ(1, fetcher.numFetches);
+  EXPECT_EQ(batchSize, ctx.resultsArray.size());
+  // Nothing overlaps a fetch that completes before it returns, so batches
+  // are made as large as they can be.
+  EXPECT_GT(ctx.getFetchBatchSize(), batchSize);
+
+  EXPECT_TRUE(ctx.fetchRenderBatchNow());
+  EXPECT_EQ(1, fetcher.numFetches);
+  EXPECT_EQ(batchSize, ctx.resultsArray.size());
+}
+
+TEST_F(QueryContextTest, batches_are_fetched_while_more_are_collected) {
+  Fetcher fetcher{Fetcher::Deferred};
+  QueryContext ctx{&query, root, false};
+  auto batchSize = ctx.getFetchBatchSize();
+
+  render(ctx, fetcher, batchSize * 4);
+  EXPECT_EQ(4, fetcher.numFetches);
+  EXPECT_EQ(0, ctx.resultsArray.size());
+  EXPECT_EQ(batchSize, ctx.getFetchBatchSize());
+
+  // A fifth batch means waiting for the first. Because that fetch hadn't
+  // kept up, batches grow.
+  render(ctx, fetcher, batchSize);
+  EXPECT_EQ(5, fetcher.numFetches);
+  EXPECT_EQ(batchSize, ctx.resultsArray.size());
+  EXPECT_EQ(batchSize * 2, ctx.getFetchBatchSize());
+
+  render(ctx, fetcher, 10);
+  EXPECT_TRUE(ctx.fetchRenderBatchNow());
+  EXPECT_EQ(6, fetcher.numFetches);
+  EXPECT_EQ(batchSize * 5 + 10, ctx.resultsArray.size());
+}
+
+TEST_F(QueryContextTest, batches_shrink_when_fetches_keep_up) {
+  QueryContext ctx{&query, root, false};
+  // Destroyed first, so that a failure can't leave ctx waiting for ever.
+  Fetcher fetcher{Fetcher::Manual};
+  auto batchSize = ctx.getFetchBatchSize();
+
+  render(ctx, fetcher, batchSize * 4);
+  EXPECT_EQ(0, ctx.resultsArray.size());
+
+  fetcher.complete();
+  render(ctx, fetcher, batchSize);
+  EXPECT_EQ(batchSize, ctx.resultsArray.size());
+  EXPECT_EQ(batchSize / 2, ctx.getFetchBatchSize());
+
+  while (!fetcher.pending.empty()) {
+    fetcher.complete();
+  }
+  EXPECT_TRUE(ctx.fetchRenderBatchNow());
+  EXPECT_EQ(batchSize * 5, ctx.resultsArray.size());
+}
+
+TEST_F(QueryContextTest, debug_info_reports_fetches) {
+  Fetcher fetcher{Fetcher::Deferred};
+  QueryContext ctx{&query, root, false};
+
+  QueryDebugInfo unfetched;
+  unfetched.numFetchBatches = ctx.getNumFetchBatches();
+  EXPECT_FALSE(unfetched.render().get_optional("fetch"));
+
+  render(ctx, fetcher, 10);
+  EXPECT_TRUE(ctx.fetchRenderBatchNow());
+  EXPECT_EQ(10, ctx.resultsArray.size());
+
+  QueryDebugInfo info;
+  info.numFetchBatches = ctx.getNumFetchBatches();
+  info.fetchBatchSize = ctx.getFetchBatchSize();
+  info.fetchWait = ctx.getFetchWaitDuration();
+  auto fetch = info.render().get_optional("fetch");
+  ASSERT_TRUE(fetch);
+  EXPECT_EQ(1, fetch->get("batches").asInt());
+  EXPECT_EQ(
+      static_cast<json_int_t>(ctx.getFetchBatchSize()),
+      fetch->get("batch_size").asInt());
+  EXPECT_LE(0, fetch->get("wait_us").asInt());
+}
+
+} // namespace
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include <string>
+#include <vector>
+#include "watchman/Logging.h"
+#include "watchman/QueryLog.h"
+
+using namespace watchman;
+
+namespace {
+
+QueryLogEntry makeEntry(int64_t totalUs) {
+  QueryLogEntry entry;
+  entry.total_us = totalUs;
+  entry.num_walked = 10;
+  QueryLogEntry::setName(entry.command, "query");
+  QueryLogEntry::setName(entry.generator, "glob");
+  return entry;
+}
+
+std::vector<std::string> takeLogLines(Publisher::Subscriber& sub) {
+  std::vector<std::shared_ptr<const Publisher::Item>> pending;
+  sub.getPending(pending);
+  std::vector<std::string> lines;
+  for (auto& item : pending) {
+    lines.push_back(json_to_w_string(item->payload.get("log")).string());
+  }
+  return lines;
+}
+
+} // namespace
+
+TEST(QueryLogTest, keeps_the_most_recent_queries) {
+  QueryLog log{w_string{"/root"}, 2, std::chrono::milliseconds(0)};
+  log.record(makeEntry(1));
+  log.record(makeEntry(2));
+  log.record(makeEntry(3));
+
+  auto entries = log.readAll();
+  ASSERT_EQ(2, entries.size());
+  EXPECT_EQ(2, entries[0].total_us);
+  EXPECT_EQ(3, entries[1].total_us);
+
+  log.clear();
+  EXPECT_TRUE(log.readAll().empty());
+}
+
+TEST(QueryLogTest, names_are_truncated) {
+  QueryLogEntry entry;
+  QueryLogEntry::setName(entry.command, "a_very_long_command_name");
+  EXPECT_STREQ("a_very_long_com", entry.command);
+  QueryLogEntry::setName(entry.command, "find");
+  EXPECT_STREQ("find", entry.command);
+}
+
+TEST(QueryLogTest, entries_render_as_json) {
+  auto entry = makeEntry(1500);
+  entry.spec_hash = 0xabc;
+  auto json = entry.asJsonValue();
+  EXPECT_EQ("query", json.get("command").asString().view());
+  EXPECT_EQ("glob", json.get("generator").asString().view());
+  EXPECT_EQ("0000000000000abc", json.get("spec_hash").asString().view());
+  EXPECT_EQ(1500, json.get("total_us").asInt());
+  EXPECT_EQ(10, json.get("num_walked").asInt());
+}
+
+TEST(QueryLogTest, slow_queries_dump_the_buffer) {
+  auto sub = getLog().subscribe(ERR, nullptr);
+  QueryLog log{w_string{"/root"}, 4, std::chrono::milliseconds(10)};
+
+  log.record(makeEntry(1000));
+  EXPECT_TRUE(takeLogLines(*sub).empty());
+
+  log.record(makeEntry(25000));
+  auto lines = takeLogLines(*sub);
+  ASSERT_EQ(3, lines.size());
+  EXPECT_NE(
+      std::string::npos,
+      lines[0].find("slow query (25ms): dumping the 2 most recent queries "
+                    "against /root"))
+      << lines[0];
+  EXPECT_NE(std::string::npos, lines[1].find("\"total_us\":1000,"))
+      << lines[1];
+  EXPECT_NE(std::string::npos, lines[2].find("\"total_us\":25000,"))
+      << lines[2];
+
+  // Dumps are rate limited.
+  log.record(makeEntry(30000));
+  EXPECT_TRUE(takeLogLines(*sub).empty());
+}
+
+TEST(QueryLogTest, zero_threshold_never_dumps) {
+  auto sub = getLog().subscribe(ERR, nullptr);
+  QueryLog log{w_string{"/root"}, 4, std::chrono::milliseconds(0)};
+  log.record(makeEntry(60000000));
+  EXPECT_TRUE(takeLogLines(*sub).empty());
+}
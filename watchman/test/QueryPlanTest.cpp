@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include "watchman/query/Query.h"
+#include "watchman/query/QueryExpr.h"
+#include "watchman/query/QueryPlan.h"
+#include "watchman/query/TermRegistry.h"
+#include "watchman/test/lib/FakeFileResult.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+
+using namespace watchman;
+
+namespace {
+
+class TestContext : public QueryContextBase {
+ public:
+  const w_string& getWholeName() override {
+    return wholename;
+  }
+
+  w_string wholename;
+};
+
+// Records the order in which terms are evaluated.
+class RecordingExpr : public QueryExpr {
+ public:
+  RecordingExpr(
+      std::string name,
+      EvaluationCost cost,
+      EvaluateResult result,
+      std::vector<std::string>& log)
+      : name_{std::move(name)}, cost_{cost}, result_{result}, log_{log} {}
+
+  EvaluateResult evaluate(QueryContextBase*, FileResult*) override {
+    log_.push_back(name_);
+    return result_;
+  }
+
+  EvaluationCost evaluationCost() const override {
+    return cost_;
+  }
+
+  std::optional<std::vector<std::string>> computeGlobUpperBound(
+      CaseSensitivity) const override {
+    return std::nullopt;
+  }
+
+  std::vector<std::string> getSuffixQueryGlobPatterns() const override {
+    return {};
+  }
+
+  ReturnOnlyFiles listOnlyFiles() const override {
+    return ReturnOnlyFiles::Unrelated;
+  }
+
+  SimpleSuffixType evaluateSimpleSuffix() const override {
+    return SimpleSuffixType::Excluded;
+  }
+
+ private:
+  std::string name_;
+  EvaluationCost cost_;
+  EvaluateResult result_;
+  std::vector<std::string>& log_;
+};
+
+std::unique_ptr<QueryExpr> parse(Query& query, const char* expression) {
+  json_error_t err{};
+  auto json = json_loads(expression, JSON_DECODE_ANY, &err);
+  EXPECT_TRUE(json.has_value()) << err.text;
+  return parseQueryExpr(&query, *json);
+}
+
+FileInformation makeInfo(mode_t mode, uint64_t size) {
+  FileInformation info;
+  info.mode = mode;
+  info.size = size;
+  return info;
+}
+
+} // namespace
+
+TEST(QueryPlanTest, cheap_terms_are_evaluated_first) {
+  std::vector<std::string> log;
+  std::vector<std::unique_ptr<QueryExpr>> exprs;
+  exprs.push_back(std::make_unique<RecordingExpr>(
+      "pattern", EvaluationCost::Pattern, true, log));
+  exprs.push_back(std::make_unique<RecordingExpr>(
+      "metadata", EvaluationCost::Metadata, true, log));
+  exprs.push_back(std::make_unique<RecordingExpr>(
+      "basename1", EvaluationCost::BaseName, true, log));
+  exprs.push_back(std::make_unique<RecordingExpr>(
+      "basename2", EvaluationCost::BaseName, false, log));
+
+  QueryPlanBuilder builder;
+  builder.addList(AggregateOp::AllOf, exprs);
+  auto plan = std::move(builder).build();
+
+  TestContext ctx;
+  EXPECT_EQ(false, plan.evaluate(&ctx, nullptr));
+  // Terms of the same cost stay in the order they were given, and the
+  // expensive terms are never reached.
+  EXPECT_EQ((std::vector<std::string>{"basename1", "basename2"}), log);
+}
+
+TEST(QueryPlanTest, simplifies_the_expression) {
+  Query query;
+  TestContext ctx;
+  FakeFileResult file{w_string{"/root"}, w_string{"a.c"}, makeInfo(0, 0)};
+
+  auto flattened = parse(
+      query,
+      R"( ["allof", ["true"], ["allof", ["suffix", "c"], ["exists"]]] )");
+  QueryPlan flattenedPlan{*flattened};
+  EXPECT_EQ(2, flattenedPlan.numTerms());
+  EXPECT_EQ(true, flattenedPlan.evaluate(&ctx, &file));
+
+  auto decided = parse(query, R"( ["anyof", ["suffix", "h"], ["true"]] )");
+  QueryPlan decidedPlan{*decided};
+  EXPECT_EQ(0, decidedPlan.numTerms());
+  EXPECT_EQ(true, decidedPlan.evaluate(&ctx, &file));
+
+  auto negated = parse(query, R"( ["not", ["not", ["suffix", "h"]]] )");
+  QueryPlan negatedPlan{*negated};
+  EXPECT_EQ(1, negatedPlan.numTerms());
+  EXPECT_EQ(false, negatedPlan.evaluate(&ctx, &file));
+}
+
+TEST(QueryPlanTest, evaluates_like_the_expression) {
+  const char* expressions[] = {
+      R"( ["allof", ["match", "*.c"], ["type", "f"], ["suffix", "c"]] )",
+      R"( ["anyof", ["name", "foo.c"],
+            ["allof", ["size", "gt", 10], ["not", ["empty"]]]] )",
+      R"( ["allof", ["exists"],
+            ["anyof", ["suffix", ["h", "cpp"]], ["dirname", "src"]],
+            ["not", ["false"]]] )",
+      R"( ["not", ["anyof", ["type", "d"],
+            ["match", "**/test/*", "wholename"]]] )",
+      R"( ["anyof", ["false"], ["allof", ["type", "f"]]] )",
+      R"( ["allof", ["anyof", ["type", "f"], ["type", "d"]],
+            ["not", ["not", ["exists"]]]] )",
+  };
+
+  struct File {
+    const char* dir;
+    const char* base;
+    FileInformation info;
+    bool exists;
+  };
+  const File files[] = {
+      {"src", "foo.c", makeInfo(S_IFREG, 20), true},
+      {"src/test", "bar.h", makeInfo(S_IFREG, 0), true},
+      {"", "src", makeInfo(S_IFDIR, 0), true},
+      {"lib", "baz.cpp", makeInfo(S_IFREG, 5), false},
+  };
+
+  for (auto* expression : expressions) {
+    Query query;
+    auto expr = parse(query, expression);
+    QueryPlan plan{*expr};
+
+    for (auto& f : files) {
+      for (bool loaded : {true, false}) {
+        TestContext ctx;
+        auto dir = w_string::build("/root/", f.dir);
+        ctx.wholename = f.dir[0] ? w_string::build(f.dir, "/", f.base)
+                                 : w_string{f.base};
+        w_string base{f.base};
+        FakeFileResult fromExpr{dir, base, f.info, f.exists, loaded};
+        FakeFileResult fromPlan{dir, base, f.info, f.exists, loaded};
+        EXPECT_EQ(
+            expr->evaluate(&ctx, &fromExpr), plan.evaluate(&ctx, &fromPlan))
+            << expression << " on " << ctx.wholename.view()
+            << (loaded ? "" : " before loading");
+      }
+    }
+  }
+}
+
+TEST(QueryPlanTest, pattern_terms_are_prefiltered_like_the_expression) {
+  Query query;
+  auto expr = parse(
+      query,
+      R"( ["anyof", ["type", "d"],
+            ["match", "*.cpp"], ["imatch", "*_TEST.*"], ["match", "*"],
+            ["match", "**/build/**", "wholename"],
+            ["pcre", "^docs/.*\\.md$", "wholename"],
+            ["anyof", ["match", "foo*.h"], ["pcre", "bar$"]]] )");
+  QueryPlan plan{*expr};
+  EXPECT_EQ(8, plan.numTerms());
+
+  const std::pair<const char*, const char*> names[] = {
+      {"src", "main.cpp"},
+      {"src", "main.h"},
+      {"src", "util_test.py"},
+      {"", ".hidden"},
+      {"out/build/x", "foo.o"},
+      {"docs", "README.md"},
+      {"lib", "foobar.h"},
+      {"lib", "foobar"},
+  };
+  for (auto& [dir, base] : names) {
+    TestContext ctx;
+    ctx.wholename = dir[0] ? w_string::build(dir, "/", base) : w_string{base};
+    FakeFileResult file{
+        w_string::build("/root/", dir),
+        w_string{base},
+        makeInfo(S_IFREG, 0)};
+    EXPECT_EQ(expr->evaluate(&ctx, &file), plan.evaluate(&ctx, &file))
+        << ctx.wholename.view();
+  }
+}
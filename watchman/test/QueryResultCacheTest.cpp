@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryResultCache.h"
+#include <folly/portability/GTest.h>
+#include <string>
+#include <thread>
+#include "watchman/query/Query.h"
+
+using namespace watchman;
+using namespace std::chrono_literals;
+
+namespace {
+
+QueryResultCache::Key makeKey(const char* spec, ClockTicks ticks) {
+  return QueryResultCache::Key{spec, ClockPosition{1, ticks}, 0};
+}
+
+QueryResultCache::Value makeValue(size_t numResults) {
+  QueryResultCache::Value value;
+  for (size_t i = 0; i < numResults; ++i) {
+    value.resultsArray.results.push_back(json_integer(i));
+  }
+  return value;
+}
+
+void fill(QueryResultCache& cache, const char* spec, size_t numResults) {
+  auto lookup = cache.lookup(makeKey(spec, 1));
+  ASSERT_TRUE(lookup.fill);
+  lookup.fill->store(makeValue(numResults));
+}
+
+std::optional<std::string> canonicalSpec(const char* spec) {
+  Query query;
+  query.query_spec = json_loads(spec, 0, nullptr);
+  if (auto since = query.query_spec->get_optional("since")) {
+    query.since_spec = ClockSpec::parseOptionalClockSpec(*since);
+  }
+  return QueryResultCache::canonicalSpec(query);
+}
+
+} // namespace
+
+TEST(QueryResultCacheTest, hits_until_the_view_changes) {
+  QueryResultCache cache{100};
+
+  auto first = cache.lookup(makeKey("q", 1));
+  EXPECT_FALSE(first.value);
+  ASSERT_TRUE(first.fill);
+  first.fill->store(makeValue(3));
+
+  auto second = cache.lookup(makeKey("q", 1));
+  ASSERT_TRUE(second.value);
+  EXPECT_FALSE(second.fill);
+  EXPECT_EQ(3, second.value->resultsArray.results.size());
+
+  auto later = cache.lookup(makeKey("q", 2));
+  EXPECT_FALSE(later.value);
+  EXPECT_TRUE(later.fill);
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(2, stats.misses);
+  // The results for the old position were dropped.
+  EXPECT_EQ(0, stats.entries);
+  EXPECT_EQ(0, stats.results);
+}
+
+TEST(QueryResultCacheTest, abandoned_fills_are_not_cached) {
+  QueryResultCache cache{100};
+  cache.lookup(makeKey("q", 1));
+  auto lookup = cache.lookup(makeKey("q", 1));
+  EXPECT_FALSE(lookup.value);
+  EXPECT_TRUE(lookup.fill);
+}
+
+TEST(QueryResultCacheTest, bounded_by_total_results) {
+  QueryResultCache cache{10};
+  fill(cache, "a", 4);
+  fill(cache, "b", 4);
+  // Keep "a" as the most recently used.
+  EXPECT_TRUE(cache.lookup(makeKey("a", 1)).value);
+  fill(cache, "c", 4);
+
+  EXPECT_TRUE(cache.lookup(makeKey("a", 1)).value);
+  EXPECT_TRUE(cache.lookup(makeKey("c", 1)).value);
+  EXPECT_FALSE(cache.lookup(makeKey("b", 1)).value);
+
+  // Too large to cache at all.
+  fill(cache, "d", 11);
+  EXPECT_FALSE(cache.lookup(makeKey("d", 1)).value);
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(2, stats.entries);
+  EXPECT_EQ(8, stats.results);
+  EXPECT_EQ(1, stats.evicted);
+}
+
+TEST(QueryResultCacheTest, empty_results_are_bounded) {
+  QueryResultCache cache{10};
+  // Each poll of a since query has its own spec, and usually no results.
+  for (int i = 0; i < 100; ++i) {
+    fill(cache, std::to_string(i).c_str(), 0);
+  }
+  auto stats = cache.getStats();
+  EXPECT_EQ(10, stats.entries);
+  EXPECT_EQ(90, stats.evicted);
+
+  // Long specs weigh more.
+  std::string longSpec(5 * QueryResultCache::kSpecBytesPerResult, 'x');
+  fill(cache, longSpec.c_str(), 0);
+  EXPECT_EQ(5, cache.getStats().entries);
+}
+
+TEST(QueryResultCacheTest, identical_queries_share_one_run) {
+  QueryResultCache cache{100};
+  auto first = cache.lookup(makeKey("q", 1));
+  ASSERT_TRUE(first.fill);
+
+  std::shared_ptr<const QueryResultCache::Value> shared;
+  std::thread waiter{[&] {
+    auto lookup = cache.lookup(makeKey("q", 1));
+    EXPECT_FALSE(lookup.fill);
+    shared = std::move(lookup.value);
+  }};
+  while (cache.getStats().shared == 0) {
+    std::this_thread::yield();
+  }
+  first.fill->store(makeValue(2));
+  waiter.join();
+
+  ASSERT_TRUE(shared);
+  EXPECT_EQ(2, shared->resultsArray.results.size());
+}
+
+TEST(QueryResultCacheTest, waiters_stop_when_their_query_gives_up) {
+  QueryResultCache cache{100};
+  auto first = cache.lookup(makeKey("q", 1));
+  ASSERT_TRUE(first.fill);
+
+  auto timedOut = cache.lookup(makeKey("q", 1), {}, 1ms);
+  EXPECT_FALSE(timedOut.value);
+  EXPECT_FALSE(timedOut.fill);
+
+  folly::CancellationSource disconnected;
+  std::thread waiter{[&] {
+    auto lookup =
+        cache.lookup(makeKey("q", 1), disconnected.getToken(), std::nullopt);
+    EXPECT_FALSE(lookup.value);
+    EXPECT_FALSE(lookup.fill);
+  }};
+  while (cache.getStats().shared < 2) {
+    std::this_thread::yield();
+  }
+  disconnected.requestCancellation();
+  waiter.join();
+
+  // The first query can still store its results.
+  first.fill->store(makeValue(1));
+  EXPECT_TRUE(cache.lookup(makeKey("q", 1)).value);
+}
+
+TEST(QueryResultCacheTest, canonical_spec) {
+  // Neither the order of the fields nor the request id matter.
+  EXPECT_EQ(
+      canonicalSpec(R"({"fields": ["name"], "suffix": "c"})"),
+      canonicalSpec(R"({"request_id": "x", "suffix": "c",
+                         "fields": ["name"]})"));
+  EXPECT_NE(
+      canonicalSpec(R"({"suffix": "c"})"), canonicalSpec(R"({"suffix": "h"})"));
+  EXPECT_TRUE(canonicalSpec(R"({"since": "c:123:1:2:3"})"));
+  // Named cursors move when they are evaluated.
+  EXPECT_FALSE(canonicalSpec(R"({"since": "n:cursor"})"));
+  EXPECT_FALSE(canonicalSpec(R"({"path_file": "/tmp/paths"})"));
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include "watchman/QueryStats.h"
+
+using namespace watchman;
+using namespace std::chrono_literals;
+
+namespace {
+
+QueryStats::Sample makeSample(std::chrono::microseconds total) {
+  QueryStats::Sample sample;
+  sample.total = total;
+  sample.generation = total / 2;
+  sample.render = total / 4;
+  sample.filesWalked = 100;
+  sample.results = 10;
+  return sample;
+}
+
+} // namespace
+
+TEST(LatencyHistogramTest, merge_combines_recordings) {
+  LatencyHistogram a;
+  LatencyHistogram b;
+  for (int i = 0; i < 90; ++i) {
+    a.recordMicros(10);
+  }
+  for (int i = 0; i < 10; ++i) {
+    b.recordMicros(1000);
+  }
+  a.merge(b);
+
+  auto summary = a.summarize();
+  EXPECT_EQ(100, summary.count);
+  EXPECT_EQ(10, summary.p50_us);
+  EXPECT_EQ(1000, summary.max_us);
+  EXPECT_EQ((90 * 10 + 10 * 1000) / 100, summary.mean_us);
+}
+
+TEST(QueryStatsTest, records_per_command) {
+  QueryStats stats;
+  auto now = QueryStats::Clock::now();
+  stats.record("query", makeSample(8ms), now);
+  stats.record("query", makeSample(8ms), now);
+  stats.record("subscribe", makeSample(1ms), now);
+
+  auto result = stats.getStats(now);
+  ASSERT_EQ(2, result.size());
+  EXPECT_EQ("query", result[0].command);
+  EXPECT_EQ(2, result[0].all.total.count);
+  EXPECT_EQ(2, result[0].last_minute.generation.count);
+  EXPECT_EQ(100, result[0].all.files_walked.max);
+  EXPECT_EQ(10, result[0].all.results.p50);
+  EXPECT_EQ("subscribe", result[1].command);
+  EXPECT_EQ(1, result[1].last_hour.total.count);
+  EXPECT_EQ(1000, result[1].last_hour.total.max_us);
+}
+
+TEST(QueryStatsTest, windows_roll_over) {
+  QueryStats stats;
+  auto start = QueryStats::Clock::now();
+  stats.record("query", makeSample(1ms), start);
+
+  // Still within the previous half of the minute window.
+  stats.record("query", makeSample(1ms), start + 90s);
+  auto result = stats.getStats(start + 90s);
+  EXPECT_EQ(2, result[0].last_minute.total.count);
+
+  // The first recording has now aged out of the minute window, but not out
+  // of the hour window.
+  result = stats.getStats(start + 150s);
+  EXPECT_EQ(1, result[0].last_minute.total.count);
+  EXPECT_EQ(2, result[0].last_hour.total.count);
+
+  // After a long idle period, only the all-time stats remain.
+  result = stats.getStats(start + 3h);
+  EXPECT_EQ(0, result[0].last_minute.total.count);
+  EXPECT_EQ(0, result[0].last_hour.total.count);
+  EXPECT_EQ(2, result[0].all.total.count);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fmt/core.h>
+#include <folly/FileUtil.h>
+#include <folly/portability/GTest.h>
+#include <folly/testing/TestUtil.h>
+#include <filesystem>
+#include "watchman/scm/GitState.h"
+#include "watchman/scm/HgDirState.h"
+#include "watchman/scm/SCM.h"
+
+using folly::test::TemporaryDirectory;
+using namespace watchman;
+
+namespace {
+
+#define SCM_FIXTURE_DIR "watchman/test/fixtures/scm"
+
+std::string fixturePath(std::string_view name) {
+  std::vector<std::string> candidates{
+      fmt::format("{}/{}", SCM_FIXTURE_DIR, name),
+#ifdef WATCHMAN_TEST_SRC_DIR
+      fmt::format("{}/{}/{}", WATCHMAN_TEST_SRC_DIR, SCM_FIXTURE_DIR, name),
+#endif
+      fmt::format("watchman/{}/{}", SCM_FIXTURE_DIR, name),
+  };
+  for (auto& candidate : candidates) {
+    if (std::filesystem::exists(candidate)) {
+      return candidate;
+    }
+  }
+  throw std::runtime_error(fmt::format("Couldn't find fixture {}", name));
+}
+
+void writeFile(const std::filesystem::path& path, std::string_view contents) {
+  std::filesystem::create_directories(path.parent_path());
+  ASSERT_TRUE(folly::writeFile(contents, path.string().c_str()));
+}
+
+} // namespace
+
+TEST(HgDirState, v1_single_parent) {
+  auto parents = readHgDirStateParents(fixturePath("hg-dirstate-v1").c_str());
+  ASSERT_TRUE(parents.has_value());
+  EXPECT_EQ(parents->p1, "0123456789abcdef0123456789abcdef01234567");
+  EXPECT_TRUE(parents->p2.empty());
+}
+
+TEST(HgDirState, v1_merge) {
+  auto parents =
+      readHgDirStateParents(fixturePath("hg-dirstate-v1-merge").c_str());
+  ASSERT_TRUE(parents.has_value());
+  EXPECT_EQ(parents->p1, "0123456789abcdef0123456789abcdef01234567");
+  EXPECT_EQ(parents->p2, "fedcba9876543210fedcba9876543210fedcba98");
+}
+
+TEST(HgDirState, v2_docket) {
+  auto parents = readHgDirStateParents(fixturePath("hg-dirstate-v2").c_str());
+  ASSERT_TRUE(parents.has_value());
+  EXPECT_EQ(parents->p1, "0123456789abcdef0123456789abcdef01234567");
+  EXPECT_TRUE(parents->p2.empty());
+}
+
+TEST(HgDirState, rejects_truncated_and_missing) {
+  EXPECT_THROW(parseHgDirStateParents("short"), SCMError);
+  EXPECT_THROW(parseHgDirStateParents(std::string(40, '\0')), SCMError);
+  EXPECT_FALSE(readHgDirStateParents("/this/does/not/exist").has_value());
+}
+
+TEST(GitState, index_v2) {
+  auto index = readGitIndexHeader(fixturePath("git-index-v2").c_str());
+  ASSERT_TRUE(index.has_value());
+  EXPECT_EQ(index->version, 2u);
+  EXPECT_EQ(index->numEntries, 2u);
+  EXPECT_EQ(index->checksum, "a1b3a821bd25c2a563d18c5520166bc303dc05e9");
+}
+
+TEST(GitState, index_v4) {
+  auto index = readGitIndexHeader(fixturePath("git-index-v4").c_str());
+  ASSERT_TRUE(index.has_value());
+  EXPECT_EQ(index->version, 4u);
+  EXPECT_EQ(index->numEntries, 2u);
+  EXPECT_EQ(index->checksum, "6ba9680ad765dcaab900825b29df68c9e7610d43");
+}
+
+TEST(GitState, index_skip_hash_has_no_checksum) {
+  auto index = parseGitIndexHeader(
+      std::string_view{"DIRC\0\0\0\2\0\0\0\0", 12}, std::string(20, '\0'));
+  EXPECT_EQ(index.version, 2u);
+  EXPECT_EQ(index.numEntries, 0u);
+  EXPECT_TRUE(index.checksum.empty());
+}
+
+TEST(GitState, index_rejects_bad_signature) {
+  EXPECT_THROW(
+      parseGitIndexHeader(std::string_view{"NOPE\0\0\0\2\0\0\0\0", 12}, ""),
+      SCMError);
+  EXPECT_THROW(parseGitIndexHeader("DIRC", ""), SCMError);
+}
+
+TEST(GitState, commit_hex) {
+  EXPECT_TRUE(isCommitHex("0123456789abcdef0123456789abcdef01234567"));
+  EXPECT_FALSE(isCommitHex("0123456789ABCDEF0123456789ABCDEF01234567"));
+  EXPECT_FALSE(isCommitHex("0123456789abcdef"));
+  EXPECT_FALSE(isCommitHex("main"));
+  EXPECT_FALSE(isCommitHex(""));
+}
+
+TEST(GitState, head_loose_ref) {
+  TemporaryDirectory dir;
+  auto gitDir = dir.path() / ".git";
+  writeFile(gitDir / "HEAD", "ref: refs/heads/main\n");
+  writeFile(
+      gitDir / "refs/heads/main", "a1b3a821bd25c2a563d18c5520166bc303dc05e9\n");
+
+  auto head = resolveGitHead(gitDir.string());
+  ASSERT_TRUE(head.has_value());
+  EXPECT_EQ(*head, "a1b3a821bd25c2a563d18c5520166bc303dc05e9");
+}
+
+TEST(GitState, head_packed_ref) {
+  TemporaryDirectory dir;
+  auto gitDir = dir.path() / ".git";
+  writeFile(gitDir / "HEAD", "ref: refs/heads/main\n");
+  writeFile(
+      gitDir / "packed-refs",
+      "# pack-refs with: peeled fully-peeled sorted\n"
+      "1111111111111111111111111111111111111111 refs/heads/other\n"
+      "6ba9680ad765dcaab900825b29df68c9e7610d43 refs/heads/main\n"
+      "^2222222222222222222222222222222222222222\n");
+
+  auto head = resolveGitHead(gitDir.string());
+  ASSERT_TRUE(head.has_value());
+  EXPECT_EQ(*head, "6ba9680ad765dcaab900825b29df68c9e7610d43");
+}
+
+TEST(GitState, head_detached) {
+  TemporaryDirectory dir;
+  auto gitDir = dir.path() / ".git";
+  writeFile(gitDir / "HEAD", "6ba9680ad765dcaab900825b29df68c9e7610d43\n");
+
+  auto head = resolveGitHead(gitDir.string());
+  ASSERT_TRUE(head.has_value());
+  EXPECT_EQ(*head, "6ba9680ad765dcaab900825b29df68c9e7610d43");
+}
+
+TEST(GitState, head_unborn_branch_falls_back) {
+  TemporaryDirectory dir;
+  auto gitDir = dir.path() / ".git";
+  writeFile(gitDir / "HEAD", "ref: refs/heads/main\n");
+
+  EXPECT_FALSE(resolveGitHead(gitDir.string()).has_value());
+}
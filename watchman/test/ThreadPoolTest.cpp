@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include "watchman/ThreadPool.h"
+#include "watchman/WorkStealingDeque.h"
+
+using namespace watchman;
+
+TEST(WorkStealingDequeTest, owner_is_lifo_and_thieves_are_fifo) {
+  WorkStealingDeque<int> deque{2};
+  EXPECT_FALSE(deque.pop().has_value());
+  EXPECT_FALSE(deque.steal().has_value());
+
+  // Push past the initial capacity to exercise growth.
+  for (int i = 0; i < 10; ++i) {
+    deque.push(i);
+  }
+  EXPECT_EQ(10, deque.sizeApprox());
+  EXPECT_EQ(9, deque.pop());
+  EXPECT_EQ(0, deque.steal());
+  EXPECT_EQ(8, deque.pop());
+  EXPECT_EQ(1, deque.steal());
+  EXPECT_EQ(6, deque.sizeApprox());
+}
+
+TEST(WorkStealingDequeTest, every_item_is_taken_exactly_once) {
+  constexpr int kItems = 100000;
+  constexpr int kThieves = 3;
+  WorkStealingDeque<int> deque{16};
+  std::vector<std::atomic<int>> taken(kItems);
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int t = 0; t < kThieves; ++t) {
+    thieves.emplace_back([&] {
+      while (!done.load()) {
+        if (auto item = deque.steal()) {
+          taken[*item]++;
+        }
+      }
+    });
+  }
+
+  for (int i = 0; i < kItems; ++i) {
+    deque.push(i);
+    // Pop some of them ourselves to race with the thieves for the
+    // last item.
+    if (i % 3 == 0) {
+      if (auto item = deque.pop()) {
+        taken[*item]++;
+      }
+    }
+  }
+  while (auto item = deque.pop()) {
+    taken[*item]++;
+  }
+  done = true;
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+  while (auto item = deque.steal()) {
+    taken[*item]++;
+  }
+
+  for (int i = 0; i < kItems; ++i) {
+    EXPECT_EQ(1, taken[i].load()) << "item " << i;
+  }
+}
+
+TEST(ThreadPoolTest, runs_all_tasks_before_stopping) {
+  ThreadPool pool;
+  pool.start(4, 1024 * 1024);
+
+  std::atomic<int> ran{0};
+  for (int i = 0; i < 1000; ++i) {
+    pool.add([&] { ran++; });
+  }
+  pool.stop();
+  EXPECT_EQ(1000, ran.load());
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(4, stats.workers);
+  EXPECT_EQ(1000, stats.executed);
+  EXPECT_EQ(1000, stats.injected);
+  EXPECT_EQ(0, stats.queued);
+  EXPECT_EQ(1000, stats.queue_latency.count);
+  EXPECT_EQ(1000, stats.run_latency.count);
+
+  EXPECT_THROW(pool.add([] {}), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, tasks_added_by_workers_stay_in_the_pool) {
+  ThreadPool pool;
+  pool.start(4, 1024 * 1024);
+
+  // Each task fans out into more tasks, which are pushed onto the adding
+  // worker's own queue and stolen by the others.
+  std::atomic<int> ran{0};
+  std::function<void(int)> fanOut = [&](int depth) {
+    ran++;
+    if (depth > 0) {
+      for (int i = 0; i < 4; ++i) {
+        pool.add([&fanOut, depth] { fanOut(depth - 1); });
+      }
+    }
+  };
+  pool.add([&] { fanOut(5); });
+
+  // 1 + 4 + ... + 4^5 tasks in total.
+  constexpr int kTotal = 1365;
+  while (ran.load() < kTotal) {
+    std::this_thread::yield();
+  }
+  pool.stop();
+  EXPECT_EQ(kTotal, ran.load());
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(1, stats.injected);
+  EXPECT_EQ(kTotal, stats.executed);
+}
+
+TEST(ThreadPoolTest, rejects_tasks_when_full) {
+  ThreadPool pool;
+  EXPECT_THROW(pool.add([] {}), std::runtime_error);
+
+  pool.start(1, 3);
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::promise<void> started;
+  pool.add([&started, released] {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+
+  // As before, one fewer than maxItems may be queued at once.
+  pool.add([] {});
+  pool.add([] {});
+  EXPECT_THROW(pool.add([] {}), std::runtime_error);
+  EXPECT_EQ(2, pool.getStats().queued);
+
+  release.set_value();
+  pool.stop();
+  EXPECT_EQ(3, pool.getStats().executed);
+}
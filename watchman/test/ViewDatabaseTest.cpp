@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/ViewDatabase.h"
+#include <folly/portability/GTest.h>
+#include <set>
+#include <string>
+
+using namespace watchman;
+
+namespace {
+
+const w_string kRoot{"/root"};
+
+std::set<std::string> resolveIgnoringCase(
+    const ViewDatabase& view,
+    const w_string& dirName) {
+  std::set<std::string> paths;
+  view.resolveDirsIgnoringCase(dirName, [&](const watchman_dir* dir) {
+    paths.insert(dir->getFullPath().string());
+  });
+  return paths;
+}
+
+std::set<std::string> childFilesIgnoringCase(
+    const watchman_dir* dir,
+    const w_string& folded) {
+  std::set<std::string> names;
+  auto [begin, end] = dir->getChildFilesIgnoringCase(folded);
+  for (auto it = begin; it != end; ++it) {
+    names.insert(it->second->getName().string());
+  }
+  return names;
+}
+
+} // namespace
+
+TEST(ViewDatabaseTest, has_no_case_folded_index_by_default) {
+  ViewDatabase view{kRoot};
+  EXPECT_FALSE(view.hasCaseFoldedIndex());
+
+  auto* dir = view.resolveDir("/root/Foo", true);
+  view.getOrCreateChildFile(dir, "Bar.txt", ClockStamp{1, 0});
+  EXPECT_EQ(nullptr, dir->caseFolded);
+  EXPECT_EQ(nullptr, view.resolveDir("/root/foo"));
+}
+
+TEST(ViewDatabaseTest, resolves_dirs_ignoring_case) {
+  ViewDatabase view{kRoot, true};
+  EXPECT_TRUE(view.hasCaseFoldedIndex());
+
+  view.resolveDir("/root/Foo/Bar", true);
+  view.resolveDir("/root/foo", true);
+
+  EXPECT_EQ(
+      (std::set<std::string>{"/root/Foo/Bar"}),
+      resolveIgnoringCase(view, "/root/FOO/bar"));
+  // Several dirs can match when the filesystem is case-sensitive.
+  EXPECT_EQ(
+      (std::set<std::string>{"/root/Foo", "/root/foo"}),
+      resolveIgnoringCase(view, "/root/FOO"));
+  EXPECT_EQ(
+      (std::set<std::string>{"/root"}), resolveIgnoringCase(view, "/root"));
+  EXPECT_TRUE(resolveIgnoringCase(view, "/root/missing").empty());
+}
+
+TEST(ViewDatabaseTest, index_follows_files_being_erased) {
+  ViewDatabase view{kRoot, true};
+  auto* dir = view.resolveDir("/root/dir", true);
+  auto* upper = view.getOrCreateChildFile(dir, "README", ClockStamp{1, 0});
+  view.getOrCreateChildFile(dir, "readme", ClockStamp{2, 0});
+
+  EXPECT_EQ(
+      (std::set<std::string>{"README", "readme"}),
+      childFilesIgnoringCase(dir, "readme"));
+
+  view.eraseChildFile(upper);
+  EXPECT_EQ(
+      (std::set<std::string>{"readme"}), childFilesIgnoringCase(dir, "readme"));
+
+  // Erasing the dir takes it out of its parent's index too.
+  view.eraseChildDir(view.resolveDir("/root", false), "dir");
+  EXPECT_TRUE(resolveIgnoringCase(view, "/root/DIR").empty());
+  EXPECT_EQ(0, view.getNumFiles());
+}
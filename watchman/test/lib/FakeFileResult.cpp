@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/test/lib/FakeFileResult.h"
+
+namespace watchman {
+
+FakeFileResult::FakeFileResult(
+    w_string dirName,
+    w_string baseName,
+    FileInformation info,
+    bool exists,
+    bool metadataLoaded)
+    : dirName_{std::move(dirName)},
+      baseName_{std::move(baseName)},
+      info_{info},
+      exists_{exists},
+      metadataLoaded_{metadataLoaded} {}
+
+bool FakeFileResult::loaded(Properties properties) {
+  if (!metadataLoaded_) {
+    accessorNeedsProperties(properties);
+  }
+  return metadataLoaded_;
+}
+
+std::optional<FileInformation> FakeFileResult::stat() {
+  if (!loaded(FileResult::FullFileInformation)) {
+    return std::nullopt;
+  }
+  return info_;
+}
+
+std::optional<struct timespec> FakeFileResult::accessedTime() {
+  if (!loaded(FileResult::StatTimeStamps)) {
+    return std::nullopt;
+  }
+  return info_.atime;
+}
+
+std::optional<struct timespec> FakeFileResult::modifiedTime() {
+  if (!loaded(FileResult::StatTimeStamps)) {
+    return std::nullopt;
+  }
+  return info_.mtime;
+}
+
+std::optional<struct timespec> FakeFileResult::changedTime() {
+  if (!loaded(FileResult::StatTimeStamps)) {
+    return std::nullopt;
+  }
+  return info_.ctime;
+}
+
+std::optional<size_t> FakeFileResult::size() {
+  if (!loaded(FileResult::Size)) {
+    return std::nullopt;
+  }
+  return info_.size;
+}
+
+w_string_piece FakeFileResult::baseName() {
+  return baseName_;
+}
+
+w_string_piece FakeFileResult::dirName() {
+  return dirName_;
+}
+
+std::optional<bool> FakeFileResult::exists() {
+  if (!loaded(FileResult::Exists)) {
+    return std::nullopt;
+  }
+  return exists_;
+}
+
+std::optional<ResolvedSymlink> FakeFileResult::readLink() {
+  return NotSymlink{};
+}
+
+std::optional<ClockStamp> FakeFileResult::ctime() {
+  if (!loaded(FileResult::CTime)) {
+    return std::nullopt;
+  }
+  return ClockStamp{0, info_.ctime.tv_sec};
+}
+
+std::optional<ClockStamp> FakeFileResult::otime() {
+  if (!loaded(FileResult::OTime)) {
+    return std::nullopt;
+  }
+  return ClockStamp{0, info_.mtime.tv_sec};
+}
+
+std::optional<FileResult::ContentHash> FakeFileResult::getContentSha1() {
+  return std::nullopt;
+}
+
+void FakeFileResult::batchFetchProperties(
+    const std::vector<std::unique_ptr<FileResult>>& files) {
+  for (auto& file : files) {
+    auto* fake = static_cast<FakeFileResult*>(file.get());
+    fake->metadataLoaded_ = true;
+    fake->clearNeededProperties();
+  }
+}
+
+} // namespace watchman
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "watchman/fs/FileInformation.h"
+#include "watchman/query/FileResult.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * A FileResult with fixed contents, for evaluating query expressions
+ * without a view.
+ *
+ * If constructed with metadataLoaded = false, accessors other than the
+ * names return nullopt, as a view that fetches its metadata would, until
+ * batchFetchProperties is called.
+ */
+class FakeFileResult final : public FileResult {
+ public:
+  FakeFileResult(
+      w_string dirName,
+      w_string baseName,
+      FileInformation info,
+      bool exists = true,
+      bool metadataLoaded = true);
+
+  std::optional<FileInformation> stat() override;
+  std::optional<struct timespec> accessedTime() override;
+  std::optional<struct timespec> modifiedTime() override;
+  std::optional<struct timespec> changedTime() override;
+  std::optional<size_t> size() override;
+  w_string_piece baseName() override;
+  w_string_piece dirName() override;
+  std::optional<bool> exists() override;
+  std::optional<ResolvedSymlink> readLink() override;
+  std::optional<ClockStamp> ctime() override;
+  std::optional<ClockStamp> otime() override;
+  std::optional<FileResult::ContentHash> getContentSha1() override;
+  void batchFetchProperties(
+      const std::vector<std::unique_ptr<FileResult>>& files) override;
+
+ private:
+  // Returns whether metadata is available, recording that it is needed if
+  // it isn't.
+  bool loaded(Properties properties);
+
+  w_string dirName_;
+  w_string baseName_;
+  FileInformation info_;
+  bool exists_;
+  bool metadataLoaded_;
+};
+
+} // namespace watchman
@@ -327,6 +327,14 @@ std::optional<json_ref> json_loadb(
     size_t buflen,
     size_t flags,
     json_error_t* error);
+/* Decodes the same documents as json_loadb, with the same results, but
+   indexes the whole buffer up front so that it can examine several bytes
+   at a time. Errors are reported by json_loadb. */
+std::optional<json_ref> json_loadb_fast(
+    const char* buffer,
+    size_t buflen,
+    size_t flags,
+    json_error_t* error);
 std::optional<json_ref>
 json_loadf(FILE* input, size_t flags, json_error_t* error);
 json_ref json_load_file(const char* path, size_t flags);
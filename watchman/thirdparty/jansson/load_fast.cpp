@@ -0,0 +1,662 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// A JSON decoder for whole, in-memory documents, in the style of simdjson
+// ("Parsing Gigabytes of JSON per Second", Langdale and Lemire, 2019).
+//
+// Stage 1 classifies the input 64 bytes at a time into bitmasks of quotes,
+// backslashes, structural characters, whitespace and control characters.
+// From those it computes which bytes are inside of strings, and records
+// the offset of every structural character, quote and scalar (number or
+// literal) that is not. This is where almost all of the bytes are
+// examined, and it is done without branching on the data.
+//
+// Stage 2 walks the recorded offsets to build the json_ref values. Strings
+// without escapes are copied in one go rather than byte by byte.
+//
+// Only documents that json_loadb would accept are decoded here. Anything
+// that looks invalid, or that is handled by rarely used json_loadb
+// behavior, is passed to json_loadb, so that the result and any error
+// message are exactly the same.
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define JSON_LOAD_FAST_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "jansson.h"
+#include "jansson_private.h"
+#include "utf.h"
+
+namespace {
+
+// Same limit as the json_loadb parser.
+constexpr size_t kMaximumDepth = 1000;
+
+inline uint32_t countTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return index;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+// Sets each bit to the xor of it and all of the bits below it, which turns
+// a mask of quotes into a mask of the bytes from each opening quote up to,
+// but not including, its closing quote.
+inline uint64_t prefixXor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+struct BlockMasks {
+  uint64_t quote;
+  uint64_t backslash;
+  // {}[]:,
+  uint64_t structural;
+  // Space, tab, newline and carriage return.
+  uint64_t whitespace;
+  // Bytes below 0x20, which aren't allowed in strings.
+  uint64_t control;
+  uint64_t nonAscii;
+};
+
+#ifdef JSON_LOAD_FAST_SSE2
+
+inline uint64_t movemask(__m128i v0, __m128i v1, __m128i v2, __m128i v3) {
+  return uint64_t(uint16_t(_mm_movemask_epi8(v0))) |
+      (uint64_t(uint16_t(_mm_movemask_epi8(v1))) << 16) |
+      (uint64_t(uint16_t(_mm_movemask_epi8(v2))) << 32) |
+      (uint64_t(uint16_t(_mm_movemask_epi8(v3))) << 48);
+}
+
+BlockMasks classifyBlock(const char* block) {
+  __m128i in[4];
+  for (int i = 0; i < 4; ++i) {
+    in[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+  }
+
+  auto eq = [&](char c) {
+    auto needle = _mm_set1_epi8(c);
+    return movemask(
+        _mm_cmpeq_epi8(in[0], needle),
+        _mm_cmpeq_epi8(in[1], needle),
+        _mm_cmpeq_epi8(in[2], needle),
+        _mm_cmpeq_epi8(in[3], needle));
+  };
+  // Unsigned byte <= 0x1f is max(byte, 0x1f) == 0x1f.
+  auto controlByte = [](__m128i v) {
+    auto limit = _mm_set1_epi8(0x1f);
+    return _mm_cmpeq_epi8(_mm_max_epu8(v, limit), limit);
+  };
+
+  BlockMasks masks;
+  masks.quote = eq('"');
+  masks.backslash = eq('\\');
+  masks.structural =
+      eq('{') | eq('}') | eq('[') | eq(']') | eq(':') | eq(',');
+  masks.whitespace = eq(' ') | eq('\t') | eq('\n') | eq('\r');
+  masks.control = movemask(
+      controlByte(in[0]),
+      controlByte(in[1]),
+      controlByte(in[2]),
+      controlByte(in[3]));
+  masks.nonAscii = movemask(in[0], in[1], in[2], in[3]);
+  return masks;
+}
+
+#else
+
+enum : uint8_t {
+  kQuote = 1,
+  kBackslash = 2,
+  kStructural = 4,
+  kWhitespace = 8,
+  kControl = 16,
+  kNonAscii = 32,
+};
+
+struct ClassTable {
+  uint8_t classes[256];
+
+  constexpr ClassTable() : classes{} {
+    for (int i = 0; i < 0x20; ++i) {
+      classes[i] = kControl;
+    }
+    for (int i = 0x80; i < 0x100; ++i) {
+      classes[i] = kNonAscii;
+    }
+    classes[uint8_t('"')] = kQuote;
+    classes[uint8_t('\\')] = kBackslash;
+    for (char c : {'{', '}', '[', ']', ':', ','}) {
+      classes[uint8_t(c)] = kStructural;
+    }
+    classes[uint8_t(' ')] = kWhitespace;
+    for (char c : {'\t', '\n', '\r'}) {
+      classes[uint8_t(c)] = kWhitespace | kControl;
+    }
+  }
+};
+
+constexpr ClassTable kClassTable;
+
+BlockMasks classifyBlock(const char* block) {
+  BlockMasks masks{};
+  for (int i = 0; i < 64; ++i) {
+    uint64_t c = kClassTable.classes[uint8_t(block[i])];
+    masks.quote |= (c & 1) << i;
+    masks.backslash |= ((c >> 1) & 1) << i;
+    masks.structural |= ((c >> 2) & 1) << i;
+    masks.whitespace |= ((c >> 3) & 1) << i;
+    masks.control |= ((c >> 4) & 1) << i;
+    masks.nonAscii |= ((c >> 5) & 1) << i;
+  }
+  return masks;
+}
+
+#endif
+
+bool isDelimiter(char c) {
+  switch (c) {
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+    case '"':
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+      return true;
+    default:
+      return false;
+  }
+}
+
+class FastLoader {
+ public:
+  FastLoader(const char* buffer, size_t length)
+      : buffer_{buffer}, length_{length} {}
+
+  /**
+   * Stage 1. Fills in tokens_ with the offsets of every structural
+   * character, quote and scalar outside of a string. Returns false if the
+   * document is obviously invalid.
+   */
+  bool index() {
+    tokens_.reserve(length_ / 8 + 16);
+
+    uint64_t prevInString = 0;
+    uint64_t prevScalar = 0;
+    uint64_t prevBackslash = 0;
+    char tail[64];
+
+    for (size_t base = 0; base < length_; base += 64) {
+      const char* block = buffer_ + base;
+      if (length_ - base < 64) {
+        // Pad with whitespace, which is never recorded.
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, block, length_ - base);
+        block = tail;
+      }
+      auto masks = classifyBlock(block);
+
+      // A quote preceded by a backslash may be escaped. This is rare, so
+      // count the run of backslashes the slow way.
+      uint64_t quote = masks.quote;
+      uint64_t maybeEscaped = quote & ((masks.backslash << 1) | prevBackslash);
+      prevBackslash = masks.backslash >> 63;
+      while (maybeEscaped) {
+        auto bit = countTrailingZeros(maybeEscaped);
+        if (isEscaped(base + bit)) {
+          quote &= ~(uint64_t(1) << bit);
+        }
+        maybeEscaped &= maybeEscaped - 1;
+      }
+
+      uint64_t inString = prefixXor(quote) ^ prevInString;
+      prevInString = uint64_t(int64_t(inString) >> 63);
+      if (masks.control & inString) {
+        return false;
+      }
+      sawNonAscii_ |= masks.nonAscii != 0;
+
+      uint64_t scalar =
+          ~(masks.structural | masks.whitespace | masks.quote | inString);
+      uint64_t scalarStart = scalar & ~((scalar << 1) | prevScalar);
+      prevScalar = scalar >> 63;
+
+      uint64_t tokens = (masks.structural & ~inString) | quote | scalarStart;
+      while (tokens) {
+        tokens_.push_back(uint32_t(base + countTrailingZeros(tokens)));
+        tokens &= tokens - 1;
+      }
+    }
+
+    // An unterminated string.
+    return prevInString == 0;
+  }
+
+  /**
+   * Stage 2. Returns nullopt if the document is not valid, or if it should
+   * be decoded by json_loadb for any other reason.
+   */
+  std::optional<json_ref> parse(size_t flags) {
+    if (tokens_.empty()) {
+      return std::nullopt;
+    }
+    if (!(flags & JSON_DECODE_ANY)) {
+      auto c = buffer_[tokens_[0]];
+      if (c != '[' && c != '{') {
+        return std::nullopt;
+      }
+    }
+    auto result = parseValue();
+    if (next_ != tokens_.size()) {
+      return std::nullopt;
+    }
+    return result;
+  }
+
+ private:
+  bool isEscaped(size_t quotePos) const {
+    size_t backslashes = 0;
+    while (backslashes < quotePos &&
+           buffer_[quotePos - backslashes - 1] == '\\') {
+      ++backslashes;
+    }
+    return backslashes % 2 == 1;
+  }
+
+  // Returns the character at the next token, or 0 at the end.
+  char peek() const {
+    return next_ < tokens_.size() ? buffer_[tokens_[next_]] : 0;
+  }
+
+  std::optional<json_ref> parseValue() {
+    if (next_ >= tokens_.size()) {
+      return std::nullopt;
+    }
+    auto pos = tokens_[next_++];
+    switch (buffer_[pos]) {
+      case '{':
+        return parseObject();
+      case '[':
+        return parseArray();
+      case '"': {
+        auto str = parseString(pos);
+        if (!str) {
+          return std::nullopt;
+        }
+        return w_string_to_json(std::move(*str));
+      }
+      case '}':
+      case ']':
+      case ':':
+      case ',':
+        return std::nullopt;
+      default:
+        return parseScalar(pos);
+    }
+  }
+
+  std::optional<json_ref> parseObject() {
+    if (depth_ >= kMaximumDepth) {
+      return std::nullopt;
+    }
+    ++depth_;
+
+    std::unordered_map<w_string, json_ref> object;
+    if (peek() == '}') {
+      ++next_;
+      --depth_;
+      return json_object(std::move(object));
+    }
+
+    while (true) {
+      if (peek() != '"') {
+        return std::nullopt;
+      }
+      auto key = parseString(tokens_[next_++]);
+      // json_loadb fails on empty keys.
+      if (!key || key->empty()) {
+        return std::nullopt;
+      }
+      if (peek() != ':') {
+        return std::nullopt;
+      }
+      ++next_;
+      auto value = parseValue();
+      if (!value) {
+        return std::nullopt;
+      }
+      object.insert_or_assign(std::move(*key), std::move(*value));
+
+      auto c = peek();
+      ++next_;
+      if (c == '}') {
+        break;
+      }
+      if (c != ',') {
+        return std::nullopt;
+      }
+    }
+
+    --depth_;
+    return json_object(std::move(object));
+  }
+
+  std::optional<json_ref> parseArray() {
+    if (depth_ >= kMaximumDepth) {
+      return std::nullopt;
+    }
+    ++depth_;
+
+    std::vector<json_ref> array;
+    if (peek() == ']') {
+      ++next_;
+      --depth_;
+      return json_array(std::move(array));
+    }
+
+    while (true) {
+      auto elem = parseValue();
+      if (!elem) {
+        return std::nullopt;
+      }
+      array.push_back(std::move(*elem));
+
+      auto c = peek();
+      ++next_;
+      if (c == ']') {
+        break;
+      }
+      if (c != ',') {
+        return std::nullopt;
+      }
+    }
+
+    --depth_;
+    return json_array(std::move(array));
+  }
+
+  // openPos is the offset of the opening quote; the closing quote is the
+  // next token.
+  std::optional<w_string> parseString(uint32_t openPos) {
+    if (next_ >= tokens_.size()) {
+      return std::nullopt;
+    }
+    auto closePos = tokens_[next_++];
+    if (buffer_[closePos] != '"') {
+      return std::nullopt;
+    }
+
+    const char* begin = buffer_ + openPos + 1;
+    size_t length = closePos - openPos - 1;
+    // Escapes are ASCII, so the raw bytes must be valid UTF-8.
+    if (sawNonAscii_ && !utf8_check_string(begin, int(length))) {
+      return std::nullopt;
+    }
+    if (!memchr(begin, '\\', length)) {
+      return w_string{begin, length, W_STRING_BYTE};
+    }
+    if (!unescape(begin, begin + length)) {
+      return std::nullopt;
+    }
+    return w_string{scratch_.data(), scratch_.size(), W_STRING_BYTE};
+  }
+
+  static std::optional<int32_t> decodeHex4(const char* p, const char* end) {
+    if (end - p < 4) {
+      return std::nullopt;
+    }
+    int32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = p[i];
+      value <<= 4;
+      if ('0' <= c && c <= '9') {
+        value += c - '0';
+      } else if ('a' <= c && c <= 'f') {
+        value += c - 'a' + 10;
+      } else if ('A' <= c && c <= 'F') {
+        value += c - 'A' + 10;
+      } else {
+        return std::nullopt;
+      }
+    }
+    return value;
+  }
+
+  // Decodes the escapes in [p, end) into scratch_.
+  bool unescape(const char* p, const char* end) {
+    scratch_.clear();
+    while (p < end) {
+      auto bs = static_cast<const char*>(memchr(p, '\\', end - p));
+      if (!bs) {
+        scratch_.append(p, end);
+        return true;
+      }
+      scratch_.append(p, bs);
+      p = bs + 1;
+      if (p == end) {
+        return false;
+      }
+
+      char c = *p++;
+      switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+          scratch_.push_back(c);
+          break;
+        case 'b':
+          scratch_.push_back('\b');
+          break;
+        case 'f':
+          scratch_.push_back('\f');
+          break;
+        case 'n':
+          scratch_.push_back('\n');
+          break;
+        case 'r':
+          scratch_.push_back('\r');
+          break;
+        case 't':
+          scratch_.push_back('\t');
+          break;
+        case 'u': {
+          auto value = decodeHex4(p, end);
+          if (!value) {
+            return false;
+          }
+          p += 4;
+          if (0xD800 <= *value && *value <= 0xDBFF) {
+            // A surrogate pair.
+            if (end - p < 2 || p[0] != '\\' || p[1] != 'u') {
+              return false;
+            }
+            auto low = decodeHex4(p + 2, end);
+            if (!low || *low < 0xDC00 || *low > 0xDFFF) {
+              return false;
+            }
+            p += 6;
+            value = ((*value - 0xD800) << 10) + (*low - 0xDC00) + 0x10000;
+          } else if ((0xDC00 <= *value && *value <= 0xDFFF) || *value == 0) {
+            return false;
+          }
+          char utf8[4];
+          int utf8Length;
+          if (utf8_encode(*value, utf8, &utf8Length)) {
+            return false;
+          }
+          scratch_.append(utf8, utf8Length);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return true;
+  }
+
+  std::optional<json_ref> parseScalar(uint32_t pos) {
+    const char* begin = buffer_ + pos;
+    const char* end = begin;
+    const char* limit = buffer_ + length_;
+    while (end < limit && !isDelimiter(*end)) {
+      ++end;
+    }
+    std::string_view text{begin, size_t(end - begin)};
+
+    if (text == "true") {
+      return json_true();
+    }
+    if (text == "false") {
+      return json_false();
+    }
+    if (text == "null") {
+      return json_null();
+    }
+    return parseNumber(text);
+  }
+
+  static bool isDigit(char c) {
+    return '0' <= c && c <= '9';
+  }
+
+  // Accepts exactly the numbers that json_loadb does, and leaves integers
+  // that don't fit in a json_int_t to it.
+  std::optional<json_ref> parseNumber(std::string_view text) {
+    size_t i = 0;
+    size_t size = text.size();
+    bool negative = i < size && text[i] == '-';
+    if (negative) {
+      ++i;
+    }
+    size_t digitsStart = i;
+    if (i < size && text[i] == '0') {
+      ++i;
+    } else if (i < size && isDigit(text[i])) {
+      while (i < size && isDigit(text[i])) {
+        ++i;
+      }
+    } else {
+      return std::nullopt;
+    }
+    size_t digitsEnd = i;
+
+    bool isInteger = true;
+    if (i < size && text[i] == '.') {
+      ++i;
+      if (i == size || !isDigit(text[i])) {
+        return std::nullopt;
+      }
+      while (i < size && isDigit(text[i])) {
+        ++i;
+      }
+      isInteger = false;
+    }
+    if (i < size && (text[i] == 'e' || text[i] == 'E')) {
+      ++i;
+      if (i < size && (text[i] == '+' || text[i] == '-')) {
+        ++i;
+      }
+      if (i == size || !isDigit(text[i])) {
+        return std::nullopt;
+      }
+      while (i < size && isDigit(text[i])) {
+        ++i;
+      }
+      isInteger = false;
+    }
+    if (i != size) {
+      return std::nullopt;
+    }
+
+    if (isInteger) {
+      // 19 digits always fit in a uint64_t.
+      if (digitsEnd - digitsStart > 19) {
+        return std::nullopt;
+      }
+      uint64_t magnitude = 0;
+      for (size_t j = digitsStart; j < digitsEnd; ++j) {
+        magnitude = magnitude * 10 + (text[j] - '0');
+      }
+      constexpr auto kMax = uint64_t(INT64_MAX);
+      if (magnitude > kMax + (negative ? 1 : 0)) {
+        return std::nullopt;
+      }
+      return json_integer(
+          negative ? json_int_t(0 - magnitude) : json_int_t(magnitude));
+    }
+
+    std::string saved{text};
+    double value;
+    if (jsonp_strtod(saved, &value)) {
+      return std::nullopt;
+    }
+    return json_real(value);
+  }
+
+  const char* buffer_;
+  size_t length_;
+  std::vector<uint32_t> tokens_;
+  size_t next_ = 0;
+  size_t depth_ = 0;
+  bool sawNonAscii_ = false;
+  // Reused when decoding strings with escapes.
+  std::string scratch_;
+};
+
+} // namespace
+
+std::optional<json_ref> json_loadb_fast(
+    const char* buffer,
+    size_t buflen,
+    size_t flags,
+    json_error_t* error) {
+  // Offsets are stored as uint32_t, and these flags are rarely used.
+  if (buffer == nullptr || buflen > INT32_MAX ||
+      (flags & (JSON_REJECT_DUPLICATES | JSON_DISABLE_EOF_CHECK))) {
+    return json_loadb(buffer, buflen, flags, error);
+  }
+
+  FastLoader loader{buffer, buflen};
+  if (loader.index()) {
+    if (auto result = loader.parse(flags)) {
+      jsonp_error_init(error, "<buffer>");
+      if (error) {
+        error->position = int(buflen);
+      }
+      return result;
+    }
+  }
+
+  // Let json_loadb describe the problem.
+  return json_loadb(buffer, buflen, flags, error);
+}
@@ -823,6 +823,7 @@ class EdenView final : public QueryableView {
     }
 
     ctx->bumpNumWalked(fileInfo.size());
+    ctx->throwIfCancelled();
   }
 
   folly::SemiFuture<folly::Unit> waitForSettle(
@@ -923,6 +924,7 @@ class EdenView final : public QueryableView {
     }
 
     ctx->bumpNumWalked(fileInfo.size());
+    ctx->throwIfCancelled();
   }
 
   // Helper for computing a relative path prefix piece.
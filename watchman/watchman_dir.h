@@ -6,6 +6,7 @@
  */
 
 #pragma once
+#include <memory>
 #include <unordered_map>
 #include "watchman/watchman_string.h"
 
@@ -28,6 +29,15 @@ struct watchman_dir {
   /* child dirs contained in this dir (keyed by dir->name) */
   std::unordered_map<w_string_piece, std::unique_ptr<watchman_dir>> dirs;
 
+  /* files and dirs keyed by their lowercased names, for case-insensitive
+   * lookups. Several children can have the same lowercased name. */
+  struct CaseFoldedIndex {
+    std::unordered_multimap<w_string, watchman_file*> files;
+    std::unordered_multimap<w_string, watchman_dir*> dirs;
+  };
+  // Only maintained by views that were configured to, and null otherwise.
+  std::unique_ptr<CaseFoldedIndex> caseFolded;
+
   // If we think this dir was deleted, we'll avoid recursing
   // to its children when processing deletes.
   bool last_check_existed{true};
@@ -42,6 +52,18 @@ struct watchman_dir {
    */
   watchman_file* getChildFile(w_string_piece name) const;
 
+  /**
+   * Returns the range of direct child files, or dirs, whose names are
+   * foldedName once lowercased. foldedName must already be lowercase, and
+   * this dir must have a caseFolded index.
+   */
+  auto getChildFilesIgnoringCase(const w_string& foldedName) const {
+    return caseFolded->files.equal_range(foldedName);
+  }
+  auto getChildDirsIgnoringCase(const w_string& foldedName) const {
+    return caseFolded->dirs.equal_range(foldedName);
+  }
+
   /**
    * Walk up to the chain of dirs via ->parent to and then produce the full path
    * to this dir.
@@ -11,7 +11,22 @@
 #include "watchman/fs/FileInformation.h"
 #include "watchman/watchman_dir.h"
 
-struct watchman_file {
+/* Linkage for the list of deleted files kept by the ViewDatabase, which is
+ * ordered by the time that they were deleted. The list is circular through
+ * a sentinel owned by the ViewDatabase, so that a file can unlink itself
+ * when it is freed. Both pointers are null when not on the list. */
+struct watchman_deleted_link {
+  watchman_deleted_link* deletedPrev;
+  watchman_deleted_link* deletedNext;
+
+  bool isOnDeletedList() const {
+    return deletedNext != nullptr;
+  }
+
+  void removeFromDeletedList();
+};
+
+struct watchman_file : watchman_deleted_link {
   /* the parent dir */
   watchman_dir* parent;
 
@@ -36,10 +51,12 @@ struct watchman_file {
    * changed */
   watchman::FileInformation stat;
 
+  /* the name of this file, relative to its parent. Usually shared with
+   * the other files of the same name through the view's NameTable */
+  w_string name;
+
   inline w_string_piece getName() const {
-    uint32_t len;
-    memcpy(&len, this + 1, 4);
-    return w_string_piece(reinterpret_cast<const char*>(this + 1) + 4, len);
+    return name.piece();
   }
 
   void removeFromFileList();
@@ -365,6 +365,17 @@ class w_string {
    */
   void reset() noexcept;
 
+  /**
+   * Returns true if this is the only reference to the underlying string.
+   * The answer can only be relied upon if no other thread can be copying
+   * this string.
+   */
+  bool isUnique() const noexcept {
+    return str_ &&
+        (str_->refcnt.load(std::memory_order_acquire) &
+         StringHeader::kRefMask) == StringHeader::kRefIncrement;
+  }
+
   StringHash hashValue() const noexcept {
     if (str_) {
       if (str_->has_hval()) {